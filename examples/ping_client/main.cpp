@@ -75,8 +75,7 @@ protected:
 
       if (packet->isRouteFlood()) {
         // let server know path TO here, so they can use sendDirect() for future ping responses
-        mesh::Packet* path = createPathReturn(server_id, secret, packet->path, packet->path_len, 0, NULL, 0);
-        if (path) sendFlood(path);
+        sendPathReturn(packet, server_id, secret, 0, NULL, 0);
       }
     }
   }
@@ -79,9 +79,7 @@ protected:
 
       if (packet->isRouteFlood()) {
         // let this sender know path TO here, so they can use sendDirect(), and ALSO encode the Ping response
-        mesh::Packet* path = createPathReturn(sender, client->secret, packet->path, packet->path_len,
-                                              PAYLOAD_TYPE_RESPONSE, (uint8_t *) &now, sizeof(now));
-        if (path) sendFlood(path);
+        sendPathReturn(packet, sender, client->secret, PAYLOAD_TYPE_RESPONSE, (uint8_t *) &now, sizeof(now));
       } else {
         mesh::Packet* reply = createDatagram(PAYLOAD_TYPE_RESPONSE, sender, client->secret, (uint8_t *) &now, sizeof(now));
         if (reply) {
@@ -13,7 +13,12 @@
 #include <helpers/StaticPoolPacketManager.h>
 #include <helpers/SimpleMeshTables.h>
 #include <helpers/IdentityStore.h>
+#include <helpers/ConfigStore.h>
+#include <helpers/AdvertScheduler.h>
 #include <helpers/AdvertDataHelpers.h>
+#include <helpers/ClientTable.h>
+#include <helpers/Telemetry.h>
+#include <helpers/AdminProtocol.h>
 #include <RTClib.h>
 
 /* ------------------------------ Config -------------------------------- */
@@ -46,19 +51,33 @@
   #define  ADVERT_LON  0.0
 #endif
 
+#ifndef ADVERT_INTERVAL_MINS
+  #define  ADVERT_INTERVAL_MINS  180   // periodic adverts (with jitter), zero to disable
+#endif
+
 #ifndef ADMIN_PASSWORD
   #define  ADMIN_PASSWORD  "h^(kl@#)"
 #endif
 
+#ifndef ADVERT_MAX_FLOOD_HOPS
+  #define  ADVERT_MAX_FLOOD_HOPS  MAX_FLOOD_HOPS   // ie. no limit
+#endif
+
+#ifndef LOW_POWER_MODE
+  #define  LOW_POWER_MODE  0   // 1 = deep sleep whenever idle, waking on a received packet (see 'sleep' config)
+#endif
+
 #if defined(HELTEC_LORA_V3)
   #include <helpers/HeltecV3Board.h>
   #include <helpers/CustomSX1262Wrapper.h>
   static HeltecV3Board board;
+  #define BOARD_HAS_DEEP_SLEEP
 #elif defined(ARDUINO_XIAO_ESP32C3)
   #include <helpers/XiaoC3Board.h>
   #include <helpers/CustomSX1262Wrapper.h>
   #include <helpers/CustomSX1268Wrapper.h>
   static XiaoC3Board board;
+  #define BOARD_HAS_DEEP_SLEEP
 #elif defined(SEEED_XIAO_S3)
   #include <helpers/ESP32Board.h>
   #include <helpers/CustomSX1262Wrapper.h>
@@ -71,9 +90,45 @@
   #error "need to provide a 'board' object"
 #endif
 
+// runtime overrides of the above (persisted alongside the identity)
+#if defined(NRF52_PLATFORM)
+  static ConfigStore config(InternalFS, "/identity");
+#elif defined(ESP32)
+  static ConfigStore config(SPIFFS, "/identity");
+#else
+  #error "need to define filesystem"
+#endif
+
+static bool fs_mounted = false;   // NOTE: not mounted when resuming from deep sleep, until needed
+
+static void mountFS() {
+  if (fs_mounted) return;
+#if defined(NRF52_PLATFORM)
+  InternalFS.begin();
+#elif defined(ESP32)
+  SPIFFS.begin(true);
+#endif
+  config.begin();
+  fs_mounted = true;
+}
+
+static bool saveConfig() {
+  mountFS();
+  return config.save();
+}
+
+#ifdef BOARD_HAS_DEEP_SLEEP
+  #include <helpers/DeepSleepState.h>
+  RTC_DATA_ATTR static DeepSleepState sleep_state;   // survives deep sleep
+#endif
+
 /* ------------------------------ Code -------------------------------- */
 
 #define CMD_GET_STATS      0x01
+#define CMD_GET_TELEMETRY  0x05   // params: max_age_secs(4), page(1), max_neighbors(1). Reply is TLVs (see Telemetry.h)
+
+#define TELEMETRY_MAX_REPLY  96   // so that a reply page always fits, even as a path return via a long path
+#define TELEMETRY_MAX_NEIGHBORS  MAX_NEIGHBORS
 
 struct RepeaterStats {
   uint16_t batt_milli_volts;
@@ -89,42 +144,85 @@ struct RepeaterStats {
   uint32_t n_full_events;
 };
 
+// appended to RepeaterStats: 1 byte count, then array of these
+struct NeighborStats {
+  uint8_t hash[MAX_PATH_HASH_SIZE];
+  uint8_t hash_size;
+  int16_t avg_rssi;
+  int8_t  avg_snr_x4;
+  uint8_t est_loss_pct;
+  uint16_t n_packets;       // saturates at 0xFFFF
+  uint16_t last_heard_secs; // seconds ago, saturates at 0xFFFF
+};
+
+#define MAX_NEIGHBOR_STATS   8
+#define STATS_MAX_REPLY     96   // as for TELEMETRY_MAX_REPLY, so neighbours are cut short to fit a path return via a long path
+
 struct ClientInfo {
   mesh::Identity id;
-  uint32_t last_timestamp;
+  uint32_t last_timestamp;  // by THEIR clock
+  uint32_t last_activity;   // by OUR clock
   uint8_t secret[PUB_KEY_SIZE];
   int out_path_len;
   uint8_t out_path[MAX_PATH_SIZE];
 };
 
-#define MAX_CLIENTS   4
+#ifndef MAX_CLIENTS
+  #define MAX_CLIENTS   16
+#endif
+#ifndef CLIENT_IDLE_EVICT_SECS
+  #define CLIENT_IDLE_EVICT_SECS   (24*60*60)   // admin sessions not active for this long are forgotten
+#endif
+#define CLIENT_EVICT_CHECK_INTERVAL  60000
 
 // NOTE: need to space the ACK and the reply text apart (in CLI)
 #define CLI_REPLY_DELAY_MILLIS  1500
 
-class MyMesh : public mesh::Mesh {
+#ifndef RADIO_RECONFIG_DELAY_MILLIS
+  #define RADIO_RECONFIG_DELAY_MILLIS  5000   // so that reply to the 'set' goes out on the old radio params
+#endif
+#define RADIO_RECONFIG_RETRY_MILLIS   1000
+
+#ifndef SLEEP_MIN_MILLIS
+  #define SLEEP_MIN_MILLIS   2000   // not worth a deep sleep (and the wake up) for less
+#endif
+#ifndef SLEEP_MAX_SECS
+  #define SLEEP_MAX_SECS     (30*60)
+#endif
+#ifndef SLEEP_ADMIN_HOLD_MILLIS
+  #define SLEEP_ADMIN_HOLD_MILLIS  (5*60*1000)   // stay awake after admin activity (client logins don't survive a sleep)
+#endif
+#ifndef SLEEP_BOOT_HOLD_MILLIS
+  #define SLEEP_BOOT_HOLD_MILLIS   60000   // stay awake after a cold boot, eg. for the serial CLI
+#endif
+
+class MyMesh : public mesh::Mesh, public ConfigListener {
   RadioLibWrapper* my_radio;
-  float airtime_factor;
+  float airtime_factor;   // cached from config
   uint8_t reply_data[MAX_PACKET_PAYLOAD];
-  int num_clients;
-  ClientInfo known_clients[MAX_CLIENTS];
+  ClientTable<ClientInfo, MAX_CLIENTS> clients;
+  unsigned long next_evict_check;
+  RateWindow rates;
+  unsigned long reboot_at;   // non-zero if a reboot is pending
+  unsigned long radio_reconfig_at;   // non-zero if radio params have changed
+  AdvertScheduler adverts;
+  uint8_t max_flood_hops[PH_TYPE_MASK + 1];   // indexed by PAYLOAD_TYPE_*, cached from config
+  bool low_power;   // cached from config
+  unsigned long awake_until;   // millis, no deep sleep before this
+  bool rx_wake_pending;   // woken by a received packet, and nothing sent yet
 
   ClientInfo* putClient(const mesh::Identity& id) {
-    for (int i = 0; i < num_clients; i++) {
-      if (id.matches(known_clients[i].id)) return &known_clients[i];  // already known
-    }
-    if (num_clients < MAX_CLIENTS) {
-      auto newClient = &known_clients[num_clients++];
-      newClient->id = id;
+    bool is_new;
+    auto newClient = clients.put(id, is_new);   // NOTE: evicts least active client, if table is full
+    if (is_new) {
       newClient->out_path_len = -1;  // initially out_path is unknown
       newClient->last_timestamp = 0;
       self_id.calcSharedSecret(newClient->secret, id);   // calc ECDH shared secret
-      return newClient;
     }
-    return NULL;  // table is full
+    return newClient;
   }
 
-  int handleRequest(ClientInfo* sender, uint8_t* payload, size_t payload_len) { 
+  int handleRequest(ClientInfo* sender, uint32_t sender_timestamp, uint8_t* payload, size_t payload_len) { 
     uint32_t now = getRTCClock()->getCurrentTime();
     memcpy(reply_data, &now, 4);   // response packets always prefixed with timestamp
 
@@ -153,47 +251,280 @@ class MyMesh : public mesh::Mesh {
         stats.n_full_events = getNumFullEvents();
 
         memcpy(&reply_data[4], &stats, sizeof(stats));
+        int len = 4 + sizeof(stats);
+
+        // append the neighbours heard within max_age_secs
+        uint8_t* count = &reply_data[len++];
+        *count = 0;
+        unsigned long now_millis = _ms->getMillis();
+        for (int i = 0; i < getNumNeighbors() && *count < MAX_NEIGHBOR_STATS && len + sizeof(NeighborStats) <= STATS_MAX_REPLY; i++) {
+          auto n = getNeighbor(i);
+          uint32_t secs_ago = (now_millis - n->last_heard) / 1000;
+          if (secs_ago > max_age_secs) continue;
+
+          NeighborStats ns;
+          memcpy(ns.hash, n->hash, sizeof(ns.hash));
+          ns.hash_size = n->hash_size;
+          int16_t snr_x4 = n->getAvgSnrX4();
+          ns.avg_rssi = n->getAvgRssi();
+          ns.avg_snr_x4 = snr_x4 < -128 ? -128 : (snr_x4 > 127 ? 127 : snr_x4);
+          ns.est_loss_pct = n->getEstLossPercent();
+          ns.n_packets = n->n_packets > 0xFFFF ? 0xFFFF : n->n_packets;
+          ns.last_heard_secs = secs_ago > 0xFFFF ? 0xFFFF : secs_ago;
+
+          memcpy(&reply_data[len], &ns, sizeof(ns)); len += sizeof(ns);
+          (*count)++;
+        }
 
-        return 4 + sizeof(stats);  //  reply_len
+        return len;  //  reply_len
+      }
+      case CMD_GET_TELEMETRY: {
+        uint32_t max_age_secs = 12*60*60;   // default, 12 hours
+        uint8_t page = 0, max_neighbors = TELEMETRY_MAX_NEIGHBORS;
+        if (payload_len >= 5) memcpy(&max_age_secs, &payload[1], 4);
+        if (payload_len >= 6) page = payload[5];
+        if (payload_len >= 7) max_neighbors = payload[6];
+
+        return 4 + writeTelemetry(&reply_data[4], TELEMETRY_MAX_REPLY - 4, page, max_age_secs, max_neighbors);
+      }
+      case CMD_ADMIN: {
+        AdminBatchWriter results(&reply_data[4], ADMIN_MAX_RESPONSE);
+        handleAdminBatch(sender_timestamp, &payload[1], payload_len - 1, results);
+        return 4 + results.getLength();
       }
     }
     // unknown command
     return 0;  // reply_len
   }
 
+  void handleAdminBatch(uint32_t sender_timestamp, const uint8_t* batch, int batch_len, AdminBatchWriter& results) {
+    AdminBatchReader commands(batch, batch_len, false);
+    uint8_t op, status, len;
+    const uint8_t* params;
+    while (results.canAddResult() && commands.next(op, status, params, len)) {   // stop when the response is full, ie. before running more
+      bool ok;
+      switch (op) {
+        case ADMIN_OP_GET_VERSION:
+          ok = results.addResult(op, ADMIN_OK, FIRMWARE_VER_TEXT, strlen(FIRMWARE_VER_TEXT));
+          break;
+        case ADMIN_OP_REBOOT:
+          reboot_at = futureMillis(CLI_REPLY_DELAY_MILLIS);   // after response is sent
+          ok = results.addResult(op, ADMIN_OK);
+          break;
+        case ADMIN_OP_SEND_ADVERT:
+          ok = results.addResult(op, adverts.request() ? ADMIN_OK : ADMIN_ERR_FAILED);   // fails if suppressed
+          break;
+        case ADMIN_OP_GET_CLOCK: {
+          uint32_t now = getRTCClock()->getCurrentTime();
+          ok = results.addResult(op, ADMIN_OK, &now, 4);
+          break;
+        }
+        case ADMIN_OP_SYNC_CLOCK: {
+          uint32_t curr = getRTCClock()->getCurrentTime();
+          if (sender_timestamp > curr) {
+            getRTCClock()->setCurrentTime(curr = sender_timestamp + 1);
+            ok = results.addResult(op, ADMIN_OK, &curr, 4);
+          } else {
+            ok = results.addResult(op, ADMIN_ERR_FAILED, &curr, 4);   // clock cannot go backwards
+          }
+          break;
+        }
+        case ADMIN_OP_SET_AIRTIME: {
+          uint16_t factor_x100;
+          if (len < 2) { ok = results.addResult(op, ADMIN_ERR_PARAM); break; }
+          memcpy(&factor_x100, params, 2);
+          if (config.setFloat(CFG_KEY_AIRTIME_FACTOR, factor_x100 / 100.0f) == CFG_OK && saveConfig()) {
+            ok = results.addResult(op, ADMIN_OK);
+          } else {
+            ok = results.addResult(op, ADMIN_ERR_PARAM);
+          }
+          break;
+        }
+        case ADMIN_OP_SET_FLOOD_HOPS:
+          if (len < 2 || params[0] > PH_TYPE_MASK) { ok = results.addResult(op, ADMIN_ERR_PARAM); break; }
+          if (config.setUInt(CFG_KEY_FLOOD_HOPS_BASE + params[0], params[1]) == CFG_OK && saveConfig()) {
+            ok = results.addResult(op, ADMIN_OK);
+          } else {
+            ok = results.addResult(op, ADMIN_ERR_PARAM);   // unknown type, or hops out of range
+          }
+          break;
+        case ADMIN_OP_GET_QUEUE: {
+          uint32_t q[NUM_TRAFFIC_CLASSES*3];
+          auto mgr = (StaticPoolPacketManager *) _mgr;
+          for (int c = 0; c < NUM_TRAFFIC_CLASSES; c++) {
+            auto cs = mgr->getTrafficClassStats(c);
+            q[c*3] = cs->n_sent;
+            q[c*3 + 1] = cs->n_dropped + cs->n_aqm_dropped;
+            q[c*3 + 2] = cs->max_latency;
+          }
+          ok = results.addResult(op, ADMIN_OK, q, sizeof(q));
+          break;
+        }
+        case ADMIN_OP_SET_TRACE: {
+          static StreamTraceSink trace_sink(Serial);
+          if (len < 1) { ok = results.addResult(op, ADMIN_ERR_PARAM); break; }
+          my_radio->setTraceSink(params[0] ? &trace_sink : NULL);
+          ok = results.addResult(op, ADMIN_OK);
+          break;
+        }
+        default:
+          ok = results.addResult(op, ADMIN_ERR_UNKNOWN);
+          break;
+      }
+      if (!ok) break;   // response is full
+    }
+  }
+
+  int writeTelemetry(uint8_t* dest, int max_len, uint8_t page, uint32_t max_age_secs, int max_neighbors) {
+    TelemetryWriter tw(dest, max_len, page);
+
+    TelemetryTotals totals;
+    totals.up_time_secs = _ms->getMillis() / 1000;
+    totals.n_packets_recv = my_radio->getPacketsRecv();
+    totals.n_packets_sent = my_radio->getPacketsSent();
+    totals.air_time_secs = getTotalAirTime() / 1000;
+    totals.batt_milli_volts = board.getBattMilliVolts();
+    totals.tx_queue_len = _mgr->getOutboundCount();
+    totals.free_queue_len = _mgr->getFreeCount();
+    tw.add(TLV_TOTALS, &totals, sizeof(totals));
+
+    static const int windows[] = { 1, RATE_WINDOW_SLOTS };   // minutes
+    for (int w = 0; w < 2; w++) {
+      TelemetryRates r;
+      if (rates.getRates(windows[w], r)) tw.add(TLV_RATES, &r, sizeof(r));
+    }
+
+    auto mgr = (StaticPoolPacketManager *) _mgr;
+    {
+      uint8_t hist[2 + 4*QUEUE_DELAY_BUCKETS];
+      uint16_t bucket0 = QUEUE_DELAY_BUCKET0_MILLIS;
+      memcpy(hist, &bucket0, 2);
+      memcpy(&hist[2], mgr->getQueueDelayHistogram(), 4*QUEUE_DELAY_BUCKETS);
+      tw.add(TLV_QUEUE_DELAY, hist, sizeof(hist));
+    }
+    {
+      uint32_t drops[NUM_DROP_REASONS];
+      memset(drops, 0, sizeof(drops));
+      drops[DROP_REASON_POOL_FULL] = getNumFullEvents();
+      for (int c = 0; c < NUM_TRAFFIC_CLASSES; c++) {
+        auto cs = mgr->getTrafficClassStats(c);
+        drops[DROP_REASON_QUEUE_CAP] += cs->n_dropped;
+        drops[DROP_REASON_AQM_STALE] += cs->n_aqm_dropped;
+      }
+      drops[DROP_REASON_SCOPE] = getNumScopeDropped();
+      tw.add(TLV_DROPS, drops, sizeof(drops));
+    }
+    TelemetryDedup dedup;
+    dedup.n_recv = getNumRecvFlood() + getNumRecvDirect();
+    dedup.n_dupes = getNumDuplicates();
+    tw.add(TLV_DEDUP, &dedup, sizeof(dedup));
+
+    uint32_t n_decrypt_failed = getNumDecryptFailed();
+    tw.add(TLV_DECRYPT_FAILED, &n_decrypt_failed, 4);
+
+  #ifdef BOARD_HAS_DEEP_SLEEP
+    if (low_power || sleep_state.stats.n_sleeps > 0) tw.add(TLV_SLEEP, &sleep_state.stats, sizeof(sleep_state.stats));
+  #endif
+
+    // top-N neighbours (heard within max_age_secs), by SNR. Selection sort, as table is small
+    unsigned long now_millis = _ms->getMillis();
+    bool done[MAX_NEIGHBORS];   // neighbours already added
+    memset(done, 0, sizeof(done));
+    for (int k = 0; k < max_neighbors; k++) {
+      int best = -1;
+      for (int i = 0; i < getNumNeighbors(); i++) {
+        auto n = getNeighbor(i);
+        if (done[i] || (now_millis - n->last_heard) / 1000 > max_age_secs) continue;
+        if (best < 0 || n->getAvgSnrX4() > getNeighbor(best)->getAvgSnrX4()) best = i;
+      }
+      if (best < 0) break;
+      done[best] = true;
+
+      auto n = getNeighbor(best);
+      uint32_t secs_ago = (now_millis - n->last_heard) / 1000;
+      TelemetryNeighbor tn;
+      memcpy(tn.hash, n->hash, sizeof(tn.hash));
+      tn.hash_size = n->hash_size;
+      int16_t snr_x4 = n->getAvgSnrX4();
+      tn.avg_rssi = n->getAvgRssi();
+      tn.avg_snr_x4 = snr_x4 < -128 ? -128 : (snr_x4 > 127 ? 127 : snr_x4);
+      tn.est_loss_pct = n->getEstLossPercent();
+      tn.n_packets = n->n_packets > 0xFFFF ? 0xFFFF : n->n_packets;
+      tn.last_heard_secs = secs_ago > 0xFFFF ? 0xFFFF : secs_ago;
+      tw.add(TLV_NEIGHBOR, &tn, sizeof(tn));
+    }
+
+    return tw.finish();
+  }
+
 protected:
+  void onConfigChanged(const ConfigKeyDef* def) override {
+    if (def->key == CFG_KEY_AIRTIME_FACTOR) {
+      airtime_factor = config.getFloat(CFG_KEY_AIRTIME_FACTOR, 1.0f);
+    } else if (def->flags & CFG_FLAG_RADIO) {
+      radio_reconfig_at = futureMillis(RADIO_RECONFIG_DELAY_MILLIS);   // let any batch of changes (and the reply) go out first
+    } else if (def->key == CFG_KEY_ADVERT_INTERVAL) {
+      adverts.setInterval(config.getUInt(CFG_KEY_ADVERT_INTERVAL, ADVERT_INTERVAL_MINS));
+    } else if (def->key == CFG_KEY_DEEP_SLEEP) {
+      low_power = config.getUInt(CFG_KEY_DEEP_SLEEP, LOW_POWER_MODE) != 0;
+    } else if (def->key == CFG_KEY_NODE_NAME || def->key == CFG_KEY_NODE_LAT || def->key == CFG_KEY_NODE_LON) {
+      adverts.onChanged();
+    } else if (def->key >= CFG_KEY_FLOOD_HOPS_BASE && def->key <= CFG_KEY_FLOOD_HOPS_BASE + PH_TYPE_MASK) {
+      loadMaxFloodHops();
+    }
+  }
+
+  void onSelfAdvertEcho(mesh::Packet* packet, uint32_t timestamp) override {
+    adverts.onEchoHeard(timestamp);
+  }
+
   float getAirtimeBudgetFactor() const override {
     return airtime_factor;
   }
 
+  void onPacketSent(mesh::Packet* packet) override {
+  #ifdef BOARD_HAS_DEEP_SLEEP
+    if (rx_wake_pending) {   // first send since woken by a packet, ie. (most likely) forwarding it
+      sleep_state.onWakeForward(_ms->getMillis());   // NOTE: millis are since boot, ie. the wake
+      rx_wake_pending = false;
+    }
+  #endif
+    mesh::Mesh::onPacketSent(packet);
+  }
+
   bool allowPacketForward(const mesh::Packet* packet) override {
     return true;   // Yes, allow packet to be forwarded
   }
 
+  uint8_t getMaxFloodHops(uint8_t payload_type) const override {
+    return max_flood_hops[payload_type & PH_TYPE_MASK];
+  }
+
   void onAnonDataRecv(mesh::Packet* packet, uint8_t type, const mesh::Identity& sender, uint8_t* data, size_t len) override {
     if (type == PAYLOAD_TYPE_ANON_REQ) {  // received an initial request by a possible admin client (unknown at this stage)
       uint32_t timestamp;
       memcpy(&timestamp, data, 4);
 
-      if (memcmp(&data[4], ADMIN_PASSWORD, strlen(ADMIN_PASSWORD)) == 0) {  // check for valid password
+      const char* password = config.getString(CFG_KEY_ADMIN_PASSWORD, ADMIN_PASSWORD);
+      if (memcmp(&data[4], password, strlen(password)) == 0) {  // check for valid password
         auto client = putClient(sender);  // add to known clients (if not already known)
-        if (client == NULL || timestamp <= client->last_timestamp) {
-          MESH_DEBUG_PRINTLN("Client table full, or replay attack!");
-          return;  // FATAL: client table is full -OR- replay attack 
+        if (timestamp <= client->last_timestamp) {
+          MESH_DEBUG_PRINTLN("possible replay attack!");
+          return;
         }
 
         MESH_DEBUG_PRINTLN("Login success!");
         client->last_timestamp = timestamp;
+        holdAwake(SLEEP_ADMIN_HOLD_MILLIS);
 
         uint32_t now = getRTCClock()->getCurrentTime();
+        clients.touch(client, now);
         memcpy(reply_data, &now, 4);   // response packets always prefixed with timestamp
         memcpy(&reply_data[4], "OK", 2);
 
         if (packet->isRouteFlood()) {
           // let this sender know path TO here, so they can use sendDirect(), and ALSO encode the response
-          mesh::Packet* path = createPathReturn(sender, client->secret, packet->path, packet->path_len,
-                                                PAYLOAD_TYPE_RESPONSE, reply_data, 4 + 2);
-          if (path) sendFlood(path);
+          sendPathReturn(packet, sender, client->secret, PAYLOAD_TYPE_RESPONSE, reply_data, 4 + 2);
         } else {
           mesh::Packet* reply = createDatagram(PAYLOAD_TYPE_RESPONSE, sender, client->secret, reply_data, 4 + 2);
           if (reply) {
@@ -214,20 +545,16 @@ protected:
   int  matching_peer_indexes[MAX_CLIENTS];
 
   int searchPeersByHash(const uint8_t* hash) override {
-    int n = 0;
-    for (int i = 0; i < num_clients; i++) {
-      if (known_clients[i].id.isHashMatch(hash)) {
-        matching_peer_indexes[n++] = i;  // store the INDEXES of matching contacts (for subsequent 'peer' methods)
-      }
-    }
-    return n;
+    // store the INDEXES of matching clients (for subsequent 'peer' methods)
+    return clients.searchByHash(hash, matching_peer_indexes, MAX_CLIENTS);
   }
 
   void getPeerSharedSecret(uint8_t* dest_secret, int peer_idx) override {
     int i = matching_peer_indexes[peer_idx];
-    if (i >= 0 && i < num_clients) {
+    auto client = clients.getByIdx(i);
+    if (client) {
       // lookup pre-calculated shared_secret
-      memcpy(dest_secret, known_clients[i].secret, PUB_KEY_SIZE);
+      memcpy(dest_secret, client->secret, PUB_KEY_SIZE);
     } else {
       MESH_DEBUG_PRINTLN("getPeerSharedSecret: Invalid peer idx: %d", i);
     }
@@ -235,26 +562,26 @@ protected:
 
   void onPeerDataRecv(mesh::Packet* packet, uint8_t type, int sender_idx, const uint8_t* secret, uint8_t* data, size_t len) override {
     int i = matching_peer_indexes[sender_idx];
-    if (i < 0 || i >= num_clients) {  // get from our known_clients table (sender SHOULD already be known in this context)
+    auto client = clients.getByIdx(i);   // get from our clients table (sender SHOULD already be known in this context)
+    if (client == NULL) {
       MESH_DEBUG_PRINTLN("onPeerDataRecv: invalid peer idx: %d", i);
       return;
     }
-    auto client = &known_clients[i];
+    holdAwake(SLEEP_ADMIN_HOLD_MILLIS);
     if (type == PAYLOAD_TYPE_REQ) {  // request (from a Known admin client!)
       uint32_t timestamp;
       memcpy(&timestamp, data, 4);
 
       if (timestamp > client->last_timestamp) {  // prevent replay attacks 
-        int reply_len = handleRequest(client, &data[4], len - 4);
+        int reply_len = handleRequest(client, timestamp, &data[4], len - 4);
         if (reply_len == 0) return;  // invalid command
 
         client->last_timestamp = timestamp;
+        clients.touch(client, getRTCClock()->getCurrentTime());
 
         if (packet->isRouteFlood()) {
           // let this sender know path TO here, so they can use sendDirect(), and ALSO encode the response
-          mesh::Packet* path = createPathReturn(client->id, secret, packet->path, packet->path_len,
-                                                PAYLOAD_TYPE_RESPONSE, reply_data, reply_len);
-          if (path) sendFlood(path);
+          sendPathReturn(packet, client->id, secret, PAYLOAD_TYPE_RESPONSE, reply_data, reply_len);
         } else {
           mesh::Packet* reply = createDatagram(PAYLOAD_TYPE_RESPONSE, client->id, secret, reply_data, reply_len);
           if (reply) {
@@ -326,10 +653,10 @@ protected:
   bool onPeerPathRecv(mesh::Packet* packet, int sender_idx, const uint8_t* secret, uint8_t* path, uint8_t path_len, uint8_t extra_type, uint8_t* extra, uint8_t extra_len) override {
     // TODO: prevent replay attacks
     int i = matching_peer_indexes[sender_idx];
+    auto client = clients.getByIdx(i);   // get from our clients table (sender SHOULD already be known in this context)
 
-    if (i >= 0 && i < num_clients) {  // get from our known_clients table (sender SHOULD already be known in this context)
+    if (client) {
       MESH_DEBUG_PRINTLN("PATH to client, path_len=%d", (uint32_t) path_len);
-      auto client = &known_clients[i];
       memcpy(client->out_path, path, client->out_path_len = path_len);  // store a copy of path, for sendDirect()
     } else {
       MESH_DEBUG_PRINTLN("onPeerPathRecv: invalid peer idx: %d", i);
@@ -341,37 +668,196 @@ protected:
 
 public:
   MyMesh(RadioLibWrapper& radio, mesh::MillisecondClock& ms, mesh::RNG& rng, mesh::RTCClock& rtc, mesh::MeshTables& tables)
-     : mesh::Mesh(radio, ms, rng, rtc, *new StaticPoolPacketManager(32), tables)
+     : mesh::Mesh(radio, ms, rng, rtc, *new StaticPoolPacketManager(32), tables), adverts(ms, rng)
   {
     my_radio = &radio;
     airtime_factor = 1.0;    // one half
-    num_clients = 0;
+    next_evict_check = 0;
+    reboot_at = 0;
+    radio_reconfig_at = 0;
+    low_power = false;
+    awake_until = 0;
+    rx_wake_pending = false;
+    loadMaxFloodHops();
+
+    // under flood storms, keep forwarding the freshest traffic, and don't let adverts crowd out the rest
+    auto mgr = (StaticPoolPacketManager *) _mgr;
+    mgr->setTrafficClass(TRAFFIC_CLASS_DATA, 4, 16, DROP_OLDEST);
+    mgr->setTrafficClass(TRAFFIC_CLASS_ADVERT, 1, 6, DROP_OLDEST);
+  }
+
+  void begin() {
+    airtime_factor = config.getFloat(CFG_KEY_AIRTIME_FACTOR, 1.0f);
+    config.setListener(this);
+    adverts.setInterval(config.getUInt(CFG_KEY_ADVERT_INTERVAL, ADVERT_INTERVAL_MINS));
+    low_power = config.getUInt(CFG_KEY_DEEP_SLEEP, LOW_POWER_MODE) != 0;
+    loadMaxFloodHops();
+    mesh::Mesh::begin();
+    awake_until = futureMillis(SLEEP_BOOT_HOLD_MILLIS);
+  }
+
+  void holdAwake(uint32_t millis) {
+    unsigned long until = futureMillis(millis);
+    if ((long)(until - awake_until) > 0) awake_until = until;
+  }
+
+#ifdef BOARD_HAS_DEEP_SLEEP
+  /**
+   * \returns  how long to deep sleep for, or zero if shouldn't sleep now
+   */
+  uint32_t getSleepSecs() {
+    if (!low_power || reboot_at || radio_reconfig_at || !millisHasNowPassed(awake_until)) return 0;
+    if (!my_radio->isInRecvMode()) return 0;   // mid-transmit, or not listening yet (ie. wouldn't wake on a packet)
+    if (adverts.isPending()) return 0;
+
+    uint32_t due = getMillisUntilNextDue();
+    uint32_t advert_due = adverts.getMillisUntilPeriodic();
+    if (advert_due < due) due = advert_due;
+    if (due < SLEEP_MIN_MILLIS) return 0;
+
+    return due / 1000 < SLEEP_MAX_SECS ? due / 1000 : SLEEP_MAX_SECS;
+  }
+
+  /**
+   * \returns  false if can't sleep now (ie. too many packets queued)
+   */
+  bool saveSleepState(DeepSleepState& dest) {
+    if (!dest.retainPackets(_mgr, _ms->getMillis())) return false;
+
+    saveState(dest.dispatcher);
+    ((StaticPoolPacketManager *) _mgr)->saveStats(dest.queue_stats);
+    dest.n_dupes = getNumDuplicates();
+    dest.n_decrypt_failed = getNumDecryptFailed();
+    dest.n_scope_dropped = getNumScopeDropped();
+    dest.n_radio_recv = my_radio->getPacketsRecv();
+    dest.n_radio_sent = my_radio->getPacketsSent();
+    dest.advert_due_millis = adverts.getMillisUntilPeriodic();
+    dest.slept_at = getRTCClock()->getCurrentTime();
+    rx_wake_pending = false;
+    return true;
+  }
+
+  // NOTE: must be after begin()
+  void resumeFrom(DeepSleepState& src) {
+    bool rx_wake = board.getStartupReason() == BD_STARTUP_RX_PACKET;
+    uint32_t slept_millis = src.onWake(getRTCClock()->getCurrentTime(), rx_wake) * 1000;
+
+    mesh::DispatcherState ds = src.dispatcher;
+    ds.tx_wait_millis = ds.tx_wait_millis > slept_millis ? ds.tx_wait_millis - slept_millis : 0;
+    for (int i = 0; i < ds.num_neighbors && i < MAX_NEIGHBORS; i++) ds.neighbors[i].last_heard += slept_millis;   // (is millis ago)
+    restoreState(ds);
+    ((StaticPoolPacketManager *) _mgr)->restoreStats(src.queue_stats);
+    setRecvCounters(src.n_dupes, src.n_decrypt_failed, src.n_scope_dropped);
+    my_radio->setPacketCounts(src.n_radio_recv, src.n_radio_sent);
+    adverts.resumePeriodic(src.advert_due_millis > slept_millis ? src.advert_due_millis - slept_millis : 0);
+
+    for (int i = 0; i < src.num_packets; i++) {   // re-queue what was waiting to be sent
+      mesh::Packet* pkt = obtainNewPacket();
+      if (pkt == NULL) break;
+      uint8_t priority;
+      uint32_t delay_millis = src.restorePacket(i, pkt, priority, slept_millis);
+      sendPacket(pkt, priority, delay_millis);
+    }
+
+    awake_until = 0;   // no need to hold awake, as on cold boot
+    rx_wake_pending = rx_wake;
+  }
+#endif
+
+  void loadMaxFloodHops() {
+    for (int t = 0; t <= PH_TYPE_MASK; t++) {
+      max_flood_hops[t] = config.getUInt(CFG_KEY_FLOOD_HOPS_BASE + t, t == PAYLOAD_TYPE_ADVERT ? ADVERT_MAX_FLOOD_HOPS : MAX_FLOOD_HOPS);
+    }
+  }
+
+  /**
+   * \brief  set the max flood hops for ALL (known) payload types, ie. 'set flood.hops='
+   * \returns  one of CFG_OK, CFG_ERR_*
+   */
+  int setMaxFloodHops(uint32_t max_hops) {
+    for (int t = 0; t <= PH_TYPE_MASK; t++) {
+      if (ConfigStore::getKeyDef(CFG_KEY_FLOOD_HOPS_BASE + t) == NULL) continue;   // (not a known type)
+      int err = config.setUInt(CFG_KEY_FLOOD_HOPS_BASE + t, max_hops);
+      if (err != CFG_OK) return err;
+    }
+    return CFG_OK;
+  }
+
+  // how congested we are: tx queue fill, or tx airtime (relative to what the airtime budget allows), whichever is worse
+  uint8_t calcLoadPercent() const {
+    int queued = _mgr->getOutboundCount();
+    int load = queued * 100 / (queued + _mgr->getFreeCount() + 1);
+    TelemetryRates r;
+    if (rates.getRates(5, r)) {
+      int air_load = r.airtime_permille * (1.0f + airtime_factor) / 10;
+      if (air_load > load) load = air_load;
+    }
+    return load > 100 ? 100 : load;
   }
 
   void sendSelfAdvertisement() {
     uint8_t app_data[MAX_ADVERT_DATA_SIZE];
     uint8_t app_data_len;
     {
-      AdvertDataBuilder builder(ADV_TYPE_REPEATER, ADVERT_NAME, ADVERT_LAT, ADVERT_LON);
+      AdvertDataBuilder builder(ADV_TYPE_REPEATER, config.getString(CFG_KEY_NODE_NAME, ADVERT_NAME),
+                                config.getFloat(CFG_KEY_NODE_LAT, ADVERT_LAT), config.getFloat(CFG_KEY_NODE_LON, ADVERT_LON));
+      builder.setBattery(board.getBattMilliVolts());
+      builder.setLoad(calcLoadPercent());   // so clients can prefer less congested repeaters
       app_data_len = builder.encodeTo(app_data);
     }
 
     mesh::Packet* pkt = createAdvert(self_id, app_data, app_data_len);
     if (pkt) {
+      adverts.onAdvertSent(getAdvertTimestamp(pkt));
       sendFlood(pkt, 800);  // add slight delay
     } else {
       MESH_DEBUG_PRINTLN("ERROR: unable to create advertisement packet!");
     }
   }
 
+  void loop() {
+    mesh::Mesh::loop();
+
+    if (adverts.isDue(hasSendCapacity(ADVERT_MAX_QUEUED))) {
+      sendSelfAdvertisement();
+    }
+
+    rates.update(_ms->getMillis(), my_radio->getPacketsRecv(), my_radio->getPacketsSent(), getTotalAirTime());
+
+    if (reboot_at && millisHasNowPassed(reboot_at)) {
+      board.reboot();  // doesn't return
+    }
+
+    if (radio_reconfig_at && millisHasNowPassed(radio_reconfig_at)) {
+      if (my_radio->reconfigure(config.getFloat(CFG_KEY_RADIO_FREQ, LORA_FREQ), config.getFloat(CFG_KEY_RADIO_BW, LORA_BW),
+                                config.getUInt(CFG_KEY_RADIO_SF, LORA_SF), config.getUInt(CFG_KEY_RADIO_CR, LORA_CR),
+                                config.getInt(CFG_KEY_TX_POWER, LORA_TX_POWER))) {
+        MESH_DEBUG_PRINTLN("radio reconfigured");
+        radio_reconfig_at = 0;
+      } else {
+        radio_reconfig_at = futureMillis(RADIO_RECONFIG_RETRY_MILLIS);   // probably mid-transmit, try again soon
+      }
+    }
+
+    if (millisHasNowPassed(next_evict_check)) {
+      int n = clients.evictIdle(getRTCClock()->getCurrentTime(), CLIENT_IDLE_EVICT_SECS);
+      if (n > 0) MESH_DEBUG_PRINTLN("evicted %d idle clients", n);
+      next_evict_check = futureMillis(CLIENT_EVICT_CHECK_INTERVAL);
+    }
+  }
+
   void handleCommand(uint32_t sender_timestamp, const char* command, char reply[]) {
     while (*command == ' ') command++;   // skip leading spaces
+    holdAwake(SLEEP_ADMIN_HOLD_MILLIS);
 
     if (memcmp(command, "reboot", 6) == 0) {
       board.reboot();  // doesn't return
     } else if (memcmp(command, "advert", 6) == 0) {
-      sendSelfAdvertisement();
-      strcpy(reply, "OK - Advert sent");
+      if (adverts.request()) {
+        strcpy(reply, "OK - Advert queued");
+      } else {
+        strcpy(reply, "OK - not needed, Advert was recently heard re-flooded");
+      }
     } else if (memcmp(command, "clock sync", 10) == 0) {
       uint32_t curr = getRTCClock()->getCurrentTime();
       if (sender_timestamp > curr) {
@@ -385,16 +871,63 @@ public:
       DateTime dt = DateTime(now);
       sprintf(reply, "%02d:%02d - %d/%d/%d UTC", dt.hour(), dt.minute(), dt.day(), dt.month(), dt.year());
     } else if (memcmp(command, "set ", 4) == 0) {
-      if (memcmp(&command[4], "AF", 2) == 0 || memcmp(&command[4], "af=", 2) == 0) {
-        airtime_factor = atof(&command[7]);
-        strcpy(reply, "OK");
+      if (memcmp(&command[4], "flood.hops=", 11) == 0) {   // all types. (per type, eg. "set advert.hops=4", is a config key)
+        int err = setMaxFloodHops(atoi(&command[15]));
+        if (err == CFG_OK) {
+          strcpy(reply, saveConfig() ? "OK" : "ERR: unable to save");
+        } else {
+          sprintf(reply, "ERR: %s", ConfigStore::getErrorText(err));
+        }
+      } else if (strchr(&command[4], '=')) {   // eg. "set sf=9"
+        const char* eq = strchr(&command[4], '=');
+        int err = config.setFromText(&command[4], eq - &command[4], &eq[1]);
+        if (err == CFG_OK) {
+          strcpy(reply, saveConfig() ? "OK" : "ERR: unable to save");
+        } else {
+          sprintf(reply, "ERR: %s", ConfigStore::getErrorText(err));
+        }
       } else {
         sprintf(reply, "unknown config: %s", &command[4]);
       }
+    } else if (memcmp(command, "get ", 4) == 0) {
+      auto def = ConfigStore::findKeyDef(&command[4], strlen(&command[4]));
+      if (def) {
+        config.formatValue(def, reply);
+      } else {
+        sprintf(reply, "unknown config: %s", &command[4]);
+      }
+    } else if (memcmp(command, "unset ", 6) == 0) {   // revert to the default
+      auto def = ConfigStore::findKeyDef(&command[6], strlen(&command[6]));
+      if (def) {
+        config.reset(def->key);
+        strcpy(reply, saveConfig() ? "OK" : "ERR: unable to save");
+      } else {
+        sprintf(reply, "unknown config: %s", &command[6]);
+      }
+    } else if (memcmp(command, "trace ", 6) == 0) {   // capture raw frames, as TRACE: lines on Serial (for host replay)
+      static StreamTraceSink trace_sink(Serial);
+      bool on = memcmp(&command[6], "on", 2) == 0;
+      my_radio->setTraceSink(on ? &trace_sink : NULL);
+      strcpy(reply, on ? "OK - tracing to Serial" : "OK - tracing off");
+    } else if (memcmp(command, "queue", 5) == 0) {   // per traffic class: sent/dropped (full or stale)/max latency
+      static const char* class_names[] = { "dir", "data", "path", "adv" };
+      auto mgr = (StaticPoolPacketManager *) _mgr;
+      int len = 0;
+      for (int c = 0; c < NUM_TRAFFIC_CLASSES; c++) {
+        auto s = mgr->getTrafficClassStats(c);
+        len += sprintf(&reply[len], "%s:%d/%d/%dms ", class_names[c], s->n_sent, s->n_dropped + s->n_aqm_dropped, s->max_latency);
+      }
+#ifdef BOARD_HAS_DEEP_SLEEP
+    } else if (memcmp(command, "sleep", 5) == 0) {   // deep sleep stats
+      auto s = &sleep_state.stats;
+      sprintf(reply, "%s - sleeps:%d (rx:%d timer:%d) %ds, wake->fwd last:%dms avg:%dms max:%dms", low_power ? "on" : "off",
+          s->n_sleeps, s->n_rx_wakes, s->n_timer_wakes, s->total_sleep_secs, (uint32_t) s->wake_fwd_last_millis,
+          s->n_wake_fwds ? s->wake_fwd_total_millis / s->n_wake_fwds : 0, (uint32_t) s->wake_fwd_max_millis);
+#endif
     } else if (memcmp(command, "ver", 3) == 0) {
       strcpy(reply, FIRMWARE_VER_TEXT);
     } else {
-      sprintf(reply, "Unknown: %s (commands: reboot, advert, clock, set, ver)", command);
+      sprintf(reply, "Unknown: %s (commands: reboot, advert, clock, set, get, unset, queue, trace, sleep, ver)", command);
     }
   }
 };
@@ -424,9 +957,32 @@ void halt() {
 
 static char command[80];
 
+#ifdef BOARD_HAS_DEEP_SLEEP
+static void enterSleep(uint32_t secs) {
+  if (!the_mesh.saveSleepState(sleep_state)) return;   // eg. too many packets queued
+
+  tables.saveState(sleep_state.tables);
+  the_mesh.self_id.writeTo(sleep_state.identity, SLEEP_IDENTITY_SIZE);
+  sleep_state.config_len = config.writeTo(sleep_state.config, sizeof(sleep_state.config));
+  sleep_state.stats.n_sleeps++;
+  sleep_state.magic = DEEP_SLEEP_STATE_MAGIC;
+
+  board.enterDeepSleep(secs);   // doesn't return. (wakes on received packet, or timer)
+}
+#endif
+
 void setup() {
   Serial.begin(115200);
-  delay(1000);
+
+#ifdef BOARD_HAS_DEEP_SLEEP
+  // fast resume: skip the flash reads, and restore state from RTC RAM
+  bool resume = esp_reset_reason() == ESP_RST_DEEPSLEEP && sleep_state.isValid();
+  if (!resume) sleep_state.clearStats();
+  sleep_state.invalidate();   // ie. if we reset before sleeping again, do a full init
+#else
+  bool resume = false;
+#endif
+  if (!resume) delay(1000);
 
   board.begin();
 #ifdef ESP32
@@ -439,13 +995,27 @@ void setup() {
   float tcxo = 1.6f;
 #endif
 
+#ifdef BOARD_HAS_DEEP_SLEEP
+  if (resume) {
+    config.readFrom(sleep_state.config, sleep_state.config_len);
+    the_mesh.self_id.readFrom(sleep_state.identity, SLEEP_IDENTITY_SIZE);
+    tables.restoreState(sleep_state.tables);
+  }
+#endif
+  if (!resume) {
+    mountFS();
+    config.load();
+  }
+
 #if defined(NRF52_PLATFORM)
   SPI.setPins(P_LORA_MISO, P_LORA_SCLK, P_LORA_MOSI);
   SPI.begin();
 #elif defined(P_LORA_SCLK)
   spi.begin(P_LORA_SCLK, P_LORA_MISO, P_LORA_MOSI);
 #endif
-  int status = radio.begin(LORA_FREQ, LORA_BW, LORA_SF, LORA_CR, RADIOLIB_SX126X_SYNC_WORD_PRIVATE, LORA_TX_POWER, 8, tcxo);
+  int status = radio.begin(config.getFloat(CFG_KEY_RADIO_FREQ, LORA_FREQ), config.getFloat(CFG_KEY_RADIO_BW, LORA_BW),
+                           config.getUInt(CFG_KEY_RADIO_SF, LORA_SF), config.getUInt(CFG_KEY_RADIO_CR, LORA_CR),
+                           RADIOLIB_SX126X_SYNC_WORD_PRIVATE, config.getInt(CFG_KEY_TX_POWER, LORA_TX_POWER), 8, tcxo);
   if (status != RADIOLIB_ERR_NONE) {
     delay(5000);
     Serial.print("ERROR: radio init failed: ");
@@ -463,27 +1033,32 @@ void setup() {
   radio.setDio2AsRfSwitch(SX126X_DIO2_AS_RF_SWITCH);
 #endif
 
-#if defined(NRF52_PLATFORM)
-  InternalFS.begin();
-  IdentityStore store(InternalFS, "/identity");
-#elif defined(ESP32)
-  SPIFFS.begin(true);
-  IdentityStore store(SPIFFS, "/identity");
-#else
-  #error "need to define filesystem"
-#endif
-  if (!store.load("_main", the_mesh.self_id)) {
-    the_mesh.self_id = mesh::LocalIdentity(the_mesh.getRNG());  // create new random identity
-    store.save("_main", the_mesh.self_id);
-  }
+  if (!resume) {
+  #if defined(NRF52_PLATFORM)
+    IdentityStore store(InternalFS, "/identity");
+  #elif defined(ESP32)
+    IdentityStore store(SPIFFS, "/identity");
+  #endif
+    if (!store.load("_main", the_mesh.self_id)) {
+      the_mesh.self_id = mesh::LocalIdentity(the_mesh.getRNG());  // create new random identity
+      store.save("_main", the_mesh.self_id);
+    }
 
-  Serial.print("Repeater ID: ");
-  mesh::Utils::printHex(Serial, the_mesh.self_id.pub_key, PUB_KEY_SIZE); Serial.println();
+    Serial.print("Repeater ID: ");
+    mesh::Utils::printHex(Serial, the_mesh.self_id.pub_key, PUB_KEY_SIZE); Serial.println();
+  }
 
   command[0] = 0;
 
   the_mesh.begin();
 
+#ifdef BOARD_HAS_DEEP_SLEEP
+  if (resume) {
+    the_mesh.resumeFrom(sleep_state);
+    return;   // no initial advert, the mesh already has it
+  }
+#endif
+
   // send out initial Advertisement to the mesh
   the_mesh.sendSelfAdvertisement();
 }
@@ -515,5 +1090,10 @@ void loop() {
 
   the_mesh.loop();
 
-  // TODO: periodically check for OLD/inactive entries in known_clients[], and evict
+#ifdef BOARD_HAS_DEEP_SLEEP
+  if (command[0] == 0 && !Serial.available()) {   // not mid-way through a serial command
+    uint32_t secs = the_mesh.getSleepSecs();
+    if (secs > 0) enterSleep(secs);   // only returns if state couldn't be retained
+  }
+#endif
 }
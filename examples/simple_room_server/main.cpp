@@ -13,7 +13,14 @@
 #include <helpers/StaticPoolPacketManager.h>
 #include <helpers/SimpleMeshTables.h>
 #include <helpers/IdentityStore.h>
+#include <helpers/ConfigStore.h>
+#include <helpers/AdvertScheduler.h>
 #include <helpers/AdvertDataHelpers.h>
+#include <helpers/TextCompressor.h>
+#include <helpers/PostLogFS.h>
+#include <helpers/PostBatch.h>
+#include <helpers/ClientTable.h>
+#include <helpers/AdminProtocol.h>
 #include <RTClib.h>
 
 /* ------------------------------ Config -------------------------------- */
@@ -46,6 +53,10 @@
   #define  ADVERT_LON  0.0
 #endif
 
+#ifndef ADVERT_INTERVAL_MINS
+  #define  ADVERT_INTERVAL_MINS  180   // periodic adverts (with jitter), zero to disable
+#endif
+
 #ifndef ADMIN_PASSWORD
   #define  ADMIN_PASSWORD  "password"
 #endif
@@ -54,8 +65,12 @@
  #define MAX_CLIENTS           32
 #endif
 
-#ifndef MAX_UNSYNCED_POSTS
-  #define MAX_UNSYNCED_POSTS    16
+#ifndef CLIENT_IDLE_EVICT_DAYS
+  #define CLIENT_IDLE_EVICT_DAYS  14    // forget clients not heard from in this long (they can just login again)
+#endif
+
+#ifndef POST_MAX_AGE_DAYS
+  #define POST_MAX_AGE_DAYS     0     // zero means keep, until compacted for space
 #endif
 
 
@@ -80,6 +95,19 @@
   #error "need to provide a 'board' object"
 #endif
 
+// runtime overrides of the above (persisted alongside the identity)
+#if defined(NRF52_PLATFORM)
+  static ConfigStore config(InternalFS, "/identity");
+#elif defined(ESP32)
+  static ConfigStore config(SPIFFS, "/identity");
+#else
+  #error "need to define filesystem"
+#endif
+
+#ifndef ROOM_PASSWORD
+  #define ROOM_PASSWORD   ""    // ie. none
+#endif
+
 /* ------------------------------ Code -------------------------------- */
 
 struct ClientInfo {
@@ -89,83 +117,78 @@ struct ClientInfo {
   uint32_t sync_since;  // sync messages SINCE this timestamp (by OUR clock)
   uint32_t pending_ack;
   uint32_t push_post_timestamp;
+  uint16_t push_backlog;    // (estimated) num posts still to sync
+  uint8_t  push_count;      // num posts in the pending push
   unsigned long ack_timeout;
   bool     is_admin;
+  uint8_t  caps;      // ROOM_LOGIN_CAP_* from client's login
   uint8_t  push_failures;
   uint8_t  secret[PUB_KEY_SIZE];
   int      out_path_len;
   uint8_t  out_path[MAX_PATH_SIZE];
 };
 
-#define MAX_POST_TEXT_LEN    (160-9)
-
-struct PostInfo {
-  mesh::Identity author;
-  uint32_t post_timestamp;   // by OUR clock
-  char text[MAX_POST_TEXT_LEN+1];
-};
-
 #define REPLY_DELAY_MILLIS         1500
 #define PUSH_NOTIFY_DELAY_MILLIS   1000
 #define SYNC_PUSH_INTERVAL         1000
 
+#ifndef MAX_CONCURRENT_PUSHES
+  #define MAX_CONCURRENT_PUSHES       4    // num clients with a push awaiting ACK, at once
+#endif
+#define PUSH_MAX_QUEUED             2    // don't start a push if this many packets are already waiting to send
+#define PUSH_MAX_BATCH_POSTS        4
+#define PUSH_MAX_BATCH_LEN   (5 + 9 + MAX_POST_TEXT_LEN)   // same as one maximal post, so always fits in a datagram
+#define PUSH_MAX_CATCHUP_POSTS     16    // for clients which can unpack TXT_TYPE_POST_BATCH (limited by datagram size)
+
 #define PUSH_ACK_TIMEOUT_FLOOD    12000
 #define PUSH_TIMEOUT_BASE          4000
 #define PUSH_ACK_TIMEOUT_FACTOR    2000
 
-class MyMesh : public mesh::Mesh {
+#define POST_LOG_MAINTAIN_INTERVAL  5000
+
+#ifndef RADIO_RECONFIG_DELAY_MILLIS
+  #define RADIO_RECONFIG_DELAY_MILLIS  5000   // so that reply to the 'set' goes out on the old radio params
+#endif
+#define RADIO_RECONFIG_RETRY_MILLIS   1000
+#define CLIENT_EVICT_CHECK_INTERVAL  60000
+
+class MyMesh : public mesh::Mesh, public ConfigListener {
   RadioLibWrapper* my_radio;
-  float airtime_factor;
+  float airtime_factor;   // cached from config
   uint8_t reply_data[MAX_PACKET_PAYLOAD];
-  int num_clients;
-  ClientInfo known_clients[MAX_CLIENTS];
+  ClientTable<ClientInfo, MAX_CLIENTS> clients;
   unsigned long next_push;
   int next_client_idx;  // for round-robin polling
-  int next_post_idx;
-  PostInfo posts[MAX_UNSYNCED_POSTS];   // cyclic queue
+  PostLog posts;   // persistent, in timestamp order
+  unsigned long next_maintain;
+  unsigned long next_evict_check;
+  unsigned long radio_reconfig_at;   // non-zero if radio params have changed
+  AdvertScheduler adverts;
+  unsigned long reboot_at;   // non-zero if a reboot is pending
 
   ClientInfo* putClient(const mesh::Identity& id) {
-    for (int i = 0; i < num_clients; i++) {
-      if (id.matches(known_clients[i].id)) return &known_clients[i];  // already known
+    bool is_new;
+    auto newClient = clients.put(id, is_new);   // NOTE: evicts least active client, if table is full
+    if (is_new) {
+      newClient->out_path_len = -1;  // initially out_path is unknown
+      newClient->last_timestamp = 0;
+      self_id.calcSharedSecret(newClient->secret, id);   // calc ECDH shared secret
     }
-    ClientInfo* newClient;
-    if (num_clients < MAX_CLIENTS) {
-      newClient = &known_clients[num_clients++];
-    } else {    // table is currently full
-      // evict least active client
-      uint32_t oldest_timestamp = 0xFFFFFFFF;
-      newClient = &known_clients[0];
-      for (int i = 0; i < num_clients; i++) {
-        auto c = &known_clients[i];
-        if (c->last_activity < oldest_timestamp) {
-          oldest_timestamp = c->last_activity;
-          newClient = c;
-        }
-      }
-    }
-    newClient->id = id;
-    newClient->out_path_len = -1;  // initially out_path is unknown
-    newClient->last_timestamp = 0;
-    self_id.calcSharedSecret(newClient->secret, id);   // calc ECDH shared secret
     return newClient;
   }
 
-  void  evict(ClientInfo* client) {
-    client->last_activity = 0;  // this slot will now be re-used (will be oldest)
-    memset(client->id.pub_key, 0, sizeof(client->id.pub_key));
-    memset(client->secret, 0, sizeof(client->secret));
-    client->pending_ack = 0;
-  }
-
   void addPost(ClientInfo* client, const char* postData, char reply[]) {
     // TODO: suggested postData format: <title>/<descrption>
-    posts[next_post_idx].author = client->id;    // add to cyclic queue
-    strncpy(posts[next_post_idx].text, postData, MAX_POST_TEXT_LEN);
-    posts[next_post_idx].text[MAX_POST_TEXT_LEN] = 0;
+    // NOTE: post log makes the post_timestamps unique (and increasing)
+    if (posts.append(client->id, postData, getRTCClock()->getCurrentTime()) == 0) {
+      strcpy(reply, "[Error: post not saved]");
+      return;
+    }
 
-    posts[next_post_idx].post_timestamp = getRTCClock()->getCurrentTime();
-    // TODO:  only post at maximum of ONE PER SECOND, so that post_timestamps are UNIQUE!!
-    next_post_idx = (next_post_idx + 1) % MAX_UNSYNCED_POSTS;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+      auto c = clients.getByIdx(i);
+      if (c && c != client && c->push_backlog < 0xFFFF) c->push_backlog++;
+    }
 
     strcpy(reply, "[Posted]");
     next_push = futureMillis(PUSH_NOTIFY_DELAY_MILLIS);
@@ -179,21 +202,78 @@ class MyMesh : public mesh::Mesh {
     }
   }
 
-  void pushPostToClient(ClientInfo* client, PostInfo& post) {
-    int len = 0;
-    memcpy(&reply_data[len], &post.post_timestamp, 4); len += 4;   // this is a PAST timestamp... but should be accepted by client
-    reply_data[len++] = 0;  // plain text
-
+  static int appendPostText(uint8_t* dest, const PostInfo& post) {
     // encode prefix of post.author.pub_key (in hex)
-    mesh::Utils::toHex((char *) &reply_data[len], post.author.pub_key, 4); len += 8;   // just first 4 bytes (8 hex chars)
-    reply_data[len++] = ':';
+    mesh::Utils::toHex((char *) dest, post.author.pub_key, 4);   // just first 4 bytes (8 hex chars)
+    int len = 8;
+    dest[len++] = ':';
 
     int text_len = strlen(post.text);
-    memcpy(&reply_data[len], post.text, text_len); len += text_len;
+    memcpy(&dest[len], post.text, text_len); len += text_len;
+    return len;
+  }
 
-    // calc expected ACK reply
+  // push the next new post(s) to Client, batching short posts into one message. Returns false if nothing to push.
+  bool pushPostsToClient(ClientInfo* client) {
+    uint32_t since = client->sync_since;
+    PostInfo post;
+    // seek to first new post for this Client, skipping (and treating as synced) posts by the Client itself
+    if (!posts.findNext(since, &client->id, post)) {
+      if (since != client->sync_since) {
+        client->sync_since = since;   // skipped over own posts
+      } else if (since >= posts.getLastTimestamp()) {
+        client->push_backlog = 0;   // fully synced
+      }
+      return false;
+    }
+
+    int len, count;
+    uint32_t last_timestamp;
+    int packed_len = -1;
+    uint8_t packed[MAX_PACKET_PAYLOAD];
+
+    if (client->caps & ROOM_LOGIN_CAP_POST_BATCH) {   // catch-up: pack as many posts as fit, each with own timestamp
+      PostBatchWriter batch(reply_data);
+      batch.add(post.post_timestamp, post.author.pub_key, post.text);
+      while (batch.getCount() < PUSH_MAX_CATCHUP_POSTS) {
+        since = batch.getLastTimestamp();
+        if (!posts.findNext(since, &client->id, post)) break;
+        if (!batch.add(post.post_timestamp, post.author.pub_key, post.text)) break;   // won't fit (send it next time)
+      }
+      len = batch.finish();
+      count = batch.getCount();
+      last_timestamp = batch.getLastTimestamp();
+    } else {
+      len = 4;   // timestamp goes here, once batch is complete
+      reply_data[len++] = 0;  // plain text
+      len += appendPostText(&reply_data[len], post);
+      last_timestamp = post.post_timestamp;
+      count = 1;
+
+      while (count < PUSH_MAX_BATCH_POSTS) {
+        since = last_timestamp;
+        if (!posts.findNext(since, &client->id, post)) break;
+        if (len + 1 + 9 + (int)strlen(post.text) > PUSH_MAX_BATCH_LEN) break;   // won't fit (send it next time)
+
+        reply_data[len++] = '\n';
+        len += appendPostText(&reply_data[len], post);
+        last_timestamp = post.post_timestamp;
+        count++;
+      }
+      memcpy(reply_data, &last_timestamp, 4);   // this is a PAST timestamp... but should be accepted by client
+
+      packed_len = DEFAULT_TEXT_COMPRESSION ? TextCompressor::compress(packed, sizeof(packed), (const char *) &reply_data[5], len - 5) : -1;
+      if (packed_len > 0) reply_data[4] |= TXT_FLAG_COMPRESSED;
+    }
+
+    // calc expected ACK reply (always over the original text, or whole batch)
     mesh::Utils::sha256((uint8_t *)&client->pending_ack, 4, reply_data, len, self_id.pub_key, PUB_KEY_SIZE);
-    client->push_post_timestamp = post.post_timestamp;
+    client->push_post_timestamp = last_timestamp;
+    client->push_count = count;
+
+    if (packed_len > 0) {
+      memcpy(&reply_data[5], packed, packed_len); len = 5 + packed_len;
+    }
 
     auto reply = createDatagram(PAYLOAD_TYPE_TXT_MSG, client->id, client->secret, reply_data, len);
     if (reply) {
@@ -208,15 +288,34 @@ class MyMesh : public mesh::Mesh {
       client->pending_ack = 0;
       MESH_DEBUG_PRINTLN("Unable to push post to client");
     }
+    return true;
+  }
+
+  // next Client to push to: those with direct paths first, then smallest backlog (ties broken round-robin)
+  ClientInfo* selectPushClient() {
+    ClientInfo* best = NULL;
+    for (int k = 0; k < MAX_CLIENTS; k++) {
+      auto c = clients.getByIdx((next_client_idx + k) % MAX_CLIENTS);
+      if (c == NULL || c->pending_ack || c->push_backlog == 0) continue;   // free slot, waiting for ACK, or synced
+
+      if (best == NULL
+        || (c->out_path_len >= 0 && best->out_path_len < 0)
+        || ((c->out_path_len >= 0) == (best->out_path_len >= 0) && c->push_backlog < best->push_backlog)) {
+        best = c;
+      }
+    }
+    return best;
   }
 
   bool processAck(const uint8_t *data) {
-    for (int i = 0; i < num_clients; i++) {
-      auto client = &known_clients[i];
-      if (client->pending_ack && memcmp(data, &client->pending_ack, 4) == 0) {     // got an ACK from Client!
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+      auto client = clients.getByIdx(i);
+      if (client && client->pending_ack && memcmp(data, &client->pending_ack, 4) == 0) {     // got an ACK from Client!
         client->pending_ack = 0;    // clear this, so next push can happen
         client->push_failures = 0;
         client->sync_since = client->push_post_timestamp;   // advance Client's SINCE timestamp, to sync next post
+        client->push_backlog = client->push_backlog > client->push_count ? client->push_backlog - client->push_count : 1;  // (1, so it re-checks)
+        next_push = futureMillis(0);  // free slot, can push again
         return true;
       }
     }
@@ -224,6 +323,22 @@ class MyMesh : public mesh::Mesh {
   }
 
 protected:
+  void onConfigChanged(const ConfigKeyDef* def) override {
+    if (def->key == CFG_KEY_AIRTIME_FACTOR) {
+      airtime_factor = config.getFloat(CFG_KEY_AIRTIME_FACTOR, 1.0f);
+    } else if (def->flags & CFG_FLAG_RADIO) {
+      radio_reconfig_at = futureMillis(RADIO_RECONFIG_DELAY_MILLIS);   // let any batch of changes (and the reply) go out first
+    } else if (def->key == CFG_KEY_ADVERT_INTERVAL) {
+      adverts.setInterval(config.getUInt(CFG_KEY_ADVERT_INTERVAL, ADVERT_INTERVAL_MINS));
+    } else if (def->key == CFG_KEY_NODE_NAME || def->key == CFG_KEY_NODE_LAT || def->key == CFG_KEY_NODE_LON) {
+      adverts.onChanged();
+    }
+  }
+
+  void onSelfAdvertEcho(mesh::Packet* packet, uint32_t timestamp) override {
+    adverts.onEchoHeard(timestamp);
+  }
+
   float getAirtimeBudgetFactor() const override {
     return airtime_factor;
   }
@@ -241,16 +356,22 @@ protected:
       memcpy(&sender_sync_since, &data[4], 4);  // sender's "sync messags SINCE x" timestamp
 
       bool is_admin;
-      if (memcmp(&data[8], ADMIN_PASSWORD, strlen(ADMIN_PASSWORD)) == 0) {  // check for valid admin password
+      const char* admin_password = config.getString(CFG_KEY_ADMIN_PASSWORD, ADMIN_PASSWORD);
+      const char* room_password = config.getString(CFG_KEY_GUEST_PASSWORD, ROOM_PASSWORD);
+      if (memcmp(&data[8], admin_password, strlen(admin_password)) == 0) {  // check for valid admin password
         is_admin = true;
       } else {
         is_admin = false;
-    #ifdef ROOM_PASSWORD
-        if (memcmp(&data[8], ROOM_PASSWORD, strlen(ROOM_PASSWORD)) != 0) {  // check the room/public password
+        if (room_password[0] && memcmp(&data[8], room_password, strlen(room_password)) != 0) {  // check the room/public password
           MESH_DEBUG_PRINTLN("Incorrect room password");
           return;   // no response. Client will timeout
         }
-    #endif
+      }
+
+      // optional capabilities byte, after password's terminator (older clients: just zero padding)
+      uint8_t caps = 0;
+      for (int i = 8; i + 1 < (int) len; i++) {
+        if (data[i] == 0) { caps = data[i + 1]; break; }
       }
 
       auto client = putClient(sender);  // add to known clients (if not already known)
@@ -261,24 +382,25 @@ protected:
 
       MESH_DEBUG_PRINTLN("Login success!");
       client->is_admin = is_admin;
+      client->caps = caps;
       client->last_timestamp = sender_timestamp;
       client->sync_since = sender_sync_since;
+      client->push_backlog = posts.countAfter(sender_sync_since);
       client->pending_ack = 0;
       client->push_failures = 0;
 
       uint32_t now = getRTCClock()->getCurrentTime();
-      client->last_activity = now;
+      clients.touch(client, now);
 
       memcpy(reply_data, &now, 4);   // response packets always prefixed with timestamp
       // TODO: maybe reply with count of messages waiting to be synced for THIS client?
       memset(&reply_data[4], 0, 4);  // FUTURE: reserve 4 bytes 
+      reply_data[4] = ROOM_LOGIN_CAP_POST_BATCH;   // our capabilities
       memcpy(&reply_data[8], "OK", 2);
 
       if (packet->isRouteFlood()) {
         // let this sender know path TO here, so they can use sendDirect(), and ALSO encode the response
-        mesh::Packet* path = createPathReturn(sender, client->secret, packet->path, packet->path_len,
-                                              PAYLOAD_TYPE_RESPONSE, reply_data, 8 + 2);
-        if (path) sendFlood(path);
+        sendPathReturn(packet, sender, client->secret, PAYLOAD_TYPE_RESPONSE, reply_data, 8 + 2);
       } else {
         mesh::Packet* reply = createDatagram(PAYLOAD_TYPE_RESPONSE, sender, client->secret, reply_data, 8 + 2);
         if (reply) {
@@ -295,20 +417,16 @@ protected:
   int  matching_peer_indexes[MAX_CLIENTS];
 
   int searchPeersByHash(const uint8_t* hash) override {
-    int n = 0;
-    for (int i = 0; i < num_clients; i++) {
-      if (known_clients[i].id.isHashMatch(hash)) {
-        matching_peer_indexes[n++] = i;  // store the INDEXES of matching contacts (for subsequent 'peer' methods)
-      }
-    }
-    return n;
+    // store the INDEXES of matching clients (for subsequent 'peer' methods)
+    return clients.searchByHash(hash, matching_peer_indexes, MAX_CLIENTS);
   }
 
   void getPeerSharedSecret(uint8_t* dest_secret, int peer_idx) override {
     int i = matching_peer_indexes[peer_idx];
-    if (i >= 0 && i < num_clients) {
+    auto client = clients.getByIdx(i);
+    if (client) {
       // lookup pre-calculated shared_secret
-      memcpy(dest_secret, known_clients[i].secret, PUB_KEY_SIZE);
+      memcpy(dest_secret, client->secret, PUB_KEY_SIZE);
     } else {
       MESH_DEBUG_PRINTLN("getPeerSharedSecret: Invalid peer idx: %d", i);
     }
@@ -316,26 +434,58 @@ protected:
 
   void onPeerDataRecv(mesh::Packet* packet, uint8_t type, int sender_idx, const uint8_t* secret, uint8_t* data, size_t len) override {
     int i = matching_peer_indexes[sender_idx];
-    if (i < 0 || i >= num_clients) {  // get from our known_clients table (sender SHOULD already be known in this context)
+    auto client = clients.getByIdx(i);   // get from our clients table (sender SHOULD already be known in this context)
+    if (client == NULL) {
       MESH_DEBUG_PRINTLN("onPeerDataRecv: invalid peer idx: %d", i);
       return;
     }
-    auto client = &known_clients[i];
-    if (type == PAYLOAD_TYPE_TXT_MSG && len > 5) {   // a CLI command
+    if (type == PAYLOAD_TYPE_REQ && len > 5 && client->is_admin) {   // binary admin commands
+      uint32_t sender_timestamp;
+      memcpy(&sender_timestamp, data, 4);
+
+      if (data[4] != CMD_ADMIN) {
+        MESH_DEBUG_PRINTLN("onPeerDataRecv: unsupported request: %d", (uint32_t) data[4]);
+      } else if (sender_timestamp > client->last_timestamp) {  // prevent replay attacks
+        client->last_timestamp = sender_timestamp;
+        uint32_t now = getRTCClock()->getCurrentTime();
+        clients.touch(client, now);
+
+        memcpy(reply_data, &now, 4);   // response packets always prefixed with timestamp
+        AdminBatchWriter results(&reply_data[4], ADMIN_MAX_RESPONSE);
+        handleAdminBatch(sender_timestamp, &data[5], len - 5, results);
+        int reply_len = 4 + results.getLength();
+
+        // the results ARE the acknowledgement, so no ACK packet, and no reply delay
+        if (packet->isRouteFlood()) {
+          // let this sender know path TO here, so they can use sendDirect(), and ALSO encode the response
+          sendPathReturn(packet, client->id, secret, PAYLOAD_TYPE_RESPONSE, reply_data, reply_len);
+        } else {
+          mesh::Packet* reply = createDatagram(PAYLOAD_TYPE_RESPONSE, client->id, secret, reply_data, reply_len);
+          if (reply) {
+            if (client->out_path_len >= 0) {  // we have an out_path, so send DIRECT
+              sendDirect(reply, client->out_path, client->out_path_len);
+            } else {
+              sendFlood(reply);
+            }
+          }
+        }
+      } else {
+        MESH_DEBUG_PRINTLN("onPeerDataRecv: possible replay attack detected");
+      }
+    } else if (type == PAYLOAD_TYPE_TXT_MSG && len > 5) {   // a CLI command
       uint32_t sender_timestamp;
       memcpy(&sender_timestamp, data, 4);  // timestamp (by sender's RTC clock - which could be wrong)
       uint flags = data[4];   // message attempt number, and other flags
 
-      if (flags != 0) {
+      if ((flags & ~TXT_FLAG_COMPRESSED) != 0) {
         MESH_DEBUG_PRINTLN("onPeerDataRecv: unsupported command type received: flags=%02x", (uint32_t)flags);
+      } else if (!TextCompressor::decodeTextPayload(data, len, MAX_PACKET_PAYLOAD - 5 - 1)) {  // also makes a C string again, with null terminator
+        MESH_DEBUG_PRINTLN("onPeerDataRecv: invalid compressed text");
       } else if (sender_timestamp > client->last_timestamp) {  // prevent replay attacks 
         client->last_timestamp = sender_timestamp;
 
         uint32_t now = getRTCClock()->getCurrentTime();
-        client->last_activity = now;
-
-        // len can be > original length, but 'text' will be padded with zeroes
-        data[len] = 0; // need to make a C string again, with null terminator
+        clients.touch(client, now);
 
         uint32_t ack_hash;    // calc truncated hash of the message timestamp + text + sender pub_key, to prove to sender that we got it
         mesh::Utils::sha256((uint8_t *) &ack_hash, 4, data, 5 + strlen((char *)&data[5]), client->id.pub_key, PUB_KEY_SIZE);
@@ -388,10 +538,10 @@ protected:
   bool onPeerPathRecv(mesh::Packet* packet, int sender_idx, const uint8_t* secret, uint8_t* path, uint8_t path_len, uint8_t extra_type, uint8_t* extra, uint8_t extra_len) override {
     // TODO: prevent replay attacks
     int i = matching_peer_indexes[sender_idx];
+    auto client = clients.getByIdx(i);   // get from our clients table (sender SHOULD already be known in this context)
 
-    if (i >= 0 && i < num_clients) {  // get from our known_clients table (sender SHOULD already be known in this context)
+    if (client) {
       MESH_DEBUG_PRINTLN("PATH to client, path_len=%d", (uint32_t) path_len);
-      auto client = &known_clients[i];
       memcpy(client->out_path, path, client->out_path_len = path_len);  // store a copy of path, for sendDirect()
     } else {
       MESH_DEBUG_PRINTLN("onPeerPathRecv: invalid peer idx: %d", i);
@@ -414,41 +564,109 @@ protected:
 
 public:
   MyMesh(RadioLibWrapper& radio, mesh::MillisecondClock& ms, mesh::RNG& rng, mesh::RTCClock& rtc, mesh::MeshTables& tables)
-     : mesh::Mesh(radio, ms, rng, rtc, *new StaticPoolPacketManager(32), tables)
+     : mesh::Mesh(radio, ms, rng, rtc, *new StaticPoolPacketManager(32), tables), adverts(ms, rng)
   {
     my_radio = &radio;
     airtime_factor = 1.0;    // one half
-    num_clients = 0;
-    next_post_idx = 0;
     next_client_idx = 0;
     next_push = 0;
-    memset(posts, 0, sizeof(posts));
+    next_maintain = 0;
+    next_evict_check = 0;
+    reboot_at = 0;
+    radio_reconfig_at = 0;
+  }
+
+  void begin(PostLogStorage& post_store) {
+    airtime_factor = config.getFloat(CFG_KEY_AIRTIME_FACTOR, 1.0f);
+    config.setListener(this);
+    adverts.setInterval(config.getUInt(CFG_KEY_ADVERT_INTERVAL, ADVERT_INTERVAL_MINS));
+    mesh::Mesh::begin();
+    posts.begin(post_store);
   }
 
   void sendSelfAdvertisement() {
     uint8_t app_data[MAX_ADVERT_DATA_SIZE];
     uint8_t app_data_len;
     {
-      AdvertDataBuilder builder(ADV_TYPE_ROOM, ADVERT_NAME, ADVERT_LAT, ADVERT_LON);
+      AdvertDataBuilder builder(ADV_TYPE_ROOM, config.getString(CFG_KEY_NODE_NAME, ADVERT_NAME),
+                                config.getFloat(CFG_KEY_NODE_LAT, ADVERT_LAT), config.getFloat(CFG_KEY_NODE_LON, ADVERT_LON));
+      builder.setBattery(board.getBattMilliVolts());
+      int queued = _mgr->getOutboundCount();
+      builder.setLoad(queued * 100 / (queued + _mgr->getFreeCount() + 1));   // tx queue fill
       app_data_len = builder.encodeTo(app_data);
     }
 
     mesh::Packet* pkt = createAdvert(self_id, app_data, app_data_len);
     if (pkt) {
+      adverts.onAdvertSent(getAdvertTimestamp(pkt));
       sendFlood(pkt, 1200);  // add slight delay
     } else {
       MESH_DEBUG_PRINTLN("ERROR: unable to create advertisement packet!");
     }
   }
 
+  void handleAdminBatch(uint32_t sender_timestamp, const uint8_t* batch, int batch_len, AdminBatchWriter& results) {
+    AdminBatchReader commands(batch, batch_len, false);
+    uint8_t op, status, len;
+    const uint8_t* params;
+    while (results.canAddResult() && commands.next(op, status, params, len)) {   // stop when the response is full, ie. before running more
+      bool ok;
+      switch (op) {
+        case ADMIN_OP_GET_VERSION:
+          ok = results.addResult(op, ADMIN_OK, FIRMWARE_VER_TEXT, strlen(FIRMWARE_VER_TEXT));
+          break;
+        case ADMIN_OP_REBOOT:
+          reboot_at = futureMillis(REPLY_DELAY_MILLIS);   // after response is sent
+          ok = results.addResult(op, ADMIN_OK);
+          break;
+        case ADMIN_OP_SEND_ADVERT:
+          ok = results.addResult(op, adverts.request() ? ADMIN_OK : ADMIN_ERR_FAILED);   // fails if suppressed
+          break;
+        case ADMIN_OP_GET_CLOCK: {
+          uint32_t now = getRTCClock()->getCurrentTime();
+          ok = results.addResult(op, ADMIN_OK, &now, 4);
+          break;
+        }
+        case ADMIN_OP_SYNC_CLOCK: {
+          uint32_t curr = getRTCClock()->getCurrentTime();
+          if (sender_timestamp > curr) {
+            getRTCClock()->setCurrentTime(curr = sender_timestamp + 1);
+            ok = results.addResult(op, ADMIN_OK, &curr, 4);
+          } else {
+            ok = results.addResult(op, ADMIN_ERR_FAILED, &curr, 4);   // clock cannot go backwards
+          }
+          break;
+        }
+        case ADMIN_OP_SET_AIRTIME: {
+          uint16_t factor_x100;
+          if (len < 2) { ok = results.addResult(op, ADMIN_ERR_PARAM); break; }
+          memcpy(&factor_x100, params, 2);
+          if (config.setFloat(CFG_KEY_AIRTIME_FACTOR, factor_x100 / 100.0f) == CFG_OK && config.save()) {
+            ok = results.addResult(op, ADMIN_OK);
+          } else {
+            ok = results.addResult(op, ADMIN_ERR_PARAM);
+          }
+          break;
+        }
+        default:
+          ok = results.addResult(op, ADMIN_ERR_UNKNOWN);
+          break;
+      }
+      if (!ok) break;   // response is full
+    }
+  }
+
   bool handleAdminCommand(uint32_t sender_timestamp, const char* command, char reply[]) {
     while (*command == ' ') command++;   // skip leading spaces
 
     if (memcmp(command, "reboot", 6) == 0) {
       board.reboot();  // doesn't return
     } else if (memcmp(command, "advert", 6) == 0) {
-      sendSelfAdvertisement();
-      strcpy(reply, "OK - Advert sent");
+      if (adverts.request()) {
+        strcpy(reply, "OK - Advert queued");
+      } else {
+        strcpy(reply, "OK - not needed, Advert was recently heard re-flooded");
+      }
     } else if (memcmp(command, "clock sync", 10) == 0) {
       uint32_t curr = getRTCClock()->getCurrentTime();
       if (sender_timestamp > curr) {
@@ -462,12 +680,30 @@ public:
       DateTime dt = DateTime(now);
       sprintf(reply, "%02d:%02d - %d/%d/%d UTC", dt.hour(), dt.minute(), dt.day(), dt.month(), dt.year());
     } else if (memcmp(command, "set ", 4) == 0) {
-      if (memcmp(&command[4], "AF", 2) == 0 || memcmp(&command[4], "af=", 2) == 0) {
-        airtime_factor = atof(&command[7]);
-        strcpy(reply, "OK");
+      const char* eq = strchr(&command[4], '=');   // eg. "set sf=9"
+      int err = eq ? config.setFromText(&command[4], eq - &command[4], &eq[1]) : CFG_ERR_UNKNOWN_KEY;
+      if (err == CFG_OK) {
+        strcpy(reply, config.save() ? "OK" : "ERR: unable to save");
+      } else if (err == CFG_ERR_UNKNOWN_KEY) {
+        sprintf(reply, "unknown config: %s", &command[4]);
+      } else {
+        sprintf(reply, "ERR: %s", ConfigStore::getErrorText(err));
+      }
+    } else if (memcmp(command, "get ", 4) == 0) {
+      auto def = ConfigStore::findKeyDef(&command[4], strlen(&command[4]));
+      if (def) {
+        config.formatValue(def, reply);
       } else {
         sprintf(reply, "unknown config: %s", &command[4]);
       }
+    } else if (memcmp(command, "unset ", 6) == 0) {   // revert to the default
+      auto def = ConfigStore::findKeyDef(&command[6], strlen(&command[6]));
+      if (def) {
+        config.reset(def->key);
+        strcpy(reply, config.save() ? "OK" : "ERR: unable to save");
+      } else {
+        sprintf(reply, "unknown config: %s", &command[6]);
+      }
     } else if (memcmp(command, "ver", 3) == 0) {
       strcpy(reply, FIRMWARE_VER_TEXT);
     } else {
@@ -481,39 +717,69 @@ public:
   void loop() {
     mesh::Mesh::loop();
 
-    if (millisHasNowPassed(next_push) && num_clients > 0) {
+    if (adverts.isDue(hasSendCapacity(ADVERT_MAX_QUEUED))) {
+      sendSelfAdvertisement();
+    }
+
+    if (reboot_at && millisHasNowPassed(reboot_at)) {
+      board.reboot();  // doesn't return
+    }
+
+    if (radio_reconfig_at && millisHasNowPassed(radio_reconfig_at)) {
+      if (my_radio->reconfigure(config.getFloat(CFG_KEY_RADIO_FREQ, LORA_FREQ), config.getFloat(CFG_KEY_RADIO_BW, LORA_BW),
+                                config.getUInt(CFG_KEY_RADIO_SF, LORA_SF), config.getUInt(CFG_KEY_RADIO_CR, LORA_CR),
+                                config.getInt(CFG_KEY_TX_POWER, LORA_TX_POWER))) {
+        MESH_DEBUG_PRINTLN("radio reconfigured");
+        radio_reconfig_at = 0;
+      } else {
+        radio_reconfig_at = futureMillis(RADIO_RECONFIG_RETRY_MILLIS);   // probably mid-transmit, try again soon
+      }
+    }
+
+    if (millisHasNowPassed(next_push) && clients.getCount() > 0) {
       // check for ACK timeouts
-      for (int i = 0; i < num_clients; i++) {
-        auto c = &known_clients[i];
-        if (c->pending_ack && millisHasNowPassed(c->ack_timeout)) {
+      int in_flight = 0;
+      for (int i = 0; i < MAX_CLIENTS; i++) {
+        auto c = clients.getByIdx(i);
+        if (c && c->pending_ack && millisHasNowPassed(c->ack_timeout)) {
           c->push_failures++;
           c->pending_ack = 0;   // reset  (TODO: keep prev expected_ack's in a list, incase they arrive LATER, after we retry)
           MESH_DEBUG_PRINTLN("pending ACK timed out: push_failures: %d", (uint32_t)c->push_failures);
 
           if (c->push_failures >= 3) {
-            evict(c);
+            clients.remove(c);   // also wipes the secret
           }
+        } else if (c && c->pending_ack) {
+          in_flight++;
         }
       }
-      // check next Round-Robin client, and sync next new post
-      auto client = &known_clients[next_client_idx];
-      if (client->pending_ack == 0 && client->last_activity != 0) {  // not already waiting for ACK, AND not evicted
-        for (int k = 0, idx = next_post_idx; k < MAX_UNSYNCED_POSTS; k++) {
-          if (posts[idx].post_timestamp > client->sync_since   // is new post for this Client?
-            && !posts[idx].author.matches(client->id)) {    // don't push posts to the author
-            // push this post to Client, then wait for ACK
-            pushPostToClient(client, posts[idx]);
-            break;
-          }
-          idx = (idx + 1) % MAX_UNSYNCED_POSTS;   // wrap to start of cyclic queue
+      // start pushes to several clients at once, while the outbound queue and airtime budget allow
+      int attempts = 0;
+      while (in_flight < MAX_CONCURRENT_PUSHES && attempts < clients.getCount() && hasSendCapacity(PUSH_MAX_QUEUED)) {
+        auto client = selectPushClient();
+        if (client == NULL) break;   // everyone synced (or waiting for ACK)
+
+        attempts++;
+        if (pushPostsToClient(client)) {   // then wait for ACK
+          if (client->pending_ack) in_flight++;
         }
       }
-      next_client_idx = (next_client_idx + 1) % num_clients;  // round robin polling for each client
+      next_client_idx = (next_client_idx + 1) % MAX_CLIENTS;  // rotate, for tie-breaks
 
       next_push = futureMillis(SYNC_PUSH_INTERVAL);
     }
 
-    // TODO: periodically check for OLD/inactive entries in known_clients[], and evict
+    if (millisHasNowPassed(next_maintain)) {
+      uint32_t min_timestamp = POST_MAX_AGE_DAYS > 0 ? getRTCClock()->getCurrentTime() - POST_MAX_AGE_DAYS*24*60*60 : 0;
+      posts.maintain(min_timestamp);   // background compaction
+      next_maintain = futureMillis(POST_LOG_MAINTAIN_INTERVAL);
+    }
+
+    if (millisHasNowPassed(next_evict_check)) {
+      int n = clients.evictIdle(getRTCClock()->getCurrentTime(), CLIENT_IDLE_EVICT_DAYS*24*60*60);
+      if (n > 0) MESH_DEBUG_PRINTLN("evicted %d idle clients", n);
+      next_evict_check = futureMillis(CLIENT_EVICT_CHECK_INTERVAL);
+    }
   }
 };
 
@@ -557,13 +823,27 @@ void setup() {
   float tcxo = 1.6f;
 #endif
 
+#if defined(NRF52_PLATFORM)
+  InternalFS.begin();
+  IdentityStore store(InternalFS, "/identity");
+  static PostLogFS post_store(InternalFS, "/posts");
+#elif defined(ESP32)
+  SPIFFS.begin(true);
+  IdentityStore store(SPIFFS, "/identity");
+  static PostLogFS post_store(SPIFFS, "/posts");
+#endif
+  config.begin();
+  config.load();
+
 #if defined(NRF52_PLATFORM)
   SPI.setPins(P_LORA_MISO, P_LORA_SCLK, P_LORA_MOSI);
   SPI.begin();
 #elif defined(P_LORA_SCLK)
   spi.begin(P_LORA_SCLK, P_LORA_MISO, P_LORA_MOSI);
 #endif
-  int status = radio.begin(LORA_FREQ, LORA_BW, LORA_SF, LORA_CR, RADIOLIB_SX126X_SYNC_WORD_PRIVATE, LORA_TX_POWER, 8, tcxo);
+  int status = radio.begin(config.getFloat(CFG_KEY_RADIO_FREQ, LORA_FREQ), config.getFloat(CFG_KEY_RADIO_BW, LORA_BW),
+                           config.getUInt(CFG_KEY_RADIO_SF, LORA_SF), config.getUInt(CFG_KEY_RADIO_CR, LORA_CR),
+                           RADIOLIB_SX126X_SYNC_WORD_PRIVATE, config.getInt(CFG_KEY_TX_POWER, LORA_TX_POWER), 8, tcxo);
   if (status != RADIOLIB_ERR_NONE) {
     delay(5000);
     Serial.print("ERROR: radio init failed: ");
@@ -581,15 +861,6 @@ void setup() {
   radio.setDio2AsRfSwitch(SX126X_DIO2_AS_RF_SWITCH);
 #endif
 
-#if defined(NRF52_PLATFORM)
-  InternalFS.begin();
-  IdentityStore store(InternalFS, "/identity");
-#elif defined(ESP32)
-  SPIFFS.begin(true);
-  IdentityStore store(SPIFFS, "/identity");
-#else
-  #error "need to define filesystem"
-#endif
   if (!store.load("_main", the_mesh.self_id)) {
     the_mesh.self_id = mesh::LocalIdentity(the_mesh.getRNG());  // create new random identity
     store.save("_main", the_mesh.self_id);
@@ -600,7 +871,8 @@ void setup() {
 
   command[0] = 0;
 
-  the_mesh.begin();
+  post_store.begin();
+  the_mesh.begin(post_store);
 
   // send out initial Advertisement to the mesh
   the_mesh.sendSelfAdvertisement();
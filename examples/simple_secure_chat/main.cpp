@@ -78,8 +78,15 @@ class MyMesh : public BaseChatMesh, ContactVisitor {
   mesh::GroupChannel* _public;
   unsigned long last_msg_sent;
   ContactInfo* curr_recipient;
+  const ContactInfo* sync_room;   // room last logged in to
+  uint32_t sync_since;   // timestamp (by room's clock) of last post received from sync_room
+  uint8_t test_blob[MAX_BLOB_SIZE];   // for the 'blob' throughput test
+  int blob_len;
+  unsigned long blob_sent_at;
   char command[MAX_TEXT_LEN+1];
 
+  static uint8_t testBlobByte(int i) { return (i * 7 + (i >> 8)) & 0xFF; }
+
   const char* getTypeName(uint8_t type) const {
     if (type == ADV_TYPE_CHAT) return "Chat";
     if (type == ADV_TYPE_REPEATER) return "Repeater";
@@ -95,14 +102,13 @@ class MyMesh : public BaseChatMesh, ContactVisitor {
         while (!full) {
           ContactInfo c;
           uint8_t pub_key[32];
-          uint8_t unused;
           uint32_t reserved;
 
           bool success = (file.read(pub_key, 32) == 32);
           success = success && (file.read((uint8_t *) &c.name, 32) == 32);
           success = success && (file.read(&c.type, 1) == 1);
           success = success && (file.read(&c.flags, 1) == 1);
-          success = success && (file.read(&unused, 1) == 1);
+          success = success && (file.read(&c.send_window, 1) == 1);  // was 'unused' (zero)
           success = success && (file.read((uint8_t *) &reserved, 4) == 4);
           success = success && (file.read((uint8_t *) &c.out_path_len, 1) == 1);
           success = success && (file.read((uint8_t *) &c.last_advert_timestamp, 4) == 4);
@@ -128,7 +134,6 @@ class MyMesh : public BaseChatMesh, ContactVisitor {
     if (file) {
       ContactsIterator iter;
       ContactInfo c;
-      uint8_t unused = 0;
       uint32_t reserved = 0;
 
       while (iter.hasNext(this, c)) {
@@ -136,7 +141,7 @@ class MyMesh : public BaseChatMesh, ContactVisitor {
         success = success && (file.write((uint8_t *) &c.name, 32) == 32);
         success = success && (file.write(&c.type, 1) == 1);
         success = success && (file.write(&c.flags, 1) == 1);
-        success = success && (file.write(&unused, 1) == 1);
+        success = success && (file.write(&c.send_window, 1) == 1);
         success = success && (file.write((uint8_t *) &reserved, 4) == 4);
         success = success && (file.write((uint8_t *) &c.out_path_len, 1) == 1);
         success = success && (file.write((uint8_t *) &c.last_advert_timestamp, 4) == 4);
@@ -154,6 +159,7 @@ protected:
 
     Serial.printf("ADVERT from -> %s\n", contact.name);
     Serial.printf("  type: %s\n", getTypeName(contact.type));
+    if (contact.load != ADV_LOAD_UNKNOWN) Serial.printf("  load: %d%%\n", (uint32_t) contact.load);
     Serial.print("   public key: "); mesh::Utils::printHex(Serial, contact.id.pub_key, PUB_KEY_SIZE); Serial.println();
 
     saveContacts();
@@ -164,24 +170,14 @@ protected:
     saveContacts();
   }
 
-  bool processAck(const uint8_t *data) override {
-    if (memcmp(data, &expected_ack_crc, 4) == 0) {     // got an ACK from recipient
-      Serial.printf("   Got ACK! (round trip: %d millis)\n", _ms->getMillis() - last_msg_sent);
-      // NOTE: the same ACK can be received multiple times!
-      expected_ack_crc = 0;  // reset our expected hash, now that we have received ACK
-      return true;
-    }
-
-    //uint32_t crc;
-    //memcpy(&crc, data, 4);
-    //MESH_DEBUG_PRINTLN("unknown ACK received: %08X (expected: %08X)", crc, expected_ack_crc);
-    return false;
-  }
-
   void onMessageRecv(const ContactInfo& from, bool was_flood, uint32_t sender_timestamp, const char *text) override {
     Serial.printf("(%s) MSG -> from %s\n", was_flood ? "FLOOD" : "DIRECT", from.name);
     Serial.printf("   %s\n", text);
 
+    if (&from == sync_room && sender_timestamp > sync_since) {   // room posts are sent with the post's timestamp
+      sync_since = sender_timestamp;
+    }
+
     if (strcmp(text, "clock sync") == 0) {  // special text command
       uint32_t curr = getRTCClock()->getCurrentTime();
       if (sender_timestamp > curr) {
@@ -202,6 +198,30 @@ protected:
     Serial.printf("   %s\n", text);
   }
 
+  void onBlobRecv(const ContactInfo& from, const uint8_t* data, size_t len) override {
+    size_t i = 0;
+    while (i < len && data[i] == testBlobByte(i)) i++;
+    Serial.printf("BLOB from %s, len=%d (%s)\n", from.name, (uint32_t) len, i == len ? "test pattern OK" : "not test pattern");
+  }
+
+  void onBlobSendComplete(const ContactInfo& recipient, uint16_t blob_id, bool delivered) override {
+    uint32_t millis = _ms->getMillis() - blob_sent_at;
+    if (delivered) {
+      Serial.printf("   Blob delivered to %s, %d bytes in %d millis (%d bytes/sec)\n", recipient.name, (uint32_t) blob_len, millis,
+          (uint32_t) (millis > 0 ? (uint64_t) blob_len * 1000 / millis : 0));
+    } else {
+      Serial.printf("   ERROR: blob to %s failed, after %d millis\n", recipient.name, millis);
+    }
+  }
+
+  void onContactResponse(const ContactInfo& contact, const uint8_t* data, uint8_t len) override {
+    if (&contact == sync_room && len >= 10 && memcmp(&data[8], "OK", 2) == 0) {
+      Serial.printf("   Logged in to room: %s\n", contact.name);
+    } else {
+      Serial.printf("   Response from %s, len=%d\n", contact.name, (uint32_t) len);
+    }
+  }
+
   uint32_t calcFloodTimeoutMillisFor(uint32_t pkt_airtime_millis) const override {
     return SEND_TIMEOUT_BASE_MILLIS + (FLOOD_SEND_TIMEOUT_FACTOR * pkt_airtime_millis);
   }
@@ -210,8 +230,16 @@ protected:
          ( (pkt_airtime_millis*DIRECT_SEND_PERHOP_FACTOR + DIRECT_SEND_PERHOP_EXTRA_MILLIS) * (path_len + 1));
   }
 
-  void onSendTimeout() override {
-    Serial.println("   ERROR: timed out, no ACK.");
+  void onSendComplete(const ContactInfo& recipient, uint32_t msg_id, bool delivered, uint8_t num_attempts) override {
+    if (delivered) {
+      if (msg_id == expected_ack_crc) {
+        Serial.printf("   Got ACK! (round trip: %d millis, attempts: %d)\n", _ms->getMillis() - last_msg_sent, (uint32_t) num_attempts);
+      } else {
+        Serial.printf("   Got ACK from %s (attempts: %d)\n", recipient.name, (uint32_t) num_attempts);
+      }
+    } else {
+      Serial.printf("   ERROR: timed out, no ACK from %s.\n", recipient.name);
+    }
   }
 
 public:
@@ -222,6 +250,10 @@ public:
   {
     command[0] = 0;
     curr_recipient = NULL;
+    sync_room = NULL;
+    sync_since = 0;
+    blob_len = 0;
+    blob_sent_at = 0;
   }
 
   void begin(FILESYSTEM& fs) {
@@ -268,22 +300,21 @@ public:
           Serial.println("   ERROR: unable to send.");
         } else {
           last_msg_sent = _ms->getMillis();
-          Serial.printf("   (message sent - %s)\n", result == MSG_SEND_SENT_FLOOD ? "FLOOD" : "DIRECT");
+          if (result == MSG_SEND_QUEUED) {
+            Serial.println("   (message queued)");
+          } else {
+            Serial.printf("   (message sent - %s)\n", result == MSG_SEND_SENT_FLOOD ? "FLOOD" : "DIRECT");
+          }
         }
       } else {
         Serial.println("   ERROR: no recipient selected (use 'to' cmd).");
       }
     } else if (memcmp(command, "public ", 7) == 0) {  // send GroupChannel msg
-      uint8_t temp[5+MAX_TEXT_LEN+32];
-      uint32_t timestamp = getRTCClock()->getCurrentTime();
-      memcpy(temp, &timestamp, 4);   // mostly an extra blob to help make packet_hash unique
-      temp[4] = 0;  // attempt and flags
-
-      sprintf((char *) &temp[5], "%s: %s", self_name, &command[7]);  // <sender>: <msg>
-      temp[5 + MAX_TEXT_LEN] = 0;  // truncate if too long
+      char text[MAX_TEXT_LEN+32];
+      sprintf(text, "%s: %s", self_name, &command[7]);  // <sender>: <msg>
+      text[MAX_TEXT_LEN] = 0;  // truncate if too long
 
-      int len = strlen((char *) &temp[5]);
-      auto pkt = createGroupDatagram(PAYLOAD_TYPE_GRP_TXT, *_public, temp, 5 + len);
+      auto pkt = composeGroupTextPacket(*_public, getRTCClock()->getCurrentTime(), text);
       if (pkt) {
         sendFlood(pkt);
         Serial.println("   Sent.");
@@ -318,14 +349,52 @@ public:
       } else {
          Serial.println("   Err: no recipient selected");
       }
-    } else if (strcmp(command, "advert") == 0) {
-      auto pkt = createSelfAdvert(self_name);
+    } else if (strcmp(command, "advert") == 0 || strcmp(command, "advert compact") == 0) {
+      auto pkt = createSelfAdvert(self_name, command[6] != 0);   // compact only verifiable by nodes which already know us
       if (pkt) {
         sendZeroHop(pkt);
         Serial.println("   (advert sent, zero hop).");
       } else {
         Serial.println("   ERR: unable to send");
       }
+    } else if (memcmp(command, "compress ", 9) == 0) {
+      setTextCompression(strcmp(&command[9], "on") == 0);
+      Serial.printf("   Text compression: %s\n", isTextCompression() ? "on" : "off");
+    } else if (memcmp(command, "login ", 6) == 0 || strcmp(command, "login") == 0) {   // login to current recipient, a room server
+      if (curr_recipient == NULL || curr_recipient->type != ADV_TYPE_ROOM) {
+        Serial.println("   ERROR: no room selected (use 'to' cmd).");
+      } else {
+        if (curr_recipient != sync_room) {   // different room, so sync all its posts
+          sync_room = curr_recipient;
+          sync_since = 0;
+        }
+        auto pkt = createRoomLogin(*curr_recipient, sync_since, command[5] ? &command[6] : "");
+        if (pkt) {
+          sendFlood(pkt);   // room will return path to here, with its response
+          Serial.println("   (login sent)");
+        } else {
+          Serial.println("   ERROR: unable to send");
+        }
+      }
+    } else if (memcmp(command, "blob", 4) == 0 && (command[4] == 0 || command[4] == ' ')) {   // throughput test, eg. "blob 4096"
+      int len = command[4] ? atoi(&command[5]) : 4096;
+      if (curr_recipient == NULL) {
+        Serial.println("   ERROR: no recipient selected (use 'to' cmd).");
+      } else if (len <= 0 || len > MAX_BLOB_SIZE) {
+        Serial.printf("   ERROR: len must be 1..%d\n", MAX_BLOB_SIZE);
+      } else if (isBlobSending()) {
+        Serial.println("   ERROR: a blob is already being sent");
+      } else {
+        for (int i = 0; i < len; i++) test_blob[i] = testBlobByte(i);
+        uint16_t blob_id;
+        if (sendBlob(*curr_recipient, test_blob, len, blob_id) == MSG_SEND_FAILED) {
+          Serial.println("   ERROR: unable to send");
+        } else {
+          blob_len = len;
+          blob_sent_at = _ms->getMillis();
+          Serial.printf("   (sending %d bytes, %d fragments)\n", len, (len + FRAG_DATA_SIZE - 1) / FRAG_DATA_SIZE);
+        }
+      }
     } else if (strcmp(command, "reset path") == 0) {
       if (curr_recipient) {
         resetPathTo(*curr_recipient);
@@ -340,8 +409,11 @@ public:
       Serial.println("   to <recipient name or prefix>");
       Serial.println("   to");
       Serial.println("   send <text>");
-      Serial.println("   advert");
+      Serial.println("   advert {compact}");
       Serial.println("   reset path");
+      Serial.println("   blob {len}");
+      Serial.println("   login {password}");
+      Serial.println("   compress on|off");
       Serial.println("   public <text>");
     } else {
       Serial.print("   ERROR: unknown command: "); Serial.println(command);
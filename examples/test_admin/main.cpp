@@ -8,6 +8,8 @@
 #include <helpers/ArduinoHelpers.h>
 #include <helpers/SimpleMeshTables.h>
 #include <helpers/StaticPoolPacketManager.h>
+#include <helpers/Telemetry.h>
+#include <helpers/AdminProtocol.h>
 
 /* ---------------------------------- CONFIGURATION ------------------------------------- */
 
@@ -41,6 +43,7 @@
 #define CMD_SET_CLOCK      0x02
 #define CMD_SEND_ANNOUNCE  0x03
 #define CMD_SET_CONFIG     0x04
+#define CMD_GET_TELEMETRY  0x05
 
 struct RepeaterStats {
   uint16_t batt_milli_volts;
@@ -56,6 +59,19 @@ struct RepeaterStats {
   uint32_t n_full_events;
 };
 
+// appended to RepeaterStats: 1 byte count, then array of these
+struct NeighborStats {
+  uint8_t hash[MAX_PATH_HASH_SIZE];
+  uint8_t hash_size;
+  int16_t avg_rssi;
+  int8_t  avg_snr_x4;
+  uint8_t est_loss_pct;
+  uint16_t n_packets;       // saturates at 0xFFFF
+  uint16_t last_heard_secs; // seconds ago, saturates at 0xFFFF
+};
+
+#define MAX_NEIGHBOR_STATS   8
+
 class MyMesh : public mesh::Mesh {
   uint32_t last_advert_timestamp = 0;
   mesh::Identity server_id;
@@ -63,6 +79,110 @@ class MyMesh : public mesh::Mesh {
   int server_path_len = -1;
   uint8_t server_path[MAX_PATH_SIZE];
   bool got_adv = false;
+  uint8_t pending_cmd = 0;
+
+  void printTelemetry(const uint8_t* data, size_t len) {
+    TelemetryReader tr(data, len);
+    if (!tr.isValid()) {
+      Serial.println("Telemetry: unsupported version");
+      return;
+    }
+    Serial.printf("Telemetry: (page %d of %d)\n", (int) tr.getPage() + 1, (int) tr.getNumPages());
+
+    uint8_t type, vlen;
+    const uint8_t* v;
+    while (tr.next(type, v, vlen)) {
+      if (type == TLV_TOTALS && vlen >= sizeof(TelemetryTotals)) {
+        TelemetryTotals t;
+        memcpy(&t, v, sizeof(t));
+        Serial.printf("  up time: %d secs, battery: %d mV\n", t.up_time_secs, (uint32_t) t.batt_milli_volts);
+        Serial.printf("  recv: %d, sent: %d, air time: %d secs\n", t.n_packets_recv, t.n_packets_sent, t.air_time_secs);
+        Serial.printf("  tx queue: %d, free: %d\n", (uint32_t) t.tx_queue_len, (uint32_t) t.free_queue_len);
+      } else if (type == TLV_RATES && vlen >= sizeof(TelemetryRates)) {
+        TelemetryRates r;
+        memcpy(&r, v, sizeof(r));
+        Serial.printf("  last %d mins: rx %.1f/min, tx %.1f/min, airtime %.1f%%\n", (int) r.window_secs / 60,
+            r.rx_per_min_x10 / 10.0f, r.tx_per_min_x10 / 10.0f, r.airtime_permille / 10.0f);
+      } else if (type == TLV_QUEUE_DELAY && vlen >= 2) {
+        uint16_t bucket0;
+        memcpy(&bucket0, v, 2);
+        Serial.print("  queue delay:");
+        for (int b = 0; 2 + (b + 1)*4 <= vlen; b++) {
+          uint32_t count;
+          memcpy(&count, &v[2 + b*4], 4);
+          if (2 + (b + 2)*4 <= vlen) {
+            Serial.printf(" <%dms:%d", (int) bucket0 << b, count);
+          } else {
+            Serial.printf(" more:%d", count);
+          }
+        }
+        Serial.println();
+      } else if (type == TLV_DROPS) {
+        static const char* reasons[] = { "pool full", "queue cap", "stale", "hop limit" };
+        Serial.print("  drops:");
+        for (int r = 0; (r + 1)*4 <= vlen; r++) {
+          uint32_t count;
+          memcpy(&count, &v[r*4], 4);
+          Serial.printf(" %s=%d", r < NUM_DROP_REASONS ? reasons[r] : "?", count);
+        }
+        Serial.println();
+      } else if (type == TLV_DEDUP && vlen >= sizeof(TelemetryDedup)) {
+        TelemetryDedup d;
+        memcpy(&d, v, sizeof(d));
+        Serial.printf("  duplicates: %d (%.1f%% of recv)\n", d.n_dupes, d.n_recv ? d.n_dupes * 100.0f / d.n_recv : 0.0f);
+      } else if (type == TLV_DECRYPT_FAILED && vlen >= 4) {
+        uint32_t n;
+        memcpy(&n, v, 4);
+        Serial.printf("  decrypt failed: %d\n", n);
+      } else if (type == TLV_SLEEP && vlen >= sizeof(TelemetrySleep)) {
+        TelemetrySleep s;
+        memcpy(&s, v, sizeof(s));
+        Serial.printf("  deep sleeps: %d (woken by rx: %d, timer: %d), slept: %d secs\n", s.n_sleeps, s.n_rx_wakes, s.n_timer_wakes, s.total_sleep_secs);
+        Serial.printf("  wake to forward: last=%dms avg=%dms max=%dms (of %d)\n", (uint32_t) s.wake_fwd_last_millis,
+            s.n_wake_fwds ? s.wake_fwd_total_millis / s.n_wake_fwds : 0, (uint32_t) s.wake_fwd_max_millis, s.n_wake_fwds);
+      } else if (type == TLV_NEIGHBOR && vlen >= sizeof(TelemetryNeighbor)) {
+        TelemetryNeighbor tn;
+        memcpy(&tn, v, sizeof(tn));
+        char hex[MAX_PATH_HASH_SIZE*2 + 1];
+        mesh::Utils::toHex(hex, tn.hash, tn.hash_size <= MAX_PATH_HASH_SIZE ? tn.hash_size : MAX_PATH_HASH_SIZE);
+        Serial.printf("  neighbour %s: SNR=%.2f RSSI=%d loss=%d%% pkts=%d heard=%ds ago\n", hex,
+            tn.avg_snr_x4 / 4.0f, (int) tn.avg_rssi,
+            (int) tn.est_loss_pct, (int) tn.n_packets, (int) tn.last_heard_secs);
+      }   // else, skip unknown TLV
+    }
+
+    if (tr.getPage() + 1 < tr.getNumPages()) {   // fetch next page
+      mesh::Packet* pkt = createTelemetryRequest(60*60, tr.getPage() + 1);
+      if (pkt) sendCommand(pkt);
+    }
+  }
+
+  void printAdminResults(const uint8_t* data, size_t len) {
+    static const char* status_names[] = { "OK", "unknown command", "bad params", "failed", "no room for result" };
+
+    AdminBatchReader results(data, len, true);
+    uint8_t op, status, rlen;
+    const uint8_t* r;
+    while (results.next(op, status, r, rlen)) {
+      Serial.printf("  op %02X: %s", (uint32_t) op, status <= ADMIN_ERR_NO_ROOM ? status_names[status] : "?");
+      if (op == ADMIN_OP_GET_VERSION && rlen > 0) {
+        char ver[MAX_PACKET_PAYLOAD];
+        memcpy(ver, r, rlen); ver[rlen] = 0;
+        Serial.printf(", version: %s", ver);
+      } else if ((op == ADMIN_OP_GET_CLOCK || op == ADMIN_OP_SYNC_CLOCK) && rlen >= 4) {
+        uint32_t t;
+        memcpy(&t, r, 4);
+        Serial.printf(", clock: %d", t);
+      } else if (op == ADMIN_OP_GET_QUEUE) {
+        for (int c = 0; (c + 1)*12 <= rlen; c++) {
+          uint32_t q[3];
+          memcpy(q, &r[c*12], 12);
+          Serial.printf(", class %d: %d/%d/%dms", c, q[0], q[1], q[2]);
+        }
+      }
+      Serial.println();
+    }
+  }
 
 protected:
   void onAdvertRecv(mesh::Packet* packet, const mesh::Identity& id, uint32_t timestamp, const uint8_t* app_data, size_t app_data_len) override {
@@ -90,7 +210,12 @@ protected:
   }
 
   void handleResponse(const uint8_t* reply, size_t reply_len) {
-    if (reply_len >= 4 + sizeof(RepeaterStats)) {      // got an GET_STATS reply from repeater
+    if (pending_cmd == CMD_GET_TELEMETRY && reply_len > 4) {
+      printTelemetry(&reply[4], reply_len - 4);
+    } else if (pending_cmd == CMD_ADMIN && reply_len > 4) {
+      Serial.println("Admin results:");
+      printAdminResults(&reply[4], reply_len - 4);
+    } else if (reply_len >= 4 + sizeof(RepeaterStats)) {      // got an GET_STATS reply from repeater
       RepeaterStats stats;
       memcpy(&stats, &reply[4], sizeof(stats));
       Serial.println("Repeater Stats:");
@@ -102,6 +227,23 @@ protected:
       Serial.printf("  num sent: %d\n", stats.n_packets_sent);
       Serial.printf("  air time (secs): %d\n", stats.total_air_time_secs);
       Serial.printf("  up time (secs): %d\n", stats.total_up_time_secs);
+
+      size_t i = 4 + sizeof(RepeaterStats);
+      if (reply_len > i) {   // neighbours appended
+        int count = reply[i++];
+        Serial.printf("  neighbours: %d\n", count);
+        while (count > 0 && i + sizeof(NeighborStats) <= reply_len) {
+          NeighborStats ns;
+          memcpy(&ns, &reply[i], sizeof(ns)); i += sizeof(ns);
+          count--;
+
+          char hex[MAX_PATH_HASH_SIZE*2 + 1];
+          mesh::Utils::toHex(hex, ns.hash, ns.hash_size <= MAX_PATH_HASH_SIZE ? ns.hash_size : MAX_PATH_HASH_SIZE);
+          Serial.printf("    %s: SNR=%.2f RSSI=%d loss=%d%% pkts=%d heard=%ds ago\n", hex,
+              ns.avg_snr_x4 / 4.0f, (int) ns.avg_rssi,
+              (int) ns.est_loss_pct, (int) ns.n_packets, (int) ns.last_heard_secs);
+        }
+      }
     } else if (reply_len > 4) {   // got an SET_* reply from repeater
       char tmp[MAX_PACKET_PAYLOAD];
       memcpy(tmp, &reply[4], reply_len - 4);
@@ -129,8 +271,7 @@ protected:
 
       if (packet->isRouteFlood()) {
         // let server know path TO here, so they can use sendDirect() for future ping responses
-        mesh::Packet* path = createPathReturn(server_id, secret, packet->path, packet->path_len, 0, NULL, 0);
-        if (path) sendFlood(path);
+        sendPathReturn(packet, server_id, secret, 0, NULL, 0);
       }
     }
   }
@@ -159,15 +300,43 @@ public:
     memcpy(payload, &now, 4);
     payload[4] = CMD_GET_STATS;
     memcpy(&payload[5], &max_age, 4);
+    pending_cmd = CMD_GET_STATS;
 
     return createDatagram(PAYLOAD_TYPE_REQ, server_id, server_secret, payload, sizeof(payload));
   }
 
+  mesh::Packet* createTelemetryRequest(uint32_t max_age, uint8_t page) {
+    uint8_t payload[11];
+    uint32_t now = getRTCClock()->getCurrentTime();
+    memcpy(payload, &now, 4);
+    payload[4] = CMD_GET_TELEMETRY;
+    memcpy(&payload[5], &max_age, 4);
+    payload[9] = page;
+    payload[10] = 8;   // max neighbours
+    pending_cmd = CMD_GET_TELEMETRY;
+
+    return createDatagram(PAYLOAD_TYPE_REQ, server_id, server_secret, payload, sizeof(payload));
+  }
+
+  // several commands, in one request (and one response)
+  mesh::Packet* createAdminRequest(const uint8_t* ops, int num_ops) {
+    uint8_t payload[5 + 1 + 2*8];
+    uint32_t now = getRTCClock()->getCurrentTime();
+    memcpy(payload, &now, 4);
+    payload[4] = CMD_ADMIN;
+    AdminBatchWriter batch(&payload[5], sizeof(payload) - 5);
+    for (int i = 0; i < num_ops; i++) batch.addCommand(ops[i]);
+    pending_cmd = CMD_ADMIN;
+
+    return createDatagram(PAYLOAD_TYPE_REQ, server_id, server_secret, payload, 5 + batch.getLength());
+  }
+
   mesh::Packet* createSetClockRequest(uint32_t timestamp) {
     uint8_t payload[9];
     uint32_t now = getRTCClock()->getCurrentTime();
     memcpy(payload, &now, 4);
     payload[4] = CMD_SET_CLOCK;
+    pending_cmd = CMD_SET_CLOCK;
     memcpy(&payload[5], &now, 4);  // repeated :-(
 
     return createDatagram(PAYLOAD_TYPE_REQ, server_id, server_secret, payload, sizeof(payload));
@@ -178,6 +347,7 @@ public:
     uint32_t now = getRTCClock()->getCurrentTime();
     memcpy(payload, &now, 4);
     payload[4] = CMD_SET_CONFIG;
+    pending_cmd = CMD_SET_CONFIG;
     sprintf((char *) &payload[5], "AF%f", airtime_factor);
 
     return createDatagram(PAYLOAD_TYPE_REQ, server_id, server_secret, payload, sizeof(payload));
@@ -188,6 +358,7 @@ public:
     uint32_t now = getRTCClock()->getCurrentTime();
     memcpy(payload, &now, 4);
     payload[4] = CMD_SEND_ANNOUNCE;
+    pending_cmd = CMD_SEND_ANNOUNCE;
 
     return createDatagram(PAYLOAD_TYPE_REQ, server_id, server_secret, payload, sizeof(payload));
   }
@@ -195,6 +366,14 @@ public:
   mesh::Packet* parseCommand(char* command) {
     if (strcmp(command, "stats") == 0) {
       return createStatsRequest(60*60);    // max_age = one hour
+    } else if (strcmp(command, "telemetry") == 0) {
+      return createTelemetryRequest(60*60, 0);
+    } else if (strcmp(command, "status") == 0) {
+      static const uint8_t ops[] = { ADMIN_OP_GET_VERSION, ADMIN_OP_GET_CLOCK, ADMIN_OP_GET_QUEUE };
+      return createAdminRequest(ops, sizeof(ops));
+    } else if (strcmp(command, "sync") == 0) {
+      static const uint8_t ops[] = { ADMIN_OP_SYNC_CLOCK };
+      return createAdminRequest(ops, sizeof(ops));
     } else if (memcmp(command, "setclock ", 9) == 0) {
       uint32_t timestamp = atol(&command[9]);
       return createSetClockRequest(timestamp);
@@ -270,6 +449,9 @@ void setup() {
   Serial.println("Help:");
   Serial.println("  enter 'key' to generate new keypair");
   Serial.println("  enter 'stats' to request repeater stats");
+  Serial.println("  enter 'status' to request version, clock and queue stats (one binary request)");
+  Serial.println("  enter 'sync' to sync repeater's clock to ours");
+  Serial.println("  enter 'telemetry' to request repeater telemetry (rates, queue delays, drops, neighbours)");
   Serial.println("  enter 'setclock {unix-epoch-seconds}' to set repeater's clock");
   Serial.println("  enter 'set AF={factor}' to set airtime budget factor");
   Serial.println("  enter 'ann' to make repeater re-announce to mesh");
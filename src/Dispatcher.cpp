@@ -1,6 +1,6 @@
 #include "Dispatcher.h"
 
-#if MESH_PACKET_LOGGING
+#if MESH_PACKET_LOGGING || MESH_POOL_TRACKING
   #include <Arduino.h>
 #endif
 
@@ -29,7 +29,13 @@ void Dispatcher::loop() {
       next_tx_time = futureMillis(t * getAirtimeBudgetFactor());
 
       _radio->onSendFinished();
+    #if MESH_POOL_TRACKING
+      Packet* sent = outbound;
       onPacketSent(outbound);
+      if (sent->pool_state == POOL_STATE_IN_FLIGHT) setPoolState(sent, POOL_STATE_HELD);   // sub-class kept it
+    #else
+      onPacketSent(outbound);
+    #endif
       if (outbound->isRouteFlood()) {
         n_sent_flood++;
       } else {
@@ -49,6 +55,13 @@ void Dispatcher::loop() {
 
   checkRecv();
   checkSend();
+
+#if MESH_POOL_TRACKING
+  if (millisHasNowPassed(next_pool_check)) {
+    checkPoolLeaks(POOL_MAX_HOLD_MILLIS);
+    next_pool_check = futureMillis(POOL_CHECK_INTERVAL_MILLIS);
+  }
+#endif
 }
 
 void Dispatcher::onPacketSent(Packet* packet) {
@@ -65,22 +78,36 @@ void Dispatcher::checkRecv() {
       if (pkt == NULL) {
         MESH_DEBUG_PRINTLN("Dispatcher::checkRecv(): WARNING: received data, no unused packets available!");
       } else {
+      #if MESH_POOL_TRACKING
+        pkt->alloc_site = "checkRecv";
+        setPoolState(pkt, POOL_STATE_RX);
+      #endif
         int i = 0;
 #ifdef NODE_ID
         uint8_t sender_id = raw[i++];
         if (sender_id == NODE_ID - 1 || sender_id == NODE_ID + 1) {  // simulate that NODE_ID can only hear NODE_ID-1 or NODE_ID+1, eg. 3 can't hear 1
         } else {
-          _mgr->free(pkt);  // put back into pool
+          releasePacket(pkt);  // put back into pool
           return;
         }
 #endif
 
         pkt->header = raw[i++];
-        pkt->path_len = raw[i++];
+        if (pkt->isRouteScoped()) {
+          pkt->max_hops = raw[i++];
+        }
+        bool valid;
+        if (pkt->getPayloadVer() == PAYLOAD_VER_2) {
+          valid = pkt->setPathDescriptor(raw[i++]);
+        } else {
+          pkt->path_hash_size = PATH_HASH_SIZE;
+          pkt->path_len = raw[i++];
+          valid = pkt->path_len <= MAX_PATH_SIZE;
+        }
 
-        if (pkt->path_len > MAX_PATH_SIZE || i + pkt->path_len > len) {
+        if (!valid || i + pkt->path_len > len) {
           MESH_DEBUG_PRINTLN("Dispatcher::checkRecv(): partial or corrupt packet received, len=%d", len);
-          _mgr->free(pkt);  // put back into pool
+          releasePacket(pkt);  // put back into pool
           pkt = NULL;
         } else {
           memcpy(pkt->path, &raw[i], pkt->path_len); i += pkt->path_len;
@@ -99,20 +126,31 @@ void Dispatcher::checkRecv() {
     } else {
       n_recv_direct++;
     }
+    if (pkt->isRouteFlood() && pkt->path_len >= pkt->path_hash_size) {
+      updateNeighbor(pkt, _radio->getLastSNR(), _radio->getLastRSSI());
+    }
     #if MESH_PACKET_LOGGING
       Serial.printf("PACKET: recv, len=%d (type=%d, route=%s, payload_len=%d) SNR=%d RSSI=%d\n", 
             2 + pkt->path_len + pkt->payload_len, pkt->getPayloadType(), pkt->isRouteDirect() ? "D" : "F", pkt->payload_len,
             (int)_radio->getLastSNR(), (int)_radio->getLastRSSI());
     #endif
+    if (_observer) _observer->onRecvStart(pkt);
     DispatcherAction action = onRecvPacket(pkt);
+    if (_observer) _observer->onRecvDone(pkt, action);
     if (action == ACTION_RELEASE) {
-      _mgr->free(pkt);
+      releasePacket(pkt);
     } else if (action == ACTION_MANUAL_HOLD) {
       // sub-class is wanting to manually hold Packet instance, and call releasePacket() at appropriate time
+    #if MESH_POOL_TRACKING
+      setPoolState(pkt, POOL_STATE_HELD);
+    #endif
     } else {   // ACTION_RETRANSMIT*
       uint8_t priority = (action >> 24) - 1;
       uint32_t _delay = action & 0xFFFFFF;
 
+    #if MESH_POOL_TRACKING
+      setPoolState(pkt, POOL_STATE_QUEUED);
+    #endif
       _mgr->queueOutbound(pkt, priority, futureMillis(_delay));
     }
   }
@@ -125,6 +163,9 @@ void Dispatcher::checkSend() {
 
   outbound = _mgr->getNextOutbound(_ms->getMillis());
   if (outbound) {
+  #if MESH_POOL_TRACKING
+    setPoolState(outbound, POOL_STATE_IN_FLIGHT);
+  #endif
     int len = 0;
     uint8_t raw[MAX_TRANS_UNIT];
 
@@ -132,12 +173,19 @@ void Dispatcher::checkSend() {
     raw[len++] = NODE_ID;
 #endif
     raw[len++] = outbound->header;
-    raw[len++] = outbound->path_len;
+    if (outbound->isRouteScoped()) {
+      raw[len++] = outbound->max_hops;
+    }
+    if (outbound->getPayloadVer() == PAYLOAD_VER_2) {
+      raw[len++] = outbound->getPathDescriptor();
+    } else {
+      raw[len++] = outbound->path_len;
+    }
     memcpy(&raw[len], outbound->path, outbound->path_len); len += outbound->path_len;
 
     if (len + outbound->payload_len > MAX_TRANS_UNIT) {
       MESH_DEBUG_PRINTLN("Dispatcher::checkSend(): FATAL: Invalid packet queued... too long, len=%d", len + outbound->payload_len);
-      _mgr->free(outbound);
+      releasePacket(outbound);
       outbound = NULL;
     } else {
       memcpy(&raw[len], outbound->payload, outbound->payload_len); len += outbound->payload_len;
@@ -146,6 +194,7 @@ void Dispatcher::checkSend() {
       outbound_start = _ms->getMillis();
       _radio->startSendRaw(raw, len);
       outbound_expiry = futureMillis(max_airtime);
+      if (_observer) _observer->onSendStart(outbound, len);
 
     #if MESH_PACKET_LOGGING
       Serial.printf("PACKET: send, len=%d (type=%d, route=%s, payload_len=%d)\n", 
@@ -155,26 +204,229 @@ void Dispatcher::checkSend() {
   }
 }
 
+uint8_t NeighborInfo::getEstLossPercent() const {
+  int margin_x4 = getAvgSnrX4() - getSnrDevX4() - NEIGHBOR_SNR_FLOOR*4;
+  if (margin_x4 <= 0) return 100;
+  if (margin_x4 >= NEIGHBOR_SNR_GOOD_MARGIN*4) return 0;
+  return 100 - (margin_x4 * 100) / (NEIGHBOR_SNR_GOOD_MARGIN*4);
+}
+
+void NeighborInfo::initSample(int16_t snr_x4, int16_t rssi) {
+  avg_snr_scaled = snr_x4 << NEIGHBOR_EWMA_SHIFT;
+  snr_dev_scaled = 0;
+  avg_rssi_scaled = rssi << NEIGHBOR_EWMA_SHIFT;
+}
+
+void NeighborInfo::addSample(int16_t snr_x4, int16_t rssi) {
+  // avg_scaled = avg_scaled*(1 - 1/2^SHIFT) + sample, ie. avg_scaled/2^SHIFT converges on sample
+  int dev = snr_x4 - getAvgSnrX4();
+  avg_snr_scaled += snr_x4 - unscale(avg_snr_scaled);
+  snr_dev_scaled += (dev < 0 ? -dev : dev) - unscale(snr_dev_scaled);
+  avg_rssi_scaled += rssi - unscale(avg_rssi_scaled);
+}
+
+static bool isNeighborMatch(const NeighborInfo& n, const uint8_t* hash, uint8_t hash_size) {
+  return memcmp(n.hash, hash, n.hash_size < hash_size ? n.hash_size : hash_size) == 0;
+}
+
+const NeighborInfo* Dispatcher::findNeighbor(const uint8_t* hash, uint8_t hash_size) const {
+  for (int i = 0; i < num_neighbors; i++) {
+    if (isNeighborMatch(neighbors[i], hash, hash_size)) return &neighbors[i];
+  }
+  return NULL;
+}
+
+void Dispatcher::updateNeighbor(const Packet* pkt, float snr, float rssi) {
+  const uint8_t* prev_hop = &pkt->path[pkt->path_len - pkt->path_hash_size];   // last hash appended, ie. who we just heard
+  int16_t snr_x4 = (int16_t) (snr * 4);
+
+  NeighborInfo* n = NULL;
+  for (int i = 0; i < num_neighbors; i++) {
+    if (isNeighborMatch(neighbors[i], prev_hop, pkt->path_hash_size)) { n = &neighbors[i]; break; }
+  }
+  if (n == NULL) {
+    if (num_neighbors < MAX_NEIGHBORS) {
+      n = &neighbors[num_neighbors++];
+    } else {   // table is full, evict least recently heard
+      n = &neighbors[0];
+      for (int i = 1; i < num_neighbors; i++) {
+        if ((long)(neighbors[i].last_heard - n->last_heard) < 0) n = &neighbors[i];
+      }
+    }
+    memset(n, 0, sizeof(*n));
+    n->initSample(snr_x4, (int16_t) rssi);
+  } else {
+    n->addSample(snr_x4, (int16_t) rssi);
+  }
+  if (pkt->path_hash_size > n->hash_size) {   // keep the longest hash seen
+    memcpy(n->hash, prev_hop, pkt->path_hash_size);
+    n->hash_size = pkt->path_hash_size;
+  }
+  n->n_packets++;
+  n->last_heard = _ms->getMillis();
+}
+
+#if MESH_POOL_TRACKING
+Packet* Dispatcher::obtainNewPacket(const char* alloc_site) {
+#else
 Packet* Dispatcher::obtainNewPacket() {
+#endif
   auto pkt = _mgr->allocNew();  // TODO: zero out all fields
-  if (pkt == NULL) n_full_events++;
+  if (pkt == NULL) {
+    n_full_events++;
+  #if MESH_POOL_TRACKING
+    Serial.printf("POOL: %s() failed to obtain packet, pool exhausted\n", alloc_site);
+    dumpPoolCensus();
+  #endif
+  } else {
+  #if MESH_POOL_TRACKING
+    pkt->alloc_site = alloc_site;
+    setPoolState(pkt, POOL_STATE_ALLOCATED);
+  #endif
+  }
 
   return pkt;
 }
 
 void Dispatcher::releasePacket(Packet* packet) {
+#if MESH_POOL_TRACKING
+  if (packet->pool_state == POOL_STATE_FREE) {
+    Serial.printf("POOL: ERROR: double release of packet from %s()\n", packet->alloc_site ? packet->alloc_site : "?");
+    return;
+  }
+  setPoolState(packet, POOL_STATE_FREE);
+#endif
   _mgr->free(packet);
 }
 
 void Dispatcher::sendPacket(Packet* packet, uint8_t priority, uint32_t delay_millis) {
   if (packet->path_len > MAX_PATH_SIZE || packet->payload_len > MAX_PACKET_PAYLOAD) {
     MESH_DEBUG_PRINTLN("Dispatcher::sendPacket(): ERROR: invalid packet... path_len=%d, payload_len=%d", (uint32_t) packet->path_len, (uint32_t) packet->payload_len);
-    _mgr->free(packet);
+    releasePacket(packet);
   } else {
+  #if MESH_POOL_TRACKING
+    setPoolState(packet, POOL_STATE_QUEUED);
+  #endif
     _mgr->queueOutbound(packet, priority, futureMillis(delay_millis));
   }
 }
 
+#if MESH_POOL_TRACKING
+static const char* pool_state_names[] = { "free", "alloc", "rx", "queued", "in-flight", "held" };
+
+void Dispatcher::setPoolState(Packet* packet, uint8_t state) {
+  packet->pool_state = state;
+  packet->state_since = _ms->getMillis();
+}
+
+int Dispatcher::getPoolCensus(int counts[]) {
+  memset(counts, 0, sizeof(int)*NUM_POOL_STATES);
+  int n = _mgr->getPoolSize();
+  for (int i = 0; i < n; i++) {
+    Packet* p = _mgr->getPoolPacketAt(i);
+    if (p && p->pool_state < NUM_POOL_STATES) counts[p->pool_state]++;
+  }
+  return n;
+}
+
+int Dispatcher::checkPoolLeaks(uint32_t max_millis) {
+  int num_leaks = 0;
+  unsigned long now = _ms->getMillis();
+  int n = _mgr->getPoolSize();
+  for (int i = 0; i < n; i++) {
+    Packet* p = _mgr->getPoolPacketAt(i);
+    if (p == NULL || p->pool_state == POOL_STATE_FREE || p->pool_state == POOL_STATE_QUEUED) continue;   // queue has its own ageing (AQM)
+    if (now - p->state_since > max_millis) {
+      Serial.printf("POOL: possible leak, packet %d %s for %lu ms (from %s(), type=%d)\n", i, pool_state_names[p->pool_state],
+            now - p->state_since, p->alloc_site ? p->alloc_site : "?", (int) p->getPayloadType());
+      num_leaks++;
+    }
+  }
+  return num_leaks;
+}
+
+void Dispatcher::dumpPoolCensus() {
+  int counts[NUM_POOL_STATES];
+  int n = getPoolCensus(counts);
+  Serial.printf("POOL: census, size=%d", n);
+  for (int s = 0; s < NUM_POOL_STATES; s++) {
+    Serial.printf(" %s=%d", pool_state_names[s], counts[s]);
+  }
+  Serial.printf("\n");
+
+  unsigned long now = _ms->getMillis();
+  for (int i = 0; i < n; i++) {
+    Packet* p = _mgr->getPoolPacketAt(i);
+    if (p == NULL || p->pool_state == POOL_STATE_FREE) continue;
+    Serial.printf("  #%d %s for %lu ms, from %s(), type=%d\n", i, pool_state_names[p->pool_state],
+          now - p->state_since, p->alloc_site ? p->alloc_site : "?", (int) p->getPayloadType());
+  }
+}
+#endif
+
+bool Dispatcher::isReadyToSend() const {
+  return outbound == NULL && _mgr->getOutboundCount() == 0 && millisHasNowPassed(next_tx_time);
+}
+
+bool Dispatcher::hasSendCapacity(int max_queued) const {
+  return _mgr->getOutboundCount() < max_queued && millisHasNowPassed(next_tx_time);
+}
+
+uint32_t Dispatcher::getMillisUntilNextDue() const {
+  if (outbound) return 0;   // mid-transmit
+
+  int n = _mgr->getOutboundCount();
+  if (n == 0) return DISPATCHER_NEVER_DUE;
+
+  unsigned long now = _ms->getMillis();
+  long next_due = 0x7FFFFFFF;
+  for (int i = 0; i < n; i++) {
+    uint8_t pri;
+    uint32_t scheduled_for;
+    if (!_mgr->getOutboundInfo(i, pri, scheduled_for)) return 0;  // don't know, so assume due now
+
+    long due = (long)(scheduled_for - now);
+    if (due < next_due) next_due = due;
+  }
+  long budget = (long)(next_tx_time - now);   // can't transmit before this anyway
+  if (budget > next_due) next_due = budget;
+
+  return next_due > 0 ? next_due : 0;
+}
+
+void Dispatcher::saveState(DispatcherState& dest) const {
+  dest.total_air_time = total_air_time;
+  dest.n_sent_flood = n_sent_flood;
+  dest.n_sent_direct = n_sent_direct;
+  dest.n_recv_flood = n_recv_flood;
+  dest.n_recv_direct = n_recv_direct;
+  dest.n_full_events = n_full_events;
+  unsigned long now = _ms->getMillis();
+  long wait = (long)(next_tx_time - now);
+  dest.tx_wait_millis = wait > 0 ? wait : 0;
+  dest.num_neighbors = num_neighbors;
+  for (int i = 0; i < num_neighbors; i++) {
+    dest.neighbors[i] = neighbors[i];
+    dest.neighbors[i].last_heard = now - neighbors[i].last_heard;
+  }
+}
+
+void Dispatcher::restoreState(const DispatcherState& src) {
+  total_air_time = src.total_air_time;
+  n_sent_flood = src.n_sent_flood;
+  n_sent_direct = src.n_sent_direct;
+  n_recv_flood = src.n_recv_flood;
+  n_recv_direct = src.n_recv_direct;
+  n_full_events = src.n_full_events;
+  next_tx_time = futureMillis(src.tx_wait_millis);
+  unsigned long now = _ms->getMillis();
+  num_neighbors = src.num_neighbors < 0 || src.num_neighbors > MAX_NEIGHBORS ? 0 : src.num_neighbors;
+  for (int i = 0; i < num_neighbors; i++) {
+    neighbors[i] = src.neighbors[i];
+    neighbors[i].last_heard = now - src.neighbors[i].last_heard;
+  }
+}
+
 // Utility function -- handles the case where millis() wraps around back to zero
 //   2's complement arithmetic will handle any unsigned subtraction up to HALF the word size (32-bits in this case)
 bool Dispatcher::millisHasNowPassed(unsigned long timestamp) const {
@@ -77,8 +77,84 @@ public:
   virtual int getFreeCount() const = 0;
   virtual Packet* getOutboundByIdx(int i) = 0;
   virtual Packet* removeOutboundByIdx(int i) = 0;
+
+  /**
+   * \brief  get the priority and scheduled send time (millis) of the i'th queued packet
+   * \returns  false if not supported
+   */
+  virtual bool getOutboundInfo(int i, uint8_t& priority, uint32_t& scheduled_for) const { return false; }
+
+#if MESH_POOL_TRACKING
+  /**
+   * \returns  total num packets managed (free or not), and access to each of them, for the pool census
+   */
+  virtual int getPoolSize() const { return 0; }
+  virtual Packet* getPoolPacketAt(int i) { return NULL; }
+#endif
 };
 
+#ifndef MAX_NEIGHBORS
+  #define MAX_NEIGHBORS      16
+#endif
+
+#ifndef NEIGHBOR_SNR_FLOOR
+  #define NEIGHBOR_SNR_FLOOR   -15    // demodulation floor in dB (SF7: -7.5, SF8: -10, SF9: -12.5, SF10: -15, SF11: -17.5, SF12: -20)
+#endif
+#define NEIGHBOR_SNR_GOOD_MARGIN  10   // dB above floor where loss is considered negligible
+#define NEIGHBOR_EWMA_SHIFT        3   // EWMA weight of new samples = 1/8
+
+/**
+ * \brief  Link quality of a directly heard neighbour, ie. the previous hop of received flood packets.
+*/
+struct NeighborInfo {
+  uint8_t hash[MAX_PATH_HASH_SIZE];
+  uint8_t hash_size;       // num valid bytes in 'hash'
+  // NOTE: the EWMAs are kept scaled up by 2^NEIGHBOR_EWMA_SHIFT, so that small deviations aren't truncated away
+  int16_t avg_snr_scaled;  // EWMA of SNR, in 1/4 dB units (scaled)
+  int16_t snr_dev_scaled;  // EWMA of absolute deviation from avg SNR, in 1/4 dB units (scaled)
+  int16_t avg_rssi_scaled; // EWMA of RSSI, in dBm (scaled)
+  uint32_t n_packets;
+  unsigned long last_heard;   // millis
+
+  void initSample(int16_t snr_x4, int16_t rssi);
+  void addSample(int16_t snr_x4, int16_t rssi);
+
+  int16_t getAvgSnrX4() const { return unscale(avg_snr_scaled); }
+  int16_t getSnrDevX4() const { return unscale(snr_dev_scaled); }
+  int16_t getAvgRssi() const { return unscale(avg_rssi_scaled); }
+
+  static int16_t unscale(int16_t v) { return (v + (1 << (NEIGHBOR_EWMA_SHIFT - 1))) >> NEIGHBOR_EWMA_SHIFT; }   // rounded
+
+  /**
+   * \returns  estimated packet loss (0..100 percent), from the SNR margin above NEIGHBOR_SNR_FLOOR (less the deviation).
+   */
+  uint8_t getEstLossPercent() const;
+};
+
+#if MESH_POOL_TRACKING
+  #ifndef POOL_MAX_HOLD_MILLIS
+    #define POOL_MAX_HOLD_MILLIS     30000   // report packets not FREE/QUEUED for longer than this
+  #endif
+  #ifndef POOL_CHECK_INTERVAL_MILLIS
+    #define POOL_CHECK_INTERVAL_MILLIS  60000
+  #endif
+#endif
+
+/**
+ * \brief  running totals, airtime budget and neighbour table of a Dispatcher. eg. so they can be carried across a deep sleep.
+*/
+struct DispatcherState {
+  uint32_t total_air_time;   // millis
+  uint32_t n_sent_flood, n_sent_direct;
+  uint32_t n_recv_flood, n_recv_direct;
+  uint32_t n_full_events;
+  uint32_t tx_wait_millis;   // remaining wait imposed by airtime budget
+  int num_neighbors;
+  NeighborInfo neighbors[MAX_NEIGHBORS];   // NOTE: here, last_heard is millis ago (when saved), not a millis timestamp
+};
+
+#define DISPATCHER_NEVER_DUE   0xFFFFFFFF
+
 typedef uint32_t  DispatcherAction;
 
 #define ACTION_RELEASE           (0)
@@ -86,6 +162,27 @@ typedef uint32_t  DispatcherAction;
 #define ACTION_RETRANSMIT(pri)   (((uint32_t)1 + (pri))<<24)
 #define ACTION_RETRANSMIT_DELAYED(pri, _delay)  ((((uint32_t)1 + (pri))<<24) | (_delay))
 
+/**
+ * \brief  Optional observer of Dispatcher activity (eg. for tracing, or replay reports)
+*/
+class PacketObserver {
+public:
+  /**
+   * \brief  called before a received packet is processed
+   */
+  virtual void onRecvStart(const Packet* packet) { }
+
+  /**
+   * \brief  called with the action decided for a received packet (before it is released or queued)
+   */
+  virtual void onRecvDone(const Packet* packet, DispatcherAction action) { }
+
+  /**
+   * \brief  called when transmit of a (queued) packet starts
+   */
+  virtual void onSendStart(const Packet* packet, int raw_len) { }
+};
+
 /**
  * \brief  The low-level task that manages detecting incoming Packets, and the queueing
  *      and scheduling of outbound Packets.
@@ -97,6 +194,15 @@ class Dispatcher {
   uint32_t n_sent_flood, n_sent_direct;
   uint32_t n_recv_flood, n_recv_direct;
   uint32_t n_full_events;
+  PacketObserver* _observer;
+  NeighborInfo neighbors[MAX_NEIGHBORS];
+  int num_neighbors;
+
+  void updateNeighbor(const Packet* pkt, float snr, float rssi);
+#if MESH_POOL_TRACKING
+  unsigned long next_pool_check;
+  void setPoolState(Packet* packet, uint8_t state);
+#endif
 
 protected:
   PacketManager* _mgr;
@@ -107,6 +213,11 @@ protected:
     : _radio(&radio), _ms(&ms), _mgr(&mgr)
   {
     outbound = NULL; total_air_time = 0; next_tx_time = 0;
+    num_neighbors = 0;
+    _observer = NULL;
+  #if MESH_POOL_TRACKING
+    next_pool_check = 0;
+  #endif
   }
 
   virtual DispatcherAction onRecvPacket(Packet* pkt) = 0;
@@ -117,10 +228,40 @@ public:
   void begin();
   void loop();
 
+  void setPacketObserver(PacketObserver* observer) { _observer = observer; }
+
+#if MESH_POOL_TRACKING
+  Packet* obtainNewPacket(const char* alloc_site = __builtin_FUNCTION());   // records the caller
+#else
   Packet* obtainNewPacket();
+#endif
   void releasePacket(Packet* packet);
   void sendPacket(Packet* packet, uint8_t priority, uint32_t delay_millis=0);
 
+  /**
+   * \returns  true if nothing is queued or being transmitted, and the airtime budget allows transmitting now.
+   *         (for pacing locally generated traffic)
+   */
+  bool isReadyToSend() const;
+
+  /**
+   * \returns  true if fewer than 'max_queued' packets are waiting to send, and the airtime budget allows transmitting now.
+   *         (for pacing bulk, locally generated traffic, while still letting other traffic in)
+   */
+  bool hasSendCapacity(int max_queued) const;
+
+  /**
+   * \returns  millis until the next queued packet is due to send (allowing for the airtime budget), zero if one is due
+   *         now or being transmitted, or DISPATCHER_NEVER_DUE if queue is empty.  (eg. to know how long the MCU could sleep)
+   */
+  uint32_t getMillisUntilNextDue() const;
+
+  /**
+   * \brief  save/restore the counters, airtime budget and neighbours.  NOTE: restore must be after begin()
+   */
+  void saveState(DispatcherState& dest) const;
+  void restoreState(const DispatcherState& src);
+
   unsigned long getTotalAirTime() const { return total_air_time; }  // in milliseconds
   uint32_t getNumSentFlood() const { return n_sent_flood; }
   uint32_t getNumSentDirect() const { return n_sent_direct; }
@@ -128,6 +269,35 @@ public:
   uint32_t getNumRecvDirect() const { return n_recv_direct; }
   uint32_t getNumFullEvents() const { return n_full_events; }
 
+  int getNumNeighbors() const { return num_neighbors; }
+  const NeighborInfo* getNeighbor(int idx) const { return idx >= 0 && idx < num_neighbors ? &neighbors[idx] : NULL; }
+
+  /**
+   * \brief  lookup neighbour by (prefix of) its hash.
+   * \returns  NULL if not found
+   */
+  const NeighborInfo* findNeighbor(const uint8_t* hash, uint8_t hash_size) const;
+
+#if MESH_POOL_TRACKING
+  /**
+   * \brief  count the pool's packets in each state.
+   * \param  counts  OUT - indexed by POOL_STATE_*, must be NUM_POOL_STATES long
+   * \returns  total num packets in pool
+   */
+  int getPoolCensus(int counts[]);
+
+  /**
+   * \brief  report (via Serial) all packets that have been allocated, received, in flight or held for longer than 'max_millis'
+   * \returns  num of such (likely leaked) packets
+   */
+  int checkPoolLeaks(uint32_t max_millis);
+
+  /**
+   * \brief  print (via Serial) the pool census, and every packet which is not FREE
+   */
+  void dumpPoolCensus();
+#endif
+
   // helper methods
   bool millisHasNowPassed(unsigned long timestamp) const;
   unsigned long futureMillis(int millis_from_now) const;
@@ -16,12 +16,12 @@ public:
   Identity(const char* pub_hex);
   Identity(const uint8_t* _pub) { memcpy(pub_key, _pub, PUB_KEY_SIZE); }
 
-  int copyHashTo(uint8_t* dest) const { 
-    memcpy(dest, pub_key, PATH_HASH_SIZE);    // hash is just prefix of pub_key
-    return PATH_HASH_SIZE;
+  int copyHashTo(uint8_t* dest, uint8_t hash_size=PATH_HASH_SIZE) const { 
+    memcpy(dest, pub_key, hash_size);    // hash is just prefix of pub_key
+    return hash_size;
   }
-  bool isHashMatch(const uint8_t* hash) const {
-    return memcmp(hash, pub_key, PATH_HASH_SIZE) == 0;
+  bool isHashMatch(const uint8_t* hash, uint8_t hash_size=PATH_HASH_SIZE) const {
+    return memcmp(hash, pub_key, hash_size) == 0;
   }
 
   /**
@@ -9,38 +9,104 @@ void Mesh::begin() {
 
 void Mesh::loop() {
   Dispatcher::loop();
+
+  if (num_path_returns > 0) checkPathReturns();
 }
 
 bool Mesh::allowPacketForward(const mesh::Packet* packet) { 
   return false;  // by default, Transport NOT enabled
 }
+uint8_t Mesh::getMaxFloodHops(uint8_t payload_type) const {
+  return MAX_FLOOD_HOPS;  // by default, no limit (apart from max path size)
+}
 uint32_t Mesh::getRetransmitDelay(const mesh::Packet* packet) { 
   uint32_t t = (_radio->getEstAirtimeFor(packet->path_len + packet->payload_len + 2) * 52 / 50) / 2;
 
   return _rng->nextInt(0, 5)*t;
 }
 
+int Mesh::scoreReturnPath(const Packet* packet) {
+  int margin_x4;
+  const NeighborInfo* prev_hop = NULL;
+  if (packet->path_len >= packet->path_hash_size) {
+    prev_hop = findNeighbor(&packet->path[packet->path_len - packet->path_hash_size], packet->path_hash_size);
+  }
+  if (prev_hop) {
+    margin_x4 = prev_hop->getAvgSnrX4() - prev_hop->getSnrDevX4() - NEIGHBOR_SNR_FLOOR*4;
+  } else {
+    margin_x4 = (int) (_radio->getLastSNR() * 4) - NEIGHBOR_SNR_FLOOR*4;
+  }
+  if (margin_x4 < 0) margin_x4 = 0;
+  if (margin_x4 > NEIGHBOR_SNR_GOOD_MARGIN*4) margin_x4 = NEIGHBOR_SNR_GOOD_MARGIN*4;
+
+  return packet->getHopCount()*PATH_SCORE_HOP_COST_X4 + (NEIGHBOR_SNR_GOOD_MARGIN*4 - margin_x4);
+}
+
 int Mesh::searchPeersByHash(const uint8_t* hash) {
   return 0;  // not found
 }
 
-int Mesh::searchChannelsByHash(const uint8_t* hash, GroupChannel channels[], int max_matches) {
+int Mesh::searchChannelsByHash(const uint8_t* hash) {
   return 0;  // not found
 }
 
+int Mesh::decryptChannelData(const Packet* packet, int match_idx, uint8_t* dest) {
+  const GroupChannel* channel = getMatchingChannel(match_idx);
+  if (channel == NULL) return 0;
+
+  return decryptPayload(packet, PATH_HASH_SIZE, channel->secret, dest);
+}
+
+bool Mesh::isDuplicate(const Packet* packet) {
+  if (_tables->hasSeen(packet)) {
+    n_dupes++;
+    return true;
+  }
+  return false;
+}
+
+bool Mesh::verifyAdvert(const Identity& id, uint32_t timestamp, const uint8_t* signature, const uint8_t* app_data, int app_data_len) const {
+  uint8_t message[PUB_KEY_SIZE + 4 + MAX_ADVERT_DATA_SIZE];
+  int msg_len = 0;
+  memcpy(&message[msg_len], id.pub_key, PUB_KEY_SIZE); msg_len += PUB_KEY_SIZE;
+  memcpy(&message[msg_len], &timestamp, 4); msg_len += 4;
+  memcpy(&message[msg_len], app_data, app_data_len); msg_len += app_data_len;
+
+  return id.verify(signature, message, msg_len);
+}
+
+void Mesh::rememberAdvertKey(const Identity& id) {
+  for (int i = 0; i < num_advert_keys; i++) {
+    if (memcmp(advert_keys[i], id.pub_key, PUB_KEY_SIZE) == 0) return;   // already known
+  }
+  memcpy(advert_keys[next_advert_key], id.pub_key, PUB_KEY_SIZE);   // when full, overwrite the oldest
+  next_advert_key = (next_advert_key + 1) % ADVERT_KEY_CACHE_SIZE;
+  if (num_advert_keys < ADVERT_KEY_CACHE_SIZE) num_advert_keys++;
+}
+
+bool Mesh::findAdvertKey(const uint8_t* prefix, uint8_t prefix_len, Identity& id) const {
+  for (int i = 0; i < num_advert_keys; i++) {
+    if (memcmp(advert_keys[i], prefix, prefix_len) == 0) {
+      memcpy(id.pub_key, advert_keys[i], PUB_KEY_SIZE);
+      return true;
+    }
+  }
+  return false;
+}
+
 DispatcherAction Mesh::onRecvPacket(Packet* pkt) {
-  if (pkt->getPayloadVer() > PAYLOAD_VER_1) {  // not supported in this firmware version
+  if (pkt->getPayloadVer() > PAYLOAD_VER_2) {  // not supported in this firmware version
     MESH_DEBUG_PRINTLN("Mesh::onRecvPacket(): unsupported packet version");
     return ACTION_RELEASE;
   }
 
-  if (pkt->isRouteDirect() && pkt->path_len >= PATH_HASH_SIZE) {
-    if (self_id.isHashMatch(pkt->path) && allowPacketForward(pkt)) {
-      if (_tables->hasSeen(pkt)) return ACTION_RELEASE;  // don't retransmit!
+  if (pkt->isRouteDirect() && pkt->path_len >= pkt->path_hash_size) {
+    if (self_id.isHashMatch(pkt->path, pkt->path_hash_size) && allowPacketForward(pkt)) {
+      if (isDuplicate(pkt)) return ACTION_RELEASE;  // don't retransmit!
 
       // remove our hash from 'path', then re-broadcast
-      pkt->path_len -= PATH_HASH_SIZE;
-      memcpy(pkt->path, &pkt->path[PATH_HASH_SIZE], pkt->path_len);
+      pkt->path_len -= pkt->path_hash_size;
+      memmove(pkt->path, &pkt->path[pkt->path_hash_size], pkt->path_len);
       return ACTION_RETRANSMIT(0);   // Routed traffic is HIGHEST priority (and NO per-hop delay)
     }
     return ACTION_RELEASE;   // this node is NOT the next hop (OR this packet has already been forwarded), so discard.
@@ -55,7 +121,7 @@ DispatcherAction Mesh::onRecvPacket(Packet* pkt) {
       memcpy(&ack_crc, &pkt->payload[i], 4); i += 4;
       if (i > pkt->payload_len) {
         MESH_DEBUG_PRINTLN("Mesh::onRecvPacket(): incomplete ACK packet");
-      } else if (!_tables->hasSeen(pkt)) {
+      } else if (!isDuplicate(pkt)) {
         onAckRecv(pkt, ack_crc);
         action = routeRecvPacket(pkt);
       }
@@ -64,18 +130,18 @@ DispatcherAction Mesh::onRecvPacket(Packet* pkt) {
     case PAYLOAD_TYPE_PATH:
     case PAYLOAD_TYPE_REQ:
     case PAYLOAD_TYPE_RESPONSE:
-    case PAYLOAD_TYPE_TXT_MSG: {
+    case PAYLOAD_TYPE_TXT_MSG:
+    case PAYLOAD_TYPE_MULTIPART: {
       int i = 0;
       uint8_t dest_hash = pkt->payload[i++];
       uint8_t src_hash = pkt->payload[i++];
 
-      uint8_t* macAndData = &pkt->payload[i];   // MAC + encrypted data 
+      // remainder is MAC + encrypted data
       if (i + 2 >= pkt->payload_len) {
         MESH_DEBUG_PRINTLN("Mesh::onRecvPacket(): incomplete data packet");
-      } else if (!_tables->hasSeen(pkt)) {
-        // NOTE: this is a 'first packet wins' impl. When receiving from multiple paths, the first to arrive wins.
+      } else if (!isDuplicate(pkt)) {
+        // NOTE: unless a path return window is set (see sendPathReturn()), the first packet to arrive wins.
         //       For flood mode, the path may not be the 'best' in terms of hops.
-        // FUTURE: could send back multiple paths, using createPathReturn(), and let sender choose which to use(?)
 
         if (self_id.isHashMatch(&dest_hash)) {
           // scan contacts DB, for all matching hashes of 'src_hash' (max 4 matches supported ATM)
@@ -88,7 +154,7 @@ DispatcherAction Mesh::onRecvPacket(Packet* pkt) {
 
             // decrypt, checking MAC is valid
             uint8_t data[MAX_PACKET_PAYLOAD];
-            int len = Utils::MACThenDecrypt(secret, data, macAndData, pkt->payload_len - i);
+            int len = decryptPayload(pkt, i, secret, data);
             if (len > 0) {  // success!
               if (pkt->getPayloadType() == PAYLOAD_TYPE_PATH) {
                 int k = 0;
@@ -114,10 +180,13 @@ DispatcherAction Mesh::onRecvPacket(Packet* pkt) {
           if (found) {
             pkt->markDoNotRetransmit();  // packet was for this node, so don't retransmit
           } else {
+            if (num > 0) n_decrypt_failed++;
             MESH_DEBUG_PRINTLN("recv matches no peers, src_hash=%02X", (uint32_t)src_hash);
           }
         }
         action = routeRecvPacket(pkt);
+      } else if (num_path_returns > 0 && pkt->isRouteFlood() && self_id.isHashMatch(&dest_hash)) {
+        offerReturnPath(pkt);   // a later copy, via a different route
       }
       break;
     }
@@ -126,10 +195,10 @@ DispatcherAction Mesh::onRecvPacket(Packet* pkt) {
       uint8_t dest_hash = pkt->payload[i++];
       uint8_t* sender_pub_key = &pkt->payload[i]; i += PUB_KEY_SIZE;
 
-      uint8_t* macAndData = &pkt->payload[i];   // MAC + encrypted data 
+      // remainder is MAC + encrypted data
       if (i + 2 >= pkt->payload_len) {
         MESH_DEBUG_PRINTLN("Mesh::onRecvPacket(): incomplete data packet");
-      } else if (!_tables->hasSeen(pkt)) {
+      } else if (!isDuplicate(pkt)) {
         if (self_id.isHashMatch(&dest_hash)) {
           Identity sender(sender_pub_key);
 
@@ -138,13 +207,17 @@ DispatcherAction Mesh::onRecvPacket(Packet* pkt) {
 
           // decrypt, checking MAC is valid
           uint8_t data[MAX_PACKET_PAYLOAD];
-          int len = Utils::MACThenDecrypt(secret, data, macAndData, pkt->payload_len - i);
+          int len = decryptPayload(pkt, i, secret, data);
           if (len > 0) {  // success!
             onAnonDataRecv(pkt, pkt->getPayloadType(), sender, data, len);
             pkt->markDoNotRetransmit();
+          } else {
+            n_decrypt_failed++;
           }
         }
         action = routeRecvPacket(pkt);
+      } else if (num_path_returns > 0 && pkt->isRouteFlood() && self_id.isHashMatch(&dest_hash)) {
+        offerReturnPath(pkt);   // a later copy, via a different route
       }
       break;
     }
@@ -153,20 +226,19 @@ DispatcherAction Mesh::onRecvPacket(Packet* pkt) {
       int i = 0;
       uint8_t channel_hash = pkt->payload[i++];
 
-      uint8_t* macAndData = &pkt->payload[i];   // MAC + encrypted data 
+      // remainder is MAC + encrypted data
       if (i + 2 >= pkt->payload_len) {
         MESH_DEBUG_PRINTLN("Mesh::onRecvPacket(): incomplete data packet");
-      } else if (!_tables->hasSeen(pkt)) {
-        // scan channels DB, for all matching hashes of 'channel_hash' (max 2 matches supported ATM)
-        GroupChannel channels[2];
-        int num = searchChannelsByHash(&channel_hash, channels, 2);
+      } else if (!isDuplicate(pkt)) {
+        // scan channels DB, for all matching hashes of 'channel_hash'
+        int num = searchChannelsByHash(&channel_hash);
         // for each matching channel, try to decrypt data
         for (int j = 0; j < num; j++) {
           // decrypt, checking MAC is valid
           uint8_t data[MAX_PACKET_PAYLOAD];
-          int len = Utils::MACThenDecrypt(channels[j].secret, data, macAndData, pkt->payload_len - i);
+          int len = decryptChannelData(pkt, j, data);
           if (len > 0) {  // success!
-            onGroupDataRecv(pkt, pkt->getPayloadType(), channels[j], data, len);
+            onGroupDataRecv(pkt, pkt->getPayloadType(), *getMatchingChannel(j), data, len);
             break;
           }
         }
@@ -176,8 +248,15 @@ DispatcherAction Mesh::onRecvPacket(Packet* pkt) {
     }
     case PAYLOAD_TYPE_ADVERT: {
       int i = 0;
-      Identity id;
-      memcpy(id.pub_key, &pkt->payload[i], PUB_KEY_SIZE); i += PUB_KEY_SIZE;
+      uint8_t key_len = PUB_KEY_SIZE;
+      if (pkt->getPayloadVer() == PAYLOAD_VER_2) {   // compact advert, key may be just a prefix
+        key_len = pkt->payload[i++];
+        if (key_len < ADVERT_MIN_KEY_SIZE || key_len > PUB_KEY_SIZE) {
+          MESH_DEBUG_PRINTLN("Mesh::onRecvPacket(): invalid compact advertisement, key_len=%d", (uint32_t) key_len);
+          break;
+        }
+      }
+      const uint8_t* key = &pkt->payload[i]; i += key_len;
 
       uint32_t timestamp;
       memcpy(&timestamp, &pkt->payload[i], 4); i += 4;
@@ -185,29 +264,39 @@ DispatcherAction Mesh::onRecvPacket(Packet* pkt) {
 
       if (i > pkt->payload_len) {
         MESH_DEBUG_PRINTLN("Mesh::onRecvPacket(): incomplete advertisement packet");
-      } else if (!_tables->hasSeen(pkt)) {
-        uint8_t* app_data = &pkt->payload[i];
-        int app_data_len = pkt->payload_len - i;
-        if (app_data_len > MAX_ADVERT_DATA_SIZE) { app_data_len = MAX_ADVERT_DATA_SIZE; }
-
-        // check that signature is valid
-        bool is_ok;
-        {
-          uint8_t message[PUB_KEY_SIZE + 4 + MAX_ADVERT_DATA_SIZE];
-          int msg_len = 0;
-          memcpy(&message[msg_len], id.pub_key, PUB_KEY_SIZE); msg_len += PUB_KEY_SIZE;
-          memcpy(&message[msg_len], &timestamp, 4); msg_len += 4;
-          memcpy(&message[msg_len], app_data, app_data_len); msg_len += app_data_len;
-
-          is_ok = id.verify(signature, message, msg_len);
-        }
-        if (is_ok) {
-          MESH_DEBUG_PRINTLN("Mesh::onRecvPacket(): valid advertisement received!");
-          onAdvertRecv(pkt, id, timestamp, app_data, app_data_len);
-          action = routeRecvPacket(pkt);
-        } else {
-          MESH_DEBUG_PRINTLN("Mesh::onRecvPacket(): received advertisement with forged signature! (app_data_len=%d)", app_data_len);
-        }
+        break;
+      }
+      uint8_t* app_data = &pkt->payload[i];
+      int app_data_len = pkt->payload_len - i;
+      if (app_data_len > MAX_ADVERT_DATA_SIZE) { app_data_len = MAX_ADVERT_DATA_SIZE; }
+
+      if (memcmp(key, self_id.pub_key, key_len) == 0 && verifyAdvert(self_id, timestamp, signature, app_data, app_data_len)) {
+        onSelfAdvertEcho(pkt, timestamp);   // NOTE: never re-forwarded
+        break;
+      }
+      if (isDuplicate(pkt)) break;
+
+      Identity id;
+      bool is_ok;
+      if (key_len == PUB_KEY_SIZE) {
+        memcpy(id.pub_key, key, PUB_KEY_SIZE);
+        is_ok = verifyAdvert(id, timestamp, signature, app_data, app_data_len);
+        if (is_ok) rememberAdvertKey(id);
+      } else {
+        // prefix could match more than one known identity, so try each source until the signature verifies
+        is_ok = lookupIdentityByPrefix(key, key_len, id) && verifyAdvert(id, timestamp, signature, app_data, app_data_len);
+        if (!is_ok) is_ok = findAdvertKey(key, key_len, id) && verifyAdvert(id, timestamp, signature, app_data, app_data_len);
+      }
+
+      if (is_ok) {
+        MESH_DEBUG_PRINTLN("Mesh::onRecvPacket(): valid advertisement received!");
+        onAdvertRecv(pkt, id, timestamp, app_data, app_data_len);
+        action = routeRecvPacket(pkt);
+      } else if (key_len < PUB_KEY_SIZE) {
+        // sender is unknown to this node, so can't verify it. Never forward unverified adverts!
+        MESH_DEBUG_PRINTLN("Mesh::onRecvPacket(): compact advertisement from unknown sender, dropped");
+      } else {
+        MESH_DEBUG_PRINTLN("Mesh::onRecvPacket(): received advertisement with forged signature! (app_data_len=%d)", app_data_len);
       }
       break;
     }
@@ -220,19 +309,37 @@ DispatcherAction Mesh::onRecvPacket(Packet* pkt) {
 }
 
 DispatcherAction Mesh::routeRecvPacket(Packet* packet) {
-  if (packet->isRouteFlood() && !packet->isMarkedDoNotRetransmit()
-    && packet->path_len + PATH_HASH_SIZE <= MAX_PATH_SIZE && allowPacketForward(packet)) {
-    // append this node's hash to 'path'
-    packet->path_len += self_id.copyHashTo(&packet->path[packet->path_len]);
-
-    uint32_t d = getRetransmitDelay(packet);
-    // as this propagates outwards, give it lower and lower priority
-    return ACTION_RETRANSMIT_DELAYED(packet->path_len, d);   // give priority to closer sources, than ones further away
+  if (!packet->isRouteFlood() || packet->isMarkedDoNotRetransmit() || !allowPacketForward(packet)) return ACTION_RELEASE;
+
+  if (!packet->hasRoomInPath() || isFloodScopeExceeded(packet)) {
+    n_scope_dropped++;
+    return ACTION_RELEASE;
+  }
+  // append this node's hash to 'path' (using the sender's hash size)
+  packet->path_len += self_id.copyHashTo(&packet->path[packet->path_len], packet->path_hash_size);
+
+  uint32_t d = getRetransmitDelay(packet);
+  // as this propagates outwards, give it lower and lower priority
+  return ACTION_RETRANSMIT_DELAYED(packet->path_len, d);   // give priority to closer sources, than ones further away
+}
+
+bool Mesh::isFloodScopeExceeded(const Packet* packet) const {
+  uint8_t hops = packet->getHopCount();
+  if (packet->isRouteScoped() && hops >= packet->max_hops) {
+    return true;   // sender's limit has been reached
   }
-  return ACTION_RELEASE;
+  return hops >= getMaxFloodHops(packet->getPayloadType());   // this node's limit for this payload type
 }
 
-Packet* Mesh::createAdvert(const LocalIdentity& id, const uint8_t* app_data, size_t app_data_len) {
+uint32_t Mesh::getAdvertTimestamp(const Packet* advert) {
+  int i = advert->getPayloadVer() == PAYLOAD_VER_2 ? 1 + advert->payload[0] : PUB_KEY_SIZE;   // skip the (compact) key
+
+  uint32_t timestamp;
+  memcpy(&timestamp, &advert->payload[i], 4);
+  return timestamp;
+}
+
+Packet* Mesh::createAdvert(const LocalIdentity& id, const uint8_t* app_data, size_t app_data_len, bool compact) {
   if (app_data_len > MAX_ADVERT_DATA_SIZE) return NULL;
 
   Packet* packet = obtainNewPacket();
@@ -241,10 +348,17 @@ Packet* Mesh::createAdvert(const LocalIdentity& id, const uint8_t* app_data, siz
     return NULL;
   }
 
-  packet->header = (PAYLOAD_TYPE_ADVERT << PH_TYPE_SHIFT);  // ROUTE_TYPE_* is set later
+  packet->header = (PAYLOAD_TYPE_ADVERT << PH_TYPE_SHIFT) | ((compact ? PAYLOAD_VER_2 : _payload_ver) << PH_VER_SHIFT);  // ROUTE_TYPE_* is set later
 
   int len = 0;
-  memcpy(&packet->payload[len], id.pub_key, PUB_KEY_SIZE); len += PUB_KEY_SIZE;
+  if (packet->getPayloadVer() == PAYLOAD_VER_2) {
+    packet->payload[len++] = compact ? ADVERT_COMPACT_KEY_SIZE : PUB_KEY_SIZE;
+  }
+  if (compact) {
+    memcpy(&packet->payload[len], id.pub_key, ADVERT_COMPACT_KEY_SIZE); len += ADVERT_COMPACT_KEY_SIZE;
+  } else {
+    memcpy(&packet->payload[len], id.pub_key, PUB_KEY_SIZE); len += PUB_KEY_SIZE;
+  }
 
   uint32_t emitted_timestamp = _rtc->getCurrentTime();
   memcpy(&packet->payload[len], &emitted_timestamp, 4); len += 4;
@@ -284,7 +398,7 @@ Packet* Mesh::createPathReturn(const uint8_t* dest_hash, const uint8_t* secret,
     MESH_DEBUG_PRINTLN("Mesh::createPathReturn(): error, packet pool empty");
     return NULL;
   }
-  packet->header = (PAYLOAD_TYPE_PATH << PH_TYPE_SHIFT);  // ROUTE_TYPE_* set later
+  packet->header = (PAYLOAD_TYPE_PATH << PH_TYPE_SHIFT) | (_payload_ver << PH_VER_SHIFT);  // ROUTE_TYPE_* set later
 
   int len = 0;
   memcpy(&packet->payload[len], dest_hash, PATH_HASH_SIZE); len += PATH_HASH_SIZE;  // dest hash
@@ -305,7 +419,7 @@ Packet* Mesh::createPathReturn(const uint8_t* dest_hash, const uint8_t* secret,
       getRNG()->random(&data[data_len], 4); data_len += 4;
     }
 
-    len += Utils::encryptThenMAC(secret, &packet->payload[len], data, data_len);
+    len += encryptPayload(packet, len, secret, data, data_len);
   }
 
   packet->payload_len = len;
@@ -314,7 +428,7 @@ Packet* Mesh::createPathReturn(const uint8_t* dest_hash, const uint8_t* secret,
 }
 
 Packet* Mesh::createDatagram(uint8_t type, const Identity& dest, const uint8_t* secret, const uint8_t* data, size_t data_len) {
-  if (type == PAYLOAD_TYPE_TXT_MSG || type == PAYLOAD_TYPE_REQ || type == PAYLOAD_TYPE_RESPONSE) {
+  if (type == PAYLOAD_TYPE_TXT_MSG || type == PAYLOAD_TYPE_REQ || type == PAYLOAD_TYPE_RESPONSE || type == PAYLOAD_TYPE_MULTIPART) {
     if (data_len + 2 + CIPHER_BLOCK_SIZE-1 > MAX_PACKET_PAYLOAD) return NULL;
   } else {
     return NULL;  // invalid type
@@ -325,12 +439,12 @@ Packet* Mesh::createDatagram(uint8_t type, const Identity& dest, const uint8_t*
     MESH_DEBUG_PRINTLN("Mesh::createDatagram(): error, packet pool empty");
     return NULL;
   }
-  packet->header = (type << PH_TYPE_SHIFT);  // ROUTE_TYPE_* set later
+  packet->header = (type << PH_TYPE_SHIFT) | (_payload_ver << PH_VER_SHIFT);  // ROUTE_TYPE_* set later
 
   int len = 0;
   len += dest.copyHashTo(&packet->payload[len]);  // dest hash
   len += self_id.copyHashTo(&packet->payload[len]);  // src hash
-  len += Utils::encryptThenMAC(secret, &packet->payload[len], data, data_len);
+  len += encryptPayload(packet, len, secret, data, data_len);
 
   packet->payload_len = len;
 
@@ -349,7 +463,7 @@ Packet* Mesh::createAnonDatagram(uint8_t type, const LocalIdentity& sender, cons
     MESH_DEBUG_PRINTLN("Mesh::createAnonDatagram(): error, packet pool empty");
     return NULL;
   }
-  packet->header = (type << PH_TYPE_SHIFT);  // ROUTE_TYPE_* set later
+  packet->header = (type << PH_TYPE_SHIFT) | (_payload_ver << PH_VER_SHIFT);  // ROUTE_TYPE_* set later
 
   int len = 0;
   if (type == PAYLOAD_TYPE_ANON_REQ) {
@@ -358,7 +472,7 @@ Packet* Mesh::createAnonDatagram(uint8_t type, const LocalIdentity& sender, cons
   } else {
     // FUTURE:
   }
-  len += Utils::encryptThenMAC(secret, &packet->payload[len], data, data_len);
+  len += encryptPayload(packet, len, secret, data, data_len);
 
   packet->payload_len = len;
 
@@ -374,11 +488,11 @@ Packet* Mesh::createGroupDatagram(uint8_t type, const GroupChannel& channel, con
     MESH_DEBUG_PRINTLN("Mesh::createGroupDatagram(): error, packet pool empty");
     return NULL;
   }
-  packet->header = (type << PH_TYPE_SHIFT);  // ROUTE_TYPE_* set later
+  packet->header = (type << PH_TYPE_SHIFT) | (_payload_ver << PH_VER_SHIFT);  // ROUTE_TYPE_* set later
 
   int len = 0;
   memcpy(&packet->payload[len], channel.hash, PATH_HASH_SIZE); len += PATH_HASH_SIZE;
-  len += Utils::encryptThenMAC(channel.secret, &packet->payload[len], data, data_len);
+  len += encryptPayload(packet, len, channel.secret, data, data_len);
 
   packet->payload_len = len;
 
@@ -391,7 +505,7 @@ Packet* Mesh::createAck(uint32_t ack_crc) {
     MESH_DEBUG_PRINTLN("Mesh::createAck(): error, packet pool empty");
     return NULL;
   }
-  packet->header = (PAYLOAD_TYPE_ACK << PH_TYPE_SHIFT);  // ROUTE_TYPE_* set later
+  packet->header = (PAYLOAD_TYPE_ACK << PH_TYPE_SHIFT) | (_payload_ver << PH_VER_SHIFT);  // ROUTE_TYPE_* set later
 
   memcpy(packet->payload, &ack_crc, 4);
   packet->payload_len = 4;
@@ -399,9 +513,100 @@ Packet* Mesh::createAck(uint32_t ack_crc) {
   return packet;
 }
 
-void Mesh::sendFlood(Packet* packet, uint32_t delay_millis) {
+#define MAX_SIV_ASSOC   (1 + PATH_HASH_SIZE + PUB_KEY_SIZE)   // payload type + largest cleartext prefix (ANON_REQ)
+
+int Mesh::encryptPayload(Packet* packet, int prefix_len, const uint8_t* secret, const uint8_t* data, int data_len) {
+  if (packet->getPayloadVer() == PAYLOAD_VER_1) {
+    return Utils::encryptThenMAC(secret, &packet->payload[prefix_len], data, data_len);
+  }
+  // V2: stream mode, also authenticating payload type and the cleartext prefix (hashes, etc)
+  uint8_t assoc[MAX_SIV_ASSOC];
+  assoc[0] = packet->getPayloadType();
+  memcpy(&assoc[1], packet->payload, prefix_len);
+  return Utils::encryptSIV(secret, &packet->payload[prefix_len], data, data_len, assoc, 1 + prefix_len);
+}
+
+int Mesh::decryptPayload(const Packet* packet, int prefix_len, const uint8_t* secret, uint8_t* dest) {
+  if (packet->getPayloadVer() == PAYLOAD_VER_1) {
+    return Utils::MACThenDecrypt(secret, dest, &packet->payload[prefix_len], packet->payload_len - prefix_len);
+  }
+  uint8_t assoc[MAX_SIV_ASSOC];
+  assoc[0] = packet->getPayloadType();
+  memcpy(&assoc[1], packet->payload, prefix_len);
+  return Utils::decryptSIV(secret, dest, &packet->payload[prefix_len], packet->payload_len - prefix_len, assoc, 1 + prefix_len);
+}
+
+void Mesh::sendPathReturn(const Packet* packet, const Identity& dest, const uint8_t* secret, uint8_t extra_type, const uint8_t* extra, size_t extra_len) {
+  PendingPathReturn* p = NULL;
+  if (_path_return_window > 0 && extra_len <= MAX_PATH_RETURN_EXTRA) {
+    for (int i = 0; i < MAX_PENDING_PATH_RETURNS; i++) {
+      if (path_returns[i].n_copies == 0) { p = &path_returns[i]; break; }
+    }
+  }
+  if (p == NULL) {   // not collecting (or no free slots), just use this path
+    Packet* rpath = createPathReturn(dest, secret, packet->path, packet->path_len, extra_type, extra, extra_len);
+    if (rpath) sendFlood(rpath);
+    return;
+  }
+
+  packet->calculatePacketHash(p->pkt_hash);
+  dest.copyHashTo(p->dest_hash);
+  memcpy(p->secret, secret, PUB_KEY_SIZE);
+  p->extra_type = extra_type;
+  p->extra_len = extra_len;
+  memcpy(p->extra, extra, extra_len);
+  memcpy(p->path, packet->path, p->path_len = packet->path_len);
+  p->best_score = scoreReturnPath(packet);
+  p->n_copies = 1;
+  p->send_at = futureMillis(_path_return_window);
+  num_path_returns++;
+}
+
+void Mesh::offerReturnPath(const Packet* packet) {
+  uint8_t hash[MAX_HASH_SIZE];
+  packet->calculatePacketHash(hash);
+
+  for (int i = 0; i < MAX_PENDING_PATH_RETURNS; i++) {
+    PendingPathReturn* p = &path_returns[i];
+    if (p->n_copies > 0 && memcmp(p->pkt_hash, hash, MAX_HASH_SIZE) == 0) {
+      p->n_copies++;
+      int score = scoreReturnPath(packet);
+      if (score < p->best_score) {
+        p->best_score = score;
+        memcpy(p->path, packet->path, p->path_len = packet->path_len);
+      }
+      break;
+    }
+  }
+}
+
+void Mesh::checkPathReturns() {
+  for (int i = 0; i < MAX_PENDING_PATH_RETURNS; i++) {
+    PendingPathReturn* p = &path_returns[i];
+    if (p->n_copies > 0 && millisHasNowPassed(p->send_at)) {
+      MESH_DEBUG_PRINTLN("Mesh: returning best of %d paths, path_len=%d, score=%d", (uint32_t) p->n_copies, (uint32_t) p->path_len, p->best_score);
+      Packet* rpath = createPathReturn(p->dest_hash, p->secret, p->path, p->path_len, p->extra_type, p->extra, p->extra_len);
+      if (rpath) sendFlood(rpath);
+
+      p->n_copies = 0;  // free the slot
+      num_path_returns--;
+    }
+  }
+}
+
+void Mesh::setOutboundPathHashSize(Packet* packet) const {
+  packet->path_hash_size = packet->getPayloadVer() == PAYLOAD_VER_2 ? _path_hash_size : PATH_HASH_SIZE;
+}
+
+void Mesh::sendFlood(Packet* packet, uint32_t delay_millis, uint8_t max_hops) {
   packet->header &= ~PH_ROUTE_MASK;
-  packet->header |= ROUTE_TYPE_FLOOD;
+  if (max_hops > 0) {
+    packet->header |= ROUTE_TYPE_FLOOD_SCOPED;
+    packet->max_hops = max_hops;
+  } else {
+    packet->header |= ROUTE_TYPE_FLOOD;
+  }
+  setOutboundPathHashSize(packet);
   packet->path_len = 0;
 
   _tables->hasSeen(packet); // mark this packet as already sent in case it is rebroadcast back to us
@@ -420,6 +625,7 @@ void Mesh::sendFlood(Packet* packet, uint32_t delay_millis) {
 void Mesh::sendDirect(Packet* packet, const uint8_t* path, uint8_t path_len, uint32_t delay_millis) {
   packet->header &= ~PH_ROUTE_MASK;
   packet->header |= ROUTE_TYPE_DIRECT;
+  setOutboundPathHashSize(packet);
 
   memcpy(packet->path, path, packet->path_len = path_len);
 
@@ -431,6 +637,7 @@ void Mesh::sendDirect(Packet* packet, const uint8_t* path, uint8_t path_len, uin
 void Mesh::sendZeroHop(Packet* packet, uint32_t delay_millis) {
   packet->header &= ~PH_ROUTE_MASK;
   packet->header |= ROUTE_TYPE_DIRECT;
+  setOutboundPathHashSize(packet);
 
   packet->path_len = 0;  // path_len of zero means Zero Hop
 
@@ -38,10 +38,64 @@ public:
  * \brief  The next layer in the basic Dispatcher task, Mesh recognises the particular Payload TYPES,
  *     and provides virtual methods for sub-classes on handling incoming, and also preparing outbound Packets.
 */
+#ifndef DEFAULT_PATH_HASH_SIZE
+  #define DEFAULT_PATH_HASH_SIZE   PATH_HASH_SIZE
+#endif
+#ifndef DEFAULT_PAYLOAD_VER
+  #define DEFAULT_PAYLOAD_VER      PAYLOAD_VER_1
+#endif
+
+#ifndef DEFAULT_PATH_RETURN_WINDOW
+  #define DEFAULT_PATH_RETURN_WINDOW   0     // millis to collect copies of a flood packet, before returning best path (0 = first copy wins)
+#endif
+#ifndef MAX_PENDING_PATH_RETURNS
+  #define MAX_PENDING_PATH_RETURNS     4
+#endif
+#ifndef MAX_PATH_RETURN_EXTRA
+  #define MAX_PATH_RETURN_EXTRA       32     // larger 'extra' payloads are returned immediately, via first path
+#endif
+#ifndef ADVERT_KEY_CACHE_SIZE
+  #define ADVERT_KEY_CACHE_SIZE       16     // full pub_keys remembered from verified adverts, to resolve compact (V2) adverts
+#endif
+#define PATH_SCORE_HOP_COST_X4        24     // each extra hop is worth 6 dB of SNR margin
+
+struct PendingPathReturn {
+  uint8_t pkt_hash[MAX_HASH_SIZE];   // of the received flood packet
+  uint8_t dest_hash[PATH_HASH_SIZE];
+  uint8_t secret[PUB_KEY_SIZE];
+  uint8_t extra_type, extra_len;
+  uint8_t extra[MAX_PATH_RETURN_EXTRA];
+  uint8_t path_len;
+  uint8_t path[MAX_PATH_SIZE];
+  int best_score;
+  uint8_t n_copies;    // zero if slot is unused
+  unsigned long send_at;
+};
+
 class Mesh : public Dispatcher {
   RTCClock* _rtc;
   RNG* _rng;
   MeshTables* _tables;
+  uint8_t _path_hash_size;
+  uint8_t _payload_ver;
+  uint32_t _path_return_window;
+  PendingPathReturn path_returns[MAX_PENDING_PATH_RETURNS];
+  int num_path_returns;
+  uint32_t n_dupes, n_decrypt_failed, n_scope_dropped;
+  uint8_t advert_keys[ADVERT_KEY_CACHE_SIZE][PUB_KEY_SIZE];
+  int num_advert_keys, next_advert_key;
+
+  bool isDuplicate(const Packet* packet);
+  bool verifyAdvert(const Identity& id, uint32_t timestamp, const uint8_t* signature, const uint8_t* app_data, int app_data_len) const;
+  void rememberAdvertKey(const Identity& id);
+  bool findAdvertKey(const uint8_t* prefix, uint8_t prefix_len, Identity& id) const;
+
+  void offerReturnPath(const Packet* packet);
+  void checkPathReturns();
+  bool isFloodScopeExceeded(const Packet* packet) const;
+  void setOutboundPathHashSize(Packet* packet) const;
+  int  encryptPayload(Packet* packet, int prefix_len, const uint8_t* secret, const uint8_t* data, int data_len);
+  int  decryptPayload(const Packet* packet, int prefix_len, const uint8_t* secret, uint8_t* dest);
 
 protected:
   DispatcherAction onRecvPacket(Packet* pkt) override;
@@ -57,11 +111,25 @@ protected:
    */
   virtual bool allowPacketForward(const Packet* packet);
 
+  /**
+   * \brief  Per payload-type ceiling on how far flood packets are allowed to propagate (via this node)
+   * \param  payload_type  one of PAYLOAD_TYPE_*
+   * \returns  max number of hops a flood packet of this type can have travelled, and still be forwarded by this node
+   */
+  virtual uint8_t getMaxFloodHops(uint8_t payload_type) const;
+
   /**
    * \returns  number of milliseconds delay to apply to retransmitting the given packet.
    */
   virtual uint32_t getRetransmitDelay(const Packet* packet);
 
+  /**
+   * \brief  Rate the route a received flood packet took, for choosing which path to return (when collecting copies).
+   *         Default is hop count plus the SNR shortfall of the last hop (from the neighbour table, if known).
+   * \returns  a cost, lower is better
+   */
+  virtual int scoreReturnPath(const Packet* packet);
+
   /**
    * \brief  Perform search of local DB of peers/contacts.
    * \returns  Number of peers with matching hash
@@ -78,7 +146,7 @@ protected:
   /**
    * \brief  A (now decrypted) data packet has been received (by a known peer).
    *         NOTE: these can be received multiple times (per sender/msg-id), via different routes
-   * \param  type  one of: PAYLOAD_TYPE_TXT_MSG, PAYLOAD_TYPE_REQ, PAYLOAD_TYPE_RESPONSE
+   * \param  type  one of: PAYLOAD_TYPE_TXT_MSG, PAYLOAD_TYPE_REQ, PAYLOAD_TYPE_RESPONSE, PAYLOAD_TYPE_MULTIPART
    * \param  sender_idx  index of peer, [0..n) where n is what searchPeersByHash() returned
    * \param  secret   the pre-calculated shared-secret (handy for sending response packet)
   */
@@ -93,12 +161,27 @@ protected:
   */
   virtual bool onPeerPathRecv(Packet* packet, int sender_idx, const uint8_t* secret, uint8_t* path, uint8_t path_len, uint8_t extra_type, uint8_t* extra, uint8_t extra_len) { return false; }
 
+  /**
+   * \brief  Resolve the full Identity of a compact (V2) advert's sender, from its pub_key prefix, ie. a previously known node.
+   *         If not found here, the keys of recently verified full adverts (ADVERT_KEY_CACHE_SIZE) are searched.
+   *         NOTE: compact adverts which can't be resolved can't be verified, so are dropped (not forwarded)
+   * \param  id  OUT - the full identity, if found
+   * \returns  true, if found
+   */
+  virtual bool lookupIdentityByPrefix(const uint8_t* prefix, uint8_t prefix_len, Identity& id) { return false; }
+
   /**
    * \brief  A new incoming Advertisement has been received.
    *         NOTE: these can be received multiple times (per id/timestamp), via different routes
   */
   virtual void onAdvertRecv(Packet* packet, const Identity& id, uint32_t timestamp, const uint8_t* app_data, size_t app_data_len) { }
 
+  /**
+   * \brief  One of this node's own Advertisements has been heard (and verified), re-flooded by a neighbour.
+   * \param  timestamp  the advert's timestamp (as emitted by this node)
+  */
+  virtual void onSelfAdvertEcho(Packet* packet, uint32_t timestamp) { }
+
   /**
    * \brief  A (now decrypted) data packet has been received.
    *         NOTE: these can be received multiple times (per sender/contents), via different routes
@@ -115,10 +198,21 @@ protected:
 
   /**
    * \brief  Perform search of local DB of matching GroupChannels.
-   * \param  channels  OUT - store matching channels in this array, up to max_matches
    * \returns  Number of channels with matching hash
    */
-  virtual int searchChannelsByHash(const uint8_t* hash, GroupChannel channels[], int max_matches);
+  virtual int searchChannelsByHash(const uint8_t* hash);
+
+  /**
+   * \returns  a matching channel, by idx [0..n) where n is what searchChannelsByHash() returned
+   */
+  virtual const GroupChannel* getMatchingChannel(int match_idx) { return NULL; }
+
+  /**
+   * \brief  decrypt (and check MAC of) a group packet's data, with a matching channel. Sub-classes can override to use cached cipher state.
+   * \param  match_idx  [0..n) where n is what searchChannelsByHash() returned
+   * \returns  length of decrypted data in 'dest', or zero if MAC is invalid
+   */
+  virtual int decryptChannelData(const Packet* packet, int match_idx, uint8_t* dest);
 
   /**
    * \brief  An encrypted group data packet has been received.
@@ -137,6 +231,13 @@ protected:
   Mesh(Radio& radio, MillisecondClock& ms, RNG& rng, RTCClock& rtc, PacketManager& mgr, MeshTables& tables)
     : Dispatcher(radio, ms, mgr), _rng(&rng), _rtc(&rtc), _tables(&tables)
   {
+    _path_hash_size = DEFAULT_PATH_HASH_SIZE;
+    _payload_ver = _path_hash_size != PATH_HASH_SIZE ? PAYLOAD_VER_2 : DEFAULT_PAYLOAD_VER;
+    _path_return_window = DEFAULT_PATH_RETURN_WINDOW;
+    num_path_returns = 0;
+    memset(path_returns, 0, sizeof(path_returns));
+    n_dupes = n_decrypt_failed = n_scope_dropped = 0;
+    num_advert_keys = next_advert_key = 0;
   }
 
 public:
@@ -148,7 +249,54 @@ public:
   RNG* getRNG() const { return _rng; }
   RTCClock* getRTCClock() const { return _rtc; }
 
-  Packet* createAdvert(const LocalIdentity& id, const uint8_t* app_data=NULL, size_t app_data_len=0);
+  /**
+   * \brief  set the format of locally originated packets. V2 uses stream mode encryption (no block padding).
+   *         NOTE: endpoints need to agree on this, but repeaters will forward either.
+   */
+  void setPayloadVersion(uint8_t ver) { if (ver <= PAYLOAD_VER_2) _payload_ver = ver; }
+  uint8_t getPayloadVersion() const { return _payload_ver; }
+
+  /**
+   * \brief  set num bytes per hop, in paths of locally originated packets. (if > 1, packets are sent in V2 format)
+   *         NOTE: endpoints in a mesh need the same setting, but repeaters will forward any.
+   */
+  void setPathHashSize(uint8_t hash_size) {
+    if (hash_size >= 1 && hash_size <= MAX_PATH_HASH_SIZE) {
+      _path_hash_size = hash_size;
+      if (hash_size != PATH_HASH_SIZE) _payload_ver = PAYLOAD_VER_2;   // V1 can't express the hash size
+    }
+  }
+  uint8_t getPathHashSize() const { return _path_hash_size; }
+  uint8_t getOutboundPathHashSize() const { return _payload_ver == PAYLOAD_VER_2 ? _path_hash_size : PATH_HASH_SIZE; }   // as actually sent
+
+  /**
+   * \brief  set how long sendPathReturn() waits for more copies of a flood packet (via other routes), before returning the best path.
+   *         Zero means return the path of the first copy, immediately.
+   */
+  void setPathReturnWindow(uint32_t millis) { _path_return_window = millis; }
+  uint32_t getPathReturnWindow() const { return _path_return_window; }
+
+  uint32_t getNumDuplicates() const { return n_dupes; }   // received packets already seen
+  uint32_t getNumDecryptFailed() const { return n_decrypt_failed; }   // addressed to us, but MAC check failed for all peers
+  uint32_t getNumScopeDropped() const { return n_scope_dropped; }   // floods not forwarded, because of hop limits
+
+  /**
+   * \brief  restore the above counters, eg. after a deep sleep
+   */
+  void setRecvCounters(uint32_t dupes, uint32_t decrypt_failed, uint32_t scope_dropped) {
+    n_dupes = dupes; n_decrypt_failed = decrypt_failed; n_scope_dropped = scope_dropped;
+  }
+
+  /**
+   * \param  compact  if true, sends just a prefix of the pub_key (V2), so only nodes which already know this identity, ie. have it
+   *                  as a contact or have recently heard a full advert from it, can verify (and forward) it
+   */
+  Packet* createAdvert(const LocalIdentity& id, const uint8_t* app_data=NULL, size_t app_data_len=0, bool compact=false);
+
+  /**
+   * \returns  the timestamp of an advert packet, eg. as made by createAdvert()
+   */
+  static uint32_t getAdvertTimestamp(const Packet* advert);
   Packet* createDatagram(uint8_t type, const Identity& dest, const uint8_t* secret, const uint8_t* data, size_t len);
   Packet* createAnonDatagram(uint8_t type, const LocalIdentity& sender, const Identity& dest, const uint8_t* secret, const uint8_t* data, size_t data_len);
   Packet* createGroupDatagram(uint8_t type, const GroupChannel& channel, const uint8_t* data, size_t data_len);
@@ -156,10 +304,17 @@ public:
   Packet* createPathReturn(const uint8_t* dest_hash, const uint8_t* secret, const uint8_t* path, uint8_t path_len, uint8_t extra_type, const uint8_t*extra, size_t extra_len);
   Packet* createPathReturn(const Identity& dest, const uint8_t* secret, const uint8_t* path, uint8_t path_len, uint8_t extra_type, const uint8_t*extra, size_t extra_len);
 
+  /**
+   * \brief  flood a path return to the sender of received flood 'packet', with optional 'extra' (eg. ACK or response).
+   *         If a path return window is set, further copies of 'packet' are collected and the best scoring path is returned.
+   */
+  void sendPathReturn(const Packet* packet, const Identity& dest, const uint8_t* secret, uint8_t extra_type, const uint8_t* extra, size_t extra_len);
+
   /**
    * \brief  send a locally-generated Packet with flood routing
+   * \param  max_hops  if non-zero, limits the scope of the flood to this many hops (repeaters will not forward beyond)
   */
-  void sendFlood(Packet* packet, uint32_t delay_millis=0);
+  void sendFlood(Packet* packet, uint32_t delay_millis=0, uint8_t max_hops=0);
 
   /**
    * \brief  send a locally-generated Packet with Direct routing
@@ -13,10 +13,15 @@
 
 // V1
 #define CIPHER_MAC_SIZE      2
+#define CIPHER_SIV_MAC_SIZE  8   // also the synthetic IV (nonce), so is longer
+#define CIPHER_SIV_MAC_KEY_SIZE  32
 #define PATH_HASH_SIZE       1
+#define ADVERT_COMPACT_KEY_SIZE  8   // pub_key prefix length, in compact (V2) adverts
+#define ADVERT_MIN_KEY_SIZE      4
 
 #define MAX_PACKET_PAYLOAD  184
 #define MAX_PATH_SIZE        64
+#define MAX_FLOOD_HOPS      (MAX_PATH_SIZE / PATH_HASH_SIZE)   // ie. limited only by path size
 #define MAX_TRANS_UNIT      255
 
 #if MESH_DEBUG && ARDUINO
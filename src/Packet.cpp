@@ -6,8 +6,25 @@ namespace mesh {
 
 Packet::Packet() {
   header = 0;
+  max_hops = 0;
+  path_hash_size = PATH_HASH_SIZE;
   path_len = 0;
   payload_len = 0;
+#if MESH_POOL_TRACKING
+  pool_state = POOL_STATE_FREE;
+  alloc_site = NULL;
+  state_since = 0;
+#endif
+}
+
+bool Packet::setPathDescriptor(uint8_t desc) {
+  uint8_t hash_size = (desc >> PATH_DESC_SIZE_SHIFT) + 1;
+  uint16_t len = (desc & PATH_DESC_HOPS_MASK) * hash_size;
+  if (hash_size > MAX_PATH_HASH_SIZE || len > MAX_PATH_SIZE) return false;
+
+  path_hash_size = hash_size;
+  path_len = len;
+  return true;
 }
 
 
@@ -11,7 +11,7 @@ namespace mesh {
 #define PH_VER_SHIFT         6
 #define PH_VER_MASK       0x03   // 2-bits
 
-#define ROUTE_TYPE_RESERVED1     0x00    // FUTURE
+#define ROUTE_TYPE_FLOOD_SCOPED  0x00    // flood mode, but with a max hop count (1 byte, sent before 'path'), ie. limited scope
 #define ROUTE_TYPE_FLOOD         0x01    // flood mode, needs 'path' to be built up (max 64 bytes)
 #define ROUTE_TYPE_DIRECT        0x02    // direct route, 'path' is supplied
 #define ROUTE_TYPE_RESERVED2     0x03    // FUTURE
@@ -25,14 +25,31 @@ namespace mesh {
 #define PAYLOAD_TYPE_GRP_DATA    0x06    // an (unverified) group datagram (prefixed with channel hash, MAC) (enc data: timestamp, blob)
 #define PAYLOAD_TYPE_ANON_REQ    0x07    // generic request (prefixed with dest_hash, ephemeral pub_key, MAC) (enc data: ...)
 #define PAYLOAD_TYPE_PATH        0x08    // returned path (prefixed with dest/src hashes, MAC) (enc data: path, extra)
+#define PAYLOAD_TYPE_MULTIPART   0x09    // fragment of a larger blob, or a selective ACK (prefixed with dest/src hashes, MAC) (enc data: msg_id, frag idx/count, flags, blob)
 //...
 #define PAYLOAD_TYPE_RESERVEDM   0x0F    // FUTURE
 
 #define PAYLOAD_VER_1       0x00   // 1-byte src/dest hashes, 2-byte MAC
-#define PAYLOAD_VER_2       0x01   // FUTURE (eg. 2-byte hashes, 4-byte MAC ??)
+#define PAYLOAD_VER_2       0x01   // path descriptor (hop count + path hash size) instead of path_len, compact ADVERT
 #define PAYLOAD_VER_3       0x02   // FUTURE
 #define PAYLOAD_VER_4       0x03   // FUTURE
 
+// V2 path descriptor byte
+#define PATH_DESC_HOPS_MASK     0x3F   // lower 6 bits: num hashes in path
+#define PATH_DESC_SIZE_SHIFT       6   // upper 2 bits: (path hash size - 1)
+#define MAX_PATH_HASH_SIZE         3
+
+#if MESH_POOL_TRACKING
+// Packet::pool_state values (ownership tracking)
+#define POOL_STATE_FREE        0   // in the unused pool
+#define POOL_STATE_ALLOCATED   1   // obtained by local code, not yet sent or released
+#define POOL_STATE_RX          2   // received, being processed
+#define POOL_STATE_QUEUED      3   // in outbound queue
+#define POOL_STATE_IN_FLIGHT   4   // being transmitted
+#define POOL_STATE_HELD        5   // ACTION_MANUAL_HOLD, or held after send, awaiting releasePacket()
+#define NUM_POOL_STATES        6
+#endif
+
 /**
  * \brief  The fundamental transmission unit.
 */
@@ -41,9 +58,16 @@ public:
   Packet();
 
   uint8_t header;
+  uint8_t max_hops;   // only for ROUTE_TYPE_FLOOD_SCOPED
+  uint8_t path_hash_size;   // num bytes per hop in 'path' (always PATH_HASH_SIZE for V1)
   uint16_t payload_len, path_len;
   uint8_t path[MAX_PATH_SIZE];
   uint8_t payload[MAX_PACKET_PAYLOAD];
+#if MESH_POOL_TRACKING
+  uint8_t pool_state;        // one of POOL_STATE_*
+  const char* alloc_site;    // name of function which obtained this packet
+  unsigned long state_since; // millis
+#endif
 
   /**
    * \brief calculate the hash of payload + type
@@ -56,9 +80,33 @@ public:
    */
   uint8_t getRouteType() const { return header & PH_ROUTE_MASK; }
 
-  bool isRouteFlood() const { return getRouteType() == ROUTE_TYPE_FLOOD; }
+  bool isRouteFlood() const { return getRouteType() == ROUTE_TYPE_FLOOD || getRouteType() == ROUTE_TYPE_FLOOD_SCOPED; }
+  bool isRouteScoped() const { return getRouteType() == ROUTE_TYPE_FLOOD_SCOPED; }
   bool isRouteDirect() const { return getRouteType() == ROUTE_TYPE_DIRECT; }
 
+  /**
+   * \returns  number of hops this (flood) packet has travelled so far
+   */
+  uint8_t getHopCount() const { return path_len / path_hash_size; }
+
+  /**
+   * \returns  true if another hop's hash can be appended to 'path'
+   */
+  bool hasRoomInPath() const {
+    return path_len + path_hash_size <= MAX_PATH_SIZE && (getPayloadVer() == PAYLOAD_VER_1 || getHopCount() < PATH_DESC_HOPS_MASK);
+  }
+
+  /**
+   * \returns  the (V2) path descriptor byte, ie. encoded hop count and path hash size
+   */
+  uint8_t getPathDescriptor() const { return ((path_hash_size - 1) << PATH_DESC_SIZE_SHIFT) | getHopCount(); }
+
+  /**
+   * \brief  set path_hash_size and path_len from a (V2) path descriptor byte
+   * \returns  false, if descriptor is invalid
+   */
+  bool setPathDescriptor(uint8_t desc);
+
   /**
    * \returns  one of PAYLOAD_TYPE_ values
    */
@@ -87,8 +87,105 @@ int Utils::MACThenDecrypt(const uint8_t* shared_secret, uint8_t* dest, const uin
   return 0; // invalid HMAC
 }
 
+#define SIV_ASSOC_IN_IV   (12 - CIPHER_SIV_MAC_SIZE)
+
+// separate keys for the MAC and the cipher, derived from the shared secret
+void Utils::deriveSIVKeys(const uint8_t* shared_secret, uint8_t* enc_key, uint8_t* mac_key) {
+  SHA256 sha;
+  sha.resetHMAC(shared_secret, PUB_KEY_SIZE);
+  sha.update("siv-enc", 7);
+  sha.finalizeHMAC(shared_secret, PUB_KEY_SIZE, enc_key, CIPHER_KEY_SIZE);
+
+  sha.resetHMAC(shared_secret, PUB_KEY_SIZE);
+  sha.update("siv-mac", 7);
+  sha.finalizeHMAC(shared_secret, PUB_KEY_SIZE, mac_key, CIPHER_SIV_MAC_KEY_SIZE);
+}
+
+static void calcSIV(const uint8_t* mac_key, uint8_t* mac, const uint8_t* assoc, int assoc_len, const uint8_t* plain, int plain_len) {
+  SHA256 sha;
+  sha.resetHMAC(mac_key, CIPHER_SIV_MAC_KEY_SIZE);
+  sha.update(assoc, assoc_len);
+  sha.update(plain, plain_len);
+  sha.finalizeHMAC(mac_key, CIPHER_SIV_MAC_KEY_SIZE, mac, CIPHER_SIV_MAC_SIZE);
+}
+
+static void applyCTR(const uint8_t* enc_key, const uint8_t* mac, const uint8_t* assoc, int assoc_len, uint8_t* dest, const uint8_t* src, int len) {
+  // counter block: MAC (8), start of assoc (4, zero padded), block counter (4, big endian)
+  uint8_t ctr[16];
+  memset(ctr, 0, sizeof(ctr));
+  memcpy(ctr, mac, CIPHER_SIV_MAC_SIZE);
+  memcpy(&ctr[CIPHER_SIV_MAC_SIZE], assoc, assoc_len < SIV_ASSOC_IN_IV ? assoc_len : SIV_ASSOC_IN_IV);
+
+  AES128 aes;
+  aes.setKey(enc_key, CIPHER_KEY_SIZE);
+
+  uint32_t n = 0;
+  uint8_t stream[16];
+  while (len > 0) {
+    ctr[12] = n >> 24; ctr[13] = n >> 16; ctr[14] = n >> 8; ctr[15] = n;
+    aes.encryptBlock(stream, ctr);
+
+    int k = len < 16 ? len : 16;
+    for (int i = 0; i < k; i++) *dest++ = *src++ ^ stream[i];
+    len -= k; n++;
+  }
+}
+
+int Utils::encryptSIV(const uint8_t* enc_key, const uint8_t* mac_key, uint8_t* dest, const uint8_t* src, int src_len, const uint8_t* assoc, int assoc_len) {
+  calcSIV(mac_key, dest, assoc, assoc_len, src, src_len);
+  applyCTR(enc_key, dest, assoc, assoc_len, dest + CIPHER_SIV_MAC_SIZE, src, src_len);
+  return CIPHER_SIV_MAC_SIZE + src_len;
+}
+
+int Utils::decryptSIV(const uint8_t* enc_key, const uint8_t* mac_key, uint8_t* dest, const uint8_t* src, int src_len, const uint8_t* assoc, int assoc_len) {
+  if (src_len <= CIPHER_SIV_MAC_SIZE) return 0;  // invalid src bytes
+
+  int len = src_len - CIPHER_SIV_MAC_SIZE;
+  applyCTR(enc_key, src, assoc, assoc_len, dest, src + CIPHER_SIV_MAC_SIZE, len);
+
+  uint8_t mac[CIPHER_SIV_MAC_SIZE];
+  calcSIV(mac_key, mac, assoc, assoc_len, dest, len);
+  if (memcmp(mac, src, CIPHER_SIV_MAC_SIZE) == 0) {
+    return len;
+  }
+  memset(dest, 0, len);  // don't leave unauthenticated plaintext around
+  return 0; // invalid MAC
+}
+
+int Utils::encryptSIV(const uint8_t* shared_secret, uint8_t* dest, const uint8_t* src, int src_len, const uint8_t* assoc, int assoc_len) {
+  uint8_t enc_key[CIPHER_KEY_SIZE], mac_key[CIPHER_SIV_MAC_KEY_SIZE];
+  deriveSIVKeys(shared_secret, enc_key, mac_key);
+
+  int len = encryptSIV(enc_key, mac_key, dest, src, src_len, assoc, assoc_len);
+
+  secureZero(enc_key, sizeof(enc_key));
+  secureZero(mac_key, sizeof(mac_key));
+  return len;
+}
+
+int Utils::decryptSIV(const uint8_t* shared_secret, uint8_t* dest, const uint8_t* src, int src_len, const uint8_t* assoc, int assoc_len) {
+  if (src_len <= CIPHER_SIV_MAC_SIZE) return 0;  // invalid src bytes
+
+  uint8_t enc_key[CIPHER_KEY_SIZE], mac_key[CIPHER_SIV_MAC_KEY_SIZE];
+  deriveSIVKeys(shared_secret, enc_key, mac_key);
+
+  int len = decryptSIV(enc_key, mac_key, dest, src, src_len, assoc, assoc_len);
+
+  secureZero(enc_key, sizeof(enc_key));
+  secureZero(mac_key, sizeof(mac_key));
+  return len;
+}
+
 static const char hex_chars[] = "0123456789ABCDEF";
 
+void Utils::secureZero(void* dest, size_t len) {
+  volatile uint8_t* d = (volatile uint8_t *) dest;
+  while (len > 0) {
+    *d++ = 0;
+    len--;
+  }
+}
+
 void Utils::toHex(char* dest, const uint8_t* src, size_t len) {
   while (len > 0) {
     uint8_t b = *src++;
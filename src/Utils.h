@@ -54,6 +54,39 @@ public:
   */
   static int MACThenDecrypt(const uint8_t* shared_secret, uint8_t* dest, const uint8_t* src, int src_len);
 
+  /**
+   * \brief  stream mode counterpart of encryptThenMAC(), without block padding. Calculates MAC over 'assoc' + plaintext,
+   *         then uses the MAC (plus start of 'assoc') as a synthetic IV, to encrypt with AES128 in CTR mode.
+   *         The MAC and cipher keys are separately derived (HMAC-SHA256) from 'shared_secret'.
+   * \param  assoc  cleartext data to also authenticate (eg. payload type and hashes). First 4 bytes are also part of the IV.
+   * \returns  total length of bytes in 'dest' (CIPHER_SIV_MAC_SIZE + src_len)
+  */
+  static int encryptSIV(const uint8_t* shared_secret, uint8_t* dest, const uint8_t* src, int src_len, const uint8_t* assoc, int assoc_len);
+
+  /**
+   * \brief  stream mode counterpart of MACThenDecrypt(). Decrypts, then checks the MAC (in leading bytes of 'src').
+   * \returns  zero if MAC is invalid, otherwise the length of decrypted bytes in 'dest' (exact, no padding)
+  */
+  static int decryptSIV(const uint8_t* shared_secret, uint8_t* dest, const uint8_t* src, int src_len, const uint8_t* assoc, int assoc_len);
+
+  /**
+   * \brief  derive the separate cipher and MAC keys that encryptSIV()/decryptSIV() use, eg. to cache them per channel
+   * \param  enc_key  OUT - must be CIPHER_KEY_SIZE bytes
+   * \param  mac_key  OUT - must be CIPHER_SIV_MAC_KEY_SIZE bytes
+  */
+  static void deriveSIVKeys(const uint8_t* shared_secret, uint8_t* enc_key, uint8_t* mac_key);
+
+  /**
+   * \brief  same as above, but with keys already derived by deriveSIVKeys()
+  */
+  static int encryptSIV(const uint8_t* enc_key, const uint8_t* mac_key, uint8_t* dest, const uint8_t* src, int src_len, const uint8_t* assoc, int assoc_len);
+  static int decryptSIV(const uint8_t* enc_key, const uint8_t* mac_key, uint8_t* dest, const uint8_t* src, int src_len, const uint8_t* assoc, int assoc_len);
+
+  /**
+   * \brief  zeroes 'len' bytes at 'dest', in a way the compiler won't optimise away (eg. for wiping secrets)
+  */
+  static void secureZero(void* dest, size_t len);
+
   /**
    * \brief  converts 'src' bytes with given length to Hex representation, and null terminates.
   */
@@ -0,0 +1,45 @@
+#include "AdminProtocol.h"
+#include <string.h>
+
+bool AdminBatchWriter::addCommand(uint8_t opcode, const void* params, uint8_t params_len) {
+  if (_len + 2 + params_len > _max_len || _dest[0] == 0xFF) return false;
+
+  _dest[_len++] = opcode;
+  _dest[_len++] = params_len;
+  if (params_len > 0) memcpy(&_dest[_len], params, params_len);
+  _len += params_len;
+  _dest[0]++;
+  return true;
+}
+
+bool AdminBatchWriter::addResult(uint8_t opcode, uint8_t status, const void* result, uint8_t result_len) {
+  if (_len + 3 + result_len > _max_len) {
+    if (result_len == 0 || _len + 3 > _max_len) return false;
+    status = ADMIN_ERR_NO_ROOM;   // at least report that it was done
+    result_len = 0;
+  }
+  if (_dest[0] == 0xFF) return false;
+
+  _dest[_len++] = opcode;
+  _dest[_len++] = status;
+  _dest[_len++] = result_len;
+  if (result_len > 0) memcpy(&_dest[_len], result, result_len);
+  _len += result_len;
+  _dest[0]++;
+  return true;
+}
+
+bool AdminBatchReader::next(uint8_t& opcode, uint8_t& status, const uint8_t*& data, uint8_t& data_len) {
+  int hdr = _is_results ? 3 : 2;
+  if (_remaining == 0 || _pos + hdr > _len) return false;
+
+  opcode = _src[_pos++];
+  status = _is_results ? _src[_pos++] : ADMIN_OK;
+  data_len = _src[_pos++];
+  if (_pos + data_len > _len) { _remaining = 0; return false; }   // truncated
+
+  data = &_src[_pos];
+  _pos += data_len;
+  _remaining--;
+  return true;
+}
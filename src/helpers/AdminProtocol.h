@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Binary admin command protocol, carried in a REQ (after the timestamp and CMD_ADMIN byte), with all the
+ * results in the one RESPONSE (or path return). So no separate ACK, or reply TXT_MSG, per command.
+ *
+ *   request:  count(1), then per command:  opcode(1), param_len(1), params
+ *   response: count(1), then per command:  opcode(1), status(1), result_len(1), result
+ *
+ * Params and results are little-endian, with a fixed layout per opcode (see below).
+ */
+#define CMD_ADMIN       0x06    // the REQ command byte, for a batch of admin commands
+
+// opcodes                        params                        result
+#define ADMIN_OP_GET_VERSION   0x01   // -                             text (no NUL)
+#define ADMIN_OP_REBOOT        0x02   // -                             -   (after the response is sent)
+#define ADMIN_OP_SEND_ADVERT   0x03   // -                             -
+#define ADMIN_OP_GET_CLOCK     0x04   // -                             uint32 epoch secs
+#define ADMIN_OP_SYNC_CLOCK    0x05   // -  (uses request timestamp)   uint32 epoch secs
+#define ADMIN_OP_SET_AIRTIME   0x06   // uint16 factor x100            -
+#define ADMIN_OP_SET_FLOOD_HOPS 0x07  // uint8 payload_type, uint8 hops  -
+#define ADMIN_OP_GET_QUEUE     0x08   // -                             per traffic class: uint32 sent, uint32 dropped, uint32 max_latency_millis
+#define ADMIN_OP_SET_TRACE     0x09   // uint8 on                      -
+
+// status codes
+#define ADMIN_OK               0
+#define ADMIN_ERR_UNKNOWN      1    // unknown (or unsupported) opcode
+#define ADMIN_ERR_PARAM        2    // missing or invalid params
+#define ADMIN_ERR_FAILED       3    // eg. clock cannot go backwards
+#define ADMIN_ERR_NO_ROOM      4    // result didn't fit in response
+
+#define ADMIN_MAX_RESPONSE    92    // (after 4 byte timestamp) fits in a path return, even via a long path
+
+/**
+ * \brief  builds a batch of admin commands (client side), or the batch of results (server side)
+ */
+class AdminBatchWriter {
+  uint8_t* _dest;
+  int _max_len, _len;
+
+public:
+  AdminBatchWriter(uint8_t* dest, int max_len) : _dest(dest), _max_len(max_len), _len(1) { dest[0] = 0; }
+
+  /**
+   * \brief  append a command (opcode + params), or a result (pass opcode, status, and result as 'data')
+   * \returns  false if it won't fit
+   */
+  bool addCommand(uint8_t opcode, const void* params=NULL, uint8_t params_len=0);
+  bool addResult(uint8_t opcode, uint8_t status, const void* result=NULL, uint8_t result_len=0);
+
+  int getCount() const { return _dest[0]; }
+  int getLength() const { return _len; }
+  int getRemaining() const { return _max_len - _len; }
+
+  /**
+   * \brief  (server side) check BEFORE running a command, so that the result of a command which has run is never lost
+   * \returns  true if at least a (status only) result can still be added
+   */
+  bool canAddResult() const { return getRemaining() >= 3 && _dest[0] < 0xFF; }
+};
+
+/**
+ * \brief  iterates over a batch of commands (server side), or results (client side)
+ */
+class AdminBatchReader {
+  const uint8_t* _src;
+  int _len, _pos, _remaining;
+  bool _is_results;
+
+public:
+  AdminBatchReader(const uint8_t* src, int len, bool is_results)
+    : _src(src), _len(len), _pos(1), _remaining(len > 0 ? src[0] : 0), _is_results(is_results) { }
+
+  /**
+   * \param  status  OUT - only for results
+   * \returns  false when no more (or malformed)
+   */
+  bool next(uint8_t& opcode, uint8_t& status, const uint8_t*& data, uint8_t& data_len);
+};
@@ -8,8 +8,17 @@
       memcpy(&app_data[i], &_lat, 4); i += 4;
       memcpy(&app_data[i], &_lon, 4); i += 4;
     }
-    // TODO:  BATTERY encoding
-    // TODO:  TEMPERATURE encoding
+    // status fields are only included if they won't cost any of the name
+    int name_len = _name ? strlen(_name) : 0;
+    if (_batt_mv && i + 2 + name_len <= MAX_ADVERT_DATA_SIZE) {
+      app_data[0] |= ADV_BATTERY_MASK;
+      memcpy(&app_data[i], &_batt_mv, 2); i += 2;
+    }
+    if ((_temperature != ADV_TEMPERATURE_UNKNOWN || _load != ADV_LOAD_UNKNOWN) && i + 2 + name_len <= MAX_ADVERT_DATA_SIZE) {
+      app_data[0] |= ADV_TEMPERATURE_MASK;
+      app_data[i++] = (uint8_t) _temperature;
+      app_data[i++] = _load;
+    }
     if (_name && *_name != 0) { 
       app_data[0] |= ADV_NAME_MASK;
       const char* sp = _name;
@@ -21,37 +30,39 @@
   }
 
   AdvertDataParser::AdvertDataParser(const uint8_t app_data[], uint8_t app_data_len) {
-    _name[0] = 0;
-    _lat = _lon = 0;
-    _flags = app_data[0];
-    _valid = false;
+    _data = app_data;
+    _flags = app_data_len > 0 ? app_data[0] : 0;
+    _batt_ofs = _temp_ofs = _name_ofs = 0;
+    _name_len = 0;
 
     int i = 1;
-    if (_flags & ADV_LATLON_MASK) {
-      memcpy(&_lat, &app_data[i], 4); i += 4;
-      memcpy(&_lon, &app_data[i], 4); i += 4;
-    }
+    if (_flags & ADV_LATLON_MASK) i += 8;
     if (_flags & ADV_BATTERY_MASK) {
-      /* TODO: somewhere to store battery volts? */ i += 2;
+      _batt_ofs = i; i += 2;
     }
     if (_flags & ADV_TEMPERATURE_MASK) {
-      /* TODO: somewhere to store temperature? */ i += 2;
+      _temp_ofs = i; i += 2;
     }
 
-    if (app_data_len >= i) {
+    _valid = app_data_len >= i;
+    if (!_valid) {
+      _batt_ofs = _temp_ofs = 0;    // don't read past app_data
+      _flags &= 0x0F;
+    } else if (_flags & ADV_NAME_MASK) {
+      _name_ofs = i;
       int nlen = 0;
-      if (_flags & ADV_NAME_MASK) {
-        nlen = app_data_len - i;  // remainder of app_data
-      }
-      if (nlen > 0) {
-        memcpy(_name, &app_data[i], nlen);
-        _name[nlen] = 0;  // set null terminator
-  MESH_DEBUG_PRINTLN("AdvertDataParser: _flags=%u, _name=%s", (uint32_t)_flags, _name);
-      }
-      _valid = true;
+      while (i + nlen < app_data_len && app_data[i + nlen] != 0) nlen++;   // (older nodes might null terminate)
+      _name_len = nlen;
     }
   }
 
+  void AdvertDataParser::copyName(char dest[], int max_len) const {
+    int n = _name_len;
+    if (n > max_len - 1) n = max_len - 1;
+    memcpy(dest, &_data[_name_ofs], n);
+    dest[n] = 0;
+  }
+
 #include <Arduino.h>
 
 void AdvertTimeHelper::formatRelativeTimeDiff(char dest[], int32_t seconds_from_now, bool short_fmt) {
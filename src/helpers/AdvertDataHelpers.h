@@ -10,48 +10,87 @@
 #define ADV_TYPE_ROOM         3
 //FUTURE: 4..15
 
-#define ADV_LATLON_MASK       0x10
-#define ADV_BATTERY_MASK      0x20
-#define ADV_TEMPERATURE_MASK  0x40
-#define ADV_NAME_MASK         0x80
+#define ADV_LATLON_MASK       0x10   // lat, lon: int32 each (degrees x 1E6)
+#define ADV_BATTERY_MASK      0x20   // uint16, millivolts
+#define ADV_TEMPERATURE_MASK  0x40   // int8 temperature (deg C), then uint8 load (percent)
+#define ADV_NAME_MASK         0x80   // remainder of app_data (not null terminated)
+
+#define ADV_TEMPERATURE_UNKNOWN  -128
+#define ADV_LOAD_UNKNOWN         0xFF
 
 class AdvertDataBuilder {
   uint8_t _type;
   const char* _name;
   int32_t _lat, _lon;
+  uint16_t _batt_mv;
+  int8_t _temperature;
+  uint8_t _load;
 public:
-  AdvertDataBuilder(uint8_t adv_type) : _type(adv_type), _name(NULL), _lat(0), _lon(0) { }
-  AdvertDataBuilder(uint8_t adv_type, const char* name) : _type(adv_type), _name(name), _lat(0), _lon(0)  { }
+  AdvertDataBuilder(uint8_t adv_type) : _type(adv_type), _name(NULL), _lat(0), _lon(0) { clearStatus(); }
+  AdvertDataBuilder(uint8_t adv_type, const char* name) : _type(adv_type), _name(name), _lat(0), _lon(0)  { clearStatus(); }
   AdvertDataBuilder(uint8_t adv_type, const char* name, double lat, double lon) : 
-      _type(adv_type), _name(name), _lat(lat * 1E6), _lon(lon * 1E6)  { }
+      _type(adv_type), _name(name), _lat(lat * 1E6), _lon(lon * 1E6)  { clearStatus(); }
+
+  void clearStatus() { _batt_mv = 0; _temperature = ADV_TEMPERATURE_UNKNOWN; _load = ADV_LOAD_UNKNOWN; }
+  void setBattery(uint16_t milli_volts) { _batt_mv = milli_volts; }
+  void setTemperature(int8_t celsius) { _temperature = celsius; }
 
   /**
-   * \brief  encode the given advertisement data.
+   * \param load_pct  how congested this node is (eg. tx queue or airtime utilisation), 0..100
+   */
+  void setLoad(uint8_t load_pct) { _load = load_pct > 100 ? 100 : load_pct; }
+
+  /**
+   * \brief  encode the given advertisement data. The status fields (battery, temperature/load) are left out
+   *         where they would truncate the name.
    * \param app_data  dest array, must be MAX_ADVERT_DATA_SIZE
    * \returns  the encoded length in bytes
    */
   uint8_t encodeTo(uint8_t app_data[]);
 };
 
+/**
+ * \brief  reads fields directly from the app_data it was given (no copies), so app_data must outlive the parser.
+ *        Only the field offsets are worked out up-front, values are decoded on access.
+ */
 class AdvertDataParser {
+  const uint8_t* _data;
   uint8_t _flags;
+  uint8_t _batt_ofs, _temp_ofs, _name_ofs;   // zero if field not present
+  uint8_t _name_len;
   bool _valid;
-  char _name[MAX_ADVERT_DATA_SIZE];
-  int32_t _lat, _lon;
+
+  int32_t readInt32(int ofs) const { int32_t v; memcpy(&v, &_data[ofs], 4); return v; }
+
 public:
   AdvertDataParser(const uint8_t app_data[], uint8_t app_data_len);
 
   bool isValid() const { return _valid; }
   uint8_t getType() const { return _flags & 0x0F; }
 
-  bool hasName() const { return _name[0] != 0; }
-  const char* getName() const { return _name; }
+  bool hasName() const { return _name_len > 0; }
+  const char* getNameChars() const { return (const char *) &_data[_name_ofs]; }   // NOTE: not null terminated!
+  int getNameLen() const { return _name_len; }
+
+  /**
+   * \brief  copy the name to dest, with null terminator (truncated if necessary)
+   */
+  void copyName(char dest[], int max_len) const;
+
+  bool hasLatLon() const { return (_flags & ADV_LATLON_MASK) && !(getIntLat() == 0 && getIntLon() == 0); }
+  int32_t getIntLat() const { return (_flags & ADV_LATLON_MASK) ? readInt32(1) : 0; }
+  int32_t getIntLon() const { return (_flags & ADV_LATLON_MASK) ? readInt32(5) : 0; }
+  double getLat() const { return ((double)getIntLat()) / 1000000.0; }
+  double getLon() const { return ((double)getIntLon()) / 1000000.0; }
+
+  bool hasBattery() const { return _batt_ofs != 0; }
+  uint16_t getBattMilliVolts() const { uint16_t mv = 0; if (_batt_ofs) memcpy(&mv, &_data[_batt_ofs], 2); return mv; }
+
+  bool hasTemperature() const { return _temp_ofs != 0 && (int8_t) _data[_temp_ofs] != ADV_TEMPERATURE_UNKNOWN; }
+  int8_t getTemperature() const { return _temp_ofs ? (int8_t) _data[_temp_ofs] : ADV_TEMPERATURE_UNKNOWN; }
 
-  bool hasLatLon() const { return !(_lat == 0 && _lon == 0); }
-  int32_t getIntLat() const { return _lat; }
-  int32_t getIntLon() const { return _lon; }
-  double getLat() const { return ((double)_lat) / 1000000.0; }
-  double getLon() const { return ((double)_lon) / 1000000.0; }
+  bool hasLoad() const { return _temp_ofs != 0 && _data[_temp_ofs + 1] <= 100; }
+  uint8_t getLoad() const { return hasLoad() ? _data[_temp_ofs + 1] : ADV_LOAD_UNKNOWN; }
 };
 
 class AdvertTimeHelper {
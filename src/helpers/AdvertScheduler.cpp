@@ -0,0 +1,72 @@
+#include "AdvertScheduler.h"
+
+AdvertScheduler::AdvertScheduler(mesh::MillisecondClock& ms, mesh::RNG& rng) : _ms(&ms), _rng(&rng) {
+  _interval = 0;
+  _next_periodic = 0;
+  _last_sent = _last_echo = 0;
+  _last_sent_timestamp = 0;
+  _pending = ADVERT_REASON_NONE;
+  _has_sent = _has_echo = false;
+  _n_suppressed = 0;
+}
+
+void AdvertScheduler::scheduleNextPeriodic() {
+  if (_interval == 0) return;
+
+  // random point in [interval - jitter, interval + jitter]
+  uint32_t jitter = _interval / 100 * ADVERT_JITTER_PCT;
+  _next_periodic = _ms->getMillis() + _interval - jitter + _rng->nextInt(0, 2*jitter + 1);
+}
+
+uint32_t AdvertScheduler::getMillisUntilPeriodic() const {
+  if (_interval == 0) return ADVERT_NEVER_DUE;
+  long diff = (long)(_next_periodic - _ms->getMillis());
+  return diff > 0 ? diff : 0;
+}
+
+void AdvertScheduler::setInterval(uint32_t interval_mins) {
+  _interval = interval_mins * 60 * 1000;
+  scheduleNextPeriodic();
+}
+
+bool AdvertScheduler::request() {
+  if (_has_echo && !hasElapsed(_last_echo, ADVERT_ECHO_SUPPRESS_SECS*1000)) {
+    _n_suppressed++;
+    return false;   // mesh has our current advert already
+  }
+  if (_pending == ADVERT_REASON_NONE) _pending = ADVERT_REASON_REQUESTED;
+  return true;
+}
+
+void AdvertScheduler::onEchoHeard(uint32_t timestamp) {
+  if (_has_sent && timestamp == _last_sent_timestamp) {   // only our current advert counts
+    _last_echo = _ms->getMillis();
+    _has_echo = true;
+  }
+}
+
+uint8_t AdvertScheduler::isDue(bool can_send) {
+  if (_pending == ADVERT_REASON_NONE && _interval > 0 && (long)(_ms->getMillis() - _next_periodic) >= 0) {
+    if (_has_echo && !hasElapsed(_last_echo, ADVERT_ECHO_SUPPRESS_SECS*1000)) {
+      _n_suppressed++;
+      scheduleNextPeriodic();   // mesh has our current advert already, skip this one
+    } else {
+      _pending = ADVERT_REASON_PERIODIC;
+    }
+  }
+  if (_pending == ADVERT_REASON_NONE) return ADVERT_REASON_NONE;
+
+  if (_has_sent && !hasElapsed(_last_sent, ADVERT_MIN_GAP_SECS*1000)) return ADVERT_REASON_NONE;   // too soon after last
+  if (!can_send) return ADVERT_REASON_NONE;   // wait for channel/airtime budget
+
+  return _pending;
+}
+
+void AdvertScheduler::onAdvertSent(uint32_t timestamp) {
+  _last_sent = _ms->getMillis();
+  _last_sent_timestamp = timestamp;
+  _has_sent = true;
+  _has_echo = false;
+  _pending = ADVERT_REASON_NONE;
+  scheduleNextPeriodic();
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <Dispatcher.h>
+
+#ifndef ADVERT_JITTER_PCT
+  #define ADVERT_JITTER_PCT          20   // periodic adverts are randomly spread over +/- this % of the interval
+#endif
+#ifndef ADVERT_MIN_GAP_SECS
+  #define ADVERT_MIN_GAP_SECS        60   // minimum time between any two adverts (ie. even change-triggered)
+#endif
+#ifndef ADVERT_ECHO_SUPPRESS_SECS
+  #define ADVERT_ECHO_SUPPRESS_SECS  (15*60)   // non-urgent adverts are suppressed if our last was heard re-flooded this recently
+#endif
+#ifndef ADVERT_MAX_QUEUED
+  #define ADVERT_MAX_QUEUED           1   // only advertise when the send queue is (nearly) empty
+#endif
+
+#define ADVERT_NEVER_DUE          0xFFFFFFFF
+
+// reasons, for isDue()
+#define ADVERT_REASON_NONE        0
+#define ADVERT_REASON_PERIODIC    1
+#define ADVERT_REASON_CHANGED     2   // name/location etc changed
+#define ADVERT_REASON_REQUESTED   3   // eg. the 'advert' CLI command
+
+/**
+ * \brief  Decides when a node should send its own Advertisement: periodically (with random jitter, so nodes
+ *        don't synchronise), promptly after its name/location changes, or on request. Periodic and requested adverts
+ *        are suppressed if the node's current advert was recently heard re-flooded (ie. the mesh already has it),
+ *        and all adverts wait for the airtime budget / send queue to allow them.
+ */
+class AdvertScheduler {
+  mesh::MillisecondClock* _ms;
+  mesh::RNG* _rng;
+  uint32_t _interval;    // millis, zero if no periodic adverts
+  unsigned long _next_periodic;
+  unsigned long _last_sent;    // millis
+  unsigned long _last_echo;    // millis
+  uint32_t _last_sent_timestamp;   // RTC timestamp of our last advert
+  uint8_t _pending;     // one of ADVERT_REASON_*
+  bool _has_sent, _has_echo;
+  uint32_t _n_suppressed;
+
+  bool hasElapsed(unsigned long since, uint32_t millis) const { return (unsigned long)(_ms->getMillis() - since) >= millis; }
+  void scheduleNextPeriodic();
+
+public:
+  AdvertScheduler(mesh::MillisecondClock& ms, mesh::RNG& rng);
+
+  /**
+   * \param interval_mins  period of automatic adverts, or zero to disable
+   */
+  void setInterval(uint32_t interval_mins);
+
+  /**
+   * \brief  node's name/location etc has changed, so advertise as soon as allowed
+   */
+  void onChanged() { _pending = ADVERT_REASON_CHANGED; }
+
+  /**
+   * \brief  an advert has been asked for (eg. by an admin)
+   * \returns  false if suppressed, ie. our current advert was recently heard re-flooded
+   */
+  bool request();
+
+  /**
+   * \brief  an (verified) echo of one of our own adverts was heard (re-flooded by a neighbour)
+   */
+  void onEchoHeard(uint32_t timestamp);
+
+  /**
+   * \param  can_send  whether the airtime budget/send queue permits sending now
+   * \returns  one of ADVERT_REASON_*, if an advert should be sent now
+   */
+  uint8_t isDue(bool can_send);
+
+  /**
+   * \brief  must be called whenever this node sends its advert
+   * \param  timestamp  the advert's (RTC) timestamp, ie. Mesh::getAdvertTimestamp()
+   */
+  void onAdvertSent(uint32_t timestamp);
+
+  /**
+   * \returns  millis until next periodic advert (zero if due), or ADVERT_NEVER_DUE if disabled. (eg. to carry across a deep sleep)
+   */
+  uint32_t getMillisUntilPeriodic() const;
+
+  /**
+   * \returns  true if a changed/requested advert is waiting to be sent
+   */
+  bool isPending() const { return _pending != ADVERT_REASON_NONE; }
+
+  /**
+   * \brief  restore the periodic schedule, eg. after a deep sleep
+   */
+  void resumePeriodic(uint32_t millis_from_now) { if (_interval > 0) _next_periodic = _ms->getMillis() + millis_from_now; }
+
+  uint32_t getNumSuppressed() const { return _n_suppressed; }
+};
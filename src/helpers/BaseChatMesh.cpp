@@ -1,7 +1,7 @@
 #include <helpers/BaseChatMesh.h>
 #include <Utils.h>
 
-mesh::Packet* BaseChatMesh::createSelfAdvert(const char* name) {
+mesh::Packet* BaseChatMesh::createSelfAdvert(const char* name, bool compact) {
   uint8_t app_data[MAX_ADVERT_DATA_SIZE];
   uint8_t app_data_len;
   {
@@ -9,7 +9,7 @@ mesh::Packet* BaseChatMesh::createSelfAdvert(const char* name) {
     app_data_len = builder.encodeTo(app_data);
   }
 
-  return createAdvert(self_id, app_data, app_data_len);
+  return createAdvert(self_id, app_data, app_data_len, compact);
 }
 
 void BaseChatMesh::onAdvertRecv(mesh::Packet* packet, const mesh::Identity& id, uint32_t timestamp, const uint8_t* app_data, size_t app_data_len) {
@@ -38,6 +38,7 @@ void BaseChatMesh::onAdvertRecv(mesh::Packet* packet, const mesh::Identity& id,
       from = &contacts[num_contacts++];
       from->id = id;
       from->out_path_len = -1;  // initially out_path is unknown
+      from->send_window = 0;  // use default
       // only need to calculate the shared_secret once, for better performance
       self_id.calcSharedSecret(from->shared_secret, id);
     } else {
@@ -47,9 +48,9 @@ void BaseChatMesh::onAdvertRecv(mesh::Packet* packet, const mesh::Identity& id,
   }
 
   // update
-  strncpy(from->name, parser.getName(), sizeof(from->name)-1);
-  from->name[sizeof(from->name)-1] = 0;
+  parser.copyName(from->name, sizeof(from->name));
   from->type = parser.getType();
+  from->load = parser.getLoad();
   from->last_advert_timestamp = timestamp;
 
   onDiscoveredContact(*from, is_new);       // let UI know
@@ -65,6 +66,16 @@ int BaseChatMesh::searchPeersByHash(const uint8_t* hash) {
   return n;
 }
 
+bool BaseChatMesh::lookupIdentityByPrefix(const uint8_t* prefix, uint8_t prefix_len, mesh::Identity& id) {
+  for (int i = 0; i < num_contacts; i++) {
+    if (memcmp(contacts[i].id.pub_key, prefix, prefix_len) == 0) {
+      id = contacts[i].id;
+      return true;
+    }
+  }
+  return false;  // not known
+}
+
 void BaseChatMesh::getPeerSharedSecret(uint8_t* dest_secret, int peer_idx) {
   int i = matching_peer_indexes[peer_idx];
   if (i >= 0 && i < num_contacts) {
@@ -76,7 +87,14 @@ void BaseChatMesh::getPeerSharedSecret(uint8_t* dest_secret, int peer_idx) {
 }
 
 void BaseChatMesh::onPeerDataRecv(mesh::Packet* packet, uint8_t type, int sender_idx, const uint8_t* secret, uint8_t* data, size_t len) {
-  if (type == PAYLOAD_TYPE_TXT_MSG && len > 5) {
+  if (type == PAYLOAD_TYPE_MULTIPART) {
+    int i = matching_peer_indexes[sender_idx];
+    if (i < 0 || i >= num_contacts) {
+      MESH_DEBUG_PRINTLN("onPeerDataRecv: Invalid sender idx: %d", i);
+      return;
+    }
+    onMultipartRecv(packet, i, secret, data, len);
+  } else if (type == PAYLOAD_TYPE_TXT_MSG && len > 5) {
     int i = matching_peer_indexes[sender_idx];
     if (i < 0 || i >= num_contacts) {
       MESH_DEBUG_PRINTLN("onPeerDataRecv: Invalid sender idx: %d", i);
@@ -89,37 +107,101 @@ void BaseChatMesh::onPeerDataRecv(mesh::Packet* packet, uint8_t type, int sender
     memcpy(&timestamp, data, 4);  // timestamp (by sender's RTC clock - which could be wrong)
     uint flags = data[4];   // message attempt number, and other flags
 
-    // len can be > original length, but 'text' will be padded with zeroes
-    data[len] = 0; // need to make a C string again, with null terminator
+    if (((flags & ~TXT_FLAG_COMPRESSED) >> 2) == TXT_TYPE_POST_BATCH) {   // batch of room posts (binary, never compressed)
+      onPostBatchRecv(packet, from, secret, data, len);
+      return;
+    }
+
+    if (!TextCompressor::decodeTextPayload(data, len, MAX_TEXT_LEN)) {  // also makes a C string again, with null terminator
+      MESH_DEBUG_PRINTLN("onPeerDataRecv: invalid compressed text");
+      return;
+    }
 
     //if ( ! alreadyReceived timestamp ) {
-    if ((flags >> 2) == 0) {   // plain text msg?
+    if (((flags & ~TXT_FLAG_COMPRESSED) >> 2) == 0) {   // plain text msg?
       onMessageRecv(from, packet->isRouteFlood(), timestamp, (const char *) &data[5]);  // let UI know
 
       uint32_t ack_hash;    // calc truncated hash of the message timestamp + text + sender pub_key, to prove to sender that we got it
       mesh::Utils::sha256((uint8_t *) &ack_hash, 4, data, 5 + strlen((char *)&data[5]), from.id.pub_key, PUB_KEY_SIZE);
+      sendAckTo(packet, from, secret, ack_hash);
+    } else {
+      MESH_DEBUG_PRINTLN("onPeerDataRecv: unsupported message type: %u", (uint32_t) (flags >> 2));
+    }
+  } else if (type == PAYLOAD_TYPE_RESPONSE && len > 4) {
+    int i = matching_peer_indexes[sender_idx];
+    if (i < 0 || i >= num_contacts) {
+      MESH_DEBUG_PRINTLN("onPeerDataRecv: Invalid sender idx: %d", i);
+      return;
+    }
+    onContactResponse(contacts[i], data, len);
+
+    if (packet->isRouteFlood()) {
+      // let responder know path TO here, so they can use sendDirect() for future responses
+      sendPathReturn(packet, contacts[i].id, secret, 0, NULL, 0);
+    }
+  }
+}
 
-      if (packet->isRouteFlood()) {
-        // let this sender know path TO here, so they can use sendDirect(), and ALSO encode the ACK
-        mesh::Packet* path = createPathReturn(from.id, secret, packet->path, packet->path_len,
-                                                PAYLOAD_TYPE_ACK, (uint8_t *) &ack_hash, 4);
-        if (path) sendFlood(path);
+void BaseChatMesh::sendAckTo(mesh::Packet* packet, const ContactInfo& from, const uint8_t* secret, uint32_t ack_hash) {
+  if (packet->isRouteFlood()) {
+    // let this sender know path TO here, so they can use sendDirect(), and ALSO encode the ACK
+    sendPathReturn(packet, from.id, secret, PAYLOAD_TYPE_ACK, (uint8_t *) &ack_hash, 4);
+  } else {
+    mesh::Packet* ack = createAck(ack_hash);
+    if (ack) {
+      if (from.out_path_len < 0) {
+        sendFlood(ack);
       } else {
-        mesh::Packet* ack = createAck(ack_hash);
-        if (ack) {
-          if (from.out_path_len < 0) {
-            sendFlood(ack);
-          } else {
-            sendDirect(ack, from.out_path, from.out_path_len);
-          }
-        }
+        sendDirect(ack, from.out_path, from.out_path_len);
       }
-    } else {
-      MESH_DEBUG_PRINTLN("onPeerDataRecv: unsupported message type: %u", (uint32_t) (flags >> 2));
     }
   }
 }
 
+void BaseChatMesh::onPostBatchRecv(mesh::Packet* packet, ContactInfo& from, const uint8_t* secret, const uint8_t* data, size_t len) {
+  PostBatchReader batch(data, len);
+  if (!batch.isValid()) {
+    MESH_DEBUG_PRINTLN("onPostBatchRecv: malformed batch");
+    return;   // no ACK, room will resend
+  }
+
+  uint32_t post_timestamp;
+  const uint8_t* author_prefix;
+  char text[MAX_PACKET_PAYLOAD];
+  while (batch.next(post_timestamp, author_prefix, text)) {
+    onRoomPostRecv(from, packet->isRouteFlood(), post_timestamp, author_prefix, text);  // let UI know
+  }
+
+  // one (cumulative) ACK for whole batch, over the content (not the padding)
+  uint32_t ack_hash;
+  mesh::Utils::sha256((uint8_t *) &ack_hash, 4, data, batch.getContentLen(), from.id.pub_key, PUB_KEY_SIZE);
+  sendAckTo(packet, from, secret, ack_hash);
+}
+
+void BaseChatMesh::onRoomPostRecv(const ContactInfo& room, bool was_flood, uint32_t post_timestamp, const uint8_t* author_prefix, const char* text) {
+  char msg[9 + MAX_PACKET_PAYLOAD];
+  mesh::Utils::toHex(msg, author_prefix, POST_BATCH_AUTHOR_PREFIX);
+  msg[8] = ':';
+  strcpy(&msg[9], text);
+  onMessageRecv(room, was_flood, post_timestamp, msg);
+}
+
+mesh::Packet* BaseChatMesh::createRoomLogin(const ContactInfo& room, uint32_t sync_since, const char* password) {
+  uint8_t temp[8 + 16 + 2];
+  uint32_t now = getRTCClock()->getCurrentTime();   // important, need timestamp in packet, so that packet_hash will be unique
+  memcpy(temp, &now, 4);
+  memcpy(&temp[4], &sync_since, 4);
+
+  int pw_len = strlen(password);
+  if (pw_len > 16) pw_len = 16;
+  memcpy(&temp[8], password, pw_len);
+  int len = 8 + pw_len;
+  temp[len++] = 0;   // terminator, then our capabilities (older rooms ignore these)
+  temp[len++] = ROOM_LOGIN_CAP_POST_BATCH;
+
+  return createAnonDatagram(PAYLOAD_TYPE_ANON_REQ, self_id, room.id, room.shared_secret, temp, len);
+}
+
 bool BaseChatMesh::onPeerPathRecv(mesh::Packet* packet, int sender_idx, const uint8_t* secret, uint8_t* path, uint8_t path_len, uint8_t extra_type, uint8_t* extra, uint8_t extra_len) {
   int i = matching_peer_indexes[sender_idx];
   if (i < 0 || i >= num_contacts) {
@@ -129,90 +211,485 @@ bool BaseChatMesh::onPeerPathRecv(mesh::Packet* packet, int sender_idx, const ui
 
   ContactInfo& from = contacts[i];
 
-  // NOTE: for this impl, we just replace the current 'out_path' regardless, whenever sender sends us a new out_path.
-  // FUTURE: could store multiple out_paths per contact, and try to find which is the 'best'(?)
-  memcpy(from.out_path, path, from.out_path_len = path_len);  // store a copy of path, for sendDirect()
-
-  onContactPathUpdated(from);
+  // keep this path as one of the candidates, then use whichever is now the 'best' as the out_path
+  routes.putRoute(i, path, path_len, getOutboundPathHashSize(), getRTCClock()->getCurrentTime());   // path is of a flood WE sent, so has our hash size
+  updateOutPath(from, i);
 
   if (extra_type == PAYLOAD_TYPE_ACK && extra_len >= 4) {
     // also got an encoded ACK!
-    if (processAck(extra)) {
-      txt_send_timeout = 0;   // matched one we're waiting for, cancel timeout timer
+    if (!processPendingAck(extra)) {
+      processAck(extra);
     }
+  } else if (extra_type == PAYLOAD_TYPE_MULTIPART) {
+    // also got an encoded SACK
+    processSack(i, extra, extra_len);
+  } else if (extra_type == PAYLOAD_TYPE_RESPONSE && extra_len > 4) {
+    onContactResponse(from, extra, extra_len);
   }
   return true;  // send reciprocal path if necessary
 }
 
 void BaseChatMesh::onAckRecv(mesh::Packet* packet, uint32_t ack_crc) {
-  if (processAck((uint8_t *)&ack_crc)) {
-    txt_send_timeout = 0;   // matched one we're waiting for, cancel timeout timer
+  if (processPendingAck((uint8_t *)&ack_crc) || processAck((uint8_t *)&ack_crc)) {
     packet->markDoNotRetransmit();   // ACK was for this node, so don't retransmit
   }
 }
 
-#ifdef MAX_GROUP_CHANNELS
-int BaseChatMesh::searchChannelsByHash(const uint8_t* hash, mesh::GroupChannel dest[], int max_matches) {
-  int n = 0;
-  for (int i = 0; i < num_channels && n < max_matches; i++) {
-    if (channels[i].hash[0] == hash[0]) {
-      dest[n++] = channels[i];
+bool BaseChatMesh::processPendingAck(const uint8_t *data) {
+  for (int i = 0; i < MAX_PENDING_MSGS; i++) {
+    auto msg = &pending_msgs[i];
+    if (!msg->in_use || !msg->is_sent) continue;
+
+    for (int a = 0; a <= msg->attempt; a++) {
+      if (memcmp(data, &msg->expected_acks[a], 4) == 0) {   // got an ACK from recipient
+        if (a == msg->attempt) {
+          routes.recordResult(msg->route_idx, msg->contact_idx, true);
+        }
+        uint32_t msg_id = msg->msg_id;
+        msg->in_use = false;   // free this slot, BEFORE notifying app (which may send another)
+        onSendComplete(contacts[msg->contact_idx], msg_id, true, msg->attempt + 1);
+        return true;
+      }
     }
   }
-  return n;
+  return false;
+}
+
+int BaseChatMesh::getContactIdx(const ContactInfo& contact) const {
+  if (&contact >= contacts && &contact < &contacts[num_contacts]) {
+    return &contact - contacts;   // is a ref into our contacts[] table
+  }
+  for (int i = 0; i < num_contacts; i++) {   // otherwise, is a copy
+    if (contacts[i].id.matches(contact.id)) return i;
+  }
+  return -1;  // not found
+}
+
+void BaseChatMesh::updateOutPath(ContactInfo& contact, int contact_idx) {
+  int best = routes.getBestRoute(contact_idx, getRTCClock()->getCurrentTime());
+  if (best >= 0) {
+    auto r = routes.getRoute(best);
+    if (r->path_len == contact.out_path_len && memcmp(r->path, contact.out_path, r->path_len) == 0) return;  // no change
+
+    memcpy(contact.out_path, r->path, contact.out_path_len = r->path_len);  // store a copy of path, for sendDirect()
+  } else {
+    if (contact.out_path_len < 0) return;  // no change
+
+    contact.out_path_len = -1;   // no candidate paths remain, revert to flood
+  }
+  onContactPathUpdated(contact);
+}
+
+#ifdef MAX_GROUP_CHANNELS
+int BaseChatMesh::searchChannelsByHash(const uint8_t* hash) {
+  return channels.search(hash, matching_channel_indexes);
+}
+
+const mesh::GroupChannel* BaseChatMesh::getMatchingChannel(int match_idx) {
+  return channels.getChannel(matching_channel_indexes[match_idx]);
+}
+
+int BaseChatMesh::decryptChannelData(const mesh::Packet* packet, int match_idx, uint8_t* dest) {
+  // use the cached cipher state (V1), or derived keys (V2)
+  int idx = matching_channel_indexes[match_idx];
+  if (packet->getPayloadVer() == PAYLOAD_VER_1) {
+    return channels.MACThenDecrypt(idx, dest, &packet->payload[PATH_HASH_SIZE], packet->payload_len - PATH_HASH_SIZE);
+  }
+  uint8_t assoc[1 + PATH_HASH_SIZE];   // same as Mesh::decryptPayload()
+  assoc[0] = packet->getPayloadType();
+  memcpy(&assoc[1], packet->payload, PATH_HASH_SIZE);
+  return channels.decryptSIV(idx, dest, &packet->payload[PATH_HASH_SIZE], packet->payload_len - PATH_HASH_SIZE, assoc, sizeof(assoc));
 }
 #endif
 
 void BaseChatMesh::onGroupDataRecv(mesh::Packet* packet, uint8_t type, const mesh::GroupChannel& channel, uint8_t* data, size_t len) {
-  uint8_t txt_type = data[4];
+  uint8_t txt_type = data[4] & ~TXT_FLAG_COMPRESSED;
   if (type == PAYLOAD_TYPE_GRP_TXT && len > 5 && (txt_type >> 2) == 0) {  // 0 = plain text msg
     uint32_t timestamp;
     memcpy(&timestamp, data, 4);
 
-    // len can be > original length, but 'text' will be padded with zeroes
-    data[len] = 0; // need to make a C string again, with null terminator
+    if (!TextCompressor::decodeTextPayload(data, len, MAX_TEXT_LEN)) {  // also makes a C string again, with null terminator
+      MESH_DEBUG_PRINTLN("onGroupDataRecv: invalid compressed text");
+      return;
+    }
 
     // notify UI  of this new message
     onChannelMessageRecv(channel, packet->isRouteFlood() ? packet->path_len : -1, timestamp, (const char *) &data[5]);  // let UI know
   }
 }
 
-mesh::Packet* BaseChatMesh::composeMsgPacket(const ContactInfo& recipient, uint8_t attempt, const char *text, uint32_t& expected_ack) {
+int BaseChatMesh::encodeText(uint8_t* data, uint32_t timestamp, uint8_t flags, const char* text, uint32_t* expected_ack) {
   int text_len = strlen(text);
-  if (text_len > MAX_TEXT_LEN) return NULL;
 
-  uint8_t temp[5+MAX_TEXT_LEN+1];
-  uint32_t timestamp = getRTCClock()->getCurrentTime();
-  memcpy(temp, &timestamp, 4);   // mostly an extra blob to help make packet_hash unique
-  temp[4] = (attempt & 3);
-  memcpy(&temp[5], text, text_len + 1);
+  memcpy(data, &timestamp, 4);   // mostly an extra blob to help make packet_hash unique
+  int packed_len = compress_text ? TextCompressor::compress(&data[5], MAX_TEXT_LEN, text, text_len) : -1;
+  if (packed_len > 0) flags |= TXT_FLAG_COMPRESSED;
+  data[4] = flags;
+
+  if (expected_ack) {
+    // calc expected ACK reply (always over the original text)
+    uint8_t temp[5+MAX_TEXT_LEN];
+    memcpy(temp, data, 5);
+    memcpy(&temp[5], text, text_len);
+    mesh::Utils::sha256((uint8_t *)expected_ack, 4, temp, 5 + text_len, self_id.pub_key, PUB_KEY_SIZE);
+  }
+
+  if (packed_len > 0) return 5 + packed_len;
+
+  memcpy(&data[5], text, text_len);
+  return 5 + text_len;
+}
+
+mesh::Packet* BaseChatMesh::composeMsgPacket(const ContactInfo& recipient, uint32_t timestamp, uint8_t attempt, const char *text, uint32_t& expected_ack) {
+  if (strlen(text) > MAX_TEXT_LEN) return NULL;
+
+  uint8_t temp[5+MAX_TEXT_LEN];
+  int len = encodeText(temp, timestamp, attempt & 3, text, &expected_ack);
+
+  return createDatagram(PAYLOAD_TYPE_TXT_MSG, recipient.id, recipient.shared_secret, temp, len);
+}
+
+uint32_t BaseChatMesh::calcExpectedAck(uint32_t timestamp, uint8_t attempt, const char *text) {
+  uint8_t temp[5+MAX_TEXT_LEN];
+  uint32_t expected_ack;
+  encodeText(temp, timestamp, attempt & 3, text, &expected_ack);
+  return expected_ack;
+}
+
+mesh::Packet* BaseChatMesh::composeGroupTextPacket(const mesh::GroupChannel& channel, uint32_t timestamp, const char* text) {
+  if (strlen(text) > MAX_TEXT_LEN) return NULL;
+
+  uint8_t temp[5+MAX_TEXT_LEN];
+  int len = encodeText(temp, timestamp, 0, text, NULL);
+
+  return createGroupDatagram(PAYLOAD_TYPE_GRP_TXT, channel, temp, len);
+}
+
+int  BaseChatMesh::sendMessage(const ContactInfo& recipient, uint8_t attempt, const char* text, uint32_t& msg_id) {
+  if (strlen(text) > MAX_TEXT_LEN) return MSG_SEND_FAILED;
 
-  // calc expected ACK reply
-  mesh::Utils::sha256((uint8_t *)&expected_ack, 4, temp, 5 + text_len, self_id.pub_key, PUB_KEY_SIZE);
+  int contact_idx = getContactIdx(recipient);
+  if (contact_idx < 0) return MSG_SEND_FAILED;   // not in contacts
 
-  return createDatagram(PAYLOAD_TYPE_TXT_MSG, recipient.id, recipient.shared_secret, temp, 5 + text_len);
+  PendingMessage* msg = NULL;
+  for (int i = 0; i < MAX_PENDING_MSGS; i++) {
+    if (!pending_msgs[i].in_use) { msg = &pending_msgs[i]; break; }
+  }
+  if (msg == NULL) {
+    MESH_DEBUG_PRINTLN("sendMessage: too many messages queued or awaiting ACK");
+    return MSG_SEND_FAILED;
+  }
+
+  msg->in_use = true;
+  msg->contact_idx = contact_idx;
+  msg->timestamp = getRTCClock()->getCurrentTime();
+  msg->attempt = attempt < MAX_SEND_ATTEMPTS ? attempt : MAX_SEND_ATTEMPTS - 1;
+  msg->seq = next_msg_seq++;
+  msg->is_sent = false;
+  msg->route_idx = -1;
+  memset(msg->expected_acks, 0, sizeof(msg->expected_acks));
+  strcpy(msg->text, text);
+
+  msg_id = msg->msg_id = msg->expected_acks[msg->attempt] = calcExpectedAck(msg->timestamp, msg->attempt, text);
+
+  const ContactInfo& c = contacts[contact_idx];
+  int window = c.send_window ? c.send_window : DEFAULT_SEND_WINDOW;
+  if (getNumInFlight(contact_idx) < window && isReadyToSend()) {
+    int rc = sendPendingMessage(*msg);
+    if (rc == MSG_SEND_FAILED) msg->in_use = false;  // free slot
+    return rc;
+  }
+  return MSG_SEND_QUEUED;   // will be sent from loop()
+}
+
+int BaseChatMesh::getNumInFlight(int contact_idx) const {
+  int n = 0;
+  for (int i = 0; i < MAX_PENDING_MSGS; i++) {
+    auto msg = &pending_msgs[i];
+    if (msg->in_use && msg->is_sent && msg->contact_idx == contact_idx) n++;
+  }
+  return n;
+}
+
+void BaseChatMesh::sendQueuedMessages() {
+  while (isReadyToSend()) {
+    // find the oldest queued message, whose recipient's send window is not yet full
+    PendingMessage* next = NULL;
+    for (int i = 0; i < MAX_PENDING_MSGS; i++) {
+      auto msg = &pending_msgs[i];
+      if (!msg->in_use || msg->is_sent) continue;
+      if (next && (int32_t)(msg->seq - next->seq) > 0) continue;
+
+      const ContactInfo& c = contacts[msg->contact_idx];
+      int window = c.send_window ? c.send_window : DEFAULT_SEND_WINDOW;
+      if (getNumInFlight(msg->contact_idx) < window) next = msg;
+    }
+    if (next == NULL) return;  // nothing can be sent yet
+
+    if (sendPendingMessage(*next) == MSG_SEND_FAILED) {
+      if (strlen(next->text) <= MAX_TEXT_LEN) break;   // most likely packet pool is (temporarily) empty, retry on next loop()
+
+      uint32_t msg_id = next->msg_id;   // can never be sent
+      next->in_use = false;
+      onSendComplete(contacts[next->contact_idx], msg_id, false, 0);
+    }
+  }
 }
 
-int  BaseChatMesh::sendMessage(const ContactInfo& recipient, uint8_t attempt, const char* text, uint32_t& expected_ack) {
-  mesh::Packet* pkt = composeMsgPacket(recipient, attempt, text, expected_ack);
+int BaseChatMesh::sendPendingMessage(PendingMessage& msg) {
+  const ContactInfo& recipient = contacts[msg.contact_idx];
+
+  mesh::Packet* pkt = composeMsgPacket(recipient, msg.timestamp, msg.attempt, msg.text, msg.expected_acks[msg.attempt]);
   if (pkt == NULL) return MSG_SEND_FAILED;
+  msg.is_sent = true;
 
   uint32_t t = _radio->getEstAirtimeFor(pkt->payload_len + pkt->path_len + 2);
 
+  const uint8_t* path;
+  int path_len;
+  if (msg.attempt >= MAX_SEND_ATTEMPTS - 1) {   // final attempt, fall back to flood
+    msg.route_idx = -1;
+    path = NULL;
+    path_len = -1;
+  } else {
+    msg.route_idx = routes.getBestRoute(msg.contact_idx, getRTCClock()->getCurrentTime());
+    if (msg.route_idx >= 0) {  // use best of the candidate paths
+      auto r = routes.getRoute(msg.route_idx);
+      path = r->path;
+      path_len = r->path_len;
+    } else {   // use the (possibly persisted) out_path
+      path = recipient.out_path;
+      path_len = recipient.out_path_len;
+      if (path_len >= 0) {   // track it as a candidate, so that timeouts penalise it too
+        msg.route_idx = routes.putRoute(msg.contact_idx, path, path_len, getOutboundPathHashSize(), getRTCClock()->getCurrentTime());
+      }
+    }
+  }
+
   int rc;
-  if (recipient.out_path_len < 0) {
+  if (path_len < 0) {
     sendFlood(pkt);
-    txt_send_timeout = futureMillis(calcFloodTimeoutMillisFor(t));
+    msg.ack_timeout = futureMillis(calcFloodTimeoutMillisFor(t));
     rc = MSG_SEND_SENT_FLOOD;
   } else {
-    sendDirect(pkt, recipient.out_path, recipient.out_path_len);
-    txt_send_timeout = futureMillis(calcDirectTimeoutMillisFor(t, recipient.out_path_len));
+    sendDirect(pkt, path, path_len);
+    msg.ack_timeout = futureMillis(calcDirectTimeoutMillisFor(t, path_len));
     rc = MSG_SEND_SENT_DIRECT;
   }
   return rc;
 }
 
+int BaseChatMesh::getNumPendingMessages() const {
+  int n = 0;
+  for (int i = 0; i < MAX_PENDING_MSGS; i++) {
+    if (pending_msgs[i].in_use) n++;
+  }
+  return n;
+}
+
+void BaseChatMesh::checkPendingTimeouts() {
+  for (int i = 0; i < MAX_PENDING_MSGS; i++) {
+    auto msg = &pending_msgs[i];
+    if (!msg->in_use || !msg->is_sent || !millisHasNowPassed(msg->ack_timeout)) continue;
+
+    // failed to get an ACK
+    if (msg->route_idx >= 0) {
+      // penalise this route, so next attempt will use the next best (or flood, if none remain)
+      routes.recordResult(msg->route_idx, msg->contact_idx, false);
+      updateOutPath(contacts[msg->contact_idx], msg->contact_idx);
+    }
+
+    if (msg->attempt + 1 < MAX_SEND_ATTEMPTS) {
+      msg->attempt++;
+      MESH_DEBUG_PRINTLN("checkPendingTimeouts: retrying, attempt=%d", (uint32_t) msg->attempt);
+      if (sendPendingMessage(*msg) == MSG_SEND_FAILED) {
+        msg->is_sent = false;   // (most likely) packet pool is empty, so re-queue this attempt for sendQueuedMessages()
+      }
+      continue;
+    }
+
+    uint32_t msg_id = msg->msg_id;
+    msg->in_use = false;   // give up
+    onSendComplete(contacts[msg->contact_idx], msg_id, false, msg->attempt + 1);
+  }
+}
+
+void BaseChatMesh::sendViaOutPath(mesh::Packet* pkt, const ContactInfo& contact) {
+  if (contact.out_path_len < 0) {
+    sendFlood(pkt);
+  } else {
+    sendDirect(pkt, contact.out_path, contact.out_path_len);
+  }
+}
+
+int BaseChatMesh::sendBlob(const ContactInfo& recipient, const uint8_t* data, size_t len, uint16_t& blob_id) {
+  if (out_blob.data || len == 0 || len > MAX_BLOB_SIZE) return MSG_SEND_FAILED;
+
+  int contact_idx = getContactIdx(recipient);
+  if (contact_idx < 0) return MSG_SEND_FAILED;   // not in contacts
+
+  out_blob.data = data;
+  out_blob.len = len;
+  out_blob.contact_idx = contact_idx;
+  out_blob.msg_id = blob_id = getRNG()->nextInt(1, 0x10000);
+  out_blob.frag_count = (len + FRAG_DATA_SIZE - 1) / FRAG_DATA_SIZE;
+  out_blob.round = 0;
+  out_blob.acked = 0;
+  out_blob.to_send = FragmentHeader::fullMask(out_blob.frag_count);
+  out_blob.sack_timeout = 0;
+  out_blob.start_millis = _ms->getMillis();
+
+  sendBlobFragments();
+  return MSG_SEND_QUEUED;
+}
+
+void BaseChatMesh::sendBlobFragments() {
+  // send ONE fragment at a time, as Dispatcher becomes idle, so as not to flood the outbound queue
+  while (out_blob.data && out_blob.to_send && isReadyToSend()) {
+    int idx = 0;
+    while ((out_blob.to_send & (1UL << idx)) == 0) idx++;
+    out_blob.to_send &= ~(1UL << idx);
+
+    FragmentHeader hdr;
+    hdr.msg_id = out_blob.msg_id;
+    hdr.frag_idx = idx;
+    hdr.frag_count = out_blob.frag_count;
+    hdr.flags = out_blob.round & FRAG_ATTEMPT_MASK;
+    if (out_blob.to_send == 0) hdr.flags |= FRAG_FLAG_POLL;   // last of this round, so ask for a SACK
+    size_t offset = idx * FRAG_DATA_SIZE;
+    hdr.frag_len = (out_blob.len - offset) < FRAG_DATA_SIZE ? (out_blob.len - offset) : FRAG_DATA_SIZE;
+
+    uint8_t temp[FRAG_HEADER_SIZE + FRAG_DATA_SIZE];
+    int len = hdr.writeTo(temp);
+    memcpy(&temp[len], &out_blob.data[offset], hdr.frag_len); len += hdr.frag_len;
+
+    const ContactInfo& recipient = contacts[out_blob.contact_idx];
+    mesh::Packet* pkt = createDatagram(PAYLOAD_TYPE_MULTIPART, recipient.id, recipient.shared_secret, temp, len);
+    if (pkt == NULL) {
+      out_blob.to_send |= (1UL << idx);   // try again later (packet pool exhausted?)
+      return;
+    }
+    uint32_t t = _radio->getEstAirtimeFor(pkt->payload_len + pkt->path_len + 2);
+    if (out_blob.round >= FRAG_MAX_ROUNDS - 1 || recipient.out_path_len < 0) {   // final round is always flood
+      sendFlood(pkt);
+      if (hdr.flags & FRAG_FLAG_POLL) out_blob.sack_timeout = futureMillis(calcFloodTimeoutMillisFor(t));
+    } else {
+      sendDirect(pkt, recipient.out_path, recipient.out_path_len);
+      if (hdr.flags & FRAG_FLAG_POLL) out_blob.sack_timeout = futureMillis(calcDirectTimeoutMillisFor(t, recipient.out_path_len));
+    }
+  }
+}
+
+void BaseChatMesh::checkBlobTimeout() {
+  if (out_blob.data == NULL || out_blob.sack_timeout == 0 || !millisHasNowPassed(out_blob.sack_timeout)) return;
+
+  // no SACK received
+  if (++out_blob.round >= FRAG_MAX_ROUNDS) {
+    completeBlob(false);
+    return;
+  }
+  // re-send just the highest un-ACK'd fragment, as a poll (missing ones will be in the SACK reply)
+  uint32_t missing = FragmentHeader::fullMask(out_blob.frag_count) & ~out_blob.acked;
+  int idx = out_blob.frag_count - 1;
+  while (idx > 0 && (missing & (1UL << idx)) == 0) idx--;
+  out_blob.to_send = 1UL << idx;
+  out_blob.sack_timeout = 0;
+  MESH_DEBUG_PRINTLN("checkBlobTimeout: re-polling, round=%d", (uint32_t) out_blob.round);
+}
+
+void BaseChatMesh::completeBlob(bool delivered) {
+  MESH_DEBUG_PRINTLN("completeBlob: %s, len=%d, frags=%d, rounds=%d, millis=%d", delivered ? "delivered" : "failed",
+      (uint32_t) out_blob.len, (uint32_t) out_blob.frag_count, (uint32_t) out_blob.round + 1, (uint32_t) (_ms->getMillis() - out_blob.start_millis));
+
+  uint16_t blob_id = out_blob.msg_id;
+  out_blob.data = NULL;   // free, BEFORE notifying app (which may send another)
+  onBlobSendComplete(contacts[out_blob.contact_idx], blob_id, delivered);
+}
+
+void BaseChatMesh::processSack(int contact_idx, const uint8_t* data, size_t len) {
+  FragmentHeader hdr;
+  if (!hdr.readFrom(data, len) || !(hdr.flags & FRAG_FLAG_SACK)) return;
+  if (out_blob.data == NULL || out_blob.contact_idx != contact_idx || out_blob.msg_id != hdr.msg_id) return;  // stale
+
+  uint32_t received;
+  memcpy(&received, &data[FRAG_HEADER_SIZE], 4);
+  out_blob.acked |= received;
+  out_blob.to_send &= ~out_blob.acked;
+
+  uint32_t missing = FragmentHeader::fullMask(out_blob.frag_count) & ~out_blob.acked;
+  if (missing == 0) {
+    completeBlob(true);
+  } else if (out_blob.sack_timeout != 0) {   // reply to our poll, start next round with just the missing fragments
+    if (++out_blob.round >= FRAG_MAX_ROUNDS) {
+      completeBlob(false);
+    } else {
+      out_blob.to_send = missing;
+      out_blob.sack_timeout = 0;
+    }
+  }
+}
+
+void BaseChatMesh::onMultipartRecv(mesh::Packet* packet, int contact_idx, const uint8_t* secret, const uint8_t* data, size_t len) {
+  FragmentHeader hdr;
+  if (!hdr.readFrom(data, len)) {
+    MESH_DEBUG_PRINTLN("onMultipartRecv: invalid fragment header");
+    return;
+  }
+  if (hdr.flags & FRAG_FLAG_SACK) {
+    processSack(contact_idx, data, len);
+    return;
+  }
+
+  ContactInfo& from = contacts[contact_idx];
+  unsigned long expires = futureMillis(FRAG_REASSEMBLY_TIMEOUT);
+
+  Reassembly* r = reassembly.find(contact_idx, hdr.msg_id);
+  if (r && !r->is_done && r->frag_count != hdr.frag_count) return;  // inconsistent, ignore
+  if (r == NULL) {
+    r = reassembly.start(contact_idx, hdr.msg_id, hdr.frag_count, expires);
+    if (r == NULL) {
+      MESH_DEBUG_PRINTLN("onMultipartRecv: no room to reassemble, frags=%d", (uint32_t) hdr.frag_count);
+      return;   // sender will re-poll, and hopefully there is room later
+    }
+  }
+
+  bool just_completed = false;
+  if (!r->is_done) {
+    reassembly.putFragment(r, hdr.frag_idx, &data[FRAG_HEADER_SIZE], hdr.frag_len);
+    r->expires = expires;
+    if (reassembly.isComplete(r)) {
+      size_t blob_len;
+      const uint8_t* blob = reassembly.getBlob(r, blob_len);
+      onBlobRecv(from, blob, blob_len);
+      reassembly.finish(r, futureMillis(FRAG_DONE_LINGER));
+      just_completed = true;
+    }
+  }
+
+  if ((hdr.flags & FRAG_FLAG_POLL) || just_completed) {
+    FragmentHeader sack;
+    sack.msg_id = hdr.msg_id;
+    sack.frag_idx = 0;
+    sack.frag_count = hdr.frag_count;
+    sack.flags = FRAG_FLAG_SACK | (hdr.flags & FRAG_ATTEMPT_MASK);
+    sack.frag_len = 4;
+
+    uint8_t temp[FRAG_HEADER_SIZE + 4];
+    int n = sack.writeTo(temp);
+    memcpy(&temp[n], &r->received, 4); n += 4;
+
+    if (packet->isRouteFlood()) {
+      // let sender know path TO here, and ALSO encode the SACK
+      sendPathReturn(packet, from.id, secret, PAYLOAD_TYPE_MULTIPART, temp, n);
+    } else {
+      mesh::Packet* pkt = createDatagram(PAYLOAD_TYPE_MULTIPART, from.id, secret, temp, n);
+      if (pkt) sendViaOutPath(pkt, from);
+    }
+  }
+}
+
 void BaseChatMesh::resetPathTo(ContactInfo& recipient) {
+  routes.removeRoutes(getContactIdx(recipient));
   if (recipient.out_path_len >= 0) {
     recipient.out_path_len = -1;
   }
@@ -258,6 +735,7 @@ bool BaseChatMesh::addContact(const ContactInfo& contact) {
   if (num_contacts < MAX_CONTACTS) {
     auto dest = &contacts[num_contacts++];
     *dest = contact;
+    dest->load = ADV_LOAD_UNKNOWN;   // until next advert
 
     // calc the ECDH shared secret (just once for performance)
     self_id.calcSharedSecret(dest->shared_secret, contact.id);
@@ -271,16 +749,12 @@ bool BaseChatMesh::addContact(const ContactInfo& contact) {
 #include <base64.hpp>
 
 mesh::GroupChannel* BaseChatMesh::addChannel(const char* psk_base64) {
-  if (num_channels < MAX_GROUP_CHANNELS) {
-    auto dest = &channels[num_channels];
-
-    memset(dest->secret, 0, sizeof(dest->secret));
-    int len = decode_base64((unsigned char *) psk_base64, strlen(psk_base64), dest->secret);
-    if (len == 32 || len == 16) {
-      mesh::Utils::sha256(dest->hash, sizeof(dest->hash), dest->secret, len);
-      num_channels++;
-      return dest;
-    }
+  if (strlen(psk_base64) > 48) return NULL;  // too long for a 32 byte key
+
+  uint8_t secret[36];
+  int len = decode_base64((unsigned char *) psk_base64, strlen(psk_base64), secret);
+  if (len == 32 || len == 16) {
+    return channels.add(secret, len);
   }
   return NULL;
 }
@@ -300,9 +774,10 @@ bool ContactsIterator::hasNext(const BaseChatMesh* mesh, ContactInfo& dest) {
 void BaseChatMesh::loop() {
   Mesh::loop();
 
-  if (txt_send_timeout && millisHasNowPassed(txt_send_timeout)) {
-    // failed to get an ACK
-    onSendTimeout();
-    txt_send_timeout = 0;
-  }
+  checkPendingTimeouts();
+  sendQueuedMessages();
+
+  checkBlobTimeout();
+  sendBlobFragments();
+  reassembly.checkExpired(_ms->getMillis());
 }
\ No newline at end of file
@@ -3,6 +3,11 @@
 #include <Arduino.h>   // needed for PlatformIO
 #include <Mesh.h>
 #include <helpers/AdvertDataHelpers.h>
+#include <helpers/RouteTable.h>
+#include <helpers/FragmentHelpers.h>
+#include <helpers/TextCompressor.h>
+#include <helpers/ChannelRegistry.h>
+#include <helpers/PostBatch.h>
 
 #define MAX_TEXT_LEN    (10*CIPHER_BLOCK_SIZE)  // must be LESS than (MAX_PACKET_PAYLOAD - 4 - CIPHER_MAC_SIZE - 1)
 
@@ -11,9 +16,11 @@ struct ContactInfo {
   char name[32];
   uint8_t type;   // on of ADV_TYPE_*
   uint8_t flags;
+  uint8_t send_window;   // max num messages awaiting ACK (0 = DEFAULT_SEND_WINDOW)
   int8_t out_path_len;
   uint8_t out_path[MAX_PATH_SIZE];
   uint32_t last_advert_timestamp;
+  uint8_t load;   // as last advertised, percent (or ADV_LOAD_UNKNOWN). Not persisted
   uint8_t shared_secret[PUB_KEY_SIZE];
 };
 
@@ -22,6 +29,29 @@ struct ContactInfo {
 #define MSG_SEND_FAILED       0
 #define MSG_SEND_SENT_FLOOD   1
 #define MSG_SEND_SENT_DIRECT  2
+#define MSG_SEND_QUEUED       3
+
+#ifndef MAX_PENDING_MSGS
+  #define MAX_PENDING_MSGS    8     // max num outbound messages queued or awaiting ACK
+#endif
+#ifndef DEFAULT_SEND_WINDOW
+  #define DEFAULT_SEND_WINDOW 2     // default max num messages (per contact) awaiting ACK
+#endif
+#define MAX_SEND_ATTEMPTS     4     // NOTE: attempt number is encoded in 2 bits. Final attempt is always sent flood
+
+struct PendingMessage {
+  bool in_use;           // false = unused slot
+  uint32_t msg_id;       // the expected_ack of first attempt (NOTE: can be any value, even zero)
+  uint32_t expected_acks[MAX_SEND_ATTEMPTS];   // per attempt, as ACK from an earlier attempt may arrive late
+  uint32_t timestamp;    // the original send timestamp, retained across attempts
+  uint32_t seq;          // for sending queued messages in order
+  unsigned long ack_timeout;
+  bool is_sent;          // false whilst queued (waiting for send window, or airtime)
+  int contact_idx;
+  int route_idx;         // route used for current attempt, or -1
+  uint8_t attempt;
+  char text[MAX_TEXT_LEN+1];
+};
 
 class ContactVisitor {
 public:
@@ -51,51 +81,126 @@ class BaseChatMesh : public mesh::Mesh {
   int num_contacts;
   int sort_array[MAX_CONTACTS];
   int matching_peer_indexes[MAX_SEARCH_RESULTS];
-  unsigned long txt_send_timeout;
+  PendingMessage pending_msgs[MAX_PENDING_MSGS];
+  uint32_t next_msg_seq;
+  bool compress_text;
+  RouteTable routes;
+  ReassemblyArena reassembly;
+  OutboundBlob out_blob;
 #ifdef MAX_GROUP_CHANNELS
-  mesh::GroupChannel channels[MAX_GROUP_CHANNELS];
-  int num_channels;
+  ChannelEntry channel_entries[MAX_GROUP_CHANNELS];
+  ChannelRegistry channels;
+  int matching_channel_indexes[MAX_GROUP_CHANNELS];
 #endif
 
-  mesh::Packet* composeMsgPacket(const ContactInfo& recipient, uint8_t attempt, const char *text, uint32_t& expected_ack);
+  int  encodeText(uint8_t* data, uint32_t timestamp, uint8_t flags, const char* text, uint32_t* expected_ack);
+  mesh::Packet* composeMsgPacket(const ContactInfo& recipient, uint32_t timestamp, uint8_t attempt, const char *text, uint32_t& expected_ack);
+  uint32_t calcExpectedAck(uint32_t timestamp, uint8_t attempt, const char *text);
+  int  getNumInFlight(int contact_idx) const;
+  void sendQueuedMessages();
+  int  getContactIdx(const ContactInfo& contact) const;
+  void updateOutPath(ContactInfo& contact, int contact_idx);
+  int  sendPendingMessage(PendingMessage& msg);
+  bool processPendingAck(const uint8_t *data);
+  void checkPendingTimeouts();
+  void sendViaOutPath(mesh::Packet* pkt, const ContactInfo& contact);
+  void sendBlobFragments();
+  void checkBlobTimeout();
+  void completeBlob(bool delivered);
+  void onMultipartRecv(mesh::Packet* packet, int contact_idx, const uint8_t* secret, const uint8_t* data, size_t len);
+  void processSack(int contact_idx, const uint8_t* data, size_t len);
+  void onPostBatchRecv(mesh::Packet* packet, ContactInfo& from, const uint8_t* secret, const uint8_t* data, size_t len);
+  void sendAckTo(mesh::Packet* packet, const ContactInfo& from, const uint8_t* secret, uint32_t ack_hash);
 
 protected:
   BaseChatMesh(mesh::Radio& radio, mesh::MillisecondClock& ms, mesh::RNG& rng, mesh::RTCClock& rtc, mesh::PacketManager& mgr, mesh::MeshTables& tables)
       : mesh::Mesh(radio, ms, rng, rtc, mgr, tables)
-  { 
-    num_contacts = 0;
   #ifdef MAX_GROUP_CHANNELS
-    num_channels = 0;
+      , channels(channel_entries, MAX_GROUP_CHANNELS)
   #endif
-    txt_send_timeout = 0;
+  { 
+    num_contacts = 0;
+    memset(pending_msgs, 0, sizeof(pending_msgs));
+    next_msg_seq = 0;
+    compress_text = DEFAULT_TEXT_COMPRESSION;
+    memset(&out_blob, 0, sizeof(out_blob));
   }
 
   // 'UI' concepts, for sub-classes to implement
   virtual void onDiscoveredContact(ContactInfo& contact, bool is_new) = 0;
-  virtual bool processAck(const uint8_t *data) = 0;
+  virtual bool processAck(const uint8_t *data) { return false; }   // for any ACKs NOT matched by sendMessage() deliveries
   virtual void onContactPathUpdated(const ContactInfo& contact) = 0;
   virtual void onMessageRecv(const ContactInfo& contact, bool was_flood, uint32_t sender_timestamp, const char *text) = 0;
   virtual uint32_t calcFloodTimeoutMillisFor(uint32_t pkt_airtime_millis) const = 0;
   virtual uint32_t calcDirectTimeoutMillisFor(uint32_t pkt_airtime_millis, uint8_t path_len) const = 0;
-  virtual void onSendTimeout() = 0;
+  virtual void onSendComplete(const ContactInfo& recipient, uint32_t msg_id, bool delivered, uint8_t num_attempts) = 0;
   virtual void onChannelMessageRecv(const mesh::GroupChannel& channel, int in_path_len, uint32_t timestamp, const char *text) = 0;
+  virtual void onBlobRecv(const ContactInfo& from, const uint8_t* data, size_t len) { }
+
+  /**
+   * \brief  a post from a room server's catch-up batch (see createRoomLogin()). Default passes it to onMessageRecv(),
+   *          as "{author prefix in hex}:{text}", same as posts pushed singly.
+   */
+  virtual void onRoomPostRecv(const ContactInfo& room, bool was_flood, uint32_t post_timestamp, const uint8_t* author_prefix, const char* text);
+
+  /**
+   * \brief  a RESPONSE from a contact, eg. to a room login (see createRoomLogin()). First 4 bytes are the responder's timestamp.
+   */
+  virtual void onContactResponse(const ContactInfo& contact, const uint8_t* data, uint8_t len) { }
+  virtual void onBlobSendComplete(const ContactInfo& recipient, uint16_t blob_id, bool delivered) { }
 
   // Mesh overrides
   void onAdvertRecv(mesh::Packet* packet, const mesh::Identity& id, uint32_t timestamp, const uint8_t* app_data, size_t app_data_len) override;
   int searchPeersByHash(const uint8_t* hash) override;
+  bool lookupIdentityByPrefix(const uint8_t* prefix, uint8_t prefix_len, mesh::Identity& id) override;
   void getPeerSharedSecret(uint8_t* dest_secret, int peer_idx) override;
   void onPeerDataRecv(mesh::Packet* packet, uint8_t type, int sender_idx, const uint8_t* secret, uint8_t* data, size_t len) override;
   bool onPeerPathRecv(mesh::Packet* packet, int sender_idx, const uint8_t* secret, uint8_t* path, uint8_t path_len, uint8_t extra_type, uint8_t* extra, uint8_t extra_len) override;
   void onAckRecv(mesh::Packet* packet, uint32_t ack_crc) override;
 #ifdef MAX_GROUP_CHANNELS
-  int searchChannelsByHash(const uint8_t* hash, mesh::GroupChannel channels[], int max_matches) override;
+  int searchChannelsByHash(const uint8_t* hash) override;
+  const mesh::GroupChannel* getMatchingChannel(int match_idx) override;
+  int decryptChannelData(const mesh::Packet* packet, int match_idx, uint8_t* dest) override;
 #endif
   void onGroupDataRecv(mesh::Packet* packet, uint8_t type, const mesh::GroupChannel& channel, uint8_t* data, size_t len) override;
 
 public:
-  mesh::Packet* createSelfAdvert(const char* name);
-  int  sendMessage(const ContactInfo& recipient, uint8_t attempt, const char* text, uint32_t& expected_ack);
+  mesh::Packet* createSelfAdvert(const char* name, bool compact=false);
+  /**
+   * \brief  send a text message, which is then retried (via alternate paths, then flood) until ACK'd or attempts exhausted.
+   *         Up to recipient's send_window messages can be awaiting ACK, beyond that they are queued (MSG_SEND_QUEUED),
+   *         and sent as ACKs arrive, paced by the Dispatcher's airtime budget. Outcome is reported via onSendComplete().
+   * \param  msg_id  OUT - identifies this message, in the onSendComplete() callback
+   * \returns  one of MSG_SEND_*
+   */
+  int  sendMessage(const ContactInfo& recipient, uint8_t attempt, const char* text, uint32_t& msg_id);
+  int  getNumPendingMessages() const;
+  void setTextCompression(bool enable) { compress_text = enable; }
+  bool isTextCompression() const { return compress_text; }
+
+  /**
+   * \brief  create a GRP_TXT packet (compressed, if enabled). Caller then sends it, eg. with sendFlood()
+   */
+  mesh::Packet* composeGroupTextPacket(const mesh::GroupChannel& channel, uint32_t timestamp, const char* text);
+
+  /**
+   * \brief  send a blob (up to MAX_BLOB_SIZE bytes) as multiple fragments, pipelined as airtime allows.
+   *         Missing fragments are resent, per the recipient's selective ACKs. Outcome is reported via onBlobSendComplete().
+   *         NOTE: only one blob can be in transit at a time, and 'data' must remain valid until completion.
+   * \param  blob_id  OUT - identifies this blob, in the onBlobSendComplete() callback
+   * \returns  MSG_SEND_QUEUED, or MSG_SEND_FAILED
+   */
+  int  sendBlob(const ContactInfo& recipient, const uint8_t* data, size_t len, uint16_t& blob_id);
+  bool isBlobSending() const { return out_blob.data != NULL; }
+  void setSendWindow(ContactInfo& contact, uint8_t window) { contact.send_window = window; }
   void resetPathTo(ContactInfo& recipient);
+
+  /**
+   * \brief  create a login (ANON_REQ) for a room server, which also tells it we can unpack batched posts.
+   *         Caller then sends it, eg. with sendFlood()
+   * \param  sync_since  the timestamp (by room's clock) of the last post we received
+   */
+  mesh::Packet* createRoomLogin(const ContactInfo& room, uint32_t sync_since, const char* password);
   void scanRecentContacts(int last_n, ContactVisitor* visitor);
   ContactInfo* searchContactsByPrefix(const char* name_prefix);
   bool  addContact(const ContactInfo& contact);
@@ -0,0 +1,85 @@
+#include "ChannelRegistry.h"
+#include <Utils.h>
+
+#define HMAC_BLOCK_SIZE   64
+
+ChannelRegistry::ChannelRegistry(ChannelEntry* storage, int max_num) {
+  entries = storage;
+  max_entries = max_num < CHANNEL_IDX_NONE ? max_num : CHANNEL_IDX_NONE;
+  num_entries = 0;
+  memset(buckets, CHANNEL_IDX_NONE, sizeof(buckets));
+}
+
+mesh::GroupChannel* ChannelRegistry::add(const uint8_t* secret, int secret_len) {
+  if (num_entries >= max_entries || secret_len > PUB_KEY_SIZE) return NULL;
+
+  int idx = num_entries++;
+  auto e = &entries[idx];
+  memset(e->channel.secret, 0, sizeof(e->channel.secret));
+  memcpy(e->channel.secret, secret, secret_len);
+  mesh::Utils::sha256(e->channel.hash, sizeof(e->channel.hash), secret, secret_len);
+
+  // pre-calc the cipher state
+  e->aes.setKey(e->channel.secret, CIPHER_KEY_SIZE);
+
+  uint8_t block[HMAC_BLOCK_SIZE];
+  memset(block, 0, sizeof(block));
+  memcpy(block, e->channel.secret, PUB_KEY_SIZE);   // same HMAC key as Utils::encryptThenMAC()
+  for (int i = 0; i < HMAC_BLOCK_SIZE; i++) block[i] ^= 0x36;
+  e->hmac_inner.reset();
+  e->hmac_inner.update(block, HMAC_BLOCK_SIZE);
+  for (int i = 0; i < HMAC_BLOCK_SIZE; i++) block[i] ^= (0x36 ^ 0x5C);
+  e->hmac_outer.reset();
+  e->hmac_outer.update(block, HMAC_BLOCK_SIZE);
+  memset(block, 0, sizeof(block));
+
+  mesh::Utils::deriveSIVKeys(e->channel.secret, e->siv_enc_key, e->siv_mac_key);
+
+  // link into hash bucket
+  e->next = buckets[e->channel.hash[0]];
+  buckets[e->channel.hash[0]] = idx;
+
+  return &e->channel;
+}
+
+int ChannelRegistry::search(const uint8_t* hash, int dest[]) const {
+  int n = 0;
+  for (uint8_t idx = buckets[hash[0]]; idx != CHANNEL_IDX_NONE; idx = entries[idx].next) {
+    dest[n++] = idx;
+  }
+  return n;
+}
+
+int ChannelRegistry::MACThenDecrypt(int idx, uint8_t* dest, const uint8_t* src, int src_len) {
+  if (src_len <= CIPHER_MAC_SIZE || idx < 0 || idx >= num_entries) return 0;  // invalid
+
+  auto e = &entries[idx];
+  uint8_t hmac[CIPHER_MAC_SIZE];
+  {
+    uint8_t inner_hash[32];
+    SHA256 sha = e->hmac_inner;
+    sha.update(src + CIPHER_MAC_SIZE, src_len - CIPHER_MAC_SIZE);
+    sha.finalize(inner_hash, sizeof(inner_hash));
+
+    sha = e->hmac_outer;
+    sha.update(inner_hash, sizeof(inner_hash));
+    sha.finalize(hmac, CIPHER_MAC_SIZE);
+  }
+  if (memcmp(hmac, src, CIPHER_MAC_SIZE) != 0) return 0;  // invalid HMAC
+
+  const uint8_t* sp = src + CIPHER_MAC_SIZE;
+  int len = src_len - CIPHER_MAC_SIZE;
+  uint8_t* dp = dest;
+  while (dp - dest < len) {
+    e->aes.decryptBlock(dp, sp);
+    dp += 16; sp += 16;
+  }
+  return dp - dest;  // will always be multiple of 16
+}
+
+int ChannelRegistry::decryptSIV(int idx, uint8_t* dest, const uint8_t* src, int src_len, const uint8_t* assoc, int assoc_len) {
+  if (idx < 0 || idx >= num_entries) return 0;  // invalid
+
+  auto e = &entries[idx];
+  return mesh::Utils::decryptSIV(e->siv_enc_key, e->siv_mac_key, dest, src, src_len, assoc, assoc_len);
+}
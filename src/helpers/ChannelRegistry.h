@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Mesh.h>
+#include <AES.h>
+#include <SHA256.h>
+
+#define CHANNEL_IDX_NONE   0xFF
+
+struct ChannelEntry {
+  mesh::GroupChannel channel;
+  uint8_t  next;          // next entry in same hash bucket, or CHANNEL_IDX_NONE
+  AES128   aes;           // key already expanded
+  SHA256   hmac_inner;    // HMAC state, with (key ^ ipad) block already hashed
+  SHA256   hmac_outer;    // HMAC state, with (key ^ opad) block already hashed
+  uint8_t  siv_enc_key[CIPHER_KEY_SIZE];           // V2 keys, already derived
+  uint8_t  siv_mac_key[CIPHER_SIV_MAC_KEY_SIZE];
+};
+
+/**
+ * \brief  A table of subscribed GroupChannels, indexed by channel hash (256 buckets), with any number of colliding channels.
+ *         Each channel caches its cipher state, so that trial decryption (of colliding hashes) is cheap.
+ */
+class ChannelRegistry {
+  ChannelEntry* entries;
+  int max_entries;
+  int num_entries;
+  uint8_t buckets[256];   // first entry idx, per hash value
+
+public:
+  ChannelRegistry(ChannelEntry* storage, int max_num);
+
+  /**
+   * \returns  the new channel, or NULL if table is full
+   */
+  mesh::GroupChannel* add(const uint8_t* secret, int secret_len);
+
+  int getCount() const { return num_entries; }
+  const mesh::GroupChannel* getChannel(int idx) const { return (idx >= 0 && idx < num_entries) ? &entries[idx].channel : NULL; }
+
+  /**
+   * \brief  find ALL channels with given hash
+   * \param  dest  OUT - indexes of matching channels (must have room for getCount() entries)
+   * \returns  number of matches
+   */
+  int search(const uint8_t* hash, int dest[]) const;
+
+  /**
+   * \brief  same as Utils::MACThenDecrypt(), but using the channel's cached cipher state.
+   * \returns  zero if MAC is invalid, otherwise the length of decrypted bytes in 'dest'
+   */
+  int MACThenDecrypt(int idx, uint8_t* dest, const uint8_t* src, int src_len);
+
+  /**
+   * \brief  same as Utils::decryptSIV(), but using the channel's cached (derived) keys.
+   * \returns  zero if MAC is invalid, otherwise the length of decrypted bytes in 'dest'
+   */
+  int decryptSIV(int idx, uint8_t* dest, const uint8_t* src, int src_len, const uint8_t* assoc, int assoc_len);
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <Mesh.h>
+
+#ifndef CLIENT_TABLE_BUCKETS
+  #define CLIENT_TABLE_BUCKETS   64    // must be power of 2
+#endif
+
+/**
+ * \brief  A fixed size table of (logged in) clients, with an index by hash (pub_key prefix), and LRU ordering.
+ *         Lookups, insertions and evictions are constant time (for hash-wise randomly distributed keys).
+ *         T must have members:  mesh::Identity id;  uint32_t last_activity;  uint8_t secret[PUB_KEY_SIZE];
+ *         Removed entries are securely wiped (so no secrets linger in RAM).
+ */
+template <class T, int N>
+class ClientTable {
+  T _slots[N];
+  bool _used[N];
+  int16_t _bucket_head[CLIENT_TABLE_BUCKETS];
+  int16_t _bucket_next[N];    // chains in each bucket, or the free list
+  int16_t _lru_prev[N], _lru_next[N];
+  int16_t _mru, _lru;       // most, and least, recently active
+  int16_t _free;
+  int _count;
+
+  static int bucketOf(const uint8_t* hash) { return hash[0] & (CLIENT_TABLE_BUCKETS - 1); }
+
+  void unlinkLRU(int i) {
+    if (_lru_prev[i] >= 0) _lru_next[_lru_prev[i]] = _lru_next[i]; else _mru = _lru_next[i];
+    if (_lru_next[i] >= 0) _lru_prev[_lru_next[i]] = _lru_prev[i]; else _lru = _lru_prev[i];
+  }
+  void linkMRU(int i) {
+    _lru_prev[i] = -1;
+    _lru_next[i] = _mru;
+    if (_mru >= 0) _lru_prev[_mru] = i; else _lru = i;
+    _mru = i;
+  }
+
+public:
+  ClientTable() { clear(); }
+
+  void clear() {
+    mesh::Utils::secureZero(_slots, sizeof(_slots));
+    memset(_used, 0, sizeof(_used));
+    for (int b = 0; b < CLIENT_TABLE_BUCKETS; b++) _bucket_head[b] = -1;
+    for (int i = 0; i < N; i++) _bucket_next[i] = i + 1 < N ? i + 1 : -1;
+    _free = 0;
+    _mru = _lru = -1;
+    _count = 0;
+  }
+
+  T* find(const mesh::Identity& id) {
+    for (int i = _bucket_head[bucketOf(id.pub_key)]; i >= 0; i = _bucket_next[i]) {
+      if (_slots[i].id.matches(id)) return &_slots[i];
+    }
+    return NULL;
+  }
+
+  /**
+   * \brief  find existing entry for 'id', or add a new (zeroed) entry, evicting least recently active if table is full
+   * \param  is_new  OUT - true if entry was added (caller should then init it, eg. calc the shared secret)
+   */
+  T* put(const mesh::Identity& id, bool& is_new) {
+    T* c = find(id);
+    if (c) { is_new = false; return c; }
+
+    if (_free < 0) remove(&_slots[_lru]);   // table is full
+
+    int i = _free;
+    _free = _bucket_next[i];
+
+    int b = bucketOf(id.pub_key);
+    _bucket_next[i] = _bucket_head[b];
+    _bucket_head[b] = i;
+    linkMRU(i);
+    _used[i] = true;
+    _count++;
+
+    _slots[i].id = id;
+    is_new = true;
+    return &_slots[i];
+  }
+
+  /**
+   * \brief  records activity by client (moves it to most recent)
+   */
+  void touch(T* c, uint32_t now) {
+    int i = indexOf(c);
+    c->last_activity = now;
+    unlinkLRU(i);
+    linkMRU(i);
+  }
+
+  /**
+   * \brief  removes entry, wiping it (including its secret)
+   */
+  void remove(T* c) {
+    int i = indexOf(c);
+    if (i < 0 || !_used[i]) return;
+
+    int16_t* p = &_bucket_head[bucketOf(c->id.pub_key)];
+    while (*p != i) p = &_bucket_next[*p];
+    *p = _bucket_next[i];   // unlink from bucket chain
+    unlinkLRU(i);
+
+    mesh::Utils::secureZero(c, sizeof(T));
+    _used[i] = false;
+    _bucket_next[i] = _free;
+    _free = i;
+    _count--;
+  }
+
+  /**
+   * \brief  removes all entries not active since 'now' - 'max_idle_secs'. (call periodically)
+   * \returns  num entries removed
+   */
+  int evictIdle(uint32_t now, uint32_t max_idle_secs) {
+    int n = 0;
+    while (_lru >= 0 && now > _slots[_lru].last_activity && now - _slots[_lru].last_activity > max_idle_secs) {
+      remove(&_slots[_lru]);
+      n++;
+    }
+    return n;
+  }
+
+  /**
+   * \brief  find all entries with given hash
+   * \param  dest_idx  OUT - the entry indexes, for getByIdx()
+   * \returns  num found
+   */
+  int searchByHash(const uint8_t* hash, int dest_idx[], int max_results) {
+    int n = 0;
+    for (int i = _bucket_head[bucketOf(hash)]; i >= 0 && n < max_results; i = _bucket_next[i]) {
+      if (_slots[i].id.isHashMatch(hash)) dest_idx[n++] = i;
+    }
+    return n;
+  }
+
+  /**
+   * \returns  NULL if 'idx' is out of range, or slot is free
+   */
+  T* getByIdx(int idx) { return idx >= 0 && idx < N && _used[idx] ? &_slots[idx] : NULL; }
+  int indexOf(const T* c) const { return c >= _slots && c < &_slots[N] ? c - _slots : -1; }
+
+  T* getLeastRecent() { return _lru >= 0 ? &_slots[_lru] : NULL; }
+  int getCount() const { return _count; }
+  int getCapacity() const { return N; }
+};
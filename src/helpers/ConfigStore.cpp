@@ -0,0 +1,350 @@
+#include "ConfigStore.h"
+#include <Utils.h>
+#include <Packet.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+static const ConfigKeyDef key_defs[] = {
+  { CFG_KEY_RADIO_FREQ,     CFG_TYPE_FLOAT, CFG_FLAG_RADIO,  "freq",  150.0f, 960.0f },
+  { CFG_KEY_RADIO_BW,       CFG_TYPE_FLOAT, CFG_FLAG_RADIO,  "bw",    7.8f, 500.0f },
+  { CFG_KEY_RADIO_SF,       CFG_TYPE_U8,    CFG_FLAG_RADIO,  "sf",    5, 12 },
+  { CFG_KEY_RADIO_CR,       CFG_TYPE_U8,    CFG_FLAG_RADIO,  "cr",    5, 8 },
+  { CFG_KEY_TX_POWER,       CFG_TYPE_I8,    CFG_FLAG_RADIO,  "tx",    -9, 22 },
+  { CFG_KEY_AIRTIME_FACTOR, CFG_TYPE_FLOAT, 0,               "af",    0, 9.0f },
+  { CFG_KEY_NODE_NAME,      CFG_TYPE_STR,   0,               "name",  1, 31 },
+  { CFG_KEY_ADMIN_PASSWORD, CFG_TYPE_STR,   CFG_FLAG_SECRET, "password", 1, 15 },
+  { CFG_KEY_GUEST_PASSWORD, CFG_TYPE_STR,   CFG_FLAG_SECRET, "guest.password", 0, 15 },
+  { CFG_KEY_NODE_LAT,       CFG_TYPE_FLOAT, 0,               "lat",   -90.0f, 90.0f },
+  { CFG_KEY_NODE_LON,       CFG_TYPE_FLOAT, 0,               "lon",   -180.0f, 180.0f },
+  { CFG_KEY_ADVERT_INTERVAL, CFG_TYPE_U16,  0,               "advert.interval", 0, 7*24*60 },
+  { CFG_KEY_DEEP_SLEEP,     CFG_TYPE_U8,    0,               "sleep", 0, 1 },
+  { CFG_KEY_FLOOD_HOPS_BASE + PAYLOAD_TYPE_REQ,       CFG_TYPE_U8, 0, "req.hops",      1, MAX_FLOOD_HOPS },
+  { CFG_KEY_FLOOD_HOPS_BASE + PAYLOAD_TYPE_RESPONSE,  CFG_TYPE_U8, 0, "resp.hops",     1, MAX_FLOOD_HOPS },
+  { CFG_KEY_FLOOD_HOPS_BASE + PAYLOAD_TYPE_TXT_MSG,   CFG_TYPE_U8, 0, "txt.hops",      1, MAX_FLOOD_HOPS },
+  { CFG_KEY_FLOOD_HOPS_BASE + PAYLOAD_TYPE_ACK,       CFG_TYPE_U8, 0, "ack.hops",      1, MAX_FLOOD_HOPS },
+  { CFG_KEY_FLOOD_HOPS_BASE + PAYLOAD_TYPE_ADVERT,    CFG_TYPE_U8, 0, "advert.hops",   1, MAX_FLOOD_HOPS },
+  { CFG_KEY_FLOOD_HOPS_BASE + PAYLOAD_TYPE_GRP_TXT,   CFG_TYPE_U8, 0, "grp.txt.hops",  1, MAX_FLOOD_HOPS },
+  { CFG_KEY_FLOOD_HOPS_BASE + PAYLOAD_TYPE_GRP_DATA,  CFG_TYPE_U8, 0, "grp.data.hops", 1, MAX_FLOOD_HOPS },
+  { CFG_KEY_FLOOD_HOPS_BASE + PAYLOAD_TYPE_ANON_REQ,  CFG_TYPE_U8, 0, "anon.hops",     1, MAX_FLOOD_HOPS },
+  { CFG_KEY_FLOOD_HOPS_BASE + PAYLOAD_TYPE_PATH,      CFG_TYPE_U8, 0, "path.hops",     1, MAX_FLOOD_HOPS },
+  { CFG_KEY_FLOOD_HOPS_BASE + PAYLOAD_TYPE_MULTIPART, CFG_TYPE_U8, 0, "multi.hops",    1, MAX_FLOOD_HOPS },
+};
+#define NUM_KEY_DEFS   ((int) (sizeof(key_defs) / sizeof(key_defs[0])))
+
+// the LoRa bandwidths the SX126x supports (kHz)
+static const float valid_bandwidths[] = { 7.8f, 10.4f, 15.6f, 20.8f, 31.25f, 41.7f, 62.5f, 125.0f, 250.0f, 500.0f };
+#define NUM_VALID_BANDWIDTHS   ((int) (sizeof(valid_bandwidths) / sizeof(valid_bandwidths[0])))
+
+static bool isValidBandwidth(float bw) {
+  for (int i = 0; i < NUM_VALID_BANDWIDTHS; i++) {
+    float diff = bw - valid_bandwidths[i];
+    if (diff > -0.01f && diff < 0.01f) return true;
+  }
+  return false;
+}
+
+static int getTypeSize(uint8_t type) {
+  switch (type) {
+    case CFG_TYPE_U8:
+    case CFG_TYPE_I8: return 1;
+    case CFG_TYPE_U16: return 2;
+    case CFG_TYPE_U32:
+    case CFG_TYPE_FLOAT: return 4;
+  }
+  return 0;  // variable length
+}
+
+const ConfigKeyDef* ConfigStore::getKeyDef(uint8_t key) {
+  for (int i = 0; i < NUM_KEY_DEFS; i++) {
+    if (key_defs[i].key == key) return &key_defs[i];
+  }
+  return NULL;  // not found
+}
+
+const ConfigKeyDef* ConfigStore::findKeyDef(const char* name, int name_len) {
+  for (int i = 0; i < NUM_KEY_DEFS; i++) {
+    if ((int) strlen(key_defs[i].name) == name_len && memcmp(key_defs[i].name, name, name_len) == 0) return &key_defs[i];
+  }
+  return NULL;  // not found
+}
+
+const uint8_t* ConfigStore::findValue(uint8_t key, uint8_t& len) const {
+  int i = 0;
+  while (i + 2 <= _data_len) {
+    if (_data[i] == key) {
+      len = _data[i + 1];
+      return &_data[i + 2];
+    }
+    i += 2 + _data[i + 1];
+  }
+  return NULL;  // not found
+}
+
+void ConfigStore::removeValue(uint8_t key) {
+  int i = 0;
+  while (i + 2 <= _data_len) {
+    int rec_len = 2 + _data[i + 1];
+    if (_data[i] == key) {
+      memmove(&_data[i], &_data[i + rec_len], _data_len - (i + rec_len));
+      _data_len -= rec_len;
+      return;
+    }
+    i += rec_len;
+  }
+}
+
+int ConfigStore::putValue(const ConfigKeyDef* def, const void* src, uint8_t len) {
+  uint8_t curr_len;
+  const uint8_t* curr = findValue(def->key, curr_len);
+  if (curr && curr_len == len && memcmp(curr, src, len) == 0) return CFG_OK;   // no change
+
+  int avail = CONFIG_MAX_DATA_SIZE - _data_len + (curr ? 2 + curr_len : 0);
+  if (2 + len > avail) return CFG_ERR_FULL;
+
+  removeValue(def->key);
+  _data[_data_len++] = def->key;
+  _data[_data_len++] = len;
+  memcpy(&_data[_data_len], src, len);
+  _data_len += len;
+
+  if (_listener) _listener->onConfigChanged(def);
+  return CFG_OK;
+}
+
+uint32_t ConfigStore::getUInt(uint8_t key, uint32_t def_val) const {
+  uint8_t len;
+  const uint8_t* v = findValue(key, len);
+  if (v == NULL) return def_val;
+
+  if (len == 1) return *v;
+  if (len == 2) { uint16_t n; memcpy(&n, v, 2); return n; }
+  if (len == 4) { uint32_t n; memcpy(&n, v, 4); return n; }
+  return def_val;
+}
+
+int32_t ConfigStore::getInt(uint8_t key, int32_t def_val) const {
+  uint8_t len;
+  const uint8_t* v = findValue(key, len);
+  if (v == NULL) return def_val;
+
+  if (len == 1) return (int8_t) *v;
+  if (len == 2) { int16_t n; memcpy(&n, v, 2); return n; }
+  if (len == 4) { int32_t n; memcpy(&n, v, 4); return n; }
+  return def_val;
+}
+
+float ConfigStore::getFloat(uint8_t key, float def_val) const {
+  uint8_t len;
+  const uint8_t* v = findValue(key, len);
+  if (v == NULL || len != sizeof(float)) return def_val;
+
+  float f;
+  memcpy(&f, v, sizeof(f));
+  return f;
+}
+
+const char* ConfigStore::getString(uint8_t key, const char* def_val) const {
+  uint8_t len;
+  const uint8_t* v = findValue(key, len);
+  if (v == NULL || len == 0 || v[len - 1] != 0) return def_val;
+
+  return (const char *) v;
+}
+
+int ConfigStore::setUInt(uint8_t key, uint32_t val) {
+  const ConfigKeyDef* def = getKeyDef(key);
+  if (def == NULL) return CFG_ERR_UNKNOWN_KEY;
+  if (def->type != CFG_TYPE_U8 && def->type != CFG_TYPE_U16 && def->type != CFG_TYPE_U32) return CFG_ERR_TYPE;
+  if (val < def->min_val || val > def->max_val) return CFG_ERR_RANGE;
+
+  if (def->type == CFG_TYPE_U8) { uint8_t n = val; return putValue(def, &n, 1); }
+  if (def->type == CFG_TYPE_U16) { uint16_t n = val; return putValue(def, &n, 2); }
+  return putValue(def, &val, 4);
+}
+
+int ConfigStore::setInt(uint8_t key, int32_t val) {
+  const ConfigKeyDef* def = getKeyDef(key);
+  if (def == NULL) return CFG_ERR_UNKNOWN_KEY;
+  if (def->type != CFG_TYPE_I8) return val >= 0 ? setUInt(key, val) : CFG_ERR_RANGE;
+  if (val < def->min_val || val > def->max_val) return CFG_ERR_RANGE;
+
+  int8_t n = val;
+  return putValue(def, &n, 1);
+}
+
+int ConfigStore::setFloat(uint8_t key, float val) {
+  const ConfigKeyDef* def = getKeyDef(key);
+  if (def == NULL) return CFG_ERR_UNKNOWN_KEY;
+  if (def->type != CFG_TYPE_FLOAT) return CFG_ERR_TYPE;
+  if (!(val >= def->min_val && val <= def->max_val)) return CFG_ERR_RANGE;   // NOTE: also rejects NaN
+  if (key == CFG_KEY_RADIO_BW && !isValidBandwidth(val)) return CFG_ERR_RANGE;
+
+  return putValue(def, &val, sizeof(val));
+}
+
+int ConfigStore::setString(uint8_t key, const char* val) {
+  const ConfigKeyDef* def = getKeyDef(key);
+  if (def == NULL) return CFG_ERR_UNKNOWN_KEY;
+  if (def->type != CFG_TYPE_STR) return CFG_ERR_TYPE;
+  int len = strlen(val);
+  if (len < def->min_val || len > def->max_val) return CFG_ERR_RANGE;
+
+  return putValue(def, val, len + 1);   // include null terminator
+}
+
+int ConfigStore::setFromText(const char* name, int name_len, const char* text) {
+  const ConfigKeyDef* def = findKeyDef(name, name_len);
+  if (def == NULL) return CFG_ERR_UNKNOWN_KEY;
+
+  if (def->type == CFG_TYPE_STR) return setString(def->key, text);
+
+  char* end;
+  if (def->type == CFG_TYPE_FLOAT) {
+    float f = strtod(text, &end);
+    if (end == text || *end) return CFG_ERR_TYPE;
+    return setFloat(def->key, f);
+  }
+  long n = strtol(text, &end, 10);
+  if (end == text || *end) return CFG_ERR_TYPE;
+  return setInt(def->key, n);
+}
+
+bool ConfigStore::formatValue(const ConfigKeyDef* def, char* dest) const {
+  if (!isSet(def->key)) {
+    strcpy(dest, "(default)");
+    return false;
+  }
+  if (def->flags & CFG_FLAG_SECRET) {
+    strcpy(dest, "***");
+  } else if (def->type == CFG_TYPE_STR) {
+    strcpy(dest, getString(def->key, ""));
+  } else if (def->type == CFG_TYPE_FLOAT) {
+    sprintf(dest, "%.3f", getFloat(def->key, 0));
+  } else if (def->type == CFG_TYPE_I8) {
+    sprintf(dest, "%d", getInt(def->key, 0));
+  } else {
+    sprintf(dest, "%u", getUInt(def->key, 0));
+  }
+  return true;
+}
+
+void ConfigStore::reset(uint8_t key) {
+  if (isSet(key)) {
+    removeValue(key);
+    const ConfigKeyDef* def = getKeyDef(key);
+    if (def && _listener) _listener->onConfigChanged(def);
+  }
+}
+
+const char* ConfigStore::getErrorText(int err) {
+  switch (err) {
+    case CFG_OK: return "OK";
+    case CFG_ERR_UNKNOWN_KEY: return "unknown config";
+    case CFG_ERR_TYPE: return "bad value";
+    case CFG_ERR_RANGE: return "value out of range";
+    case CFG_ERR_FULL: return "config store full";
+  }
+  return "?";
+}
+
+int ConfigStore::writeTo(uint8_t* dest, int max_len) const {
+  if (CONFIG_HEADER_SIZE + _data_len + CONFIG_CHECK_SIZE > max_len) return 0;  // too small
+
+  dest[0] = CONFIG_FILE_MAGIC;
+  dest[1] = CONFIG_FORMAT_VER;
+  dest[2] = _data_len;
+  memcpy(&dest[CONFIG_HEADER_SIZE], _data, _data_len);
+  int len = CONFIG_HEADER_SIZE + _data_len;
+  mesh::Utils::sha256(&dest[len], CONFIG_CHECK_SIZE, dest, len);
+  return len + CONFIG_CHECK_SIZE;
+}
+
+bool ConfigStore::readFrom(const uint8_t* src, int len) {
+  _data_len = 0;
+  if (len < 2 || src[0] != CONFIG_FILE_MAGIC) return false;  // not ours
+
+  int i, end;
+  if (src[1] == CONFIG_FORMAT_VER) {
+    if (len < CONFIG_HEADER_SIZE + CONFIG_CHECK_SIZE) return false;
+    end = CONFIG_HEADER_SIZE + src[2];
+    if (end + CONFIG_CHECK_SIZE != len) return false;   // partially written (or trailing junk)
+
+    uint8_t check[CONFIG_CHECK_SIZE];
+    mesh::Utils::sha256(check, CONFIG_CHECK_SIZE, src, end);
+    if (memcmp(check, &src[end], CONFIG_CHECK_SIZE) != 0) return false;   // corrupt
+    i = CONFIG_HEADER_SIZE;
+  } else if (src[1] == CONFIG_FORMAT_VER_UNCHECKED) {
+    i = 2;
+    end = len;
+  } else {
+    return false;   // unsupported version
+  }
+
+  // only keep values which are still known, and valid (ie. from an older/newer firmware)
+  while (i + 2 <= end) {
+    uint8_t key = src[i];
+    uint8_t val_len = src[i + 1];
+    const uint8_t* val = &src[i + 2];
+    if (i + 2 + val_len > end) break;   // truncated
+    i += 2 + val_len;
+
+    const ConfigKeyDef* def = getKeyDef(key);
+    if (def == NULL || isSet(key)) continue;
+
+    int type_size = getTypeSize(def->type);
+    bool valid;
+    if (type_size) {
+      valid = val_len == type_size;
+    } else {   // string
+      valid = val_len > 0 && val[val_len - 1] == 0 && strlen((const char *) val) + 1 == val_len && val_len - 1 <= def->max_val;
+    }
+    if (valid && 2 + val_len <= CONFIG_MAX_DATA_SIZE - _data_len) {
+      _data[_data_len++] = key;
+      _data[_data_len++] = val_len;
+      memcpy(&_data[_data_len], val, val_len);
+      _data_len += val_len;
+    }
+  }
+  return true;
+}
+
+void ConfigStore::getFilename(char* dest) const {
+  sprintf(dest, "%s/_config.kv", _dir);
+}
+
+bool ConfigStore::load() {
+  char filename[40];
+  getFilename(filename);
+  if (!_fs->exists(filename)) return false;
+
+  File file = _fs->open(filename);
+  if (!file) return false;
+
+  uint8_t buf[CONFIG_MAX_FILE_SIZE];
+  int len = file.read(buf, sizeof(buf));
+  file.close();
+
+  return readFrom(buf, len);
+}
+
+bool ConfigStore::save() {
+  char filename[40];
+  getFilename(filename);
+
+  uint8_t buf[CONFIG_MAX_FILE_SIZE];
+  int len = writeTo(buf, sizeof(buf));
+
+#if defined(NRF52_PLATFORM)
+  File file = _fs->open(filename, FILE_O_WRITE);
+  if (file) { file.seek(0); file.truncate(); }
+#else
+  File file = _fs->open(filename, "w", true);
+#endif
+  if (file) {
+    bool success = (int) file.write(buf, len) == len;
+    file.close();
+    return success;
+  }
+  return false;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#if defined(ESP32)
+  #include <FS.h>
+  #define FILESYSTEM  fs::FS
+#elif defined(NRF52_PLATFORM)
+  #include <Adafruit_LittleFS.h>
+  #define FILESYSTEM  Adafruit_LittleFS
+
+  using namespace Adafruit_LittleFS_Namespace;
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef CONFIG_MAX_DATA_SIZE
+  #define CONFIG_MAX_DATA_SIZE   160   // total bytes of (encoded) overridden values
+#endif
+
+#if CONFIG_MAX_DATA_SIZE > 255
+  #error "CONFIG_MAX_DATA_SIZE must fit in the (1 byte) length field"
+#endif
+
+// file: magic(1), format ver(1), data length(1), data, check(2). The length and check reject partial (eg. power loss) writes
+#define CONFIG_FILE_MAGIC      0xC7
+#define CONFIG_FORMAT_VER         2
+#define CONFIG_FORMAT_VER_UNCHECKED  1   // (older) no length or check, still read on load
+#define CONFIG_HEADER_SIZE        3
+#define CONFIG_CHECK_SIZE         2
+#define CONFIG_MAX_FILE_SIZE   (CONFIG_HEADER_SIZE + CONFIG_MAX_DATA_SIZE + CONFIG_CHECK_SIZE)
+
+// value types
+#define CFG_TYPE_U8       1
+#define CFG_TYPE_I8       2
+#define CFG_TYPE_U16      3
+#define CFG_TYPE_U32      4
+#define CFG_TYPE_FLOAT    5
+#define CFG_TYPE_STR      6
+
+// ConfigKeyDef::flags
+#define CFG_FLAG_RADIO    0x01   // a radio (modem) param, needs radio reconfigure
+#define CFG_FLAG_REBOOT   0x02   // only takes effect after reboot
+#define CFG_FLAG_SECRET   0x04   // never shown by get/format
+
+// keys (NOTE: persisted, so never re-number these!)
+#define CFG_KEY_RADIO_FREQ       1   // float, MHz
+#define CFG_KEY_RADIO_BW         2   // float, kHz
+#define CFG_KEY_RADIO_SF         3   // u8
+#define CFG_KEY_RADIO_CR         4   // u8
+#define CFG_KEY_TX_POWER         5   // i8, dBm
+#define CFG_KEY_AIRTIME_FACTOR   6   // float
+#define CFG_KEY_NODE_NAME        7   // str
+#define CFG_KEY_ADMIN_PASSWORD   8   // str
+#define CFG_KEY_GUEST_PASSWORD   9   // str
+#define CFG_KEY_NODE_LAT        10   // float, degrees
+#define CFG_KEY_NODE_LON        11   // float, degrees
+#define CFG_KEY_ADVERT_INTERVAL 12   // u16, minutes (0 = no periodic adverts)
+#define CFG_KEY_DEEP_SLEEP      13   // u8, 1 = sleep whenever idle (low power repeater)
+#define CFG_KEY_FLOOD_HOPS_BASE 14   // u8, max hops to flood, per payload type, ie. key = BASE + PAYLOAD_TYPE_*  (14..29 reserved)
+//  next free key: 30
+
+// set*() results
+#define CFG_OK                0
+#define CFG_ERR_UNKNOWN_KEY   1
+#define CFG_ERR_TYPE          2
+#define CFG_ERR_RANGE         3
+#define CFG_ERR_FULL          4
+
+struct ConfigKeyDef {
+  uint8_t key;
+  uint8_t type;      // one of CFG_TYPE_*
+  uint8_t flags;     // CFG_FLAG_*
+  const char* name;  // for CLI, eg. "sf"
+  float min_val, max_val;   // for CFG_TYPE_STR, max_val is the max length
+};
+
+/**
+ * \brief  gets notified when a config value changes (ie. so it can be applied without a reboot)
+ */
+class ConfigListener {
+public:
+  virtual void onConfigChanged(const ConfigKeyDef* def) = 0;
+};
+
+/**
+ * \brief  Typed, versioned key/value store of runtime settings, persisted next to the IdentityStore.
+ *       Only values which have been explicitly set are stored, the getters take the (compile-time) default.
+ *       Values are kept (and saved) encoded as: key(1), len(1), value bytes.  Strings are stored with their null terminator.
+ */
+class ConfigStore {
+  FILESYSTEM* _fs;
+  const char* _dir;
+  uint8_t _data[CONFIG_MAX_DATA_SIZE];
+  int _data_len;
+  ConfigListener* _listener;
+
+  const uint8_t* findValue(uint8_t key, uint8_t& len) const;
+  void removeValue(uint8_t key);
+  int putValue(const ConfigKeyDef* def, const void* src, uint8_t len);
+  void getFilename(char* dest) const;
+
+public:
+  ConfigStore(FILESYSTEM& fs, const char* dir): _fs(&fs), _dir(dir) { _data_len = 0; _listener = NULL; }
+
+  void begin() { _fs->mkdir(_dir); }
+  bool load();
+  bool save();
+
+  void setListener(ConfigListener* listener) { _listener = listener; }
+
+  static const ConfigKeyDef* getKeyDef(uint8_t key);
+  static const ConfigKeyDef* findKeyDef(const char* name, int name_len);
+
+  bool isSet(uint8_t key) const { uint8_t len; return findValue(key, len) != NULL; }
+
+  uint32_t getUInt(uint8_t key, uint32_t def_val) const;
+  int32_t getInt(uint8_t key, int32_t def_val) const;
+  float getFloat(uint8_t key, float def_val) const;
+  const char* getString(uint8_t key, const char* def_val) const;
+
+  /**
+   * \brief  validate and set the value for 'key', notifying the listener if value is different
+   * \returns  one of CFG_OK, CFG_ERR_*
+   */
+  int setUInt(uint8_t key, uint32_t val);
+  int setInt(uint8_t key, int32_t val);
+  int setFloat(uint8_t key, float val);
+  int setString(uint8_t key, const char* val);
+
+  /**
+   * \brief  parse 'text' per the type of key 'name', and set it.  (eg. from CLI 'set sf=9')
+   * \returns  one of CFG_OK, CFG_ERR_*
+   */
+  int setFromText(const char* name, int name_len, const char* text);
+
+  /**
+   * \brief  format the current value of 'def' as text (or "***" if secret)
+   * \returns  false if not set, ie. is default
+   */
+  bool formatValue(const ConfigKeyDef* def, char* dest) const;
+
+  /**
+   * \brief  revert 'key' to its default value (notifies listener)
+   */
+  void reset(uint8_t key);
+
+  /**
+   * \returns  text description of a CFG_ERR_* code
+   */
+  static const char* getErrorText(int err);
+
+  /**
+   * \brief  (de)serialise, ie. the file content. 'dest' should be CONFIG_MAX_FILE_SIZE
+   * \returns  writeTo(): length, or zero if too small.  readFrom(): false if not a (complete) config
+   */
+  int writeTo(uint8_t* dest, int max_len) const;
+  bool readFrom(const uint8_t* src, int len);
+};
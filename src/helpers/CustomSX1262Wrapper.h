@@ -4,6 +4,16 @@
 #include "RadioLibWrappers.h"
 
 class CustomSX1262Wrapper : public RadioLibWrapper {
+protected:
+  int applyModemParams(float freq, float bw, uint8_t sf, uint8_t cr, int8_t tx_power) override {
+    auto sx = (CustomSX1262 *)_radio;
+    int err = sx->setFrequency(freq);
+    if (err == RADIOLIB_ERR_NONE) err = sx->setBandwidth(bw);
+    if (err == RADIOLIB_ERR_NONE) err = sx->setSpreadingFactor(sf);
+    if (err == RADIOLIB_ERR_NONE) err = sx->setCodingRate(cr);
+    if (err == RADIOLIB_ERR_NONE) err = sx->setOutputPower(tx_power);
+    return err;
+  }
 public:
   CustomSX1262Wrapper(CustomSX1262& radio, mesh::MainBoard& board) : RadioLibWrapper(radio, board) { }
   bool isReceiving() override { 
@@ -0,0 +1,59 @@
+#include "DeepSleepState.h"
+
+bool DeepSleepState::retainPackets(mesh::PacketManager* mgr, unsigned long now_millis) {
+  int n = mgr->getOutboundCount();
+  if (n > SLEEP_MAX_RETAINED_PACKETS) return false;
+
+  for (int i = 0; i < n; i++) {
+    RetainedPacket* dest = &packets[i];
+    uint32_t scheduled_for;
+    if (!mgr->getOutboundInfo(i, dest->priority, scheduled_for)) return false;
+
+    const mesh::Packet* pkt = mgr->getOutboundByIdx(i);
+    dest->header = pkt->header;
+    dest->max_hops = pkt->max_hops;
+    dest->path_hash_size = pkt->path_hash_size;
+    dest->path_len = pkt->path_len;
+    dest->payload_len = pkt->payload_len;
+    memcpy(dest->path, pkt->path, pkt->path_len);
+    memcpy(dest->payload, pkt->payload, pkt->payload_len);
+
+    long due = (long)(scheduled_for - now_millis);
+    dest->due_in_millis = due > 0 ? due : 0;
+  }
+  num_packets = n;
+  return true;
+}
+
+uint32_t DeepSleepState::restorePacket(int i, mesh::Packet* dest, uint8_t& priority, uint32_t slept_millis) const {
+  const RetainedPacket* src = &packets[i];
+  dest->header = src->header;
+  dest->max_hops = src->max_hops;
+  dest->path_hash_size = src->path_hash_size;
+  dest->path_len = src->path_len;
+  dest->payload_len = src->payload_len;
+  memcpy(dest->path, src->path, src->path_len);
+  memcpy(dest->payload, src->payload, src->payload_len);
+  priority = src->priority;
+
+  return src->due_in_millis > slept_millis ? src->due_in_millis - slept_millis : 0;
+}
+
+uint32_t DeepSleepState::onWake(uint32_t now, bool rx_wake) {
+  if (rx_wake) {
+    stats.n_rx_wakes++;
+  } else {
+    stats.n_timer_wakes++;
+  }
+  uint32_t secs = now > slept_at ? now - slept_at : 0;
+  stats.total_sleep_secs += secs;
+  return secs;
+}
+
+void DeepSleepState::onWakeForward(unsigned long millis) {
+  uint16_t ms = millis > 0xFFFF ? 0xFFFF : millis;
+  stats.n_wake_fwds++;
+  stats.wake_fwd_total_millis += millis;
+  stats.wake_fwd_last_millis = ms;
+  if (ms > stats.wake_fwd_max_millis) stats.wake_fwd_max_millis = ms;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Dispatcher.h>
+#include <Identity.h>
+#include <helpers/SimpleMeshTables.h>
+#include <helpers/StaticPoolPacketManager.h>
+#include <helpers/ConfigStore.h>
+#include <helpers/Telemetry.h>
+
+#ifndef SLEEP_MAX_RETAINED_PACKETS
+  #define SLEEP_MAX_RETAINED_PACKETS   4   // won't sleep if more than this are queued
+#endif
+
+#define DEEP_SLEEP_STATE_MAGIC   0x5EE9D00D
+#define SLEEP_IDENTITY_SIZE      (PRV_KEY_SIZE + PUB_KEY_SIZE)
+
+struct RetainedPacket {
+  uint8_t header, max_hops, path_hash_size;
+  uint8_t priority;
+  uint16_t path_len, payload_len;
+  uint32_t due_in_millis;    // from when sleep started
+  uint8_t path[MAX_PATH_SIZE];
+  uint8_t payload[MAX_PACKET_PAYLOAD];
+};
+
+/**
+ * \brief  Everything a repeater needs to resume after a deep sleep, without re-reading flash: the dedup table, the
+ *       send queue, counters and stats (incl. neighbours and traffic classes), identity and config.  Intended to live in RTC (retained) RAM, so is plain data (ie. no
+ *       constructor, which would re-run on every wake).  Only valid if isValid(), ie. not after a cold boot.
+ */
+struct DeepSleepState {
+  uint32_t magic;
+  uint32_t slept_at;        // RTC time, when sleep started
+  uint32_t advert_due_millis;   // next periodic advert, from when sleep started
+  SimpleMeshTablesState tables;
+  mesh::DispatcherState dispatcher;   // (incl. neighbours)
+  TrafficStatsState queue_stats;
+  uint32_t n_dupes, n_decrypt_failed, n_scope_dropped;
+  uint32_t n_radio_recv, n_radio_sent;
+  uint8_t identity[SLEEP_IDENTITY_SIZE];
+  uint8_t config[CONFIG_MAX_FILE_SIZE];
+  uint16_t config_len;
+  uint8_t num_packets;
+  RetainedPacket packets[SLEEP_MAX_RETAINED_PACKETS];
+  TelemetrySleep stats;     // NOTE: kept across wakes, even when magic is cleared
+
+  bool isValid() const { return magic == DEEP_SLEEP_STATE_MAGIC; }
+  void invalidate() { magic = 0; }
+
+  /**
+   * \brief  reset the stats, ie. on a power-on or other (non deep sleep) reset
+   */
+  void clearStats() { memset(&stats, 0, sizeof(stats)); }
+
+  /**
+   * \brief  copy the outbound queue
+   * \returns  false if too many queued (or queue info not supported), ie. should not sleep
+   */
+  bool retainPackets(mesh::PacketManager* mgr, unsigned long now_millis);
+
+  /**
+   * \brief  copy the i'th retained packet into 'dest'
+   * \param  slept_millis  how long was slept
+   * \returns  delay until it's due to be sent
+   */
+  uint32_t restorePacket(int i, mesh::Packet* dest, uint8_t& priority, uint32_t slept_millis) const;
+
+  /**
+   * \brief  record a wake, and whether it was due to a received packet
+   * \returns  seconds slept
+   */
+  uint32_t onWake(uint32_t now, bool rx_wake);
+
+  /**
+   * \brief  record time from (rx) wake to a packet being sent
+   */
+  void onWakeForward(unsigned long millis);
+};
@@ -0,0 +1,124 @@
+#include "FragmentHelpers.h"
+#include <string.h>
+
+bool FragmentHeader::readFrom(const uint8_t* src, size_t len) {
+  if (len < FRAG_HEADER_SIZE) return false;
+
+  memcpy(&msg_id, src, 2);
+  frag_idx = src[2];
+  frag_count = src[3];
+  flags = src[4];
+  frag_len = src[5];
+
+  if (frag_count == 0 || frag_count > FRAG_MAX_COUNT) return false;
+  if ((size_t)(FRAG_HEADER_SIZE + frag_len) > len) return false;
+  if (flags & FRAG_FLAG_SACK) return frag_len == 4;
+
+  if (frag_idx >= frag_count || frag_len == 0 || frag_len > FRAG_DATA_SIZE) return false;
+  return frag_idx == frag_count - 1 || frag_len == FRAG_DATA_SIZE;  // only final fragment can be short
+}
+
+int FragmentHeader::writeTo(uint8_t* dest) const {
+  memcpy(dest, &msg_id, 2);
+  dest[2] = frag_idx;
+  dest[3] = frag_count;
+  dest[4] = flags;
+  dest[5] = frag_len;
+  return FRAG_HEADER_SIZE;
+}
+
+ReassemblyArena::ReassemblyArena() {
+  used = 0;
+  for (int i = 0; i < FRAG_MAX_REASSEMBLIES; i++) {
+    slots[i].contact_idx = -1;
+  }
+}
+
+int ReassemblyArena::allocBlocks(int num) {
+  // first-fit search for 'num' contiguous free blocks
+  int run = 0;
+  for (int i = 0; i < FRAG_ARENA_BLOCKS; i++) {
+    if (used & (1ULL << i)) {
+      run = 0;
+    } else if (++run == num) {
+      int first = i - num + 1;
+      for (int j = first; j <= i; j++) used |= (1ULL << j);
+      return first;
+    }
+  }
+  return -1;  // arena too fragmented, or full
+}
+
+void ReassemblyArena::freeBlocks(const Reassembly* r) {
+  if (r->is_done) return;   // already freed
+  for (int j = 0; j < r->frag_count; j++) used &= ~(1ULL << (r->first_block + j));
+}
+
+Reassembly* ReassemblyArena::find(int contact_idx, uint16_t msg_id) {
+  for (int i = 0; i < FRAG_MAX_REASSEMBLIES; i++) {
+    if (slots[i].contact_idx == contact_idx && slots[i].msg_id == msg_id) return &slots[i];
+  }
+  return NULL;
+}
+
+Reassembly* ReassemblyArena::start(int contact_idx, uint16_t msg_id, uint8_t frag_count, unsigned long expires) {
+  Reassembly* r = NULL;
+  for (int i = 0; i < FRAG_MAX_REASSEMBLIES; i++) {
+    if (slots[i].contact_idx < 0) { r = &slots[i]; break; }
+  }
+  if (r == NULL) {   // try to recycle a completed one
+    for (int i = 0; i < FRAG_MAX_REASSEMBLIES; i++) {
+      if (slots[i].is_done) { r = &slots[i]; break; }
+    }
+  }
+  if (r == NULL || frag_count > FRAG_ARENA_BLOCKS) return NULL;
+
+  int first = allocBlocks(frag_count);
+  if (first < 0) return NULL;
+
+  r->contact_idx = contact_idx;
+  r->msg_id = msg_id;
+  r->frag_count = frag_count;
+  r->first_block = first;
+  r->last_len = 0;
+  r->is_done = false;
+  r->received = 0;
+  r->expires = expires;
+  return r;
+}
+
+bool ReassemblyArena::putFragment(Reassembly* r, uint8_t frag_idx, const uint8_t* data, uint8_t len) {
+  uint32_t bit = 1UL << frag_idx;
+  if (r->is_done || frag_idx >= r->frag_count || (r->received & bit)) return false;
+
+  memcpy(blocks[r->first_block + frag_idx], data, len);
+  if (frag_idx == r->frag_count - 1) r->last_len = len;
+  r->received |= bit;
+  return true;
+}
+
+const uint8_t* ReassemblyArena::getBlob(const Reassembly* r, size_t& len) const {
+  len = (r->frag_count - 1) * FRAG_DATA_SIZE + r->last_len;
+  return blocks[r->first_block];
+}
+
+void ReassemblyArena::finish(Reassembly* r, unsigned long expires) {
+  freeBlocks(r);
+  r->is_done = true;
+  r->expires = expires;
+}
+
+void ReassemblyArena::release(Reassembly* r) {
+  freeBlocks(r);
+  r->contact_idx = -1;
+}
+
+void ReassemblyArena::checkExpired(unsigned long now) {
+  for (int i = 0; i < FRAG_MAX_REASSEMBLIES; i++) {
+    auto r = &slots[i];
+    if (r->contact_idx >= 0 && (long)(now - r->expires) >= 0) {
+      MESH_DEBUG_PRINTLN("ReassemblyArena: expired msg_id=%04X, received=%08X", (uint32_t) r->msg_id, r->received);
+      release(r);
+    }
+  }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <Mesh.h>
+
+/*
+  PAYLOAD_TYPE_MULTIPART encrypted data layout:
+    msg_id(2), frag_idx(1), frag_count(1), flags(1), frag_len(1), fragment data[frag_len]
+  Or, if flags has FRAG_FLAG_SACK:
+    msg_id(2), 0, frag_count(1), flags(1), 4, received bitmap(4)
+*/
+#define FRAG_HEADER_SIZE        6
+#ifndef FRAG_DATA_SIZE
+  #define FRAG_DATA_SIZE      160     // must be <= (MAX_PACKET_PAYLOAD - CIPHER_MAC_SIZE - (CIPHER_BLOCK_SIZE-1) - FRAG_HEADER_SIZE)
+#endif
+static_assert(FRAG_HEADER_SIZE + FRAG_DATA_SIZE + CIPHER_MAC_SIZE + (CIPHER_BLOCK_SIZE-1) <= MAX_PACKET_PAYLOAD,
+              "FRAG_DATA_SIZE too big for Mesh::createDatagram()");
+#define FRAG_MAX_COUNT         32     // so that received fragments fit in a 32-bit SACK bitmap
+#define MAX_BLOB_SIZE         (FRAG_MAX_COUNT*FRAG_DATA_SIZE)
+
+#define FRAG_FLAG_POLL       0x80     // sender wants a SACK in reply
+#define FRAG_FLAG_SACK       0x40     // a selective ACK, from the receiver
+#define FRAG_ATTEMPT_MASK    0x3F     // (re)send round. Makes retransmitted fragments unique (to packet hash)
+
+#ifndef FRAG_ARENA_BLOCKS
+  #define FRAG_ARENA_BLOCKS    40     // num FRAG_DATA_SIZE blocks shared by all reassemblies (max 64)
+#endif
+#ifndef FRAG_MAX_REASSEMBLIES
+  #define FRAG_MAX_REASSEMBLIES 4
+#endif
+#define FRAG_REASSEMBLY_TIMEOUT  60000   // millis, after last fragment received
+#define FRAG_DONE_LINGER         30000   // millis, to remember completed blobs (to answer repeated polls)
+#define FRAG_MAX_ROUNDS              4   // max num SACK polls by sender. Final round is always sent flood
+
+#if FRAG_ARENA_BLOCKS > 64
+  #error "FRAG_ARENA_BLOCKS must be <= 64"
+#endif
+
+struct FragmentHeader {
+  uint16_t msg_id;
+  uint8_t  frag_idx;
+  uint8_t  frag_count;
+  uint8_t  flags;
+  uint8_t  frag_len;
+
+  bool readFrom(const uint8_t* src, size_t len);
+  int  writeTo(uint8_t* dest) const;
+
+  static uint32_t fullMask(uint8_t frag_count) { return frag_count >= 32 ? 0xFFFFFFFF : ((1UL << frag_count) - 1); }
+};
+
+struct Reassembly {
+  int      contact_idx;     // -1 = unused slot
+  uint16_t msg_id;
+  uint8_t  frag_count;
+  uint8_t  first_block;     // index into arena (fragments are stored contiguously)
+  uint8_t  last_len;        // length of final fragment
+  bool     is_done;         // blob already delivered, blocks released
+  uint32_t received;        // bitmap of fragments received
+  unsigned long expires;
+};
+
+/**
+ * \brief  A bounded arena of fixed size blocks, for reassembling inbound multipart blobs.
+ *         Each blob is allocated a contiguous run of blocks, so it can be handed to the app without copying.
+ */
+class ReassemblyArena {
+  uint8_t blocks[FRAG_ARENA_BLOCKS][FRAG_DATA_SIZE];
+  uint64_t used;   // bitmap of allocated blocks
+  Reassembly slots[FRAG_MAX_REASSEMBLIES];
+
+  int  allocBlocks(int num);
+  void freeBlocks(const Reassembly* r);
+
+public:
+  ReassemblyArena();
+
+  Reassembly* find(int contact_idx, uint16_t msg_id);
+
+  /**
+   * \returns  a new reassembly, or NULL if no slots or blocks are free
+   */
+  Reassembly* start(int contact_idx, uint16_t msg_id, uint8_t frag_count, unsigned long expires);
+
+  /**
+   * \returns  true if this is a fragment not previously received
+   */
+  bool putFragment(Reassembly* r, uint8_t frag_idx, const uint8_t* data, uint8_t len);
+
+  bool isComplete(const Reassembly* r) const { return r->received == FragmentHeader::fullMask(r->frag_count); }
+  const uint8_t* getBlob(const Reassembly* r, size_t& len) const;
+
+  /**
+   * \brief  release the blocks of a delivered blob, but remember its id until 'expires'
+   */
+  void finish(Reassembly* r, unsigned long expires);
+
+  void release(Reassembly* r);
+  void checkExpired(unsigned long now);
+};
+
+/**
+ * \brief  state of the (single) outbound multipart transfer. Blob data is owned by caller, until completion.
+ */
+struct OutboundBlob {
+  const uint8_t* data;      // NULL = idle
+  size_t   len;
+  int      contact_idx;
+  uint16_t msg_id;
+  uint8_t  frag_count;
+  uint8_t  round;           // num times SACK poll has been (re)sent
+  uint32_t acked;           // bitmap from recipient's SACKs
+  uint32_t to_send;         // fragments still to be sent, this round
+  unsigned long sack_timeout;   // 0 = not yet polled, this round
+  unsigned long start_millis;   // for throughput stats
+};
@@ -0,0 +1,67 @@
+#include "PacketTrace.h"
+#include <string.h>
+#include <ctype.h>
+
+int PacketTrace::writeHeader(uint8_t* dest) {
+  memcpy(dest, TRACE_MAGIC, 4);
+  dest[4] = TRACE_FORMAT_VER;
+  return TRACE_HEADER_SIZE;
+}
+
+bool PacketTrace::isValidHeader(const uint8_t* src, int len) {
+  return len >= TRACE_HEADER_SIZE && memcmp(src, TRACE_MAGIC, 4) == 0 && src[4] == TRACE_FORMAT_VER;
+}
+
+int PacketTrace::encode(uint8_t* dest, const TraceRecord& rec) {
+  int i = 0;
+  memcpy(&dest[i], &rec.timestamp, 4); i += 4;
+  memcpy(&dest[i], &rec.rssi_x4, 2); i += 2;
+  dest[i++] = (uint8_t) rec.snr_x4;
+  dest[i++] = rec.flags;
+  dest[i++] = rec.len;
+  memcpy(&dest[i], rec.raw, rec.len); i += rec.len;
+  return i;
+}
+
+int PacketTrace::decode(const uint8_t* src, int len, TraceRecord& rec) {
+  if (len < TRACE_RECORD_HDR_SIZE) return 0;
+
+  int i = 0;
+  memcpy(&rec.timestamp, &src[i], 4); i += 4;
+  memcpy(&rec.rssi_x4, &src[i], 2); i += 2;
+  rec.snr_x4 = (int8_t) src[i++];
+  rec.flags = src[i++];
+  rec.len = src[i++];
+  if (i + rec.len > len) return 0;   // incomplete
+
+  memcpy(rec.raw, &src[i], rec.len); i += rec.len;
+  return i;
+}
+
+int PacketTrace::parseLine(const char* line, uint8_t* dest, int max_len) {
+  const char* sp = strstr(line, TRACE_LINE_PREFIX);
+  if (sp == NULL) return 0;
+  sp += strlen(TRACE_LINE_PREFIX);
+
+  int hex_len = 0;
+  while (isxdigit(sp[hex_len])) hex_len++;
+  int len = hex_len / 2;
+  if (len < TRACE_RECORD_HDR_SIZE || len > max_len) return 0;
+
+  char hex[MAX_TRACE_RECORD_SIZE*2 + 1];
+  memcpy(hex, sp, len*2);
+  hex[len*2] = 0;
+  if (!mesh::Utils::fromHex(dest, len, hex)) return 0;
+
+  TraceRecord rec;
+  return decode(dest, len, rec) == len ? len : 0;   // check it is a whole record
+}
+
+void StreamTraceSink::onTraceRecord(const TraceRecord& rec) {
+  uint8_t buf[MAX_TRACE_RECORD_SIZE];
+  int len = PacketTrace::encode(buf, rec);
+
+  _out->print(TRACE_LINE_PREFIX);
+  mesh::Utils::printHex(*_out, buf, len);
+  _out->println();
+}
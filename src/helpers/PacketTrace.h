@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Mesh.h>
+
+/*
+ * Packet trace format (all little-endian):
+ *   header:  "MCTR", format version (1 byte)
+ *   records: timestamp millis (4), RSSI x4 (2), SNR x4 (1), flags (1), raw len (1), raw frame (len)
+ */
+#define TRACE_MAGIC             "MCTR"
+#define TRACE_FORMAT_VER        1
+#define TRACE_HEADER_SIZE       5
+#define TRACE_RECORD_HDR_SIZE   9
+#define MAX_TRACE_RECORD_SIZE   (TRACE_RECORD_HDR_SIZE + MAX_TRANS_UNIT)
+
+#define TRACE_FLAG_TX        0x01    // frame was transmitted by this node (RSSI/SNR not applicable)
+
+#define TRACE_LINE_PREFIX    "TRACE:"   // for records captured as hex text lines (eg. over Serial)
+
+struct TraceRecord {
+  uint32_t timestamp;   // millis
+  int16_t rssi_x4;
+  int8_t snr_x4;
+  uint8_t flags;
+  uint8_t len;
+  uint8_t raw[MAX_TRANS_UNIT];
+};
+
+class PacketTrace {
+public:
+  /**
+   * \returns  num bytes written to 'dest' (must be TRACE_HEADER_SIZE)
+   */
+  static int writeHeader(uint8_t* dest);
+
+  /**
+   * \returns  true if 'src' starts with a valid trace header (of supported version)
+   */
+  static bool isValidHeader(const uint8_t* src, int len);
+
+  /**
+   * \returns  num bytes written to 'dest' (max MAX_TRACE_RECORD_SIZE)
+   */
+  static int encode(uint8_t* dest, const TraceRecord& rec);
+
+  /**
+   * \returns  num bytes consumed from 'src', or zero if incomplete/invalid
+   */
+  static int decode(const uint8_t* src, int len, TraceRecord& rec);
+
+  /**
+   * \brief  parse a TRACE_LINE_PREFIX text line (as written by StreamTraceSink) back into an encoded record.
+   * \returns  num bytes written to 'dest', or zero if not a valid trace line
+   */
+  static int parseLine(const char* line, uint8_t* dest, int max_len);
+};
+
+/**
+ * \brief  receives captured frames, eg. from RadioLibWrapper::setTraceSink()
+ */
+class PacketTraceSink {
+public:
+  virtual void onTraceRecord(const TraceRecord& rec) = 0;
+};
+
+/**
+ * \brief  writes each record as a hex text line, with TRACE_LINE_PREFIX, to a Stream (eg. Serial)
+ */
+class StreamTraceSink : public PacketTraceSink {
+  Stream* _out;
+public:
+  StreamTraceSink(Stream& out) : _out(&out) { }
+
+  void onTraceRecord(const TraceRecord& rec) override;
+};
@@ -0,0 +1,59 @@
+#include "PostBatch.h"
+#include <string.h>
+
+bool PostBatchWriter::add(uint32_t post_timestamp, const uint8_t* author_pub_key, const char* text) {
+  int text_len = strlen(text);
+  if (_count >= 255 || text_len > 255) return false;
+  if (_len + 4 + POST_BATCH_AUTHOR_PREFIX + 1 + text_len > POST_BATCH_MAX_LEN) return false;
+
+  memcpy(&_buf[_len], &post_timestamp, 4); _len += 4;
+  memcpy(&_buf[_len], author_pub_key, POST_BATCH_AUTHOR_PREFIX); _len += POST_BATCH_AUTHOR_PREFIX;
+  _buf[_len++] = text_len;
+  memcpy(&_buf[_len], text, text_len); _len += text_len;
+
+  _last_ts = post_timestamp;
+  _count++;
+  return true;
+}
+
+int PostBatchWriter::finish() {
+  memcpy(_buf, &_last_ts, 4);   // for packet_hash uniqueness (and cumulative 'synced up to')
+  _buf[4] = TXT_TYPE_POST_BATCH << 2;
+  _buf[5] = _count;
+  return _len;
+}
+
+PostBatchReader::PostBatchReader(const uint8_t* data, int len) : _data(data), _len(len) {
+  _pos = POST_BATCH_HEADER_SIZE;
+  _remaining = len >= POST_BATCH_HEADER_SIZE ? data[5] : 0;
+}
+
+bool PostBatchReader::isValid() const {
+  if (_len < POST_BATCH_HEADER_SIZE || ((_data[4] >> 2) & 0x1F) != TXT_TYPE_POST_BATCH) return false;
+  return getContentLen() > 0;
+}
+
+int PostBatchReader::getContentLen() const {
+  int pos = POST_BATCH_HEADER_SIZE;
+  for (int i = 0; i < _data[5]; i++) {
+    if (pos + 4 + POST_BATCH_AUTHOR_PREFIX + 1 > _len) return -1;
+    pos += 4 + POST_BATCH_AUTHOR_PREFIX;
+    pos += 1 + _data[pos];
+    if (pos > _len) return -1;
+  }
+  return pos;
+}
+
+bool PostBatchReader::next(uint32_t& post_timestamp, const uint8_t*& author_prefix, char* text) {
+  if (_remaining == 0 || _pos + 4 + POST_BATCH_AUTHOR_PREFIX + 1 > _len) return false;
+
+  memcpy(&post_timestamp, &_data[_pos], 4); _pos += 4;
+  author_prefix = &_data[_pos]; _pos += POST_BATCH_AUTHOR_PREFIX;
+  int text_len = _data[_pos++];
+  if (_pos + text_len > _len) { _remaining = 0; return false; }
+
+  memcpy(text, &_data[_pos], text_len); _pos += text_len;
+  text[text_len] = 0;
+  _remaining--;
+  return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <MeshCore.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define TXT_TYPE_POST_BATCH        1       // in TXT_MSG flags byte (bits 2+): several room posts, each with own timestamp and author
+
+#define ROOM_LOGIN_CAP_POST_BATCH  0x01    // room login capability: can unpack TXT_TYPE_POST_BATCH
+
+#define POST_BATCH_HEADER_SIZE     6       // timestamp(4), flags(1), count(1)
+#define POST_BATCH_AUTHOR_PREFIX   4       // num bytes of author's pub_key in each record
+#define POST_BATCH_MAX_LEN   (MAX_PACKET_PAYLOAD - CIPHER_MAC_SIZE - (CIPHER_BLOCK_SIZE-1))   // max datagram plaintext
+
+/**
+ * \brief  builds a TXT_TYPE_POST_BATCH datagram payload:  timestamp(4), flags(1), count(1), then per post:
+ *         post_timestamp(4), author_prefix(4), text_len(1), text.  The whole payload is ACK'd (cumulatively) as one.
+ */
+class PostBatchWriter {
+  uint8_t* _buf;
+  int _len, _count;
+  uint32_t _last_ts;
+
+public:
+  PostBatchWriter(uint8_t* buf) : _buf(buf), _len(POST_BATCH_HEADER_SIZE), _count(0), _last_ts(0) { }
+
+  /**
+   * \returns  false if post won't fit (or too many posts)
+   */
+  bool add(uint32_t post_timestamp, const uint8_t* author_pub_key, const char* text);
+
+  /**
+   * \brief  fills in the header
+   * \returns  length of payload
+   */
+  int finish();
+
+  int getCount() const { return _count; }
+  uint32_t getLastTimestamp() const { return _last_ts; }
+};
+
+/**
+ * \brief  iterates over the posts in a (decrypted) TXT_TYPE_POST_BATCH payload
+ */
+class PostBatchReader {
+  const uint8_t* _data;
+  int _len, _pos, _remaining;
+
+public:
+  /**
+   * \param  len  decrypted length (can include padding)
+   */
+  PostBatchReader(const uint8_t* data, int len);
+
+  /**
+   * \returns  false if header, or any record, is malformed
+   */
+  bool isValid() const;
+
+  /**
+   * \returns  length of the payload, without any padding (ie. the bytes covered by the ACK)
+   */
+  int getContentLen() const;
+
+  /**
+   * \param  text  OUT - NUL terminated, must be MAX_PACKET_PAYLOAD bytes
+   * \returns  false if no more posts
+   */
+  bool next(uint32_t& post_timestamp, const uint8_t*& author_prefix, char* text);
+};
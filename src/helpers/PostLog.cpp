@@ -0,0 +1,183 @@
+#include "PostLog.h"
+#include <Utils.h>
+
+static void calcCheck(uint8_t* dest, const uint8_t* record) {
+  mesh::Utils::sha256(dest, 2, record, POST_LOG_RECORD_SIZE - 2);
+}
+
+bool PostLog::readRecord(int slot, int idx, PostInfo* post, uint32_t* timestamp) {
+  uint8_t rec[POST_LOG_RECORD_SIZE];
+  if (post == NULL) {   // just need timestamp
+    return _store->readAt(slot, (uint32_t) idx * POST_LOG_RECORD_SIZE, (uint8_t *) timestamp, 4);
+  }
+  if (!_store->readAt(slot, (uint32_t) idx * POST_LOG_RECORD_SIZE, rec, POST_LOG_RECORD_SIZE)) return false;
+
+  uint8_t check[2];
+  calcCheck(check, rec);
+  if (memcmp(check, &rec[POST_LOG_RECORD_SIZE - 2], 2) != 0) return false;
+
+  int i = 0;
+  memcpy(&post->post_timestamp, &rec[i], 4); i += 4;
+  memcpy(post->author.pub_key, &rec[i], PUB_KEY_SIZE); i += PUB_KEY_SIZE;
+  int text_len = rec[i++];
+  if (text_len > MAX_POST_TEXT_LEN) return false;
+  memcpy(post->text, &rec[i], text_len);
+  post->text[text_len] = 0;
+
+  if (timestamp) *timestamp = post->post_timestamp;
+  return true;
+}
+
+void PostLog::scanSegment(int slot) {
+  PostLogSegment* seg = &_segs[slot];
+  uint32_t size = _store->getSize(slot);
+  int n = size / POST_LOG_RECORD_SIZE;
+  seg->sealed = (size % POST_LOG_RECORD_SIZE) != 0 || n >= POST_LOG_SEGMENT_POSTS;   // partial append, or full
+
+  // only the tail can be damaged (by power loss mid append)
+  PostInfo post;
+  while (n > 0 && !readRecord(slot, n - 1, &post, &seg->last_ts)) {
+    MESH_DEBUG_PRINTLN("PostLog: discarding damaged record, slot=%d idx=%d", slot, n - 1);
+    n--;
+    seg->sealed = true;   // can't append after the damage
+  }
+  seg->count = n;
+  if (n == 0 || !readRecord(slot, 0, NULL, &seg->first_ts)) {
+    seg->count = 0;
+    seg->first_ts = seg->last_ts = 0;
+  }
+}
+
+void PostLog::begin(PostLogStorage& store) {
+  _store = &store;
+  _head = -1;
+  _last_ts = 0;
+  for (int s = 0; s < POST_LOG_MAX_SEGMENTS; s++) {
+    scanSegment(s);
+    if (_segs[s].count > 0 && (_head < 0 || _segs[s].last_ts > _last_ts)) {
+      _head = s;
+      _last_ts = _segs[s].last_ts;
+    }
+  }
+}
+
+void PostLog::eraseSegment(int slot) {
+  _store->erase(slot);
+  memset(&_segs[slot], 0, sizeof(_segs[slot]));
+}
+
+uint32_t PostLog::append(const mesh::Identity& author, const char* text, uint32_t now) {
+  if (_store == NULL) return 0;
+
+  if (_head < 0 || _segs[_head].sealed || _segs[_head].count >= POST_LOG_SEGMENT_POSTS) {
+    _head = (_head + 1) % POST_LOG_MAX_SEGMENTS;   // start next segment (in ring)
+    if (_store->getSize(_head) > 0) eraseSegment(_head);   // maintain() didn't get to it
+  }
+
+  uint32_t ts = now > _last_ts ? now : _last_ts + 1;
+
+  uint8_t rec[POST_LOG_RECORD_SIZE];
+  memset(rec, 0, sizeof(rec));
+  int i = 0;
+  memcpy(&rec[i], &ts, 4); i += 4;
+  memcpy(&rec[i], author.pub_key, PUB_KEY_SIZE); i += PUB_KEY_SIZE;
+  int text_len = strlen(text);
+  if (text_len > MAX_POST_TEXT_LEN) text_len = MAX_POST_TEXT_LEN;
+  rec[i++] = text_len;
+  memcpy(&rec[i], text, text_len);
+  calcCheck(&rec[POST_LOG_RECORD_SIZE - 2], rec);
+
+  PostLogSegment* seg = &_segs[_head];
+  if (!_store->append(_head, rec, POST_LOG_RECORD_SIZE)) {
+    MESH_DEBUG_PRINTLN("PostLog: append failed, slot=%d", _head);
+    seg->sealed = true;   // may have written partial record, so next append goes to a fresh segment
+    return 0;
+  }
+  if (seg->count == 0) seg->first_ts = ts;
+  seg->last_ts = ts;
+  seg->count++;
+  _last_ts = ts;
+  return ts;
+}
+
+bool PostLog::findNext(uint32_t& since, const mesh::Identity* exclude_author, PostInfo& post) {
+  if (_head < 0) return false;
+
+  int scanned = 0;
+  for (int k = 1; k <= POST_LOG_MAX_SEGMENTS; k++) {   // oldest segment first
+    int slot = (_head + k) % POST_LOG_MAX_SEGMENTS;
+    PostLogSegment* seg = &_segs[slot];
+    if (seg->count == 0 || seg->last_ts <= since) continue;
+
+    // binary search for first record with timestamp > since
+    int lo = 0, hi = seg->count - 1;
+    if (seg->first_ts <= since) {
+      while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        uint32_t ts;
+        if (!readRecord(slot, mid, NULL, &ts)) return false;
+        if (ts <= since) lo = mid + 1; else hi = mid;
+      }
+    }
+    for (int idx = lo; idx < seg->count; idx++) {
+      if (!readRecord(slot, idx, &post, NULL)) continue;   // skip damaged record
+      if (post.post_timestamp <= since) continue;
+
+      if (exclude_author && post.author.matches(*exclude_author)) {
+        since = post.post_timestamp;   // skip over
+        if (++scanned >= POST_LOG_MAX_SCAN) return false;   // let caller try again later
+        continue;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+void PostLog::maintain(uint32_t min_timestamp) {
+  if (_head < 0) return;
+
+  int next = (_head + 1) % POST_LOG_MAX_SEGMENTS;
+  if (_segs[next].count > 0 || _segs[next].sealed) {   // (sealed, but empty, means damaged)
+    if (_segs[_head].sealed || _segs[_head].count >= POST_LOG_SEGMENT_POSTS*3/4) {
+      eraseSegment(next);  // make room ahead of time, one segment per call
+      return;
+    }
+  }
+  if (min_timestamp > 0) {
+    for (int k = 1; k < POST_LOG_MAX_SEGMENTS; k++) {   // oldest first, never the head
+      int slot = (_head + k) % POST_LOG_MAX_SEGMENTS;
+      if (_segs[slot].count > 0 && _segs[slot].last_ts < min_timestamp) {
+        eraseSegment(slot);
+        return;
+      }
+    }
+  }
+}
+
+int PostLog::countAfter(uint32_t since) {
+  int n = 0;
+  for (int s = 0; s < POST_LOG_MAX_SEGMENTS; s++) {
+    PostLogSegment* seg = &_segs[s];
+    if (seg->count == 0 || seg->last_ts <= since) continue;
+    if (seg->first_ts > since) {
+      n += seg->count;   // all newer
+      continue;
+    }
+    int lo = 0, hi = seg->count - 1;   // binary search for first record with timestamp > since
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      uint32_t ts;
+      if (!readRecord(s, mid, NULL, &ts)) break;
+      if (ts <= since) lo = mid + 1; else hi = mid;
+    }
+    n += seg->count - lo;
+  }
+  return n;
+}
+
+int PostLog::getNumPosts() const {
+  int n = 0;
+  for (int s = 0; s < POST_LOG_MAX_SEGMENTS; s++) n += _segs[s].count;
+  return n;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <Identity.h>
+
+#ifndef MAX_POST_TEXT_LEN
+  #define MAX_POST_TEXT_LEN    (160-9)
+#endif
+
+#if defined(NRF52_PLATFORM)
+  // InternalFS is only ~28KB (in 4KB blocks), shared with identity, config, etc. So 4 x ~3KB segments (one block each)
+  #ifndef POST_LOG_SEGMENT_POSTS
+    #define POST_LOG_SEGMENT_POSTS     16
+  #endif
+  #ifndef POST_LOG_MAX_SEGMENTS
+    #define POST_LOG_MAX_SEGMENTS       4
+  #endif
+#endif
+
+#ifndef POST_LOG_SEGMENT_POSTS
+  #define POST_LOG_SEGMENT_POSTS    128   // posts per segment (file)
+#endif
+#ifndef POST_LOG_MAX_SEGMENTS
+  #define POST_LOG_MAX_SEGMENTS      16   // so, max (POST_LOG_MAX_SEGMENTS - 1) * POST_LOG_SEGMENT_POSTS posts retained
+#endif
+#ifndef POST_LOG_MAX_SCAN
+  #define POST_LOG_MAX_SCAN          16   // max records findNext() will skip over per call
+#endif
+
+// record: timestamp (4), author pub_key, text_len (1), text (zero padded), check (2)
+#define POST_LOG_RECORD_SIZE   (4 + PUB_KEY_SIZE + 1 + MAX_POST_TEXT_LEN + 2)
+
+struct PostInfo {
+  mesh::Identity author;
+  uint32_t post_timestamp;   // by OUR clock
+  char text[MAX_POST_TEXT_LEN+1];
+};
+
+/**
+ * \brief  the storage the PostLog needs: a fixed set of append-only segments (eg. files), by slot number.
+ *        (so can be implemented with a flash filesystem, or a host filesystem for testing)
+ */
+class PostLogStorage {
+public:
+  /**
+   * \returns  size in bytes of segment, or zero if doesn't exist
+   */
+  virtual uint32_t getSize(int slot) = 0;
+  virtual bool readAt(int slot, uint32_t offset, uint8_t* dest, int len) = 0;
+  virtual bool append(int slot, const uint8_t* src, int len) = 0;
+  virtual void erase(int slot) = 0;
+};
+
+struct PostLogSegment {
+  uint16_t count;    // num valid records
+  bool sealed;       // no more appends (eg. damaged tail, after a crash)
+  uint32_t first_ts, last_ts;
+};
+
+/**
+ * \brief  Append-only, persistent log of posts, in timestamp order. Stored as a ring of segments, with
+ *        oldest segment erased to make room (compaction). Per segment timestamp ranges are kept in RAM,
+ *        and records are fixed size, so seeking to a timestamp is a binary search (O(log n) reads).
+ */
+class PostLog {
+  PostLogStorage* _store;
+  PostLogSegment _segs[POST_LOG_MAX_SEGMENTS];
+  int _head;    // slot of newest segment, or -1 if log is empty
+  uint32_t _last_ts;
+
+  bool readRecord(int slot, int idx, PostInfo* post, uint32_t* timestamp);
+  void scanSegment(int slot);
+  void eraseSegment(int slot);
+
+public:
+  PostLog() : _store(NULL), _head(-1), _last_ts(0) { memset(_segs, 0, sizeof(_segs)); }
+
+  /**
+   * \brief  load the index from storage, recovering from any partially written record.
+   */
+  void begin(PostLogStorage& store);
+
+  /**
+   * \brief  append a new post. Timestamps are forced to be unique and increasing.
+   * \returns  the post's timestamp, or zero if failed
+   */
+  uint32_t append(const mesh::Identity& author, const char* text, uint32_t now);
+
+  /**
+   * \brief  find the first post with timestamp after 'since', skipping over those by 'exclude_author'
+   * \param  since  IN/OUT - advanced past any skipped posts (which can be treated as synced)
+   * \returns  true if found (in 'post')
+   */
+  bool findNext(uint32_t& since, const mesh::Identity* exclude_author, PostInfo& post);
+
+  /**
+   * \brief  background compaction, call periodically. Erases the oldest segment ahead of time when the newest
+   *         is nearly full (so append() doesn't have to), and any segments entirely older than 'min_timestamp'.
+   */
+  void maintain(uint32_t min_timestamp=0);
+
+  /**
+   * \returns  number of posts with timestamp after 'since' (including any by the client itself)
+   */
+  int countAfter(uint32_t since);
+
+  int getNumPosts() const;
+  uint32_t getLastTimestamp() const { return _last_ts; }
+};
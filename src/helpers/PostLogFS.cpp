@@ -0,0 +1,45 @@
+#include "PostLogFS.h"
+
+uint32_t PostLogFS::getSize(int slot) {
+  char filename[40];
+  getFilename(filename, slot);
+  if (!_fs->exists(filename)) return 0;
+
+  File file = _fs->open(filename);
+  if (!file) return 0;
+  uint32_t sz = file.size();
+  file.close();
+  return sz;
+}
+
+bool PostLogFS::readAt(int slot, uint32_t offset, uint8_t* dest, int len) {
+  char filename[40];
+  getFilename(filename, slot);
+
+  File file = _fs->open(filename);
+  if (!file) return false;
+  bool success = file.seek(offset) && (int) file.read(dest, len) == len;
+  file.close();
+  return success;
+}
+
+bool PostLogFS::append(int slot, const uint8_t* src, int len) {
+  char filename[40];
+  getFilename(filename, slot);
+
+#if defined(NRF52_PLATFORM)
+  File file = _fs->open(filename, FILE_O_WRITE);   // NOTE: opens at end of file
+#else
+  File file = _fs->open(filename, "a", true);
+#endif
+  if (!file) return false;
+  bool success = (int) file.write(src, len) == len;
+  file.close();   // commits to flash
+  return success;
+}
+
+void PostLogFS::erase(int slot) {
+  char filename[40];
+  getFilename(filename, slot);
+  _fs->remove(filename);
+}
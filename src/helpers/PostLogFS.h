@@ -0,0 +1,33 @@
+#pragma once
+
+#if defined(ESP32)
+  #include <FS.h>
+  #define FILESYSTEM  fs::FS
+#elif defined(NRF52_PLATFORM)
+  #include <Adafruit_LittleFS.h>
+  #define FILESYSTEM  Adafruit_LittleFS
+
+  using namespace Adafruit_LittleFS_Namespace;
+#endif
+
+#include <helpers/PostLog.h>
+
+/**
+ * \brief  PostLogStorage with a file per segment, ie. "{dir}/{slot}.log", on the device's flash filesystem
+ */
+class PostLogFS : public PostLogStorage {
+  FILESYSTEM* _fs;
+  const char* _dir;
+
+  void getFilename(char* dest, int slot) { sprintf(dest, "%s/%d.log", _dir, slot); }
+
+public:
+  PostLogFS(FILESYSTEM& fs, const char* dir): _fs(&fs), _dir(dir) { }
+
+  void begin() { _fs->mkdir(_dir); }
+
+  uint32_t getSize(int slot) override;
+  bool readAt(int slot, uint32_t offset, uint8_t* dest, int len) override;
+  bool append(int slot, const uint8_t* src, int len) override;
+  void erase(int slot) override;
+};
@@ -45,6 +45,7 @@ int RadioLibWrapper::recvRaw(uint8_t* bytes, int sz) {
         MESH_DEBUG_PRINTLN("RadioLibWrapper: error: readData(%d)", err);
       } else {
       //  Serial.print("  readData() -> "); Serial.println(len);
+        if (_trace) capture(bytes, len, 0);
       }
       n_recv++;
     }
@@ -62,17 +63,50 @@ int RadioLibWrapper::recvRaw(uint8_t* bytes, int sz) {
   return 0;
 }
 
+bool RadioLibWrapper::isInRecvMode() const {
+  return state == STATE_RX;
+}
+
 uint32_t RadioLibWrapper::getEstAirtimeFor(int len_bytes) {
   return _radio->getTimeOnAir(len_bytes) / 1000;
 }
 
+bool RadioLibWrapper::reconfigure(float freq, float bw, uint8_t sf, uint8_t cr, int8_t tx_power) {
+  if (state == STATE_TX_WAIT) return false;   // don't pull the rug from under a transmit
+
+  idle();
+  int err = applyModemParams(freq, bw, sf, cr, tx_power);
+  if (err != RADIOLIB_ERR_NONE) {
+    MESH_DEBUG_PRINTLN("RadioLibWrapper: error: reconfigure(%d)", err);
+    return false;
+  }
+  return true;
+}
+
 void RadioLibWrapper::startSendRaw(const uint8_t* bytes, int len) {
   state = STATE_TX_WAIT;
   _board->onBeforeTransmit();
   int err = _radio->startTransmit((uint8_t *) bytes, len);
   if (err != RADIOLIB_ERR_NONE) {
     MESH_DEBUG_PRINTLN("RadioLibWrapper: error: startTransmit(%d)", err);
+  } else if (_trace) {
+    capture(bytes, len, TRACE_FLAG_TX);
+  }
+}
+
+void RadioLibWrapper::capture(const uint8_t* bytes, int len, uint8_t flags) {
+  TraceRecord rec;
+  rec.timestamp = millis();
+  if (flags & TRACE_FLAG_TX) {
+    rec.rssi_x4 = 0; rec.snr_x4 = 0;
+  } else {
+    rec.rssi_x4 = (int16_t) (getLastRSSI() * 4);
+    rec.snr_x4 = (int8_t) (getLastSNR() * 4);
   }
+  rec.flags = flags;
+  rec.len = len;
+  memcpy(rec.raw, bytes, len);
+  _trace->onTraceRecord(rec);
 }
 
 bool RadioLibWrapper::isSendComplete() {
@@ -2,17 +2,26 @@
 
 #include <Mesh.h>
 #include <RadioLib.h>
+#include <helpers/PacketTrace.h>
 
 class RadioLibWrapper : public mesh::Radio {
 protected:
   PhysicalLayer* _radio;
   mesh::MainBoard* _board;
   uint32_t n_recv, n_sent;
+  PacketTraceSink* _trace;
 
   void idle();
+  void capture(const uint8_t* bytes, int len, uint8_t flags);
+
+  /**
+   * \brief  set the modem params on the (idle) radio chip
+   * \returns  RADIOLIB_ERR_NONE, or the first error
+   */
+  virtual int applyModemParams(float freq, float bw, uint8_t sf, uint8_t cr, int8_t tx_power) { return RADIOLIB_ERR_UNSUPPORTED; }
 
 public:
-  RadioLibWrapper(PhysicalLayer& radio, mesh::MainBoard& board) : _radio(&radio), _board(&board) { n_recv = n_sent = 0; }
+  RadioLibWrapper(PhysicalLayer& radio, mesh::MainBoard& board) : _radio(&radio), _board(&board) { n_recv = n_sent = 0; _trace = NULL; }
 
   void begin() override;
   int recvRaw(uint8_t* bytes, int sz) override;
@@ -23,6 +32,23 @@ public:
 
   uint32_t getPacketsRecv() const { return n_recv; }
   uint32_t getPacketsSent() const { return n_sent; }
+  void setPacketCounts(uint32_t recv, uint32_t sent) { n_recv = recv; n_sent = sent; }   // eg. after a deep sleep
+
+  /**
+   * \returns  true if radio is in (continuous) receive mode, ie. will raise DIO1 when a packet arrives
+   */
+  bool isInRecvMode() const;
+
+  /**
+   * \brief  change the LoRa modem params without a reboot. (receive is restarted in next recvRaw())
+   * \returns  false if mid-transmit (so, try again later), or the radio rejected a param
+   */
+  bool reconfigure(float freq, float bw, uint8_t sf, uint8_t cr, int8_t tx_power);
+
+  /**
+   * \brief  capture all received and transmitted raw frames to 'sink' (NULL to stop)
+   */
+  void setTraceSink(PacketTraceSink* sink) { _trace = sink; }
   virtual float getLastRSSI() const override;
   virtual float getLastSNR() const override;
 };
@@ -0,0 +1,121 @@
+#include "RouteTable.h"
+
+#define SCORE_PER_HOP             40
+#define SCORE_PER_DELIVERY        20
+#define SCORE_PER_FAILURE        150
+#define SCORE_AGE_SECS          3600    // lose one point per hour of age
+#define MAX_DELIVERY_CREDIT        8
+
+RouteTable::RouteTable() {
+  for (int i = 0; i < MAX_ROUTE_ENTRIES; i++) {
+    routes[i].contact_idx = -1;
+  }
+}
+
+int RouteTable::calcScore(const RouteInfo& route, uint32_t now) {
+  int score = 0;
+  score -= route.getHopCount() * SCORE_PER_HOP;
+  score += route.n_delivered * SCORE_PER_DELIVERY;
+  score -= route.n_failed * SCORE_PER_FAILURE;
+  if (now > route.last_updated) {
+    score -= (now - route.last_updated) / SCORE_AGE_SECS;
+  }
+  return score;
+}
+
+int RouteTable::countRoutesFor(int contact_idx) const {
+  int n = 0;
+  for (int i = 0; i < MAX_ROUTE_ENTRIES; i++) {
+    if (routes[i].contact_idx == contact_idx) n++;
+  }
+  return n;
+}
+
+int RouteTable::putRoute(int contact_idx, const uint8_t* path, uint8_t path_len, uint8_t path_hash_size, uint32_t now) {
+  if (contact_idx < 0 || path_len > MAX_PATH_SIZE || path_hash_size == 0 || path_hash_size > MAX_PATH_HASH_SIZE) return -1;
+
+  for (int i = 0; i < MAX_ROUTE_ENTRIES; i++) {
+    auto r = &routes[i];
+    if (r->contact_idx == contact_idx && r->path_len == path_len && r->path_hash_size == path_hash_size
+        && memcmp(r->path, path, path_len) == 0) {
+      // already known, just refresh
+      r->last_updated = now;
+      return i;
+    }
+  }
+
+  int idx = -1;
+  if (countRoutesFor(contact_idx) >= MAX_ROUTES_PER_CONTACT) {
+    // replace the worst of this contact's routes
+    int worst_score = 0x7FFFFFFF;
+    for (int i = 0; i < MAX_ROUTE_ENTRIES; i++) {
+      if (routes[i].contact_idx != contact_idx) continue;
+      int score = calcScore(routes[i], now);
+      if (score < worst_score) {
+        worst_score = score;
+        idx = i;
+      }
+    }
+  } else {
+    // find unused slot, otherwise evict the least recently updated route (of any contact)
+    uint32_t oldest = 0xFFFFFFFF;
+    for (int i = 0; i < MAX_ROUTE_ENTRIES; i++) {
+      if (routes[i].contact_idx < 0) {
+        idx = i;
+        break;
+      }
+      if (routes[i].last_updated < oldest) {
+        oldest = routes[i].last_updated;
+        idx = i;
+      }
+    }
+  }
+  if (idx < 0) return -1;
+
+  auto r = &routes[idx];
+  r->contact_idx = contact_idx;
+  memcpy(r->path, path, r->path_len = path_len);
+  r->path_hash_size = path_hash_size;
+  r->n_delivered = r->n_failed = 0;
+  r->last_updated = now;
+  return idx;
+}
+
+int RouteTable::getBestRoute(int contact_idx, uint32_t now) const {
+  if (contact_idx < 0) return -1;
+
+  int best_idx = -1;
+  int best_score = 0;
+  for (int i = 0; i < MAX_ROUTE_ENTRIES; i++) {
+    if (routes[i].contact_idx != contact_idx) continue;
+    int score = calcScore(routes[i], now);
+    if (best_idx < 0 || score > best_score) {
+      best_score = score;
+      best_idx = i;
+    }
+  }
+  return best_idx;
+}
+
+void RouteTable::recordResult(int route_idx, int contact_idx, bool delivered) {
+  if (route_idx < 0 || route_idx >= MAX_ROUTE_ENTRIES) return;
+
+  auto r = &routes[route_idx];
+  if (r->contact_idx != contact_idx) return;  // slot has since been re-used
+
+  if (delivered) {
+    if (r->n_delivered < MAX_DELIVERY_CREDIT) r->n_delivered++;
+    r->n_failed = 0;
+  } else {
+    r->n_failed++;
+    if (r->n_failed >= ROUTE_MAX_FAILURES) {
+      r->contact_idx = -1;   // give up on this route
+    }
+  }
+}
+
+void RouteTable::removeRoutes(int contact_idx) {
+  for (int i = 0; i < MAX_ROUTE_ENTRIES; i++) {
+    if (routes[i].contact_idx == contact_idx) routes[i].contact_idx = -1;
+  }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Mesh.h>
+
+#ifndef MAX_ROUTE_ENTRIES
+  #define MAX_ROUTE_ENTRIES        48
+#endif
+#ifndef MAX_ROUTES_PER_CONTACT
+  #define MAX_ROUTES_PER_CONTACT    3
+#endif
+
+#define ROUTE_MAX_FAILURES          2    // route is discarded after this many consecutive delivery failures
+
+struct RouteInfo {
+  int      contact_idx;   // -1 = unused slot
+  uint8_t  path_len;
+  uint8_t  path_hash_size;   // num bytes per hop in 'path'
+  uint8_t  path[MAX_PATH_SIZE];
+  uint8_t  n_delivered;   // num ACKs received, when sending via this path
+  uint8_t  n_failed;      // num consecutive send timeouts via this path
+  uint32_t last_updated;  // by OUR clock
+
+  int getHopCount() const { return path_len / path_hash_size; }
+};
+
+/**
+ * \brief  A store of (multiple) candidate out paths per contact, with their delivery history, so that senders can choose
+ *         the 'best' path (by hop count, and ACKs/timeouts when sent via it), and fall back to the next best when one fails.
+ *         NOTE: link SNR is not used, as the SNR of a received PATH is of just one link, in the opposite direction.
+ */
+class RouteTable {
+  RouteInfo routes[MAX_ROUTE_ENTRIES];
+
+  int countRoutesFor(int contact_idx) const;
+
+public:
+  RouteTable();
+
+  /**
+   * \brief  add (or refresh) a candidate path to given contact.
+   * \param  path_hash_size  num bytes per hop in 'path', ie. the hash size it will be sent with
+   * \returns  index of the route entry, or -1 if unable to store
+   */
+  int putRoute(int contact_idx, const uint8_t* path, uint8_t path_len, uint8_t path_hash_size, uint32_t now);
+
+  /**
+   * \returns  index of the best scoring route to given contact, or -1 if none known
+   */
+  int getBestRoute(int contact_idx, uint32_t now) const;
+
+  /**
+   * \brief  record whether a send (via given route) was ACK'd or not. Routes which keep failing are discarded.
+   */
+  void recordResult(int route_idx, int contact_idx, bool delivered);
+
+  /**
+   * \brief  discard all known routes to given contact
+   */
+  void removeRoutes(int contact_idx);
+
+  const RouteInfo* getRoute(int route_idx) const { return (route_idx >= 0 && route_idx < MAX_ROUTE_ENTRIES) ? &routes[route_idx] : NULL; }
+
+  static int calcScore(const RouteInfo& route, uint32_t now);
+};
@@ -8,6 +8,11 @@
 
 #define MAX_PACKET_HASHES  128
 
+struct SimpleMeshTablesState {
+  uint8_t hashes[MAX_PACKET_HASHES*MAX_HASH_SIZE];
+  int next_idx;
+};
+
 class SimpleMeshTables : public mesh::MeshTables {
   uint8_t _hashes[MAX_PACKET_HASHES*MAX_HASH_SIZE];
   int _next_idx;
@@ -29,6 +34,16 @@ public:
   }
 #endif
 
+  // eg. to keep in retained RAM, across a deep sleep
+  void saveState(SimpleMeshTablesState& dest) const {
+    memcpy(dest.hashes, _hashes, sizeof(_hashes));
+    dest.next_idx = _next_idx;
+  }
+  void restoreState(const SimpleMeshTablesState& src) {
+    memcpy(_hashes, src.hashes, sizeof(_hashes));
+    _next_idx = src.next_idx % MAX_PACKET_HASHES;
+  }
+
   bool hasSeen(const mesh::Packet* packet) override {
     uint8_t hash[MAX_HASH_SIZE];
     packet->calculatePacketHash(hash);
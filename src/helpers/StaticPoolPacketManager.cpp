@@ -1,8 +1,10 @@
 #include "StaticPoolPacketManager.h"
+#include <math.h>
 
 PacketQueue::PacketQueue(int max_entries) {
   _table = new mesh::Packet*[max_entries];
   _pri_table = new uint8_t[max_entries];
+  _class_table = new uint8_t[max_entries];
   _schedule_table = new uint32_t[max_entries];
   _size = max_entries;
   _num = 0;
@@ -20,16 +22,36 @@ mesh::Packet* PacketQueue::get(uint32_t now) {
   }
   if (best_idx < 0) return NULL;   // empty, or all items are still in the future
 
-  mesh::Packet* top = _table[best_idx];
-  int i = best_idx;
-  _num--;
-  while (i < _num) {
-    _table[i] = _table[i+1];
-    _pri_table[i] = _pri_table[i+1];
-    _schedule_table[i] = _schedule_table[i+1];
-    i++;
+  return removeByIdx(best_idx);
+}
+
+int PacketQueue::findNext(uint8_t traffic_class, uint32_t now) const {
+  uint8_t min_pri = 0xFF;
+  int best_idx = -1;
+  for (int j = 0; j < _num; j++) {
+    if (_class_table[j] != traffic_class) continue;
+    if (_schedule_table[j] > now) continue;   // scheduled for future... ignore for now
+    if (_pri_table[j] < min_pri) {  // select most important priority amongst non-future entries
+      min_pri = _pri_table[j];
+      best_idx = j;
+    }
   }
-  return top;
+  return best_idx;
+}
+
+int PacketQueue::findOldest(uint8_t traffic_class) const {
+  for (int j = 0; j < _num; j++) {   // entries are in order of being added
+    if (_class_table[j] == traffic_class) return j;
+  }
+  return -1;
+}
+
+int PacketQueue::countClass(uint8_t traffic_class) const {
+  int n = 0;
+  for (int j = 0; j < _num; j++) {
+    if (_class_table[j] == traffic_class) n++;
+  }
+  return n;
 }
 
 mesh::Packet* PacketQueue::removeByIdx(int i) {
@@ -40,28 +62,123 @@ mesh::Packet* PacketQueue::removeByIdx(int i) {
   while (i < _num) {
     _table[i] = _table[i+1];
     _pri_table[i] = _pri_table[i+1];
+    _class_table[i] = _class_table[i+1];
     _schedule_table[i] = _schedule_table[i+1];
     i++;
   }
   return item;
 }
 
-void PacketQueue::add(mesh::Packet* packet, uint8_t priority, uint32_t scheduled_for) {
+bool PacketQueue::add(mesh::Packet* packet, uint8_t priority, uint32_t scheduled_for, uint8_t traffic_class) {
   if (_num == _size) {
-    // TODO: log "FATAL: queue is full!"
-    return;
+    MESH_DEBUG_PRINTLN("PacketQueue::add(): FATAL: queue is full!");
+    return false;
   }
   _table[_num] = packet;
   _pri_table[_num] = priority;
+  _class_table[_num] = traffic_class;
   _schedule_table[_num] = scheduled_for;
   _num++;
+  return true;
 }
 
 StaticPoolPacketManager::StaticPoolPacketManager(int pool_size): unused(pool_size), send_queue(pool_size) {
   // load up our unusued Packet pool
+#if MESH_POOL_TRACKING
+  _pool = new mesh::Packet*[pool_size];
+  _pool_size = pool_size;
+  for (int i = 0; i < pool_size; i++) {
+    unused.add(_pool[i] = new mesh::Packet(), 0, 0);
+  }
+#else
   for (int i = 0; i < pool_size; i++) {
     unused.add(new mesh::Packet(), 0, 0);
   }
+#endif
+
+  // defaults: routed traffic gets biggest share, but no class can be starved, or hog the whole queue
+  int cap = pool_size / 2;
+  if (cap > 0xFF) cap = 0xFF;
+  setTrafficClass(TRAFFIC_CLASS_DIRECT, 8, cap, DROP_NEWEST);
+  setTrafficClass(TRAFFIC_CLASS_DATA,   4, cap, DROP_OLDEST);
+  setTrafficClass(TRAFFIC_CLASS_PATH,   2, cap, DROP_NEWEST);
+  setTrafficClass(TRAFFIC_CLASS_ADVERT, 1, cap, DROP_OLDEST);
+
+  memset(_codel, 0, sizeof(_codel));
+  memset(_delay_hist, 0, sizeof(_delay_hist));
+  setTrafficClassAQM(TRAFFIC_CLASS_DATA,   AQM_TARGET_MILLIS, AQM_INTERVAL_MILLIS);
+  setTrafficClassAQM(TRAFFIC_CLASS_PATH,   AQM_TARGET_MILLIS, AQM_INTERVAL_MILLIS);
+  setTrafficClassAQM(TRAFFIC_CLASS_ADVERT, AQM_TARGET_MILLIS, AQM_INTERVAL_MILLIS);
+
+  memset(_deficit, 0, sizeof(_deficit));
+  memset(_stats, 0, sizeof(_stats));
+  _curr_class = 0;
+  _turn_started = false;
+}
+
+void StaticPoolPacketManager::setTrafficClass(uint8_t traffic_class, uint8_t weight, uint8_t max_queued, uint8_t drop_policy) {
+  if (traffic_class >= NUM_TRAFFIC_CLASSES || weight == 0) return;   // invalid params
+
+  _weight[traffic_class] = weight;
+  _max_queued[traffic_class] = max_queued;
+  _drop_policy[traffic_class] = drop_policy;
+}
+
+void StaticPoolPacketManager::setTrafficClassAQM(uint8_t traffic_class, uint16_t target_millis, uint16_t interval_millis) {
+  if (traffic_class >= NUM_TRAFFIC_CLASSES) return;
+
+  CoDelState* cd = &_codel[traffic_class];
+  memset(cd, 0, sizeof(*cd));
+  cd->target = target_millis;
+  cd->interval = interval_millis;
+}
+
+void StaticPoolPacketManager::saveStats(TrafficStatsState& dest) const {
+  memcpy(dest.classes, _stats, sizeof(dest.classes));
+  memcpy(dest.delay_hist, _delay_hist, sizeof(dest.delay_hist));
+}
+
+void StaticPoolPacketManager::restoreStats(const TrafficStatsState& src) {
+  memcpy(_stats, src.classes, sizeof(_stats));
+  memcpy(_delay_hist, src.delay_hist, sizeof(_delay_hist));
+}
+
+// CoDel: drop when sojourn time has stayed above target for a whole interval, then at increasing rate (interval/sqrt(n))
+//   until sojourn comes back under target.
+bool StaticPoolPacketManager::isStale(uint8_t traffic_class, uint32_t sojourn, uint32_t now) {
+  CoDelState* cd = &_codel[traffic_class];
+  if (cd->target == 0) return false;    // AQM disabled for this class
+  if (sojourn >= AQM_MAX_SOJOURN_MILLIS) return true;
+
+  if (sojourn < cd->target) {
+    cd->first_above_time = 0;
+    cd->dropping = false;
+    return false;
+  }
+  if (cd->first_above_time == 0) {
+    cd->first_above_time = (now + cd->interval) | 1;   // non-zero
+    return false;
+  }
+  if (cd->dropping) {
+    if ((int32_t)(now - cd->drop_next) < 0) return false;
+    cd->drop_count++;
+  } else {
+    if ((int32_t)(now - cd->first_above_time) < 0) return false;
+    cd->dropping = true;
+    cd->drop_count = cd->drop_count > 2 ? cd->drop_count - 2 : 1;   // resume near previous rate, if recently dropping
+  }
+  cd->drop_next = now + (uint32_t) (cd->interval / sqrtf(cd->drop_count));
+  return true;
+}
+
+uint8_t StaticPoolPacketManager::classify(const mesh::Packet* packet, uint8_t priority) const {
+  if (packet->isRouteDirect()) return TRAFFIC_CLASS_DIRECT;
+
+  switch (packet->getPayloadType()) {
+    case PAYLOAD_TYPE_PATH:   return TRAFFIC_CLASS_PATH;
+    case PAYLOAD_TYPE_ADVERT: return TRAFFIC_CLASS_ADVERT;
+    default:                  return TRAFFIC_CLASS_DATA;
+  }
 }
 
 mesh::Packet* StaticPoolPacketManager::allocNew() {
@@ -69,16 +186,79 @@ mesh::Packet* StaticPoolPacketManager::allocNew() {
 }
 
 void StaticPoolPacketManager::free(mesh::Packet* packet) {
+#if MESH_POOL_TRACKING
+  packet->pool_state = POOL_STATE_FREE;   // may be dropped from send_queue, without Dispatcher knowing
+#endif
   unused.add(packet, 0, 0);
 }
 
 void StaticPoolPacketManager::queueOutbound(mesh::Packet* packet, uint8_t priority, uint32_t scheduled_for) {
-  send_queue.add(packet, priority, scheduled_for);
+  uint8_t c = classify(packet, priority);
+  if (send_queue.countClass(c) >= _max_queued[c]) {
+    _stats[c].n_dropped++;
+    int oldest;
+    if (_drop_policy[c] == DROP_OLDEST && (oldest = send_queue.findOldest(c)) >= 0) {
+      MESH_DEBUG_PRINTLN("StaticPoolPacketManager: class %d full, dropping oldest", (uint32_t) c);
+      free(send_queue.removeByIdx(oldest));
+    } else {
+      MESH_DEBUG_PRINTLN("StaticPoolPacketManager: class %d full, dropping newest", (uint32_t) c);
+      free(packet);
+      return;
+    }
+  }
+  if (send_queue.add(packet, priority, scheduled_for, c)) {
+    _stats[c].n_queued++;
+  } else {
+    _stats[c].n_dropped++;
+    free(packet);  // don't leak it
+  }
 }
 
 mesh::Packet* StaticPoolPacketManager::getNextOutbound(uint32_t now) {
-  //send_queue.sort();   // sort by scheduled_for/priority first
-  return send_queue.get(now);
+  // Deficit round-robin: each class, on its turn, earns quantum * weight bytes of credit, and is served while
+  //  its head packet fits in its credit. Idle classes don't accumulate credit.
+  int idle_visits = 0;
+  while (idle_visits < NUM_TRAFFIC_CLASSES) {
+    uint8_t c = _curr_class;
+    int idx = send_queue.findNext(c, now);
+    if (idx < 0) {
+      _deficit[c] = 0;
+      nextClass();
+      idle_visits++;
+      continue;
+    }
+    idle_visits = 0;
+
+    if (!_turn_started) {
+      _deficit[c] += _weight[c] * TRAFFIC_QUANTUM_BYTES;
+      _turn_started = true;
+    }
+    uint32_t sojourn = now - send_queue.scheduleAt(idx);
+    if (isStale(c, sojourn, now)) {
+      MESH_DEBUG_PRINTLN("StaticPoolPacketManager: class %d, dropping stale packet, waited=%d", (uint32_t) c, sojourn);
+      _stats[c].n_aqm_dropped++;
+      free(send_queue.removeByIdx(idx));
+      continue;
+    }
+
+    mesh::Packet* pkt = send_queue.itemAt(idx);
+    int sz = pkt->path_len + pkt->payload_len + 2;
+    if (sz <= _deficit[c]) {
+      _deficit[c] -= sz;
+
+      _stats[c].n_sent++;
+      _stats[c].total_latency += sojourn;
+      if (sojourn > _stats[c].max_latency) _stats[c].max_latency = sojourn;
+
+      int b = 0;
+      while (b < QUEUE_DELAY_BUCKETS - 1 && sojourn >= ((uint32_t)QUEUE_DELAY_BUCKET0_MILLIS << b)) b++;
+      _delay_hist[b]++;
+
+      return send_queue.removeByIdx(idx);
+    }
+    nextClass();   // this class has used its credit, for this round
+  }
+  return NULL;   // empty, or all items are still in the future
 }
 
 int  StaticPoolPacketManager::getOutboundCount() const {
@@ -95,3 +275,9 @@ mesh::Packet* StaticPoolPacketManager::getOutboundByIdx(int i) {
 mesh::Packet* StaticPoolPacketManager::removeOutboundByIdx(int i) {
   return send_queue.removeByIdx(i);
 }
+bool StaticPoolPacketManager::getOutboundInfo(int i, uint8_t& priority, uint32_t& scheduled_for) const {
+  if (i < 0 || i >= send_queue.count()) return false;
+  priority = send_queue.priorityAt(i);
+  scheduled_for = send_queue.scheduleAt(i);
+  return true;
+}
@@ -2,27 +2,143 @@
 
 #include <Dispatcher.h>
 
+// traffic classes, for fair queueing of outbound packets
+#define TRAFFIC_CLASS_DIRECT    0    // direct routed (incl. zero hop)
+#define TRAFFIC_CLASS_DATA      1    // flood: data, acks, group msgs
+#define TRAFFIC_CLASS_PATH      2    // flood: path returns
+#define TRAFFIC_CLASS_ADVERT    3    // flood: adverts
+#define NUM_TRAFFIC_CLASSES     4
+
+#define DROP_NEWEST   0   // when class is at its cap, discard the incoming packet
+#define DROP_OLDEST   1   // when class is at its cap, discard its longest queued packet
+
+#ifndef TRAFFIC_QUANTUM_BYTES
+  #define TRAFFIC_QUANTUM_BYTES  128    // deficit round-robin quantum, per unit of class weight
+#endif
+
+// active queue management (CoDel), default for the flood classes
+#ifndef AQM_TARGET_MILLIS
+  #define AQM_TARGET_MILLIS        3000    // acceptable standing sojourn time (past scheduled time)
+#endif
+#ifndef AQM_INTERVAL_MILLIS
+  #define AQM_INTERVAL_MILLIS     15000    // sojourn must exceed target for this long, before dropping starts
+#endif
+#ifndef AQM_MAX_SOJOURN_MILLIS
+  #define AQM_MAX_SOJOURN_MILLIS  60000    // hard limit, always stale after this
+#endif
+
+// histogram of queueing delay (past scheduled time), when sent. Bucket i counts delays < (BUCKET0 << i), last is the overflow
+#define QUEUE_DELAY_BUCKETS          8
+#define QUEUE_DELAY_BUCKET0_MILLIS 250
+
 class PacketQueue {
   mesh::Packet** _table;
   uint8_t* _pri_table;
+  uint8_t* _class_table;
   uint32_t* _schedule_table;
   int _size, _num;
 
 public:
   PacketQueue(int max_entries);
   mesh::Packet* get(uint32_t now);
-  void add(mesh::Packet* packet, uint8_t priority, uint32_t scheduled_for);
+  bool add(mesh::Packet* packet, uint8_t priority, uint32_t scheduled_for, uint8_t traffic_class=0);
   int count() const { return _num; }
+  int countClass(uint8_t traffic_class) const;
   mesh::Packet* itemAt(int i) const { return _table[i]; }
+  uint32_t scheduleAt(int i) const { return _schedule_table[i]; }
+  uint8_t priorityAt(int i) const { return _pri_table[i]; }
   mesh::Packet* removeByIdx(int i);
+
+  /**
+   * \returns  index of most important (lowest priority value) non-future entry of given class, or -1 if none
+   */
+  int findNext(uint8_t traffic_class, uint32_t now) const;
+
+  /**
+   * \returns  index of the longest queued entry of given class, or -1 if none
+   */
+  int findOldest(uint8_t traffic_class) const;
+};
+
+struct TrafficClassStats {
+  uint32_t n_queued, n_sent, n_dropped;
+  uint32_t n_aqm_dropped;    // dropped as stale, by AQM
+  uint32_t total_latency;    // sum of millis past scheduled time, when sent
+  uint32_t max_latency;
+};
+
+/**
+ * \brief  the stats of a StaticPoolPacketManager, eg. so they can be carried across a deep sleep
+ */
+struct TrafficStatsState {
+  TrafficClassStats classes[NUM_TRAFFIC_CLASSES];
+  uint32_t delay_hist[QUEUE_DELAY_BUCKETS];
 };
 
+struct CoDelState {
+  uint16_t target, interval;   // millis, target of zero means AQM disabled
+  bool dropping;
+  uint16_t drop_count;
+  uint32_t first_above_time, drop_next;
+};
+
+/**
+ * \brief  Static pool of Packets, and an outbound queue which is shared between traffic classes,
+ *         via weighted deficit round-robin (so that no class can be starved), with per-class queue caps.
+ */
 class StaticPoolPacketManager : public mesh::PacketManager {
   PacketQueue unused, send_queue;
+#if MESH_POOL_TRACKING
+  mesh::Packet** _pool;
+  int _pool_size;
+#endif
+  uint8_t _weight[NUM_TRAFFIC_CLASSES];
+  uint8_t _max_queued[NUM_TRAFFIC_CLASSES];
+  uint8_t _drop_policy[NUM_TRAFFIC_CLASSES];
+  int _deficit[NUM_TRAFFIC_CLASSES];
+  TrafficClassStats _stats[NUM_TRAFFIC_CLASSES];
+  CoDelState _codel[NUM_TRAFFIC_CLASSES];
+  uint32_t _delay_hist[QUEUE_DELAY_BUCKETS];
+  uint8_t _curr_class;
+  bool _turn_started;
+
+  void nextClass() { _curr_class = (_curr_class + 1) % NUM_TRAFFIC_CLASSES; _turn_started = false; }
+  bool isStale(uint8_t traffic_class, uint32_t sojourn, uint32_t now);
+
+protected:
+  /**
+   * \returns  one of TRAFFIC_CLASS_*, for the given outbound packet
+   */
+  virtual uint8_t classify(const mesh::Packet* packet, uint8_t priority) const;
 
 public:
   StaticPoolPacketManager(int pool_size);
 
+  /**
+   * \brief  configure a traffic class.
+   * \param  weight  relative share of airtime (in bytes) when classes are competing, must be > 0
+   * \param  max_queued  max packets of this class allowed in outbound queue
+   * \param  drop_policy  DROP_NEWEST or DROP_OLDEST, for when max_queued is reached
+   */
+  void setTrafficClass(uint8_t traffic_class, uint8_t weight, uint8_t max_queued, uint8_t drop_policy);
+
+  /**
+   * \brief  configure CoDel style dropping of packets which have been waiting (past their scheduled time) too long.
+   * \param  target_millis  acceptable queueing delay, or zero to disable AQM for this class
+   * \param  interval_millis  how long delay must stay above target before dropping begins
+   */
+  void setTrafficClassAQM(uint8_t traffic_class, uint16_t target_millis, uint16_t interval_millis);
+
+  const TrafficClassStats* getTrafficClassStats(uint8_t traffic_class) const { return traffic_class < NUM_TRAFFIC_CLASSES ? &_stats[traffic_class] : NULL; }
+
+  /**
+   * \returns  counts of packets sent, by queueing delay (all classes). QUEUE_DELAY_BUCKETS long
+   */
+  const uint32_t* getQueueDelayHistogram() const { return _delay_hist; }
+
+  void saveStats(TrafficStatsState& dest) const;
+  void restoreStats(const TrafficStatsState& src);
+
   mesh::Packet* allocNew() override;
   void free(mesh::Packet* packet) override;
   void queueOutbound(mesh::Packet* packet, uint8_t priority, uint32_t scheduled_for) override;
@@ -31,4 +147,9 @@ public:
   int getFreeCount() const override;
   mesh::Packet* getOutboundByIdx(int i) override;
   mesh::Packet* removeOutboundByIdx(int i) override;
-};
\ No newline at end of file
+  bool getOutboundInfo(int i, uint8_t& priority, uint32_t& scheduled_for) const override;
+#if MESH_POOL_TRACKING
+  int getPoolSize() const override { return _pool_size; }
+  mesh::Packet* getPoolPacketAt(int i) override { return i >= 0 && i < _pool_size ? _pool[i] : NULL; }
+#endif
+};
@@ -0,0 +1,69 @@
+#include "Telemetry.h"
+#include <string.h>
+
+TelemetryWriter::TelemetryWriter(uint8_t* dest, int max_len, uint8_t page)
+  : _dest(dest), _max_len(max_len), _len(TELEMETRY_HEADER_SIZE), _page_len(TELEMETRY_HEADER_SIZE), _page(page), _curr_page(0)
+{
+  dest[0] = TELEMETRY_VERSION;
+  dest[1] = page;
+}
+
+void TelemetryWriter::add(uint8_t type, const void* value, uint8_t len) {
+  if (TELEMETRY_HEADER_SIZE + 2 + len > _max_len) return;   // can never fit
+
+  if (_page_len + 2 + len > _max_len) {   // start next page
+    _curr_page++;
+    _page_len = TELEMETRY_HEADER_SIZE;
+  }
+  _page_len += 2 + len;
+
+  if (_curr_page == _page) {
+    _dest[_len++] = type;
+    _dest[_len++] = len;
+    memcpy(&_dest[_len], value, len); _len += len;
+  }
+}
+
+int TelemetryWriter::finish() {
+  _dest[2] = _curr_page + 1;   // num_pages
+  return _len;
+}
+
+bool TelemetryReader::next(uint8_t& type, const uint8_t*& value, uint8_t& len) {
+  if (_pos + 2 > _len || _src[_pos] == TLV_END) return false;
+
+  type = _src[_pos];
+  len = _src[_pos + 1];
+  if (_pos + 2 + len > _len) return false;   // truncated
+
+  value = &_src[_pos + 2];
+  _pos += 2 + len;
+  return true;
+}
+
+void RateWindow::update(unsigned long now_millis, uint32_t n_recv, uint32_t n_sent, uint32_t air_time_millis) {
+  if (_num > 0 && (long)(now_millis - _next_sample) < 0) return;   // not time yet
+
+  _head = (_head + 1) % (RATE_WINDOW_SLOTS + 1);
+  _samples[_head].n_recv = n_recv;
+  _samples[_head].n_sent = n_sent;
+  _samples[_head].air_time_millis = air_time_millis;
+  if (_num < RATE_WINDOW_SLOTS + 1) _num++;
+
+  _next_sample = now_millis + 60000;
+}
+
+bool RateWindow::getRates(int minutes, TelemetryRates& rates) const {
+  if (minutes > _num - 1) minutes = _num - 1;
+  if (minutes <= 0) return false;
+
+  const Sample& curr = _samples[_head];
+  const Sample& prev = _samples[(_head + RATE_WINDOW_SLOTS + 1 - minutes) % (RATE_WINDOW_SLOTS + 1)];
+
+  rates.window_secs = minutes * 60;
+  rates.rx_per_min_x10 = (curr.n_recv - prev.n_recv) * 10 / minutes;
+  rates.tx_per_min_x10 = (curr.n_sent - prev.n_sent) * 10 / minutes;
+  uint32_t permille = (curr.air_time_millis - prev.air_time_millis) / (minutes * 60);   // millis per 1000 millis
+  rates.airtime_permille = permille > 1000 ? 1000 : permille;
+  return true;
+}
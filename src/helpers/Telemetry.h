@@ -0,0 +1,126 @@
+#pragma once
+
+#include <Packet.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define TELEMETRY_VERSION        1
+#define TELEMETRY_HEADER_SIZE    3     // version, page, num_pages
+
+// TLV types. Each TLV is: type(1), len(1), value. Unknown types should be skipped (by len)
+#define TLV_END                  0     // (zero padding)
+#define TLV_TOTALS            0x01     // TelemetryTotals
+#define TLV_RATES             0x02     // TelemetryRates, one per window length
+#define TLV_QUEUE_DELAY       0x03     // uint16 bucket0_millis, then uint32 per bucket (bucket i: < bucket0 << i, last is overflow)
+#define TLV_DROPS             0x04     // uint32 per DROP_REASON_*
+#define TLV_DEDUP             0x05     // TelemetryDedup
+#define TLV_DECRYPT_FAILED    0x06     // uint32
+#define TLV_SLEEP             0x07     // TelemetrySleep (only from nodes in deep sleep mode)
+#define TLV_NEIGHBOR          0x10     // TelemetryNeighbor, one per neighbour, in descending SNR order
+
+// indexes in TLV_DROPS
+#define DROP_REASON_POOL_FULL      0   // no free packet to receive into
+#define DROP_REASON_QUEUE_CAP      1   // traffic class at its queue cap
+#define DROP_REASON_AQM_STALE      2   // waited too long in queue
+#define DROP_REASON_SCOPE          3   // flood hop limits
+#define NUM_DROP_REASONS           4
+
+struct TelemetryTotals {
+  uint32_t up_time_secs;
+  uint32_t n_packets_recv, n_packets_sent;
+  uint32_t air_time_secs;
+  uint16_t batt_milli_volts;
+  uint8_t  tx_queue_len, free_queue_len;
+};
+
+struct TelemetryRates {
+  uint16_t window_secs;
+  uint16_t rx_per_min_x10, tx_per_min_x10;
+  uint16_t airtime_permille;   // tx airtime, as fraction of window
+};
+
+struct TelemetryDedup {
+  uint32_t n_recv;
+  uint32_t n_dupes;
+};
+
+struct TelemetrySleep {
+  uint32_t n_sleeps;
+  uint32_t n_rx_wakes, n_timer_wakes;   // woken by a received packet, or to send something
+  uint32_t total_sleep_secs;
+  uint32_t n_wake_fwds;                 // rx wakes which led to a packet being sent (forwarded)
+  uint32_t wake_fwd_total_millis;       // wake to send completed, ie. avg is total/n_wake_fwds
+  uint16_t wake_fwd_last_millis, wake_fwd_max_millis;
+};
+
+struct TelemetryNeighbor {
+  uint8_t hash[MAX_PATH_HASH_SIZE];
+  uint8_t hash_size;
+  int16_t avg_rssi;
+  int8_t  avg_snr_x4;
+  uint8_t est_loss_pct;
+  uint16_t n_packets;       // saturates at 0xFFFF
+  uint16_t last_heard_secs; // seconds ago, saturates at 0xFFFF
+};
+
+/**
+ * \brief  encodes a (versioned) telemetry response as TLVs, split into pages of at most 'max_len' bytes,
+ *         writing only the TLVs that land on the requested page.
+ */
+class TelemetryWriter {
+  uint8_t* _dest;
+  int _max_len, _len, _page_len;
+  uint8_t _page, _curr_page;
+
+public:
+  TelemetryWriter(uint8_t* dest, int max_len, uint8_t page);
+
+  void add(uint8_t type, const void* value, uint8_t len);
+
+  /**
+   * \returns  length of this page
+   */
+  int finish();
+};
+
+class TelemetryReader {
+  const uint8_t* _src;
+  int _len, _pos;
+
+public:
+  TelemetryReader(const uint8_t* src, int len) : _src(src), _len(len), _pos(TELEMETRY_HEADER_SIZE) { }
+
+  bool isValid() const { return _len >= TELEMETRY_HEADER_SIZE && _src[0] == TELEMETRY_VERSION; }
+  uint8_t getPage() const { return _src[1]; }
+  uint8_t getNumPages() const { return _src[2]; }
+
+  /**
+   * \returns  false when no more TLVs
+   */
+  bool next(uint8_t& type, const uint8_t*& value, uint8_t& len);
+};
+
+#define RATE_WINDOW_SLOTS   15
+
+/**
+ * \brief  per-minute samples of rx/tx/airtime counters, for rates over the last 1 .. RATE_WINDOW_SLOTS minutes
+ */
+class RateWindow {
+  struct Sample { uint32_t n_recv, n_sent, air_time_millis; };
+  Sample _samples[RATE_WINDOW_SLOTS + 1];   // ring
+  int _head, _num;
+  unsigned long _next_sample;
+
+public:
+  RateWindow() : _head(0), _num(0), _next_sample(0) { }
+
+  /**
+   * \brief  call periodically (at least once per minute), with current totals
+   */
+  void update(unsigned long now_millis, uint32_t n_recv, uint32_t n_sent, uint32_t air_time_millis);
+
+  /**
+   * \returns  false if not enough samples yet
+   */
+  bool getRates(int minutes, TelemetryRates& rates) const;
+};
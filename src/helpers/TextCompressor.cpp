@@ -0,0 +1,90 @@
+#include "TextCompressor.h"
+#include <string.h>
+
+#define CODE_DICT_FIRST   0x80
+#define CODE_ESCAPE       0xFF
+
+// NOTE: must be exactly 127 entries. Changing this breaks compatibility with other nodes!
+static const char* dictionary[] = {
+  " the", "the ", " and", "ing ", " you", " to ", " is ", " in ", " of ", " it", " for", "tion", " that",
+  "ing", " be", " th", " on", " are", " was", " we", " no", "he", "th", "in", "er", "an", "re", "on", "at",
+  "en", "nd", "ou", "ea", "ha", "es", "or", "ti", "te", "is", "it", "ar", "st", "to", "nt", "ng", "se", "al",
+  "ed", "hi", "le", "me", "ve", "ll", "of", "as", "co", "ne", "de", "ro", "ri", "ra", "ce", "ma", "li", "ic",
+  "ho", "om", "ur", "ge", "lo", "no", "el", "ch", "wh", "be", "we", "so", "do", "go", "ok", "up", "us", "ay",
+  "ow", "ee", "oo", "ck", "ly", "e ", "s ", "t ", "d ", "y ", "r ", "n ", "o ", ", ", ". ", "? ", "! ", " a",
+  " w", " s", " h", " c", " m", " o", " f", " b", " i", " I", " g", " l", " n", " d", " p", " t", "I'm ",
+  "you", "what", "here", "have", "this", "with", "not", "there", "good"
+};
+#define DICT_SIZE  ((int) (sizeof(dictionary) / sizeof(dictionary[0])))
+
+int TextCompressor::compress(uint8_t* dest, int max_len, const char* text, int text_len) {
+  if (max_len > text_len - 1) max_len = text_len - 1;   // only worth it if at least one byte smaller
+
+  int len = 0;
+  int i = 0;
+  while (i < text_len) {
+    // greedy, longest dictionary match
+    int best = -1, best_len = 1;
+    for (int d = 0; d < DICT_SIZE; d++) {
+      int n = strlen(dictionary[d]);
+      if (n > best_len && n <= text_len - i && memcmp(&text[i], dictionary[d], n) == 0) {
+        best = d; best_len = n;
+      }
+    }
+
+    if (best >= 0) {
+      if (len + 1 > max_len) return -1;
+      dest[len++] = CODE_DICT_FIRST + best;
+      i += best_len;
+    } else {
+      uint8_t c = text[i++];
+      if (c == 0) return -1;   // not text!
+      if (c >= CODE_DICT_FIRST) {   // eg. UTF-8
+        if (len + 2 > max_len) return -1;
+        dest[len++] = CODE_ESCAPE;
+      } else {
+        if (len + 1 > max_len) return -1;
+      }
+      dest[len++] = c;
+    }
+  }
+  return len;
+}
+
+int TextCompressor::decompress(char* dest, int max_len, const uint8_t* src, int src_len) {
+  int len = 0;
+  int i = 0;
+  while (i < src_len) {
+    uint8_t c = src[i++];
+    if (c == 0) break;   // padding (from cipher blocks)
+
+    if (c == CODE_ESCAPE) {
+      if (i >= src_len || len + 1 > max_len) return -1;
+      dest[len++] = src[i++];
+    } else if (c >= CODE_DICT_FIRST) {
+      const char* s = dictionary[c - CODE_DICT_FIRST];
+      int n = strlen(s);
+      if (len + n > max_len) return -1;
+      memcpy(&dest[len], s, n); len += n;
+    } else {
+      if (len + 1 > max_len) return -1;
+      dest[len++] = c;
+    }
+  }
+  dest[len] = 0;
+  return len;
+}
+
+bool TextCompressor::decodeTextPayload(uint8_t* data, size_t len, int max_text_len) {
+  if ((data[4] & TXT_FLAG_COMPRESSED) == 0) {
+    data[len] = 0;   // len can be > original length, but 'text' will be padded with zeroes
+    return true;
+  }
+
+  uint8_t src[256];
+  int src_len = len - 5;
+  if (src_len > (int) sizeof(src)) return false;
+  memcpy(src, &data[5], src_len);
+
+  return decompress((char *) &data[5], max_text_len, src, src_len) >= 0;
+}
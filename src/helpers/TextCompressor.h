@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TXT_FLAG_COMPRESSED   0x80    // in TXT_MSG / GRP_TXT flags byte, text is encoded with TextCompressor
+
+#ifndef DEFAULT_TEXT_COMPRESSION
+  #define DEFAULT_TEXT_COMPRESSION   false   // NOTE: older firmware can't decode compressed text
+#endif
+
+/**
+ * \brief  A small static-dictionary compressor (smaz style) tuned for short English chat messages.
+ *         Encoding: 0x01..0x7F = ASCII literal, 0x80..0xFE = dictionary entry, 0xFF = escape (next byte is literal)
+ */
+class TextCompressor {
+public:
+  /**
+   * \returns  length of compressed output, or -1 if it would not be smaller than the original text
+   */
+  static int compress(uint8_t* dest, int max_len, const char* text, int text_len);
+
+  /**
+   * \brief  decompresses to 'dest', and NUL terminates (dest must be max_len+1 bytes)
+   * \returns  length of text, or -1 if input is invalid or too long
+   */
+  static int decompress(char* dest, int max_len, const uint8_t* src, int src_len);
+
+  /**
+   * \brief  the reverse of BaseChatMesh text encoding. If TXT_FLAG_COMPRESSED is set in flags byte (data[4]), the text (from data[5])
+   *         is decompressed in-place. The text is then NUL terminated.
+   * \param  data  must have room for 5 + max_text_len + 1 bytes
+   * \returns  false, if invalid
+   */
+  static bool decodeTextPayload(uint8_t* data, size_t len, int max_text_len);
+};
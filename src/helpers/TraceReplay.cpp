@@ -0,0 +1,175 @@
+#include "TraceReplay.h"
+#include <stdio.h>
+#include <string.h>
+
+TraceReplayRadio::TraceReplayRadio(const uint8_t* trace, int trace_len, VirtualMillis& clock) {
+  _trace = trace;
+  _trace_len = trace_len;
+  _pos = PacketTrace::isValidHeader(trace, trace_len) ? TRACE_HEADER_SIZE : 0;
+  _clock = &clock;
+  _start = clock.getMillis();
+  _last_rssi = _last_snr = 0;
+  _tx_end = 0;
+  n_replayed = n_sent = n_sent_bytes = 0;
+  _tx_sink = NULL;
+
+  readNext();
+  _first_timestamp = _has_next ? _next.timestamp : 0;
+}
+
+void TraceReplayRadio::readNext() {
+  _has_next = false;
+  while (_pos < _trace_len) {
+    int n = PacketTrace::decode(&_trace[_pos], _trace_len - _pos, _next);
+    if (n == 0) {
+      MESH_DEBUG_PRINTLN("TraceReplayRadio: truncated trace, at pos=%d", _pos);
+      _pos = _trace_len;
+      break;
+    }
+    _pos += n;
+    if ((_next.flags & TRACE_FLAG_TX) == 0) {   // only replay what was received
+      _has_next = true;
+      break;
+    }
+  }
+}
+
+int TraceReplayRadio::recvRaw(uint8_t* bytes, int sz) {
+  if (!_has_next) return 0;
+  if (_clock->getMillis() - _start < _next.timestamp - _first_timestamp) return 0;   // not due yet
+
+  int len = _next.len > sz ? sz : _next.len;
+  memcpy(bytes, _next.raw, len);
+  _last_rssi = _next.rssi_x4 / 4.0f;
+  _last_snr = _next.snr_x4 / 4.0f;
+  n_replayed++;
+
+  readNext();
+  return len;
+}
+
+uint32_t TraceReplayRadio::getEstAirtimeFor(int len_bytes) {
+  return TRACE_AIRTIME_BASE_MILLIS + len_bytes*TRACE_AIRTIME_BYTE_MILLIS;
+}
+
+void TraceReplayRadio::startSendRaw(const uint8_t* bytes, int len) {
+  _tx_end = _clock->getMillis() + getEstAirtimeFor(len);
+  n_sent++;
+  n_sent_bytes += len;
+
+  if (_tx_sink) {
+    TraceRecord rec;
+    rec.timestamp = _clock->getMillis();
+    rec.rssi_x4 = 0; rec.snr_x4 = 0;
+    rec.flags = TRACE_FLAG_TX;
+    rec.len = len;
+    memcpy(rec.raw, bytes, len);
+    _tx_sink->onTraceRecord(rec);
+  }
+}
+
+bool TraceReplayRadio::isSendComplete() {
+  return (long)(_clock->getMillis() - _tx_end) >= 0;
+}
+
+TraceReport::TraceReport(mesh::MillisecondClock& ms) : _ms(&ms) {
+  memset(&_stats, 0, sizeof(_stats));
+  memset(_hashes, 0, sizeof(_hashes));
+  _next_hash = 0;
+  _curr_is_dup = false;
+  _curr_hops = 0;
+  memset(_pending, 0, sizeof(_pending));
+}
+
+void TraceReport::onRecvStart(const mesh::Packet* packet) {
+  uint8_t hash[MAX_HASH_SIZE];
+  packet->calculatePacketHash(hash);
+
+  _curr_is_dup = false;
+  _curr_hops = packet->getHopCount();   // as received (before forwarding appends to path)
+  for (int i = 0; i < MAX_REPLAY_HASHES; i++) {
+    if (memcmp(&_hashes[i*MAX_HASH_SIZE], hash, MAX_HASH_SIZE) == 0) { _curr_is_dup = true; break; }
+  }
+  if (!_curr_is_dup) {
+    memcpy(&_hashes[_next_hash*MAX_HASH_SIZE], hash, MAX_HASH_SIZE);
+    _next_hash = (_next_hash + 1) % MAX_REPLAY_HASHES;
+  }
+  _stats.n_recv++;
+
+  for (int i = 0; i < MAX_REPLAY_PENDING; i++) {
+    if (_pending[i] == packet) _pending[i] = NULL;   // was never sent (eg. dropped from queue), and is now re-used
+  }
+}
+
+void TraceReport::onRecvDone(const mesh::Packet* packet, mesh::DispatcherAction action) {
+  const char* what;
+  if (action == ACTION_RELEASE) {
+    if (_curr_is_dup) {
+      _stats.n_duplicate++; what = "dropped (duplicate)";
+    } else if (packet->isMarkedDoNotRetransmit()) {
+      _stats.n_consumed++; what = "consumed";
+    } else {
+      _stats.n_dropped++; what = "dropped";
+    }
+  } else if (action == ACTION_MANUAL_HOLD) {
+    _stats.n_held++; what = "held";
+  } else {
+    _stats.n_forwarded++; what = "forwarded";
+    for (int i = 0; i < MAX_REPLAY_PENDING; i++) {
+      if (_pending[i] == NULL) {
+        _pending[i] = packet;
+        _pending_since[i] = _ms->getMillis();
+        break;
+      }
+    }
+  }
+
+  char line[80];
+  snprintf(line, sizeof(line), "%lu recv type=%d route=%s hops=%d len=%d -> %s", _ms->getMillis(),
+      packet->isMarkedDoNotRetransmit() ? -1 : (int) packet->getPayloadType(), packet->isRouteDirect() ? "D" : "F",
+      (int) _curr_hops, (int) packet->payload_len, what);
+  onAction(line);
+}
+
+void TraceReport::onSendStart(const mesh::Packet* packet, int raw_len) {
+  _stats.n_sent++;
+
+  char line[80];
+  for (int i = 0; i < MAX_REPLAY_PENDING; i++) {
+    if (_pending[i] == packet) {
+      _pending[i] = NULL;
+      uint32_t delay = _ms->getMillis() - _pending_since[i];
+      _stats.n_sent_forwards++;
+      _stats.total_queue_delay += delay;
+      if (delay > _stats.max_queue_delay) _stats.max_queue_delay = delay;
+
+      snprintf(line, sizeof(line), "%lu send forward type=%d len=%d, queue delay=%u ms", _ms->getMillis(),
+          (int) packet->getPayloadType(), raw_len, (unsigned int) delay);
+      onAction(line);
+      return;
+    }
+  }
+  snprintf(line, sizeof(line), "%lu send local type=%d len=%d", _ms->getMillis(), (int) packet->getPayloadType(), raw_len);
+  onAction(line);
+}
+
+int TraceReport::formatSummary(char* dest, int max_len) const {
+  return snprintf(dest, max_len, "recv=%u forwarded=%u duplicate=%u consumed=%u dropped=%u held=%u sent=%u (forwards=%u) "
+      "queue delay: avg=%u max=%u ms",
+      (unsigned int) _stats.n_recv, (unsigned int) _stats.n_forwarded, (unsigned int) _stats.n_duplicate,
+      (unsigned int) _stats.n_consumed, (unsigned int) _stats.n_dropped, (unsigned int) _stats.n_held,
+      (unsigned int) _stats.n_sent, (unsigned int) _stats.n_sent_forwards,
+      (unsigned int) (_stats.n_sent_forwards ? _stats.total_queue_delay / _stats.n_sent_forwards : 0),
+      (unsigned int) _stats.max_queue_delay);
+}
+
+void runTraceReplay(mesh::Dispatcher& node, TraceReplayRadio& radio, VirtualMillis& clock, uint32_t tick_millis, uint32_t drain_millis) {
+  while (!radio.isFinished()) {
+    node.loop();
+    clock.advance(tick_millis);
+  }
+  for (uint32_t t = 0; t < drain_millis; t += tick_millis) {
+    node.loop();
+    clock.advance(tick_millis);
+  }
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <Mesh.h>
+#include <helpers/PacketTrace.h>
+
+#ifndef TRACE_AIRTIME_BASE_MILLIS
+  #define TRACE_AIRTIME_BASE_MILLIS     60   // approx preamble + header time, SF10/BW250
+#endif
+#ifndef TRACE_AIRTIME_BYTE_MILLIS
+  #define TRACE_AIRTIME_BYTE_MILLIS      7
+#endif
+
+/**
+ * \brief  a MillisecondClock which only moves when told to, for deterministic replay.
+ */
+class VirtualMillis : public mesh::MillisecondClock {
+  unsigned long _now;
+public:
+  VirtualMillis(unsigned long start=0) : _now(start) { }
+
+  unsigned long getMillis() override { return _now; }
+  void advance(unsigned long millis) { _now += millis; }
+};
+
+/**
+ * \brief  a Radio which 'receives' the frames of a captured trace, at their original (relative) times,
+ *       according to a VirtualMillis clock. Frames captured as transmitted (TRACE_FLAG_TX) are skipped,
+ *       as the node being replayed generates its own.
+ */
+class TraceReplayRadio : public mesh::Radio {
+  const uint8_t* _trace;
+  int _trace_len, _pos;
+  VirtualMillis* _clock;
+  unsigned long _start;
+  uint32_t _first_timestamp;
+  TraceRecord _next;
+  bool _has_next;
+  float _last_rssi, _last_snr;
+  unsigned long _tx_end;
+  uint32_t n_replayed, n_sent, n_sent_bytes;
+  PacketTraceSink* _tx_sink;
+
+  void readNext();
+
+public:
+  /**
+   * \param  trace  the encoded trace (with or without header)
+   */
+  TraceReplayRadio(const uint8_t* trace, int trace_len, VirtualMillis& clock);
+
+  int recvRaw(uint8_t* bytes, int sz) override;
+  uint32_t getEstAirtimeFor(int len_bytes) override;
+  void startSendRaw(const uint8_t* bytes, int len) override;
+  bool isSendComplete() override;
+  void onSendFinished() override { }
+  float getLastRSSI() const override { return _last_rssi; }
+  float getLastSNR() const override { return _last_snr; }
+
+  /**
+   * \brief  also capture what the replayed node transmits (eg. to diff against a previous replay)
+   */
+  void setTxSink(PacketTraceSink* sink) { _tx_sink = sink; }
+
+  bool isFinished() const { return !_has_next; }
+  uint32_t getNumReplayed() const { return n_replayed; }
+  uint32_t getNumSent() const { return n_sent; }
+  uint32_t getNumSentBytes() const { return n_sent_bytes; }
+};
+
+#define MAX_REPLAY_HASHES     256
+#define MAX_REPLAY_PENDING     32
+
+struct TraceReportStats {
+  uint32_t n_recv;
+  uint32_t n_forwarded;     // ACTION_RETRANSMIT*
+  uint32_t n_duplicate;     // released, and an identical packet was already received
+  uint32_t n_consumed;      // released, was for this node (eg. decrypted)
+  uint32_t n_dropped;       // released, for other reasons (not for this node, scope, etc)
+  uint32_t n_held;          // ACTION_MANUAL_HOLD
+  uint32_t n_sent, n_sent_forwards;
+  uint32_t total_queue_delay, max_queue_delay;   // of forwarded packets, millis from recv to transmit start
+};
+
+/**
+ * \brief  observes a replayed node (via Dispatcher::setPacketObserver()), classifying what it did with each packet.
+ */
+class TraceReport : public mesh::PacketObserver {
+  mesh::MillisecondClock* _ms;
+  TraceReportStats _stats;
+  uint8_t _hashes[MAX_REPLAY_HASHES*MAX_HASH_SIZE];
+  int _next_hash;
+  bool _curr_is_dup;
+  uint8_t _curr_hops;
+  const mesh::Packet* _pending[MAX_REPLAY_PENDING];   // forwards, waiting to be sent
+  unsigned long _pending_since[MAX_REPLAY_PENDING];
+
+protected:
+  /**
+   * \brief  called for each action, with a one-line description. (eg. host tool can print these)
+   */
+  virtual void onAction(const char* line) { }
+
+public:
+  TraceReport(mesh::MillisecondClock& ms);
+
+  void onRecvStart(const mesh::Packet* packet) override;
+  void onRecvDone(const mesh::Packet* packet, mesh::DispatcherAction action) override;
+  void onSendStart(const mesh::Packet* packet, int raw_len) override;
+
+  const TraceReportStats& getStats() const { return _stats; }
+
+  /**
+   * \brief  formats a summary of all stats, as text
+   * \returns  length of text in 'dest'
+   */
+  int formatSummary(char* dest, int max_len) const;
+};
+
+/**
+ * \brief  drive 'node' through the whole trace, ticking the virtual clock, then for 'drain_millis' after, to let queues empty.
+ */
+void runTraceReplay(mesh::Dispatcher& node, TraceReplayRadio& radio, VirtualMillis& clock, uint32_t tick_millis=1, uint32_t drain_millis=60000);
@@ -0,0 +1,11 @@
+#pragma once
+
+// minimal host stand-in for the Arduino core, for the 'native' (unit test) env only
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Stream.h>
@@ -0,0 +1,15 @@
+#pragma once
+
+// minimal host stand-in for Arduino's Stream, for the 'native' (unit test) env only
+
+#include <stdint.h>
+#include <stddef.h>
+
+class Stream {
+public:
+  virtual size_t write(const uint8_t* src, size_t len) { return 0; }
+  virtual size_t readBytes(uint8_t* dest, size_t len) { return 0; }
+  virtual size_t print(char c) { return 0; }
+  virtual size_t print(const char* s) { return 0; }
+  virtual size_t println(const char* s = "") { return 0; }
+};
@@ -0,0 +1,167 @@
+#include <unity.h>
+#include <helpers/AdvertDataHelpers.h>
+
+static uint8_t app_data[MAX_ADVERT_DATA_SIZE];
+
+void setUp() { memset(app_data, 0xEE, sizeof(app_data)); }
+void tearDown() { }
+
+static void assert_name(const AdvertDataParser& parser, const char* expected) {
+  char name[MAX_ADVERT_DATA_SIZE + 1];
+  parser.copyName(name, sizeof(name));
+  TEST_ASSERT_EQUAL_STRING(expected, name);
+}
+
+static void test_type_only() {
+  AdvertDataBuilder builder(ADV_TYPE_REPEATER);
+  uint8_t len = builder.encodeTo(app_data);
+  TEST_ASSERT_EQUAL_INT(1, len);
+
+  AdvertDataParser parser(app_data, len);
+  TEST_ASSERT_TRUE(parser.isValid());
+  TEST_ASSERT_EQUAL_INT(ADV_TYPE_REPEATER, parser.getType());
+  TEST_ASSERT_FALSE(parser.hasName());
+  TEST_ASSERT_FALSE(parser.hasLatLon());
+  TEST_ASSERT_FALSE(parser.hasBattery());
+  TEST_ASSERT_FALSE(parser.hasTemperature());
+  TEST_ASSERT_FALSE(parser.hasLoad());
+}
+
+static void test_name_and_latlon() {
+  AdvertDataBuilder builder(ADV_TYPE_CHAT, "Alice", -33.865143, 151.2099);
+  uint8_t len = builder.encodeTo(app_data);
+  TEST_ASSERT_EQUAL_INT(1 + 8 + 5, len);
+
+  AdvertDataParser parser(app_data, len);
+  TEST_ASSERT_TRUE(parser.isValid());
+  TEST_ASSERT_EQUAL_INT(ADV_TYPE_CHAT, parser.getType());
+  TEST_ASSERT_TRUE(parser.hasLatLon());
+  TEST_ASSERT_EQUAL_INT32(-33865143, parser.getIntLat());
+  TEST_ASSERT_EQUAL_INT32(151209900, parser.getIntLon());
+  TEST_ASSERT_EQUAL_INT(5, parser.getNameLen());
+  assert_name(parser, "Alice");
+}
+
+static void test_all_status_fields() {
+  AdvertDataBuilder builder(ADV_TYPE_ROOM, "Room 1", 1.5, -2.25);
+  builder.setBattery(3950);
+  builder.setTemperature(-12);
+  builder.setLoad(140);   // clamped
+  uint8_t len = builder.encodeTo(app_data);
+  TEST_ASSERT_EQUAL_INT(1 + 8 + 2 + 2 + 6, len);
+
+  AdvertDataParser parser(app_data, len);
+  TEST_ASSERT_TRUE(parser.isValid());
+  TEST_ASSERT_EQUAL_INT(ADV_TYPE_ROOM, parser.getType());
+  TEST_ASSERT_TRUE(parser.hasBattery());
+  TEST_ASSERT_EQUAL_UINT16(3950, parser.getBattMilliVolts());
+  TEST_ASSERT_TRUE(parser.hasTemperature());
+  TEST_ASSERT_EQUAL_INT8(-12, parser.getTemperature());
+  TEST_ASSERT_TRUE(parser.hasLoad());
+  TEST_ASSERT_EQUAL_UINT8(100, parser.getLoad());
+  TEST_ASSERT_EQUAL_INT32(1500000, parser.getIntLat());
+  TEST_ASSERT_EQUAL_INT32(-2250000, parser.getIntLon());
+  assert_name(parser, "Room 1");
+}
+
+static void test_load_without_temperature() {
+  AdvertDataBuilder builder(ADV_TYPE_REPEATER, "R");
+  builder.setLoad(42);
+  uint8_t len = builder.encodeTo(app_data);
+
+  AdvertDataParser parser(app_data, len);
+  TEST_ASSERT_FALSE(parser.hasTemperature());
+  TEST_ASSERT_TRUE(parser.hasLoad());
+  TEST_ASSERT_EQUAL_UINT8(42, parser.getLoad());
+  assert_name(parser, "R");
+}
+
+static void test_long_name_drops_status() {
+  const char* name = "ABCDEFGHIJKLMNOPQRSTUVW";   // 23, ie. exactly fills the space left after lat/lon
+  AdvertDataBuilder builder(ADV_TYPE_REPEATER, name, 10.0, 20.0);
+  builder.setBattery(4100);
+  builder.setTemperature(25);
+  builder.setLoad(10);
+  uint8_t len = builder.encodeTo(app_data);
+  TEST_ASSERT_EQUAL_INT(MAX_ADVERT_DATA_SIZE, len);
+
+  AdvertDataParser parser(app_data, len);
+  TEST_ASSERT_TRUE(parser.isValid());
+  TEST_ASSERT_FALSE(parser.hasBattery());
+  TEST_ASSERT_FALSE(parser.hasTemperature());
+  TEST_ASSERT_FALSE(parser.hasLoad());
+  TEST_ASSERT_TRUE(parser.hasLatLon());
+  assert_name(parser, name);
+}
+
+static void test_status_kept_while_room() {
+  const char* name = "ABCDEFGHIJKLMNOPQRST";   // 20, so room for battery (2), but not temperature/load too
+  AdvertDataBuilder builder(ADV_TYPE_REPEATER, name, 10.0, 20.0);
+  builder.setBattery(4100);
+  builder.setTemperature(25);
+  uint8_t len = builder.encodeTo(app_data);
+  TEST_ASSERT_EQUAL_INT(1 + 8 + 2 + 20, len);
+
+  AdvertDataParser parser(app_data, len);
+  TEST_ASSERT_TRUE(parser.hasBattery());
+  TEST_ASSERT_EQUAL_UINT16(4100, parser.getBattMilliVolts());
+  TEST_ASSERT_FALSE(parser.hasTemperature());
+  assert_name(parser, name);
+}
+
+static void test_max_name_without_latlon() {
+  const char* name = "ABCDEFGHIJKLMNOPQRSTUVWXYZ01234";   // 31, ie. max node name
+  AdvertDataBuilder builder(ADV_TYPE_CHAT, name);
+  builder.setBattery(3700);
+  uint8_t len = builder.encodeTo(app_data);
+  TEST_ASSERT_EQUAL_INT(MAX_ADVERT_DATA_SIZE, len);
+
+  AdvertDataParser parser(app_data, len);
+  TEST_ASSERT_FALSE(parser.hasBattery());
+  assert_name(parser, name);
+}
+
+static void test_truncated_data_invalid() {
+  AdvertDataBuilder builder(ADV_TYPE_CHAT, "Bob", 1.0, 2.0);
+  builder.setBattery(3800);
+  builder.encodeTo(app_data);
+
+  AdvertDataParser parser(app_data, 1 + 8 + 1);   // cut short, inside battery field
+  TEST_ASSERT_FALSE(parser.isValid());
+  TEST_ASSERT_FALSE(parser.hasBattery());
+  TEST_ASSERT_FALSE(parser.hasName());
+  TEST_ASSERT_FALSE(parser.hasLatLon());
+}
+
+static void test_null_terminated_name() {   // as sent by older nodes
+  uint8_t data[] = { ADV_TYPE_CHAT | ADV_NAME_MASK, 'O', 'l', 'd', 0, 0, 0 };
+  AdvertDataParser parser(data, sizeof(data));
+  TEST_ASSERT_TRUE(parser.isValid());
+  TEST_ASSERT_EQUAL_INT(3, parser.getNameLen());
+  assert_name(parser, "Old");
+}
+
+static void test_copy_name_truncates() {
+  AdvertDataBuilder builder(ADV_TYPE_CHAT, "LongName");
+  uint8_t len = builder.encodeTo(app_data);
+
+  AdvertDataParser parser(app_data, len);
+  char name[5];
+  parser.copyName(name, sizeof(name));
+  TEST_ASSERT_EQUAL_STRING("Long", name);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_type_only);
+  RUN_TEST(test_name_and_latlon);
+  RUN_TEST(test_all_status_fields);
+  RUN_TEST(test_load_without_temperature);
+  RUN_TEST(test_long_name_drops_status);
+  RUN_TEST(test_status_kept_while_room);
+  RUN_TEST(test_max_name_without_latlon);
+  RUN_TEST(test_truncated_data_invalid);
+  RUN_TEST(test_null_terminated_name);
+  RUN_TEST(test_copy_name_truncates);
+  return UNITY_END();
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <helpers/BaseChatMesh.h>
+#include <helpers/StaticPoolPacketManager.h>
+#include <helpers/SimpleMeshTables.h>
+
+/**
+ * \brief  host stand-in for the millis and RTC clocks, advanced by the test
+ */
+class SimClock : public mesh::MillisecondClock, public mesh::RTCClock {
+  unsigned long _millis;
+  uint32_t _base_time;
+
+public:
+  SimClock() : _millis(0), _base_time(1700000000) { }
+
+  void advance(unsigned long millis) { _millis += millis; }
+
+  unsigned long getMillis() override { return _millis; }
+  uint32_t getCurrentTime() override { return _base_time + _millis / 1000; }
+  void setCurrentTime(uint32_t time) override { _base_time = time - _millis / 1000; }
+};
+
+/**
+ * \brief  deterministic RNG (xorshift32), so test runs are repeatable
+ */
+class SimRNG : public mesh::RNG {
+  uint32_t _state;
+
+public:
+  SimRNG(uint32_t seed) : _state(seed) { }
+
+  void random(uint8_t* dest, size_t sz) override {
+    for (size_t i = 0; i < sz; i++) {
+      _state ^= _state << 13; _state ^= _state >> 17; _state ^= _state << 5;
+      dest[i] = _state;
+    }
+  }
+};
+
+#define SIM_RX_QUEUE_SIZE   8
+#define SIM_MAX_DROPS       8
+
+/**
+ * \brief  host stand-in for a radio, linked to a single peer. Packets arrive at the peer once their airtime has elapsed.
+ *         Selected transmissions (by sequence number, from zero) can be dropped, to simulate loss.
+ */
+class SimRadio : public mesh::Radio {
+  SimClock* _clock;
+  SimRadio* _peer;
+  uint8_t rx_buf[SIM_RX_QUEUE_SIZE][MAX_TRANS_UNIT];
+  int rx_len[SIM_RX_QUEUE_SIZE];
+  int rx_head, rx_count;
+  uint8_t tx_buf[MAX_TRANS_UNIT];
+  int tx_len;
+  unsigned long tx_done;
+  int drops[SIM_MAX_DROPS];
+  int num_drops;
+
+  void deliver(const uint8_t* bytes, int len) {
+    if (rx_count >= SIM_RX_QUEUE_SIZE) return;   // overrun, lost
+    int i = (rx_head + rx_count++) % SIM_RX_QUEUE_SIZE;
+    memcpy(rx_buf[i], bytes, rx_len[i] = len);
+  }
+
+public:
+  int n_sent;                        // num transmissions started
+  int n_sent_by_type[PH_TYPE_MASK + 1];
+
+  SimRadio(SimClock& clock) : _clock(&clock), _peer(NULL) { reset(); }
+
+  void linkTo(SimRadio& peer) { _peer = &peer; peer._peer = this; }
+
+  void reset() {
+    rx_head = rx_count = 0;
+    tx_len = 0;
+    num_drops = 0;
+    n_sent = 0;
+    memset(n_sent_by_type, 0, sizeof(n_sent_by_type));
+  }
+
+  /**
+   * \brief  drop the 'seq'th transmission (counted from zero, ie. n_sent)
+   */
+  void dropTx(int seq) { if (num_drops < SIM_MAX_DROPS) drops[num_drops++] = seq; }
+
+  int recvRaw(uint8_t* bytes, int sz) override {
+    if (rx_count == 0) return 0;
+    int len = rx_len[rx_head];
+    memcpy(bytes, rx_buf[rx_head], len);
+    rx_head = (rx_head + 1) % SIM_RX_QUEUE_SIZE;
+    rx_count--;
+    return len;
+  }
+
+  uint32_t getEstAirtimeFor(int len_bytes) override { return 40 + len_bytes / 2; }   // roughly SF7 @ 125kHz
+
+  void startSendRaw(const uint8_t* bytes, int len) override {
+    bool dropped = false;
+    for (int i = 0; i < num_drops; i++) {
+      if (drops[i] == n_sent) dropped = true;
+    }
+    n_sent_by_type[(bytes[0] >> PH_TYPE_SHIFT) & PH_TYPE_MASK]++;
+    n_sent++;
+
+    tx_len = dropped ? 0 : len;
+    if (!dropped) memcpy(tx_buf, bytes, len);
+    tx_done = _clock->getMillis() + getEstAirtimeFor(len);
+  }
+
+  bool isSendComplete() override {
+    if ((long)(_clock->getMillis() - tx_done) < 0) return false;
+    if (tx_len > 0 && _peer) _peer->deliver(tx_buf, tx_len);
+    tx_len = 0;
+    return true;
+  }
+
+  void onSendFinished() override { }
+};
+
+/**
+ * \brief  a chat node, which just records contacts and blob events
+ */
+class SimNode : public BaseChatMesh {
+public:
+  ContactInfo* last_contact;
+  uint8_t blob_recv[MAX_BLOB_SIZE];
+  size_t blob_recv_len;
+  int n_blobs_recv;
+  int n_blobs_completed;
+  bool blob_delivered;
+
+  SimNode(SimRadio& radio, SimClock& clock, SimRNG& rng, mesh::PacketManager& mgr, mesh::MeshTables& tables)
+    : BaseChatMesh(radio, clock, rng, clock, mgr, tables)
+  {
+    self_id = mesh::LocalIdentity(&rng);
+    last_contact = NULL;
+    blob_recv_len = 0;
+    n_blobs_recv = n_blobs_completed = 0;
+    blob_delivered = false;
+  }
+
+  void sendSelfAdvert(const char* name) {
+    auto pkt = createSelfAdvert(name);
+    if (pkt) sendFlood(pkt);
+  }
+
+protected:
+  void onDiscoveredContact(ContactInfo& contact, bool is_new) override { last_contact = &contact; }
+  void onContactPathUpdated(const ContactInfo& contact) override { }
+  void onMessageRecv(const ContactInfo& contact, bool was_flood, uint32_t sender_timestamp, const char *text) override { }
+  uint32_t calcFloodTimeoutMillisFor(uint32_t pkt_airtime_millis) const override { return 500 + 16*pkt_airtime_millis; }
+  uint32_t calcDirectTimeoutMillisFor(uint32_t pkt_airtime_millis, uint8_t path_len) const override {
+    return 500 + (pkt_airtime_millis*6 + 250) * (path_len + 1);
+  }
+  void onSendComplete(const ContactInfo& recipient, uint32_t msg_id, bool delivered, uint8_t num_attempts) override { }
+  void onChannelMessageRecv(const mesh::GroupChannel& channel, int in_path_len, uint32_t timestamp, const char *text) override { }
+
+  void onBlobRecv(const ContactInfo& from, const uint8_t* data, size_t len) override {
+    memcpy(blob_recv, data, blob_recv_len = len);
+    n_blobs_recv++;
+  }
+  void onBlobSendComplete(const ContactInfo& recipient, uint16_t blob_id, bool delivered) override {
+    blob_delivered = delivered;
+    n_blobs_completed++;
+  }
+};
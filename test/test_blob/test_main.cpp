@@ -0,0 +1,214 @@
+#include <unity.h>
+#include "SimMesh.h"
+
+#define BLOB_LEN   4096
+#define BLOB_FRAGS ((BLOB_LEN + FRAG_DATA_SIZE - 1) / FRAG_DATA_SIZE)
+
+static uint8_t blob[BLOB_LEN];
+
+// two nodes, in range of each other
+struct SimPair {
+  SimClock clock;
+  SimRNG rng_a, rng_b;
+  SimRadio radio_a, radio_b;
+  StaticPoolPacketManager mgr_a, mgr_b;
+  SimpleMeshTables tables_a, tables_b;
+  SimNode node_a, node_b;
+
+  SimPair() : rng_a(0x1234567), rng_b(0x7654321), radio_a(clock), radio_b(clock), mgr_a(16), mgr_b(16),
+      node_a(radio_a, clock, rng_a, mgr_a, tables_a), node_b(radio_b, clock, rng_b, mgr_b, tables_b) {
+    radio_a.linkTo(radio_b);
+  }
+};
+
+static SimPair* sim;
+static SimClock* sim_clock;
+static SimRadio *radio_a, *radio_b;
+static SimNode *node_a, *node_b;
+
+void setUp() {
+  for (int i = 0; i < BLOB_LEN; i++) blob[i] = (i * 7 + (i >> 8)) & 0xFF;
+
+  sim = new SimPair();
+  sim_clock = &sim->clock;
+  radio_a = &sim->radio_a; radio_b = &sim->radio_b;
+  node_a = &sim->node_a; node_b = &sim->node_b;
+  node_a->begin();
+  node_b->begin();
+}
+
+void tearDown() {
+  delete sim;
+}
+
+static void run(unsigned long millis) {
+  for (unsigned long t = 0; t < millis; t += 10) {
+    node_a->loop();
+    node_b->loop();
+    sim_clock->advance(10);
+  }
+}
+
+static void run_until_blob_done(unsigned long max_millis) {
+  for (unsigned long t = 0; t < max_millis && node_a->n_blobs_completed == 0; t += 10) {
+    node_a->loop();
+    node_b->loop();
+    sim_clock->advance(10);
+  }
+}
+
+// exchange adverts, so each has the other as a contact
+static void introduce() {
+  node_a->sendSelfAdvert("A");
+  run(1000);
+  node_b->sendSelfAdvert("B");
+  run(1000);
+  TEST_ASSERT_NOT_NULL(node_a->last_contact);
+  TEST_ASSERT_NOT_NULL(node_b->last_contact);
+  radio_a->reset();
+  radio_b->reset();
+}
+
+static void test_header_round_trip() {
+  FragmentHeader hdr;
+  hdr.msg_id = 0xBEEF;
+  hdr.frag_idx = 3;
+  hdr.frag_count = BLOB_FRAGS;
+  hdr.flags = FRAG_FLAG_POLL | 2;
+  hdr.frag_len = FRAG_DATA_SIZE;
+
+  uint8_t buf[FRAG_HEADER_SIZE + FRAG_DATA_SIZE];
+  TEST_ASSERT_EQUAL_INT(FRAG_HEADER_SIZE, hdr.writeTo(buf));
+
+  FragmentHeader out;
+  TEST_ASSERT_TRUE(out.readFrom(buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_HEX16(0xBEEF, out.msg_id);
+  TEST_ASSERT_EQUAL_INT(3, out.frag_idx);
+  TEST_ASSERT_EQUAL_INT(BLOB_FRAGS, out.frag_count);
+  TEST_ASSERT_EQUAL_HEX8(FRAG_FLAG_POLL | 2, out.flags);
+
+  TEST_ASSERT_FALSE(out.readFrom(buf, FRAG_HEADER_SIZE + 10));   // truncated
+  buf[5] = 10;
+  TEST_ASSERT_FALSE(out.readFrom(buf, sizeof(buf)));   // only the final fragment can be short
+}
+
+static void test_reassemble_out_of_order() {
+  static ReassemblyArena arena;
+  Reassembly* r = arena.start(0, 1, BLOB_FRAGS, 1000);
+  TEST_ASSERT_NOT_NULL(r);
+
+  for (int i = BLOB_FRAGS - 1; i >= 0; i -= 2) {   // odd then even, in reverse
+    int len = i == BLOB_FRAGS - 1 ? BLOB_LEN - i*FRAG_DATA_SIZE : FRAG_DATA_SIZE;
+    TEST_ASSERT_TRUE(arena.putFragment(r, i, &blob[i*FRAG_DATA_SIZE], len));
+  }
+  TEST_ASSERT_FALSE(arena.isComplete(r));
+  TEST_ASSERT_FALSE(arena.putFragment(r, BLOB_FRAGS - 1, &blob[(BLOB_FRAGS - 1)*FRAG_DATA_SIZE], 1));   // repeat
+
+  for (int i = BLOB_FRAGS - 2; i >= 0; i -= 2) {
+    TEST_ASSERT_TRUE(arena.putFragment(r, i, &blob[i*FRAG_DATA_SIZE], FRAG_DATA_SIZE));
+  }
+  TEST_ASSERT_TRUE(arena.isComplete(r));
+
+  size_t len;
+  const uint8_t* data = arena.getBlob(r, len);
+  TEST_ASSERT_EQUAL_INT(BLOB_LEN, len);
+  TEST_ASSERT_EQUAL_MEMORY(blob, data, BLOB_LEN);
+}
+
+static void test_arena_full_then_evicts() {
+  static ReassemblyArena arena;
+  Reassembly* r1 = arena.start(0, 1, BLOB_FRAGS, 1000);
+  TEST_ASSERT_NOT_NULL(r1);
+  TEST_ASSERT_NULL(arena.start(1, 2, FRAG_ARENA_BLOCKS - BLOB_FRAGS + 1, 1000));   // not enough blocks left
+  Reassembly* r2 = arena.start(1, 2, FRAG_ARENA_BLOCKS - BLOB_FRAGS, 1000);   // takes the rest
+  TEST_ASSERT_NOT_NULL(r2);
+  TEST_ASSERT_NULL(arena.start(2, 3, 1, 1000));   // arena is full
+
+  arena.finish(r1, 2000);   // delivered, so its blocks are free (but id is remembered)
+  TEST_ASSERT_NOT_NULL(arena.find(0, 1));
+  TEST_ASSERT_NOT_NULL(arena.start(2, 3, BLOB_FRAGS - FRAG_MAX_REASSEMBLIES + 2, 1000));   // leaves a block per remaining slot
+
+  // fill all the slots, so that the completed one is recycled (evicted)
+  for (int i = 3; i < FRAG_MAX_REASSEMBLIES; i++) {
+    TEST_ASSERT_NOT_NULL(arena.start(i, i + 1, 1, 1000));
+  }
+  TEST_ASSERT_NOT_NULL(arena.start(9, 10, 1, 1000));
+  TEST_ASSERT_NULL(arena.find(0, 1));
+  TEST_ASSERT_NULL(arena.start(10, 11, 1, 1000));   // no slots left to evict
+
+  arena.checkExpired(1000);   // all in-progress ones have timed out
+  TEST_ASSERT_NULL(arena.find(1, 2));
+  TEST_ASSERT_NOT_NULL(arena.start(10, 11, BLOB_FRAGS, 3000));
+}
+
+static void test_blob_no_loss() {
+  introduce();
+
+  uint16_t blob_id;
+  TEST_ASSERT_EQUAL_INT(MSG_SEND_QUEUED, node_a->sendBlob(*node_a->last_contact, blob, BLOB_LEN, blob_id));
+  TEST_ASSERT_TRUE(node_a->isBlobSending());
+  run_until_blob_done(60000);
+
+  TEST_ASSERT_EQUAL_INT(1, node_a->n_blobs_completed);
+  TEST_ASSERT_TRUE(node_a->blob_delivered);
+  TEST_ASSERT_EQUAL_INT(1, node_b->n_blobs_recv);
+  TEST_ASSERT_EQUAL_INT(BLOB_LEN, node_b->blob_recv_len);
+  TEST_ASSERT_EQUAL_MEMORY(blob, node_b->blob_recv, BLOB_LEN);
+  TEST_ASSERT_EQUAL_INT(BLOB_FRAGS, radio_a->n_sent_by_type[PAYLOAD_TYPE_MULTIPART]);   // nothing resent
+}
+
+static void test_blob_dropped_fragments_resent() {
+  introduce();
+  radio_a->dropTx(3);
+  radio_a->dropTx(17);
+
+  uint16_t blob_id;
+  TEST_ASSERT_EQUAL_INT(MSG_SEND_QUEUED, node_a->sendBlob(*node_a->last_contact, blob, BLOB_LEN, blob_id));
+  run_until_blob_done(60000);
+
+  TEST_ASSERT_TRUE(node_a->blob_delivered);
+  TEST_ASSERT_EQUAL_INT(1, node_b->n_blobs_recv);
+  TEST_ASSERT_EQUAL_MEMORY(blob, node_b->blob_recv, BLOB_LEN);
+  TEST_ASSERT_EQUAL_INT(BLOB_FRAGS + 2, radio_a->n_sent_by_type[PAYLOAD_TYPE_MULTIPART]);   // just the two missing ones, per SACK
+}
+
+static void test_blob_lost_poll_repolls() {
+  introduce();
+  radio_a->dropTx(BLOB_FRAGS - 1);   // the final fragment, which carries the poll
+  radio_a->dropTx(5);
+
+  uint16_t blob_id;
+  TEST_ASSERT_EQUAL_INT(MSG_SEND_QUEUED, node_a->sendBlob(*node_a->last_contact, blob, BLOB_LEN, blob_id));
+  run_until_blob_done(120000);
+
+  TEST_ASSERT_TRUE(node_a->blob_delivered);
+  TEST_ASSERT_EQUAL_MEMORY(blob, node_b->blob_recv, BLOB_LEN);
+  // re-poll (final frag) after the SACK timeout, then the other missing one
+  TEST_ASSERT_EQUAL_INT(BLOB_FRAGS + 2, radio_a->n_sent_by_type[PAYLOAD_TYPE_MULTIPART]);
+}
+
+static void test_blob_gives_up() {
+  introduce();
+  for (int i = 0; i < SIM_MAX_DROPS; i++) radio_a->dropTx(BLOB_FRAGS - 1 + i);   // every poll is lost
+
+  uint16_t blob_id;
+  TEST_ASSERT_EQUAL_INT(MSG_SEND_QUEUED, node_a->sendBlob(*node_a->last_contact, blob, BLOB_LEN, blob_id));
+  run_until_blob_done(300000);
+
+  TEST_ASSERT_EQUAL_INT(1, node_a->n_blobs_completed);
+  TEST_ASSERT_FALSE(node_a->blob_delivered);
+  TEST_ASSERT_FALSE(node_a->isBlobSending());
+  TEST_ASSERT_EQUAL_INT(0, node_b->n_blobs_recv);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_header_round_trip);
+  RUN_TEST(test_reassemble_out_of_order);
+  RUN_TEST(test_arena_full_then_evicts);
+  RUN_TEST(test_blob_no_loss);
+  RUN_TEST(test_blob_dropped_fragments_resent);
+  RUN_TEST(test_blob_lost_poll_repolls);
+  RUN_TEST(test_blob_gives_up);
+  return UNITY_END();
+}
@@ -0,0 +1,75 @@
+#include <unity.h>
+#include <Dispatcher.h>
+
+using mesh::NeighborInfo;
+
+static NeighborInfo n;
+
+void setUp() { memset(&n, 0, sizeof(n)); }
+void tearDown() { }
+
+static void feed(int16_t snr_x4, int16_t rssi, int count) {
+  for (int i = 0; i < count; i++) n.addSample(snr_x4, rssi);
+}
+
+static void test_init() {
+  n.initSample(-22, -97);
+  TEST_ASSERT_EQUAL_INT(-22, n.getAvgSnrX4());
+  TEST_ASSERT_EQUAL_INT(0, n.getSnrDevX4());
+  TEST_ASSERT_EQUAL_INT(-97, n.getAvgRssi());
+}
+
+// a constant offset smaller than 2^NEIGHBOR_EWMA_SHIFT units must still move the average
+static void test_small_offset_converges() {
+  n.initSample(0, -100);
+  feed(1, -99, 100);
+  TEST_ASSERT_EQUAL_INT(1, n.getAvgSnrX4());
+  TEST_ASSERT_EQUAL_INT(-99, n.getAvgRssi());
+
+  n.initSample(40, -80);
+  feed(33, -87, 100);
+  TEST_ASSERT_EQUAL_INT(33, n.getAvgSnrX4());
+  TEST_ASSERT_EQUAL_INT(-87, n.getAvgRssi());
+}
+
+static void test_negative_offset_converges() {
+  n.initSample(-40, -120);
+  feed(-45, -125, 100);
+  TEST_ASSERT_EQUAL_INT(-45, n.getAvgSnrX4());
+  TEST_ASSERT_EQUAL_INT(-125, n.getAvgRssi());
+  TEST_ASSERT_EQUAL_INT(0, n.getSnrDevX4());   // deviation decays once samples are steady
+}
+
+static void test_ewma_step() {
+  n.initSample(0, -100);
+  n.addSample(80, -100);   // +20 dB, 1/8 weight
+  TEST_ASSERT_EQUAL_INT(10, n.getAvgSnrX4());
+  TEST_ASSERT_EQUAL_INT(10, n.getSnrDevX4());
+}
+
+static void test_deviation_tracks_jitter() {
+  n.initSample(20, -100);
+  for (int i = 0; i < 100; i++) n.addSample((i & 1) ? 24 : 16, -100);   // +/- 1 dB
+  TEST_ASSERT_INT_WITHIN(1, 20, n.getAvgSnrX4());
+  TEST_ASSERT_INT_WITHIN(1, 4, n.getSnrDevX4());
+}
+
+static void test_est_loss() {
+  n.initSample(NEIGHBOR_SNR_FLOOR*4, -120);
+  TEST_ASSERT_EQUAL_INT(100, n.getEstLossPercent());
+  n.initSample((NEIGHBOR_SNR_FLOOR + NEIGHBOR_SNR_GOOD_MARGIN)*4, -90);
+  TEST_ASSERT_EQUAL_INT(0, n.getEstLossPercent());
+  n.initSample((NEIGHBOR_SNR_FLOOR + NEIGHBOR_SNR_GOOD_MARGIN/2)*4, -100);
+  TEST_ASSERT_EQUAL_INT(50, n.getEstLossPercent());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_init);
+  RUN_TEST(test_small_offset_converges);
+  RUN_TEST(test_negative_offset_converges);
+  RUN_TEST(test_ewma_step);
+  RUN_TEST(test_deviation_tracks_jitter);
+  RUN_TEST(test_est_loss);
+  return UNITY_END();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <helpers/PostLog.h>
+#include <stdio.h>
+
+/**
+ * \brief  host stand-in for PostLogFS, ie. a file per segment: "{prefix}{slot}.log"
+ */
+class PostLogFiles : public PostLogStorage {
+  const char* _prefix;
+
+public:
+  PostLogFiles(const char* prefix): _prefix(prefix) { }
+
+  void getFilename(char* dest, int slot) const { sprintf(dest, "%s%d.log", _prefix, slot); }
+
+  uint32_t getSize(int slot) override {
+    char filename[80];
+    getFilename(filename, slot);
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) return 0;
+    fseek(f, 0, SEEK_END);
+    long sz = ftell(f);
+    fclose(f);
+    return sz > 0 ? sz : 0;
+  }
+
+  bool readAt(int slot, uint32_t offset, uint8_t* dest, int len) override {
+    char filename[80];
+    getFilename(filename, slot);
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) return false;
+    bool success = fseek(f, offset, SEEK_SET) == 0 && (int) fread(dest, 1, len, f) == len;
+    fclose(f);
+    return success;
+  }
+
+  bool append(int slot, const uint8_t* src, int len) override {
+    char filename[80];
+    getFilename(filename, slot);
+    FILE* f = fopen(filename, "ab");
+    if (f == NULL) return false;
+    bool success = (int) fwrite(src, 1, len, f) == len;
+    fclose(f);
+    return success;
+  }
+
+  void erase(int slot) override {
+    char filename[80];
+    getFilename(filename, slot);
+    remove(filename);
+  }
+};
@@ -0,0 +1,190 @@
+#include <unity.h>
+#include <helpers/PostLog.h>
+#include "PostLogFiles.h"
+
+// NOTE: the 'native' env builds with a small POST_LOG_SEGMENT_POSTS / POST_LOG_MAX_SEGMENTS, so the ring wraps quickly
+#define CAPACITY   (POST_LOG_SEGMENT_POSTS * POST_LOG_MAX_SEGMENTS)
+
+static PostLogFiles store("test_post_log_");
+static PostLog* posts;
+static mesh::Identity alice, bob;
+
+void setUp() {
+  for (int s = 0; s < POST_LOG_MAX_SEGMENTS; s++) store.erase(s);
+  memset(alice.pub_key, 0xA1, PUB_KEY_SIZE);
+  memset(bob.pub_key, 0xB0, PUB_KEY_SIZE);
+
+  posts = new PostLog();
+  posts->begin(store);
+}
+
+void tearDown() {
+  delete posts;
+  for (int s = 0; s < POST_LOG_MAX_SEGMENTS; s++) store.erase(s);
+}
+
+static void reopen() {
+  delete posts;
+  posts = new PostLog();
+  posts->begin(store);
+}
+
+static void test_empty() {
+  PostInfo post;
+  uint32_t since = 0;
+  TEST_ASSERT_FALSE(posts->findNext(since, NULL, post));
+  TEST_ASSERT_EQUAL_INT(0, posts->getNumPosts());
+  TEST_ASSERT_EQUAL_INT(0, posts->countAfter(0));
+}
+
+static void test_append_and_find_in_order() {
+  TEST_ASSERT_EQUAL_UINT32(1000, posts->append(alice, "first", 1000));
+  TEST_ASSERT_EQUAL_UINT32(1001, posts->append(bob, "second", 1000));   // same clock, so forced unique
+  TEST_ASSERT_EQUAL_UINT32(1002, posts->append(alice, "third", 900));   // clock went backwards
+
+  PostInfo post;
+  uint32_t since = 0;
+  TEST_ASSERT_TRUE(posts->findNext(since, NULL, post));
+  TEST_ASSERT_EQUAL_STRING("first", post.text);
+  TEST_ASSERT_TRUE(post.author.matches(alice));
+
+  since = post.post_timestamp;
+  TEST_ASSERT_TRUE(posts->findNext(since, NULL, post));
+  TEST_ASSERT_EQUAL_STRING("second", post.text);
+  TEST_ASSERT_TRUE(post.author.matches(bob));
+
+  since = post.post_timestamp;
+  TEST_ASSERT_TRUE(posts->findNext(since, NULL, post));
+  TEST_ASSERT_EQUAL_STRING("third", post.text);
+
+  since = post.post_timestamp;
+  TEST_ASSERT_FALSE(posts->findNext(since, NULL, post));
+
+  TEST_ASSERT_EQUAL_INT(3, posts->getNumPosts());
+  TEST_ASSERT_EQUAL_INT(2, posts->countAfter(1000));
+}
+
+static void test_exclude_author() {
+  posts->append(alice, "a1", 100);
+  posts->append(alice, "a2", 101);
+  posts->append(bob, "b1", 102);
+
+  PostInfo post;
+  uint32_t since = 0;
+  TEST_ASSERT_TRUE(posts->findNext(since, &alice, post));
+  TEST_ASSERT_EQUAL_STRING("b1", post.text);
+  TEST_ASSERT_EQUAL_UINT32(101, since);   // advanced past alice's own posts
+}
+
+static void test_long_text_truncated() {
+  char text[MAX_POST_TEXT_LEN + 20];
+  memset(text, 'x', sizeof(text) - 1);
+  text[sizeof(text) - 1] = 0;
+  posts->append(alice, text, 100);
+
+  PostInfo post;
+  uint32_t since = 0;
+  TEST_ASSERT_TRUE(posts->findNext(since, NULL, post));
+  TEST_ASSERT_EQUAL_INT(MAX_POST_TEXT_LEN, strlen(post.text));
+}
+
+static void test_reload() {
+  for (int i = 0; i < POST_LOG_SEGMENT_POSTS + 1; i++) posts->append(alice, "post", 100 + i);
+  reopen();
+
+  TEST_ASSERT_EQUAL_INT(POST_LOG_SEGMENT_POSTS + 1, posts->getNumPosts());
+  TEST_ASSERT_EQUAL_UINT32(100 + POST_LOG_SEGMENT_POSTS, posts->getLastTimestamp());
+  uint32_t later = 200 + POST_LOG_SEGMENT_POSTS;
+  TEST_ASSERT_EQUAL_UINT32(later, posts->append(bob, "after", later));
+}
+
+static void test_damaged_tail_discarded() {
+  posts->append(alice, "one", 100);
+  posts->append(alice, "two", 101);
+
+  // simulate power loss mid append: a partial record at the end of the head segment
+  int head = -1;
+  for (int s = 0; s < POST_LOG_MAX_SEGMENTS; s++) if (store.getSize(s) > 0) head = s;
+  uint8_t junk[POST_LOG_RECORD_SIZE / 2];
+  memset(junk, 0x55, sizeof(junk));
+  store.append(head, junk, sizeof(junk));
+
+  reopen();
+  TEST_ASSERT_EQUAL_INT(2, posts->getNumPosts());
+  TEST_ASSERT_EQUAL_UINT32(101, posts->getLastTimestamp());
+
+  TEST_ASSERT_EQUAL_UINT32(102, posts->append(bob, "three", 50));   // goes to a fresh segment
+  TEST_ASSERT_EQUAL_UINT32(2*POST_LOG_RECORD_SIZE + sizeof(junk), store.getSize(head));
+
+  PostInfo post;
+  uint32_t since = 101;
+  TEST_ASSERT_TRUE(posts->findNext(since, NULL, post));
+  TEST_ASSERT_EQUAL_STRING("three", post.text);
+}
+
+static void test_corrupt_record_skipped() {
+  posts->append(alice, "one", 100);
+  posts->append(alice, "two", 101);
+  posts->append(alice, "three", 102);
+
+  // flip a byte inside the middle record's text (check mismatch)
+  char filename[80];
+  store.getFilename(filename, 0);
+  FILE* f = fopen(filename, "r+b");
+  TEST_ASSERT_NOT_NULL(f);
+  fseek(f, POST_LOG_RECORD_SIZE + 4 + PUB_KEY_SIZE + 1, SEEK_SET);
+  fputc('X', f);
+  fclose(f);
+
+  PostInfo post;
+  uint32_t since = 100;
+  TEST_ASSERT_TRUE(posts->findNext(since, NULL, post));
+  TEST_ASSERT_EQUAL_STRING("three", post.text);
+}
+
+static void test_ring_drops_oldest() {
+  int n = CAPACITY + POST_LOG_SEGMENT_POSTS / 2;
+  for (int i = 0; i < n; i++) {
+    TEST_ASSERT_EQUAL_UINT32(1000 + i, posts->append(alice, "post", 1000 + i));
+  }
+  TEST_ASSERT_TRUE(posts->getNumPosts() >= CAPACITY - POST_LOG_SEGMENT_POSTS);
+  TEST_ASSERT_TRUE(posts->getNumPosts() <= CAPACITY);
+
+  // everything still retained is returned, in order, and ends with the newest
+  PostInfo post;
+  uint32_t since = 0, prev = 0;
+  int count = 0;
+  while (posts->findNext(since, NULL, post)) {
+    TEST_ASSERT_TRUE(post.post_timestamp > prev);
+    prev = since = post.post_timestamp;
+    count++;
+  }
+  TEST_ASSERT_EQUAL_INT(posts->getNumPosts(), count);
+  TEST_ASSERT_EQUAL_UINT32(1000 + n - 1, prev);
+}
+
+static void test_maintain_erases_ahead_and_old() {
+  for (int i = 0; i < CAPACITY; i++) posts->append(alice, "post", 1000 + i);   // ring now full
+  int before = posts->getNumPosts();
+
+  posts->maintain();   // head segment is full, so erases the next (oldest) ahead of time
+  TEST_ASSERT_EQUAL_INT(before - POST_LOG_SEGMENT_POSTS, posts->getNumPosts());
+
+  posts->append(alice, "post", 5000);   // new head segment
+  posts->maintain(2000);   // drops one segment entirely older than 2000, per call
+  TEST_ASSERT_EQUAL_INT(before - 2*POST_LOG_SEGMENT_POSTS + 1, posts->getNumPosts());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty);
+  RUN_TEST(test_append_and_find_in_order);
+  RUN_TEST(test_exclude_author);
+  RUN_TEST(test_long_text_truncated);
+  RUN_TEST(test_reload);
+  RUN_TEST(test_damaged_tail_discarded);
+  RUN_TEST(test_corrupt_record_skipped);
+  RUN_TEST(test_ring_drops_oldest);
+  RUN_TEST(test_maintain_erases_ahead_and_old);
+  return UNITY_END();
+}
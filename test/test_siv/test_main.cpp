@@ -0,0 +1,113 @@
+#include <unity.h>
+#include <Utils.h>
+
+// Known answer tests for Utils::encryptSIV(). Expected outputs were computed independently (OpenSSL):
+//   enc_key = HMAC-SHA256(secret, "siv-enc")[0..15],  mac_key = HMAC-SHA256(secret, "siv-mac")
+//   siv = HMAC-SHA256(mac_key, assoc | plain)[0..7]
+//   out = siv | AES-128-CTR(enc_key, iv = siv | assoc[0..3] (zero padded) | 00000000, plain)
+
+static uint8_t secret[PUB_KEY_SIZE];
+
+static const uint8_t assoc_short[] = { 0x02, 0xAB, 0xCD };
+static const char plain_short[] = "a twenty byte messag";
+static const uint8_t expected_short[] = {
+  0x8A, 0xC1, 0x6A, 0x9F, 0xAE, 0x22, 0x00, 0x4C, 0x41, 0x45, 0x38, 0xC9,
+  0x82, 0x2B, 0x10, 0xA1, 0x8A, 0xCB, 0x34, 0x99, 0x41, 0x61, 0xE2, 0x2C,
+  0x4B, 0x8E, 0x45, 0xCF
+};
+
+static uint8_t assoc_long[1 + PATH_HASH_SIZE + PUB_KEY_SIZE];
+static const char plain_long[] = "Hello, this message is longer than two AES blocks.";
+static const uint8_t expected_long[] = {
+  0x2B, 0x78, 0x44, 0xAB, 0xC9, 0x20, 0xED, 0xA3, 0x38, 0x68, 0x35, 0x32,
+  0x98, 0x70, 0x1B, 0xA4, 0x7C, 0x3E, 0x3C, 0x5E, 0x03, 0x46, 0xB2, 0x66,
+  0x22, 0x2C, 0xCF, 0x6F, 0xB9, 0xCF, 0x74, 0x44, 0xFC, 0x89, 0x18, 0x0C,
+  0x3C, 0x9E, 0x9A, 0x1B, 0xB0, 0x20, 0x89, 0xFB, 0x41, 0x50, 0x21, 0x64,
+  0x2E, 0x03, 0xB2, 0x07, 0x26, 0x66, 0x05, 0x9E, 0xA7, 0xD9
+};
+
+void setUp() {
+  for (int i = 0; i < PUB_KEY_SIZE; i++) secret[i] = i*7 + 1;
+
+  assoc_long[0] = 0x07;
+  assoc_long[1] = 0x5A;
+  for (int i = 0; i < PUB_KEY_SIZE; i++) assoc_long[2 + i] = 0xF0 - i;
+}
+
+void tearDown() { }
+
+static void check_kat(const uint8_t* assoc, int assoc_len, const char* plain, const uint8_t* expected, int expected_len) {
+  int plain_len = strlen(plain);
+  uint8_t out[MAX_PACKET_PAYLOAD];
+  int len = mesh::Utils::encryptSIV(secret, out, (const uint8_t *) plain, plain_len, assoc, assoc_len);
+
+  TEST_ASSERT_EQUAL_INT(CIPHER_SIV_MAC_SIZE + plain_len, len);
+  TEST_ASSERT_EQUAL_INT(expected_len, len);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, out, len);
+
+  uint8_t dec[MAX_PACKET_PAYLOAD];
+  TEST_ASSERT_EQUAL_INT(plain_len, mesh::Utils::decryptSIV(secret, dec, out, len, assoc, assoc_len));
+  TEST_ASSERT_EQUAL_MEMORY(plain, dec, plain_len);
+}
+
+static void test_kat_short() {
+  check_kat(assoc_short, sizeof(assoc_short), plain_short, expected_short, sizeof(expected_short));
+}
+
+static void test_kat_multi_block() {
+  check_kat(assoc_long, sizeof(assoc_long), plain_long, expected_long, sizeof(expected_long));
+}
+
+static void test_tampered_ciphertext_rejected() {
+  uint8_t out[MAX_PACKET_PAYLOAD], dec[MAX_PACKET_PAYLOAD];
+  int len = mesh::Utils::encryptSIV(secret, out, (const uint8_t *) plain_short, strlen(plain_short), assoc_short, sizeof(assoc_short));
+
+  out[CIPHER_SIV_MAC_SIZE + 3] ^= 0x01;
+  TEST_ASSERT_EQUAL_INT(0, mesh::Utils::decryptSIV(secret, dec, out, len, assoc_short, sizeof(assoc_short)));
+  out[CIPHER_SIV_MAC_SIZE + 3] ^= 0x01;
+
+  out[0] ^= 0x80;   // the SIV itself
+  TEST_ASSERT_EQUAL_INT(0, mesh::Utils::decryptSIV(secret, dec, out, len, assoc_short, sizeof(assoc_short)));
+}
+
+static void test_tampered_assoc_rejected() {
+  uint8_t out[MAX_PACKET_PAYLOAD], dec[MAX_PACKET_PAYLOAD];
+  int len = mesh::Utils::encryptSIV(secret, out, (const uint8_t *) plain_long, strlen(plain_long), assoc_long, sizeof(assoc_long));
+
+  assoc_long[sizeof(assoc_long) - 1] ^= 0x01;   // beyond the part used in the IV, so only caught by the MAC
+  TEST_ASSERT_EQUAL_INT(0, mesh::Utils::decryptSIV(secret, dec, out, len, assoc_long, sizeof(assoc_long)));
+}
+
+static void test_short_input_rejected() {
+  uint8_t dec[MAX_PACKET_PAYLOAD];
+  TEST_ASSERT_EQUAL_INT(0, mesh::Utils::decryptSIV(secret, dec, expected_short, CIPHER_SIV_MAC_SIZE, assoc_short, sizeof(assoc_short)));
+}
+
+// pre-derived keys (eg. as cached per channel) must give the same result as the shared secret
+static void test_derived_keys_match() {
+  uint8_t enc_key[CIPHER_KEY_SIZE], mac_key[CIPHER_SIV_MAC_KEY_SIZE];
+  mesh::Utils::deriveSIVKeys(secret, enc_key, mac_key);
+
+  uint8_t out[MAX_PACKET_PAYLOAD], dec[MAX_PACKET_PAYLOAD];
+  int plain_len = strlen(plain_long);
+  int len = mesh::Utils::encryptSIV(enc_key, mac_key, out, (const uint8_t *) plain_long, plain_len, assoc_long, sizeof(assoc_long));
+  TEST_ASSERT_EQUAL_INT(sizeof(expected_long), len);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected_long, out, len);
+
+  TEST_ASSERT_EQUAL_INT(plain_len, mesh::Utils::decryptSIV(enc_key, mac_key, dec, out, len, assoc_long, sizeof(assoc_long)));
+  TEST_ASSERT_EQUAL_MEMORY(plain_long, dec, plain_len);
+
+  out[len - 1] ^= 0x01;
+  TEST_ASSERT_EQUAL_INT(0, mesh::Utils::decryptSIV(enc_key, mac_key, dec, out, len, assoc_long, sizeof(assoc_long)));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_kat_short);
+  RUN_TEST(test_kat_multi_block);
+  RUN_TEST(test_tampered_ciphertext_rejected);
+  RUN_TEST(test_tampered_assoc_rejected);
+  RUN_TEST(test_short_input_rejected);
+  RUN_TEST(test_derived_keys_match);
+  return UNITY_END();
+}